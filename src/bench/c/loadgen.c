@@ -0,0 +1,251 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A load generator which runs many invocations concurrently over
+ * libgroovyclient against groovyserver or the stand-in server, and reports
+ * throughput, latency percentiles and bytes/s of the output.
+ *
+ * usage: loadgen [-s host] [-p port] [-a authtoken] [-c concurrency]
+ *                [-n requests] [-i stdin-size] [-z] [args...]
+ *
+ * -z requests compression, and the ratio and CPU time on the client are reported.
+ * stdin is made of lines like a CSV, not to be compressed too much.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/param.h>
+
+#include "libgroovyclient.h"
+
+#define DEFAULT_HOST "localhost"
+#define DEFAULT_PORT 1961
+#define STDIN_CHUNK_SIZE 65536
+
+struct bench_t {
+    long long* latencies;   // microseconds of finished invocations
+    int finished;
+    int failed;
+    long long output_bytes;
+    long long raw_bytes;    // compressed or decompressed
+    long long wire_bytes;
+    long long compress_micros;
+};
+
+struct client_t {
+    groovyclient_session* session;
+    long long started_at;
+};
+
+static long long now_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static char* read_authtoken(int port)
+{
+    static char authtoken[256];
+    char path[MAXPATHLEN];
+    snprintf(path, sizeof(path), "%s/.groovy/groovyserv/authtoken-%d", getenv("HOME"), port);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL || fgets(authtoken, sizeof(authtoken), fp) == NULL) {
+        fprintf(stderr, "ERROR: could not read authtoken file: %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    authtoken[strcspn(authtoken, "\r\n")] = '\0';
+    return authtoken;
+}
+
+static void count_output(groovyclient_session* session, const char* channel, const char* data, int size, void* user_data)
+{
+    ((struct bench_t*) user_data)->output_bytes += size;
+}
+
+static void count_compression(struct bench_t* bench, groovyclient_session* session)
+{
+    long long raw_bytes, wire_bytes, micros;
+    groovyclient_session_compression(session, &raw_bytes, &wire_bytes, &micros);
+    bench->raw_bytes += raw_bytes;
+    bench->wire_bytes += wire_bytes;
+    bench->compress_micros += micros;
+}
+
+static int compare_latency(const void* a, const void* b)
+{
+    long long x = *(const long long*) a, y = *(const long long*) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_millis(struct bench_t* bench, double percent)
+{
+    int index = (int) (bench->finished * percent / 100.0 + 0.999999) - 1;
+    if (index < 0) {
+        index = 0;
+    }
+    return bench->latencies[index] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    char* host = DEFAULT_HOST;
+    int port = DEFAULT_PORT;
+    char* authtoken = NULL;
+    int concurrency = 8;
+    int requests = 1000;
+    int stdin_size = 0;
+    int compress = 0;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "+s:p:a:c:n:i:z")) != -1) {
+        switch (opt) {
+        case 's': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'a': authtoken = optarg; break;
+        case 'c': concurrency = atoi(optarg); break;
+        case 'n': requests = atoi(optarg); break;
+        case 'i': stdin_size = atoi(optarg); break;
+        case 'z': compress = 1; break;
+        default:
+            fprintf(stderr, "usage: loadgen [-s host] [-p port] [-a authtoken] [-c concurrency] [-n requests] [-i stdin-size] [-z] [args...]\n");
+            exit(1);
+        }
+    }
+    if (concurrency <= 0 || requests <= 0 || stdin_size < 0) {
+        fprintf(stderr, "ERROR: invalid number of concurrency, requests or stdin size\n");
+        exit(1);
+    }
+    if (concurrency > requests) {
+        concurrency = requests;
+    }
+    if (authtoken == NULL) {
+        authtoken = read_authtoken(port);
+    }
+
+    char* input = malloc(stdin_size + 1);
+    int filled = 0;
+    for (i = 0; filled < stdin_size; i++) {
+        char line[64];
+        int len = sprintf(line, "%d,item-%d,%d.%02d,ok\n", i, i % 97, i * 31 % 1000, i % 100);
+        memcpy(input + filled, line, (stdin_size - filled < len) ? stdin_size - filled : len);
+        filled += len;
+    }
+
+    struct bench_t bench = { malloc(sizeof(long long) * requests), 0, 0, 0, 0, 0, 0 };
+    struct client_t* clients = calloc(concurrency, sizeof(struct client_t));
+    struct pollfd* fds = malloc(sizeof(struct pollfd) * concurrency);
+    int* owners = malloc(sizeof(int) * concurrency);
+    int started = 0;
+    long long begin = now_micros();
+
+    while (bench.finished + bench.failed < requests) {
+        // keep the number of running invocations
+        for (i = 0; i < concurrency && started < requests; i++) {
+            if (clients[i].session != NULL) {
+                continue;
+            }
+            groovyclient_session* session = groovyclient_session_new(host, port, authtoken);
+            int j;
+            for (j = optind; j < argc; j++) {
+                groovyclient_session_add_arg(session, argv[j]);
+            }
+            groovyclient_session_set_callbacks(session, count_output, NULL, &bench);
+            if (compress) {
+                groovyclient_session_set_compress(session);
+            }
+            clients[i].started_at = now_micros();
+            int ret = groovyclient_session_start(session);
+            int offset;
+            for (offset = 0; ret == GROOVYCLIENT_OK && offset < stdin_size; offset += STDIN_CHUNK_SIZE) {
+                int size = (stdin_size - offset < STDIN_CHUNK_SIZE) ? stdin_size - offset : STDIN_CHUNK_SIZE;
+                ret = groovyclient_session_write_stdin(session, input + offset, size);
+            }
+            if (ret == GROOVYCLIENT_OK) {
+                ret = groovyclient_session_close_stdin(session);
+            }
+            started++;
+            if (ret == GROOVYCLIENT_ERROR_CONNECTION_REFUSED) {
+                fprintf(stderr, "ERROR: could not connect to server: %s:%d\n", host, port);
+                exit(1);
+            }
+            if (ret != GROOVYCLIENT_OK) {
+                bench.failed++;
+                groovyclient_session_free(session);
+                continue;
+            }
+            clients[i].session = session;
+        }
+
+        int count = 0;
+        for (i = 0; i < concurrency; i++) {
+            if (clients[i].session != NULL) {
+                fds[count].fd = groovyclient_session_fd(clients[i].session);
+                fds[count].events = POLLIN;
+                owners[count++] = i;
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+        if (poll(fds, count, -1) < 0) {
+            perror("ERROR: could not poll");
+            exit(1);
+        }
+        for (i = 0; i < count; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            struct client_t* client = &clients[owners[i]];
+            int ret = groovyclient_session_process(client->session);
+            if (ret == GROOVYCLIENT_RUNNING) {
+                continue;
+            }
+            if (ret == GROOVYCLIENT_FINISHED && groovyclient_session_status(client->session) == 0) {
+                bench.latencies[bench.finished++] = now_micros() - client->started_at;
+            } else {
+                bench.failed++;
+            }
+            count_compression(&bench, client->session);
+            groovyclient_session_free(client->session);
+            client->session = NULL;
+        }
+    }
+
+    double elapsed = (now_micros() - begin) / 1000000.0;
+    qsort(bench.latencies, bench.finished, sizeof(long long), compare_latency);
+    printf("requests: %d, failed: %d, concurrency: %d, elapsed: %.3fs\n", bench.finished, bench.failed, concurrency, elapsed);
+    printf("throughput: %.1f req/s, output: %.2f MB/s (%lld bytes)\n",
+           bench.finished / elapsed, bench.output_bytes / elapsed / (1024 * 1024), bench.output_bytes);
+    if (bench.finished > 0) {
+        printf("latency: p50 %.3fms, p99 %.3fms, p999 %.3fms, max %.3fms\n",
+               percentile_millis(&bench, 50), percentile_millis(&bench, 99), percentile_millis(&bench, 99.9),
+               bench.latencies[bench.finished - 1] / 1000.0);
+    }
+    if (compress) {
+        printf("compression: ratio %.3f (%lld -> %lld bytes), cpu %.3fms\n",
+               (bench.raw_bytes > 0) ? (double) bench.wire_bytes / bench.raw_bytes : 1.0,
+               bench.raw_bytes, bench.wire_bytes, bench.compress_micros / 1000.0);
+    }
+    return (bench.failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,395 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the code of the client on the path of each invocation
+ * and each chunk: buf, base64, option and header making/parsing of session.
+ *
+ * The code under test is compiled with malloc() and others replaced by the
+ * counting versions here, so that allocations per op are reported as well
+ * as ns per op.
+ *
+ * usage: microbench [-b baseline] [-w baseline] [-t threshold-percent] [-f filter]
+ *
+ * With -b, it fails when a result is slower than the baseline by more than
+ * the threshold, or allocates more than the baseline. -w writes the results
+ * as a new baseline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "buf.h"
+#include "base64.h"
+#include "option.h"
+#include "session.h"
+
+#define MIN_BENCH_MICROS 200000
+#define REPEAT 3
+#define MAX_BENCHMARKS 32
+#define MAX_NAME_LEN 63
+#define DEFAULT_THRESHOLD 20.0
+
+#define ENV_COUNT 300
+#define ARG_COUNT 5000
+#define CLASSPATH_ENTRIES 200
+#define STREAM_FRAMES 100
+#define STREAM_FRAME_SIZE 100
+
+/*
+ * allocation counting
+ */
+
+static long long allocations = 0;
+
+void* bench_malloc(size_t size)
+{
+    allocations++;
+    return malloc(size);
+}
+
+void* bench_calloc(size_t count, size_t size)
+{
+    allocations++;
+    return calloc(count, size);
+}
+
+void* bench_realloc(void* ptr, size_t size)
+{
+    allocations++;
+    return realloc(ptr, size);
+}
+
+char* bench_strdup(const char* s)
+{
+    allocations++;
+    return strdup(s);
+}
+
+/*
+ * inputs
+ */
+
+static char* envs[ENV_COUNT + 1];
+static char* args[ARG_COUNT + 1];
+static char* classpath;
+static char* response_stream;
+static int response_stream_size;
+
+static void make_inputs()
+{
+    int i;
+    char work[256];
+    for (i = 0; i < ENV_COUNT; i++) {
+        sprintf(work, "ENVIRONMENT_VARIABLE_%03d=/usr/local/lib/some/path/value/%d", i, i);
+        envs[i] = strdup(work);
+    }
+    envs[ENV_COUNT] = NULL;
+
+    args[0] = "groovyclient";
+    for (i = 1; i < ARG_COUNT; i++) {
+        sprintf(work, (i % 100 == 0) ? "-Cq" : "argument-%d.groovy", i);
+        args[i] = strdup(work);
+    }
+    args[ARG_COUNT] = NULL;
+
+    classpath = malloc(CLASSPATH_ENTRIES * 80);
+    classpath[0] = '\0';
+    for (i = 0; i < CLASSPATH_ENTRIES; i++) {
+        sprintf(work, "%s/home/user/.m2/repository/org/example/lib%d/1.0.%d/lib%d-1.0.%d.jar",
+                (i == 0) ? "" : ":", i, i, i, i);
+        strcat(classpath, work);
+    }
+
+    char body[STREAM_FRAME_SIZE];
+    memset(body, 'o', sizeof(body));
+    response_stream = malloc((STREAM_FRAME_SIZE + 64) * STREAM_FRAMES + 64);
+    response_stream_size = 0;
+    for (i = 0; i < STREAM_FRAMES; i++) {
+        response_stream_size += sprintf(response_stream + response_stream_size,
+                                        "Channel: %s\nSize: %d\n\n", (i % 2 == 0) ? "out" : "err", STREAM_FRAME_SIZE);
+        memcpy(response_stream + response_stream_size, body, STREAM_FRAME_SIZE);
+        response_stream_size += STREAM_FRAME_SIZE;
+    }
+    response_stream_size += sprintf(response_stream + response_stream_size, "Status: 0\n\n");
+}
+
+/*
+ * benchmarks
+ */
+
+static void bench_buf_printf()
+{
+    buf b = buf_new(0, NULL);
+    int i;
+    for (i = 0; i < ENV_COUNT; i++) {
+        buf_printf(&b, "%s: %s\n", "Env", envs[i]);
+    }
+    buf_delete(&b);
+}
+
+static void bench_base64_encode()
+{
+    static char encoded[512];
+    int i;
+    for (i = 0; i < 100; i++) {
+        base64_encode(encoded, (unsigned char*) envs[i]);
+    }
+}
+
+static void bench_scan_options()
+{
+    static char* argv[ARG_COUNT + 1];
+    struct option_t option = client_option;
+    memcpy(argv, args, sizeof(argv)); // scan_options() clears client options in argv
+    scan_options(&option, ARG_COUNT, argv);
+}
+
+static void make_request_header(int argc, char** argv, char** env, char* cp)
+{
+    struct invocation_t invocation = { argc, argv, "/tmp", env, cp, NULL, FALSE, NULL, 0, NULL };
+    buf b = buf_new(BUFFER_SIZE, NULL);
+    make_invocation_header(&b, &invocation, "authtoken");
+    buf_delete(&b);
+}
+
+static void bench_header_env()
+{
+    make_request_header(2, args, envs, "");
+}
+
+static void bench_header_args()
+{
+    make_request_header(ARG_COUNT, args, NULL, "");
+}
+
+static void bench_header_classpath()
+{
+    make_request_header(2, args, NULL, classpath);
+}
+
+static int socket_pair[2];
+
+static void ignore_chunk(struct session_t* session, const char* channel, const char* data, int size)
+{
+}
+
+static void receive_stream(int chunk_size)
+{
+    struct session_t session;
+    int sent = 0;
+    int ret = SESSION_RUNNING;
+    session_init(&session, socket_pair[1], NULL);
+    while (sent < response_stream_size) {
+        int size = response_stream_size - sent;
+        if (size > chunk_size) {
+            size = chunk_size;
+        }
+        sent += write(socket_pair[0], response_stream + sent, size);
+        ret = session_receive(&session, ignore_chunk);
+    }
+    while (ret == SESSION_RUNNING) {
+        ret = session_receive(&session, ignore_chunk);
+    }
+    if (ret != SESSION_FINISHED) {
+        fprintf(stderr, "ERROR: could not parse response stream\n");
+        exit(1);
+    }
+    session_delete(&session);
+}
+
+static void bench_receive_1() { receive_stream(1); }
+static void bench_receive_64() { receive_stream(64); }
+static void bench_receive_4k() { receive_stream(4 * 1024); }
+static void bench_receive_64k() { receive_stream(64 * 1024); }
+
+static const struct {
+    const char* name;
+    void (*run)();
+} benchmarks[] = {
+    { "buf_printf_env300", bench_buf_printf },
+    { "base64_encode_100", bench_base64_encode },
+    { "scan_options_args5000", bench_scan_options },
+    { "make_header_env300", bench_header_env },
+    { "make_header_args5000", bench_header_args },
+    { "make_header_classpath200", bench_header_classpath },
+    { "session_receive_chunk1", bench_receive_1 },
+    { "session_receive_chunk64", bench_receive_64 },
+    { "session_receive_chunk4k", bench_receive_4k },
+    { "session_receive_chunk64k", bench_receive_64k },
+};
+
+/*
+ * harness
+ */
+
+struct result_t {
+    char name[MAX_NAME_LEN + 1];
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+static long long now_nanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * run a benchmark for MIN_BENCH_MICROS at least, and take the best of REPEAT runs.
+ */
+static void measure(const char* name, void (*run)(), struct result_t* result)
+{
+    long long iterations = 1;
+    long long elapsed;
+    int i;
+
+    run(); // warm up
+    while (1) {
+        long long begin = now_nanos(), n;
+        for (n = 0; n < iterations; n++) {
+            run();
+        }
+        elapsed = now_nanos() - begin;
+        if (elapsed >= MIN_BENCH_MICROS * 1000LL) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->ns_per_op = (double) elapsed / iterations;
+    for (i = 1; i < REPEAT; i++) {
+        long long begin = now_nanos(), n;
+        for (n = 0; n < iterations; n++) {
+            run();
+        }
+        double ns_per_op = (double) (now_nanos() - begin) / iterations;
+        if (ns_per_op < result->ns_per_op) {
+            result->ns_per_op = ns_per_op;
+        }
+    }
+
+    allocations = 0;
+    run();
+    result->allocs_per_op = allocations;
+}
+
+static int read_baseline(const char* path, struct result_t* baseline)
+{
+    FILE* fp = fopen(path, "r");
+    int count = 0;
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: could not open baseline: %s\n", path);
+        exit(1);
+    }
+    while (count < MAX_BENCHMARKS
+           && fscanf(fp, "%63s %lf %lf", baseline[count].name, &baseline[count].ns_per_op, &baseline[count].allocs_per_op) == 3) {
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static struct result_t* find_result(struct result_t* results, int count, const char* name)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(results[i].name, name) == 0) {
+            return &results[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    char* baseline_path = NULL;
+    char* output_path = NULL;
+    char* filter = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "b:w:t:f:")) != -1) {
+        switch (opt) {
+        case 'b': baseline_path = optarg; break;
+        case 'w': output_path = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        case 'f': filter = optarg; break;
+        default:
+            fprintf(stderr, "usage: microbench [-b baseline] [-w baseline] [-t threshold-percent] [-f filter]\n");
+            exit(1);
+        }
+    }
+
+    make_inputs();
+    int buffer_size = 256 * 1024;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socket_pair) != 0) {
+        perror("ERROR: could not create socket pair");
+        exit(1);
+    }
+    setsockopt(socket_pair[0], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(socket_pair[1], SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    struct result_t baseline[MAX_BENCHMARKS];
+    int baseline_count = (baseline_path != NULL) ? read_baseline(baseline_path, baseline) : 0;
+    struct result_t results[MAX_BENCHMARKS];
+    int count = 0;
+    int regressions = 0;
+
+    printf("%-28s %14s %12s %10s\n", "benchmark", "ns/op", "allocs/op", "vs base");
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL) {
+            continue;
+        }
+        struct result_t* result = &results[count++];
+        measure(benchmarks[i].name, benchmarks[i].run, result);
+        printf("%-28s %14.1f %12.1f", result->name, result->ns_per_op, result->allocs_per_op);
+
+        struct result_t* base = find_result(baseline, baseline_count, result->name);
+        if (base != NULL) {
+            double change = (result->ns_per_op / base->ns_per_op - 1) * 100;
+            BOOL regressed = change > threshold || result->allocs_per_op > base->allocs_per_op;
+            printf(" %+9.1f%%%s", change, regressed ? " REGRESSION" : "");
+            regressions += regressed;
+        }
+        printf("\n");
+    }
+
+    if (output_path != NULL) {
+        FILE* fp = fopen(output_path, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "ERROR: could not write baseline: %s\n", output_path);
+            exit(1);
+        }
+        for (i = 0; i < count; i++) {
+            fprintf(fp, "%s %.1f %.1f\n", results[i].name, results[i].ns_per_op, results[i].allocs_per_op);
+        }
+        fclose(fp);
+    }
+    if (regressions > 0) {
+        fprintf(stderr, "ERROR: %d benchmark(s) regressed over %.1f%% or in allocations\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A stand-in server for benchmarks, which serves a session recorded by
+ * groovyclient -Crecord to every invocation, whatever it requests. The recorded
+ * blocks are sent as they were received, at the original timing by default,
+ * or at speed times faster, or as fast as possible when speed is 0.
+ * Input from the client such as stdin is read and discarded.
+ *
+ * A command request like ping is answered by an exit status 0 instead.
+ *
+ * usage: replay [-p port] [-a authtoken] [-x speed] file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "record.h"
+
+#define DEFAULT_PORT 1961
+#define DEFAULT_AUTHTOKEN "standin"
+#define MAX_HEADER 65536
+
+static const char* authtoken = DEFAULT_AUTHTOKEN;
+static double speed = 1.0;
+static struct record_block_t* blocks;
+static int block_count;
+
+static long long now_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int send_fully(int fd, const char* data, int size)
+{
+    while (size > 0) {
+        int ret = write(fd, data, size);
+        if (ret <= 0) {
+            return 0;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+/*
+ * read the header part of the request up to the blank line.
+ * return 1 if it's a command request, 0 for an invocation, or -1 when closed.
+ */
+static int read_header(int fd)
+{
+    char header[MAX_HEADER];
+    int size = 0;
+    while (size < (int) sizeof(header) - 1) {
+        if (read(fd, header + size, 1) != 1) {
+            return -1;
+        }
+        size++;
+        if (header[size - 1] == '\n' && (size == 1 || header[size - 2] == '\n')) {
+            break;
+        }
+    }
+    header[size] = '\0';
+    return (strncmp(header, "Cmd: ", 5) == 0 || strstr(header, "\nCmd: ") != NULL) ? 1 : 0;
+}
+
+static void* drain(void* arg)
+{
+    int fd = (int) (long) arg;
+    char buf[8192];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+        ;
+    }
+    return NULL;
+}
+
+/*
+ * send the blocks on the schedule from the start, so that the time to send them
+ * doesn't accumulate into delays.
+ */
+static void play(int fd)
+{
+    long long start = now_micros();
+    long long offset = 0;
+    int i;
+    for (i = 0; i < block_count; i++) {
+        if (speed > 0) {
+            offset += blocks[i].delay;
+            long long wait = start + (long long) (offset / speed) - now_micros();
+            if (wait > 0) {
+                usleep(wait);
+            }
+        }
+        if (!send_fully(fd, blocks[i].data, blocks[i].size)) {
+            return; // the client has gone
+        }
+    }
+}
+
+static void* handle(void* arg)
+{
+    int fd = (int) (long) arg;
+    int command = read_header(fd);
+    if (command == 1) {
+        const char* status = "Status: 0\n\n";
+        send_fully(fd, status, strlen(status));
+    }
+    else if (command == 0) {
+        // input isn't left unread not to block the client writing it
+        pthread_t drainer;
+        if (pthread_create(&drainer, NULL, drain, arg) == 0) {
+            play(fd);
+            shutdown(fd, SHUT_WR);
+            pthread_join(drainer, NULL);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void save_authtoken(int port)
+{
+    char path[MAXPATHLEN];
+    snprintf(path, sizeof(path), "%s/.groovy/groovyserv/authtoken-%d", getenv("HOME"), port);
+    FILE* fp = fopen(path, "w");
+    if (fp != NULL) {
+        fputs(authtoken, fp);
+        fclose(fp);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int port = DEFAULT_PORT;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:a:x:")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'a':
+            authtoken = optarg;
+            break;
+        case 'x':
+            speed = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: replay [-p port] [-a authtoken] [-x speed] file\n");
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: replay [-p port] [-a authtoken] [-x speed] file\n");
+        exit(1);
+    }
+    if (speed < 0) {
+        fprintf(stderr, "ERROR: invalid speed\n");
+        exit(1);
+    }
+    if ((blocks = record_load(argv[optind], &block_count)) == NULL) {
+        fprintf(stderr, "ERROR: could not load recorded session: %s\n", argv[optind]);
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(server, 128) != 0) {
+        perror("ERROR: could not listen");
+        exit(1);
+    }
+    save_authtoken(port);
+
+    while (1) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, handle, (void*) (long) fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,424 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A stand-in server for benchmarks, which speaks the same protocol as
+ * groovyserver without JVM. Instead of running a script, it emits output
+ * in a pattern which is specified by the arguments of the invocation:
+ *
+ *   hello                  a line of "Hello, World!" (default)
+ *   lines <n>              n tiny lines, each of which is sent in a frame
+ *   blob <size>            a blob of size bytes in frames of 8KB
+ *   interleave <n>         n lines alternately to out and err
+ *   log <n>                n lines like a log in frames of 8KB
+ *   echo                   stdin as it's received
+ *   sleep <msec>           nothing after sleeping
+ *
+ * Frames are compressed in the same way as groovyserver when 'Compress: lz4' is requested.
+ * With 'Window', stdin is granted by credits of STDIN_CREDIT as groovyserver does,
+ * but output isn't limited by credits from the client, which are read and ignored.
+ *
+ * usage: standin [-p port] [-a authtoken]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "lz4.h"
+
+#define DEFAULT_PORT 1961
+#define DEFAULT_AUTHTOKEN "standin"
+#define MAX_LINE 8192
+#define MAX_ARGS 16
+#define BLOB_FRAME_SIZE 8192
+#define STATUS_INVALID_AUTHTOKEN 201
+#define COMPRESS_MIN_FRAME_SIZE 512
+#define COMPRESS_MAX_FRAME_SIZE (64 * 1024)
+#define STDIN_CREDIT (64 * 1024)
+#define CREDIT_BLOCK -2
+
+static const char* authtoken = DEFAULT_AUTHTOKEN;
+
+struct request_t {
+    char* args[MAX_ARGS];
+    int argc;
+    char command[32];
+    int authorized;
+    int compress;
+    int window;
+    struct lz4_t lz4;
+};
+
+static int base64_value(char c)
+{
+    const char* table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char* p = strchr(table, c);
+    return (c != '\0' && p != NULL) ? p - table : -1;
+}
+
+static char* base64_decode(const char* encoded)
+{
+    char* decoded = malloc(strlen(encoded) + 1);
+    int bits = 0, value = 0, size = 0;
+    for (; *encoded != '\0' && *encoded != '='; encoded++) {
+        int v = base64_value(*encoded);
+        if (v < 0) {
+            continue;
+        }
+        value = (value << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            decoded[size++] = (value >> bits) & 0xff;
+        }
+    }
+    decoded[size] = '\0';
+    return decoded;
+}
+
+static int send_fully(int fd, const char* data, int size)
+{
+    while (size > 0) {
+        int ret = write(fd, data, size);
+        if (ret <= 0) {
+            return 0;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static int send_frame(int fd, const char* channel, const char* data, int size)
+{
+    char header[64];
+    int len = sprintf(header, "Channel: %s\nSize: %d\n\n", channel, size);
+    return send_fully(fd, header, len) && send_fully(fd, data, size);
+}
+
+/*
+ * send a frame compressed if it's requested and worth it.
+ */
+static int send_output(int fd, struct request_t* request, const char* channel, const char* data, int size)
+{
+    static __thread char packed[LZ4_MAX_COMPRESSED_SIZE(BLOB_FRAME_SIZE)];
+    if (!request->compress || size < COMPRESS_MIN_FRAME_SIZE || size > BLOB_FRAME_SIZE) {
+        return send_frame(fd, channel, data, size);
+    }
+    int packed_size = lz4_compress(&request->lz4, data, size, packed);
+    if (packed_size >= size) {
+        return send_frame(fd, channel, data, size);
+    }
+    char header[96];
+    int len = sprintf(header, "Channel: %s\nSize: %d\nCompressed: %d\n\n", channel, size, packed_size);
+    return send_fully(fd, header, len) && send_fully(fd, packed, packed_size);
+}
+
+static int send_status(int fd, int status)
+{
+    char header[32];
+    int len = sprintf(header, "Status: %d\n\n", status);
+    return send_fully(fd, header, len);
+}
+
+static int send_credit(int fd, int size)
+{
+    char header[64];
+    int len = sprintf(header, "Channel: in\nCredit: %d\n\n", size);
+    return send_fully(fd, header, len);
+}
+
+/*
+ * read a header block and return the value of Size, CREDIT_BLOCK for a credit
+ * of output from the client, or -1 at the end of stream.
+ * packed_size is set to the value of Compressed, or 0.
+ */
+static int read_chunk_size(FILE* in, char* command, int command_size, int* packed_size)
+{
+    char line[MAX_LINE];
+    int size = -1;
+    int empty = 1;
+    *packed_size = 0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0') {
+            return empty ? -1 : size;
+        }
+        empty = 0;
+        if (strncmp(line, "Size: ", 6) == 0) {
+            size = atoi(line + 6);
+        } else if (strncmp(line, "Compressed: ", 12) == 0) {
+            *packed_size = atoi(line + 12);
+        } else if (strncmp(line, "Cmd: ", 5) == 0 && command != NULL) {
+            snprintf(command, command_size, "%s", line + 5);
+            size = 0;
+        } else if (strncmp(line, "Credit: ", 8) == 0) {
+            size = CREDIT_BLOCK;
+        }
+    }
+    return -1;
+}
+
+static void read_request(FILE* in, struct request_t* request)
+{
+    char line[MAX_LINE];
+    memset(request, 0, sizeof(*request));
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0') {
+            break;
+        }
+        char* value = strchr(line, ':');
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+        while (*value == ' ') {
+            value++;
+        }
+        if (strcmp(line, "Arg") == 0 && request->argc < MAX_ARGS) {
+            request->args[request->argc++] = base64_decode(value);
+        } else if (strcmp(line, "Auth") == 0) {
+            request->authorized = (strcmp(value, authtoken) == 0);
+        } else if (strcmp(line, "Cmd") == 0) {
+            snprintf(request->command, sizeof(request->command), "%s", value);
+        } else if (strcmp(line, "Compress") == 0) {
+            request->compress = (strcmp(value, "lz4") == 0);
+        } else if (strcmp(line, "Window") == 0) {
+            request->window = atoi(value);
+        }
+    }
+}
+
+/*
+ * read a compressed body of a stdin frame and copy it to out channel when echo is TRUE.
+ */
+static int consume_packed_stdin(FILE* in, int fd, struct request_t* request, int echo, int size, int packed_size)
+{
+    static __thread char packed[LZ4_MAX_COMPRESSED_SIZE(COMPRESS_MAX_FRAME_SIZE)];
+    static __thread char buf[COMPRESS_MAX_FRAME_SIZE];
+    int offset;
+    if (size > COMPRESS_MAX_FRAME_SIZE || packed_size > sizeof(packed)
+        || fread(packed, 1, packed_size, in) != packed_size
+        || lz4_decompress(packed, packed_size, buf, size) != size) {
+        return 0;
+    }
+    for (offset = 0; echo && offset < size; offset += BLOB_FRAME_SIZE) {
+        if (!send_output(fd, request, "out", buf + offset, (size - offset < BLOB_FRAME_SIZE) ? size - offset : BLOB_FRAME_SIZE)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * copy stdin frames to out channel when echo is TRUE, or discard them.
+ */
+static int consume_stdin(FILE* in, int fd, struct request_t* request, int echo)
+{
+    char buf[BLOB_FRAME_SIZE];
+    char command[32] = "";
+    int size, packed_size;
+    while ((size = read_chunk_size(in, command, sizeof(command), &packed_size)) > 0 || size == CREDIT_BLOCK) {
+        if (size == CREDIT_BLOCK) {
+            continue;
+        }
+        // the frame is granted again as soon as it arrives
+        if (request->window > 0 && !send_credit(fd, size)) {
+            return 0;
+        }
+        if (packed_size > 0) {
+            if (!consume_packed_stdin(in, fd, request, echo, size, packed_size)) {
+                return 0;
+            }
+            continue;
+        }
+        while (size > 0) {
+            int len = fread(buf, 1, (size < sizeof(buf)) ? size : sizeof(buf), in);
+            if (len <= 0) {
+                return 0;
+            }
+            if (echo && !send_output(fd, request, "out", buf, len)) {
+                return 0;
+            }
+            size -= len;
+        }
+    }
+    return strcmp(command, "interrupt") != 0;
+}
+
+static int emit(int fd, struct request_t* request)
+{
+    const char* pattern = (request->argc > 0) ? request->args[0] : "hello";
+    long n = (request->argc > 1) ? atol(request->args[1]) : 0;
+    char line[64];
+    long i;
+
+    if (strcmp(pattern, "lines") == 0 || strcmp(pattern, "interleave") == 0) {
+        int interleave = (strcmp(pattern, "interleave") == 0);
+        for (i = 0; i < n; i++) {
+            int len = sprintf(line, "line %ld\n", i);
+            if (!send_frame(fd, (interleave && i % 2 == 1) ? "err" : "out", line, len)) {
+                return 0;
+            }
+        }
+    }
+    else if (strcmp(pattern, "blob") == 0) {
+        char blob[BLOB_FRAME_SIZE];
+        memset(blob, 'x', sizeof(blob));
+        for (i = 0; i < n; i += sizeof(blob)) {
+            if (!send_output(fd, request, "out", blob, (n - i < sizeof(blob)) ? n - i : sizeof(blob))) {
+                return 0;
+            }
+        }
+    }
+    else if (strcmp(pattern, "log") == 0) {
+        char frame[BLOB_FRAME_SIZE];
+        int size = 0;
+        for (i = 0; i < n; i++) {
+            if (size + 128 > sizeof(frame)) {
+                if (!send_output(fd, request, "out", frame, size)) {
+                    return 0;
+                }
+                size = 0;
+            }
+            size += sprintf(frame + size, "2013-10-19 12:%02ld:%02ld.%03ld INFO  [worker-%ld] org.example.Service - processed request %ld in %ld ms\n",
+                            (i / 60000) % 60, (i / 1000) % 60, i % 1000, i % 16, i, (i * 7919) % 500);
+        }
+        if (size > 0 && !send_output(fd, request, "out", frame, size)) {
+            return 0;
+        }
+    }
+    else if (strcmp(pattern, "sleep") == 0) {
+        usleep(n * 1000);
+    }
+    else if (strcmp(pattern, "echo") != 0) {
+        const char* hello = "Hello, World!\n";
+        return send_frame(fd, "out", hello, strlen(hello));
+    }
+    return 1;
+}
+
+static void* handle(void* arg)
+{
+    int fd = (int) (long) arg;
+    FILE* in = fdopen(fd, "r");
+    struct request_t request;
+    int i;
+
+    read_request(in, &request);
+    if (!request.authorized) {
+        send_status(fd, STATUS_INVALID_AUTHTOKEN);
+    }
+    else if (strcmp(request.command, "shutdown") == 0) {
+        send_status(fd, 0);
+        exit(0);
+    }
+    else if (request.command[0] != '\0') {
+        send_status(fd, 0); // ping and others
+    }
+    else {
+        int echo = (request.argc > 0 && strcmp(request.args[0], "echo") == 0);
+        const char* accepted = "Compress: lz4\n\n";
+        // stdin is read before output not to be blocked by each other
+        if ((!request.compress || send_fully(fd, accepted, strlen(accepted)))
+            && (request.window <= 0 || send_credit(fd, STDIN_CREDIT))
+            && consume_stdin(in, fd, &request, echo) && emit(fd, &request)) {
+            send_status(fd, 0);
+        }
+    }
+    for (i = 0; i < request.argc; i++) {
+        free(request.args[i]);
+    }
+    // credits sent by the client until it sees the status are read not to reset the connection
+    char rest[BLOB_FRAME_SIZE];
+    shutdown(fd, SHUT_WR);
+    while (fread(rest, 1, sizeof(rest), in) > 0) {
+        ;
+    }
+    fclose(in);
+    return NULL;
+}
+
+static void save_authtoken(int port)
+{
+    char path[MAXPATHLEN];
+    snprintf(path, sizeof(path), "%s/.groovy/groovyserv/authtoken-%d", getenv("HOME"), port);
+    FILE* fp = fopen(path, "w");
+    if (fp != NULL) {
+        fputs(authtoken, fp);
+        fclose(fp);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int port = DEFAULT_PORT;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:a:")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'a':
+            authtoken = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: standin [-p port] [-a authtoken]\n");
+            exit(1);
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(server, 128) != 0) {
+        perror("ERROR: could not listen");
+        exit(1);
+    }
+    save_authtoken(port);
+
+    while (1) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, handle, (void*) (long) fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A relay which emulates a slow link between a client and a server for benchmarks.
+ * All connections share a link of the rate in each direction, and each chunk
+ * is relayed when its transmission time on the link has passed.
+ *
+ * usage: throttle [-l listen-port] [-p server-port] [-r bytes-per-sec]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_LISTEN_PORT 19623
+#define DEFAULT_SERVER_PORT 1961
+#define DEFAULT_RATE (1024 * 1024) // bytes per second
+#define CHUNK_SIZE 1460
+
+struct link_t {
+    pthread_mutex_t lock;
+    long long free_at;  // microseconds when the link finishes sending queued chunks
+};
+
+struct relay_t {
+    int from;
+    int to;
+    struct link_t* link;
+    struct relay_t* peer;
+    pthread_mutex_t* lock;
+    int* remained;      // relays of the connection still running
+};
+
+static struct link_t upstream = { PTHREAD_MUTEX_INITIALIZER, 0 };
+static struct link_t downstream = { PTHREAD_MUTEX_INITIALIZER, 0 };
+static long long rate = DEFAULT_RATE;
+static int server_port = DEFAULT_SERVER_PORT;
+
+static long long now_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * wait until the chunk of size has passed through the link.
+ */
+static void pass_link(struct link_t* link, int size)
+{
+    long long now = now_micros();
+    pthread_mutex_lock(&link->lock);
+    long long start = (link->free_at > now) ? link->free_at : now;
+    link->free_at = start + size * 1000000LL / rate;
+    long long arrival = link->free_at;
+    pthread_mutex_unlock(&link->lock);
+    if (arrival > now) {
+        usleep(arrival - now);
+    }
+}
+
+static int send_fully(int fd, const char* data, int size)
+{
+    while (size > 0) {
+        int ret = write(fd, data, size);
+        if (ret <= 0) {
+            return 0;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static void* relay(void* arg)
+{
+    struct relay_t* relay = arg;
+    char buf[CHUNK_SIZE];
+    int len;
+    while ((len = read(relay->from, buf, sizeof(buf))) > 0) {
+        pass_link(relay->link, len);
+        if (!send_fully(relay->to, buf, len)) {
+            break;
+        }
+    }
+    shutdown(relay->to, SHUT_WR);
+
+    // the last one of the connection closes it
+    pthread_mutex_lock(relay->lock);
+    int remained = --*relay->remained;
+    pthread_mutex_unlock(relay->lock);
+    if (remained == 0) {
+        close(relay->from);
+        close(relay->to);
+        pthread_mutex_destroy(relay->lock);
+        free(relay->lock);
+        free(relay->remained);
+        free(relay->peer);
+        free(relay);
+    }
+    return NULL;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void start_relays(int client, int server)
+{
+    struct relay_t* up = calloc(1, sizeof(struct relay_t));
+    struct relay_t* down = calloc(1, sizeof(struct relay_t));
+    pthread_mutex_t* lock = malloc(sizeof(pthread_mutex_t));
+    int* remained = malloc(sizeof(int));
+    pthread_t thread;
+
+    pthread_mutex_init(lock, NULL);
+    *remained = 2;
+    *up = (struct relay_t) { client, server, &upstream, down, lock, remained };
+    *down = (struct relay_t) { server, client, &downstream, up, lock, remained };
+    pthread_create(&thread, NULL, relay, up);
+    pthread_detach(thread);
+    pthread_create(&thread, NULL, relay, down);
+    pthread_detach(thread);
+}
+
+int main(int argc, char** argv)
+{
+    int listen_port = DEFAULT_LISTEN_PORT;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:p:r:")) != -1) {
+        switch (opt) {
+        case 'l': listen_port = atoi(optarg); break;
+        case 'p': server_port = atoi(optarg); break;
+        case 'r': rate = atoll(optarg); break;
+        default:
+            fprintf(stderr, "usage: throttle [-l listen-port] [-p server-port] [-r bytes-per-sec]\n");
+            exit(1);
+        }
+    }
+    if (rate <= 0) {
+        fprintf(stderr, "ERROR: invalid rate\n");
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(listen_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+        perror("ERROR: could not listen");
+        exit(1);
+    }
+
+    while (1) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        int server = connect_server();
+        if (server < 0) {
+            close(client);
+            continue;
+        }
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        start_relays(client, server);
+    }
+}
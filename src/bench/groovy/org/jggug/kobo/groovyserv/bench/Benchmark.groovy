@@ -0,0 +1,101 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.bench
+
+import groovy.transform.CompileStatic
+
+import java.lang.management.ManagementFactory
+
+/**
+ * A minimal harness in the manner of JMH: a body is called repeatedly in
+ * warm-up and measurement iterations of fixed time, and the throughput and
+ * the bytes allocated by the current thread per call are reported.
+ */
+@CompileStatic
+class Benchmark {
+
+    static int warmupIterations = 5
+    static int measurementIterations = 5
+    static long iterationNanos = 200L * 1000 * 1000
+
+    private static volatile Object sink // to prevent a result from being eliminated as dead code
+
+    final String name
+    final Closure body
+
+    Benchmark(String name, Closure body) {
+        this.name = name
+        this.body = body
+    }
+
+    Result run() {
+        warmupIterations.times { iterate() }
+
+        long allocatedBefore = allocatedBytes()
+        long totalOps = 0
+        List<Double> opsPerSec = []
+        measurementIterations.times {
+            long begin = System.nanoTime()
+            long ops = iterate()
+            opsPerSec << (ops * 1e9d / (System.nanoTime() - begin))
+            totalOps += ops
+        }
+        long allocated = allocatedBytes() - allocatedBefore
+
+        double mean = (double) opsPerSec.sum() / opsPerSec.size()
+        double variance = (double) opsPerSec.collect { double ops -> (ops - mean) * (ops - mean) }.sum() / opsPerSec.size()
+        return new Result(
+            name: name,
+            opsPerSec: mean,
+            errorPercent: (mean == 0d) ? 0d : Math.sqrt(variance) / mean * 100,
+            bytesPerOp: (allocated < 0) ? -1d : allocated / (double) totalOps,
+        )
+    }
+
+    private long iterate() {
+        long deadline = System.nanoTime() + iterationNanos
+        long ops = 0
+        while (true) {
+            for (int i = 0; i < 64; i++) {
+                sink = body.call()
+            }
+            ops += 64
+            if (System.nanoTime() >= deadline) {
+                return ops
+            }
+        }
+    }
+
+    private static long allocatedBytes() {
+        def threads = ManagementFactory.threadMXBean
+        if (threads instanceof com.sun.management.ThreadMXBean) {
+            return ((com.sun.management.ThreadMXBean) threads).getThreadAllocatedBytes(Thread.currentThread().id)
+        }
+        return -1
+    }
+
+    static class Result {
+        String name
+        double opsPerSec
+        double errorPercent
+        double bytesPerOp  // -1 if not supported by JVM
+
+        String toString() {
+            String.format(Locale.ENGLISH, "%-44s %14.1f ops/s  +-%5.1f%%  %12s B/op",
+                name, opsPerSec, errorPercent, (bytesPerOp < 0) ? "n/a" : String.format(Locale.ENGLISH, "%.1f", bytesPerOp))
+        }
+    }
+}
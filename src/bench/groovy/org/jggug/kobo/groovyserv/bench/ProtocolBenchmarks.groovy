@@ -0,0 +1,129 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.bench
+
+import org.jggug.kobo.groovyserv.AuthToken
+import org.jggug.kobo.groovyserv.ClientConnection
+import org.jggug.kobo.groovyserv.ClientProtocols
+import org.jggug.kobo.groovyserv.StreamRequest
+import org.jggug.kobo.groovyserv.stream.DynamicDelegatedPrintStream
+import org.jggug.kobo.groovyserv.stream.StreamResponseOutputStream
+import org.jggug.kobo.groovyserv.utils.IOUtils
+
+/**
+ * Benchmarks of the protocol code which runs for every frame on the server:
+ * parsing and formatting headers, emitting stdout frames and decoding stdin frames.
+ * println via System.out is measured as well, which is dispatched to the connection
+ * of the current thread.
+ *
+ * Usage: gradle bench [-Dbench.filter=substring]
+ */
+class ProtocolBenchmarks {
+
+    private static final List<Integer> WRITE_SIZES = [1, 80, 1024, 8192]
+
+    static void main(String[] args) {
+        def filter = args ? args[0] : ''
+        benchmarks().findAll { it.name.contains(filter) }.each { Benchmark benchmark ->
+            println benchmark.run()
+        }
+    }
+
+    static List<Benchmark> benchmarks() {
+        def benchmarks = []
+
+        // header parsing
+        def invocationHeader = new ByteArrayInputStream(invocationHeader().bytes)
+        benchmarks << new Benchmark("parseHeaders(invocation)", {
+            invocationHeader.reset()
+            ClientProtocols.parseHeaders(invocationHeader)
+        })
+        def streamHeader = new ByteArrayInputStream("Size: 1024\n\n".bytes)
+        benchmarks << new Benchmark("parseHeaders(stream)", {
+            streamHeader.reset()
+            ClientProtocols.parseHeaders(streamHeader)
+        })
+        def line = new ByteArrayInputStream(("Env: " + "X" * 80 + "\n").bytes)
+        benchmarks << new Benchmark("IOUtils.readLine(80 chars)", {
+            line.reset()
+            IOUtils.readLine(line)
+        })
+
+        // header formatting
+        benchmarks << new Benchmark("formatAsResponseHeader", {
+            ClientProtocols.formatAsResponseHeader('out', 1024)
+        })
+        benchmarks << new Benchmark("formatAsExitHeader", {
+            ClientProtocols.formatAsExitHeader(0)
+        })
+
+        // stdout frame emission
+        WRITE_SIZES.each { int size ->
+            def socket = new NullOutputStream()
+            def out = StreamResponseOutputStream.newOut(socket)
+            def data = new byte[size]
+            benchmarks << new Benchmark("StreamResponseOutputStream.write(${size})", {
+                out.write(data, 0, size)
+            })
+        }
+        def printStream = new PrintStream(StreamResponseOutputStream.newOut(new NullOutputStream()))
+        def text = "x" * 79
+        benchmarks << new Benchmark("PrintStream.println(80 chars)", {
+            printStream.println(text)
+        })
+        new ClientConnection(new AuthToken("bench"), new NullSocket()) // bound to the benchmark thread as a session
+        def systemOut = new DynamicDelegatedPrintStream(DynamicDelegatedPrintStream.OUT)
+        benchmarks << new Benchmark("System.out.println(80 chars)", {
+            systemOut.println(text)
+        })
+
+        // stdin frame decoding
+        WRITE_SIZES.each { int size ->
+            def bytes = new ByteArrayOutputStream()
+            bytes.write("Size: ${size}\n\n".bytes)
+            bytes.write(new byte[size])
+            def frame = new ByteArrayInputStream(bytes.toByteArray())
+            benchmarks << new Benchmark("decode stdin frame(${size})", {
+                frame.reset()
+                def headers = ClientProtocols.parseHeaders(frame)
+                def request = new StreamRequest(port: 0, size: headers.Size?.getAt(0), command: headers.Cmd?.getAt(0))
+                request.check()
+                ClientProtocols.readBody(frame, request.size)
+            })
+        }
+        return benchmarks
+    }
+
+    private static String invocationHeader() {
+        def lines = []
+        lines << "Cwd: /home/user/projects/example"
+        lines << "Auth: 0123456789abcdef"
+        10.times { lines << "Arg: ${"argument-${it}.groovy".bytes.encodeBase64()}" }
+        30.times { lines << "Env: ENVIRONMENT_VARIABLE_${it}=/usr/local/lib/value/${it}" }
+        lines << "Cp: " + (1..50).collect { "/home/user/.m2/repository/lib${it}/lib${it}.jar" }.join(File.pathSeparator)
+        return lines.join("\n") + "\n\n"
+    }
+
+    private static class NullOutputStream extends OutputStream {
+        void write(int b) {}
+        void write(byte[] b, int offset, int length) {}
+    }
+
+    private static class NullSocket extends Socket {
+        InputStream getInputStream() { new ByteArrayInputStream(new byte[0]) }
+        OutputStream getOutputStream() { new NullOutputStream() }
+    }
+}
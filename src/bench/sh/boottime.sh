@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Copyright 2009-2013 the original author or authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Measure boot time of groovyserver, which is until the server answers to clients,
+# without and with a class data sharing archive.
+#
+# usage: boottime.sh
+#
+# environment:
+#   GROOVYSERVER  groovyserver command (default: groovyserver)
+#   PORT          port of groovyserver (default: 19622)
+#   ROUNDS        boots to measure for each (default: 5)
+#
+
+GROOVYSERVER=${GROOVYSERVER:-groovyserver}
+PORT=${PORT:-19622}
+ROUNDS=${ROUNDS:-5}
+
+now_ms() {
+    # date +%N isn't available on some platforms
+    perl -MTime::HiRes=time -e 'printf "%d\n", time * 1000'
+}
+
+boot_average() {
+    total=0
+    i=0
+    while [ $i -lt $ROUNDS ]; do
+        started=$(now_ms)
+        "$GROOVYSERVER" -p $PORT -q || exit 1
+        total=$((total + $(now_ms) - started))
+        "$GROOVYSERVER" -p $PORT -q -k
+        i=$((i + 1))
+    done
+    echo $((total / ROUNDS))
+}
+
+# records loaded classes, and the archive is built by the next start
+"$GROOVYSERVER" -p $PORT -q -r --cds-train || exit 1
+"$GROOVYSERVER" -p $PORT -q -k
+"$GROOVYSERVER" -p $PORT -q || exit 1
+"$GROOVYSERVER" -p $PORT -q -k
+
+without=$(export GROOVYSERV_CDS=off; boot_average)
+with=$(boot_average)
+echo "boot time without class data sharing: ${without} ms"
+echo "boot time with class data sharing: ${with} ms"
+echo "difference: $((without - with)) ms"
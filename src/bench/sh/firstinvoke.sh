@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Copyright 2009-2013 the original author or authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Measure latency of the first invocation of a script after groovyserver starts,
+# without warm-up and with each mode of --warmup.
+#
+# usage: firstinvoke.sh <script> [args...]
+#
+# environment:
+#   GROOVYSERVER  groovyserver command (default: groovyserver)
+#   GROOVYCLIENT  groovyclient command (default: build/natives/groovyclient)
+#   PORT          port of groovyserver (default: 19621)
+#   RECORDS       invocations to record into the warm-up manifest (default: 5)
+#
+
+GROOVYSERVER=${GROOVYSERVER:-groovyserver}
+GROOVYCLIENT=${GROOVYCLIENT:-build/natives/groovyclient}
+PORT=${PORT:-19621}
+RECORDS=${RECORDS:-5}
+
+if [ $# -eq 0 ]; then
+    echo "usage: $(basename $0) <script> [args...]" >&2
+    exit 1
+fi
+
+now_ms() {
+    # date +%N isn't available on some platforms
+    perl -MTime::HiRes=time -e 'printf "%d\n", time * 1000'
+}
+
+stat_value() {
+    "$GROOVYCLIENT" -Cp $PORT -Cstats | sed -n "s/^$1: //p"
+}
+
+# records invocations into the manifest, which is saved at shutdown
+"$GROOVYSERVER" -p $PORT -q -r || exit 1
+i=0
+while [ $i -lt $RECORDS ]; do
+    "$GROOVYCLIENT" -Cp $PORT "$@" > /dev/null 2>&1
+    i=$((i + 1))
+done
+
+for mode in none compile run; do
+    if [ $mode = none ]; then
+        "$GROOVYSERVER" -p $PORT -q -r || exit 1
+    else
+        "$GROOVYSERVER" -p $PORT -q -r --warmup $mode || exit 1
+    fi
+    while [ "$(stat_value warmup.state)" = "running" ]; do
+        sleep 1
+    done
+    started=$(now_ms)
+    "$GROOVYCLIENT" -Cp $PORT "$@" > /dev/null 2>&1
+    elapsed=$(($(now_ms) - started))
+    echo "warm-up $mode: client ${elapsed} ms, server first-invoke $(stat_value latency.first-invoke.ms) ms"
+done
+"$GROOVYSERVER" -p $PORT -q -k
@@ -113,7 +113,8 @@ call :info_log GroovyServ default classpath: "%CLASSPATH%"
 
 @rem -server: for performance (experimental)
 @rem -Djava.awt.headless=true: without this, annoying to switch an active process to it when new process is created as daemon
-set JAVA_OPTS=%JAVA_OPTS% -server -Djava.awt.headless=true
+@rem -XX:MinHeapFreeRatio/MaxHeapFreeRatio: to shrink the heap by a full GC which reclaims memory while idle (overridable by JAVA_OPTS)
+set JAVA_OPTS=-XX:MinHeapFreeRatio=20 -XX:MaxHeapFreeRatio=40 %JAVA_OPTS% -server -Djava.awt.headless=true
 
 @rem -------------------------------------------
 @rem Invoke server
@@ -202,4 +203,9 @@ echo   -r,--restart                  restart the running groovyserver
 echo   -v,--verbose                  verbose output to a log file
 echo      --allow-from ^<addresses^>   specify optional acceptable client addresses ^(delimiter: comma^)
 echo      --authtoken ^<authtoken^>    specify authtoken ^(which is automatically generated if not specified^)
+echo      --spill ^<size^>             buffer output for a slow client up to the size ^(suffix K/M/G^) in memory and the rest in a file
+echo      --warmup ^<mode^>            replay frequent invocations at startup to warm up ^('compile' or 'run'^)
+echo      --memory-budget ^<size^>     reclaim memory while idle when heap and metaspace in use are over the size ^(suffix K/M/G^)
+echo      --max-interactive ^<n^>      specify max number of concurrent interactive sessions ^(default: 4 per CPU^)
+echo      --max-batch ^<n^>            specify max number of concurrent batch sessions ^(default: number of CPUs - 1^)
 exit /B 0
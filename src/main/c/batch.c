@@ -0,0 +1,712 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "config.h"
+
+#include <sys/types.h>
+#ifdef WINDOWS
+#include <windows.h>
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#endif
+
+#include <unistd.h>
+#include <signal.h>
+
+#include "bool.h"
+#include "option.h"
+#include "session.h"
+#include "batch.h"
+
+#define BATCH_OPTION_CWD "-Ccwd"
+#define BATCH_OPTION_SETENV "-Csetenv"
+
+struct slot_t {
+    struct session_t session;
+    struct job_t* job;      // NULL when the slot is idle
+    struct server_t* server;
+    int spare_fd;           // connection opened in advance for the next job
+};
+
+static struct slot_t* active_slots = NULL;
+static int active_slot_count = 0;
+
+int default_concurrency()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) {
+        return (int) n;
+    }
+#endif
+    return 4;
+}
+
+static void close_socket(int fd)
+{
+#ifdef WINDOWS
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+static void send_text(int fd, const char* text)
+{
+#ifdef WINDOWS
+    send(fd, text, strlen(text), 0);
+#else
+    write(fd, text, strlen(text));
+#endif
+}
+
+static void interrupt_handler(int sig)
+{
+    int i;
+    for (i = 0; i < active_slot_count; i++) {
+        if (active_slots[i].job != NULL) {
+            send_text(active_slots[i].session.fd, "Cmd: interrupt\n\n");
+            close_socket(active_slots[i].session.fd);
+        }
+    }
+    exit(1);
+}
+
+/*
+ * A connection opened in advance but not used must be closed by a harmless request.
+ * Otherwise the server regards it as an invalid request.
+ */
+static void release_spare(struct slot_t* slot)
+{
+    char text[BUFFER_SIZE];
+    if (slot->spare_fd < 0) {
+        return;
+    }
+    sprintf(text, "Cmd: ping\nAuth: %s\n\n", slot->server->authtoken);
+    send_text(slot->spare_fd, text);
+    close_socket(slot->spare_fd);
+    slot->spare_fd = -1;
+}
+
+static void fail_job(struct job_runner_t* runner, struct job_t* job, const char* message)
+{
+    char text[BUFFER_SIZE];
+    snprintf(text, sizeof(text), "ERROR: %s\n", message);
+    runner->output(runner, job, "err", text, strlen(text));
+    job->status = 1;
+    runner->finished(runner, job);
+    delete_job(job);
+}
+
+static int open_server_socket(struct server_t* server)
+{
+    return server->resolved ? connect_server_addr(&server->addr) : OPEN_SOCKET_FAILED;
+}
+
+static BOOL start_job(struct job_runner_t* runner, struct slot_t* slot, struct job_t* job)
+{
+    int fd = slot->spare_fd;
+    slot->spare_fd = -1;
+    if (fd < 0) {
+        fd = open_server_socket(slot->server);
+    }
+    if (fd < 0) {
+        fail_job(runner, job, "could not connect to server");
+        return FALSE;
+    }
+#ifdef DEBUG
+    fprintf(stderr, "DEBUG: job %d is started on %s:%d\n", job->id, slot->server->host, slot->server->port);
+#endif
+    job->invocation.priority = (client_option.priority != NULL) ? client_option.priority : DEFAULT_JOB_PRIORITY;
+    job->invocation.env_all = client_option.env_all;
+    job->invocation.env_includes = client_option.env_include_mask;
+    job->invocation.env_excludes = client_option.env_exclude_mask;
+    if (!send_invocation_header(fd, &job->invocation, slot->server->authtoken)
+        || !send_stdin_chunk(fd, NULL, 0)) { // jobs have no stdin
+        close_socket(fd);
+        fail_job(runner, job, "could not send request to server");
+        return FALSE;
+    }
+    session_init(&slot->session, fd, slot);
+    slot->job = job;
+    return TRUE;
+}
+
+static struct job_runner_t* current_runner = NULL;
+
+static void dispatch_chunk(struct session_t* session, const char* channel, const char* data, int size)
+{
+    struct slot_t* slot = (struct slot_t*) session->data;
+    current_runner->output(current_runner, slot->job, channel, data, size);
+}
+
+static void finish_job(struct job_runner_t* runner, struct slot_t* slot, int result)
+{
+    struct job_t* job = slot->job;
+    if (result == SESSION_FINISHED) {
+        job->status = slot->session.status;
+    } else {
+        const char* message = "ERROR: connection closed by server\n";
+        runner->output(runner, job, "err", message, strlen(message));
+        job->status = 1;
+    }
+    session_delete(&slot->session);
+    close_socket(slot->session.fd);
+    slot->job = NULL;
+    runner->finished(runner, job);
+    delete_job(job);
+}
+
+/*
+ * Run jobs from the runner with at most concurrency sessions at once.
+ * Each slot of sessions is bound to one of the servers, and an idle slot
+ * pulls the next job from the shared queue, so that a slot on a faster server
+ * takes more jobs. A connection for a queued job is opened in advance while
+ * the current job of the slot is running, so that connecting doesn't appear
+ * in the latency of jobs.
+ * first_fd is an already connected socket to the first server or -1.
+ * Return the number of finished jobs.
+ */
+int run_jobs(struct job_runner_t* runner, struct server_t* servers, int server_count, int concurrency, int first_fd)
+{
+    struct slot_t slots[concurrency];
+    struct job_t* queue[concurrency];
+    int queued = 0;
+    BOOL exhausted = FALSE;
+    int finished = 0;
+    int i;
+
+    // each server is resolved once for all connections to it
+    for (i = 0; i < server_count; i++) {
+        servers[i].resolved = (resolve_server(servers[i].host, servers[i].port, &servers[i].addr) == 0);
+    }
+    for (i = 0; i < concurrency; i++) {
+        slots[i].job = NULL;
+        slots[i].server = &servers[i % server_count];
+        slots[i].spare_fd = -1;
+    }
+    slots[0].spare_fd = first_fd;
+
+    current_runner = runner;
+    active_slots = slots;
+    active_slot_count = concurrency;
+    signal(SIGINT, interrupt_handler);
+
+    while (1) {
+        int busy = 0;
+        int spares = 0;
+        int max_fd = -1;
+        fd_set read_set;
+
+        // read jobs ahead as many as concurrency
+        while (!exhausted && queued < concurrency) {
+            struct job_t* job = runner->next(runner);
+            if (job == NULL) {
+                exhausted = TRUE;
+            } else {
+                queue[queued++] = job;
+            }
+        }
+
+        // assign queued jobs to idle slots
+        for (i = 0; i < concurrency && queued > 0; i++) {
+            if (slots[i].job != NULL) {
+                continue;
+            }
+            struct job_t* job = queue[0];
+            memmove(queue, queue + 1, sizeof(struct job_t*) * --queued);
+            if (job->invocation.argv == NULL) { // invalid spec
+                fail_job(runner, job, job->storage);
+                finished++;
+                i--;
+                continue;
+            }
+            if (!start_job(runner, &slots[i], job)) {
+                finished++;
+            }
+        }
+
+        FD_ZERO(&read_set);
+        for (i = 0; i < concurrency; i++) {
+            if (slots[i].job == NULL) {
+                release_spare(&slots[i]);
+                continue;
+            }
+            if (slots[i].spare_fd >= 0) {
+                spares++;
+            }
+            FD_SET(slots[i].session.fd, &read_set);
+            if (slots[i].session.fd > max_fd) {
+                max_fd = slots[i].session.fd;
+            }
+            busy++;
+        }
+        if (busy == 0) {
+            if (exhausted && queued == 0) {
+                break;
+            }
+            continue; // all assigned jobs failed to start
+        }
+
+        // open connections in advance no more than queued jobs
+        for (i = 0; i < concurrency && spares < queued; i++) {
+            if (slots[i].job != NULL && slots[i].spare_fd < 0) {
+                slots[i].spare_fd = open_server_socket(slots[i].server);
+                spares++;
+            }
+        }
+
+        if (select(max_fd + 1, &read_set, NULL, NULL, NULL) == -1) {
+            perror("ERROR: could not select I/O");
+            exit(1);
+        }
+        for (i = 0; i < concurrency; i++) {
+            if (slots[i].job == NULL || !FD_ISSET(slots[i].session.fd, &read_set)) {
+                continue;
+            }
+            int result = session_receive(&slots[i].session, dispatch_chunk);
+            if (result != SESSION_RUNNING) {
+                finish_job(runner, &slots[i], result);
+                finished++;
+            }
+        }
+    }
+
+    for (i = 0; i < concurrency; i++) {
+        release_spare(&slots[i]);
+    }
+    signal(SIGINT, SIG_DFL);
+    active_slots = NULL;
+    active_slot_count = 0;
+    current_runner = NULL;
+    return finished;
+}
+
+/*
+ * The status of the first failed job in input order is the exit status of all jobs.
+ */
+void aggregate_exit_status(struct exit_status_t* exit_status, struct job_t* job)
+{
+    if (job->status != 0 && (exit_status->failed_id == 0 || job->id < exit_status->failed_id)) {
+        exit_status->failed_id = job->id;
+        exit_status->status = job->status;
+    }
+}
+
+void delete_job(struct job_t* job)
+{
+    if (job == NULL) {
+        return;
+    }
+    free(job->invocation.argv);
+    free(job->invocation.envs);
+    free(job->storage);
+    free(job);
+}
+
+//--------------------------------------
+// Batch mode
+
+struct batch_t {
+    FILE* fp;
+    int next_id;
+    struct exit_status_t exit_status;
+};
+
+/*
+ * read a line of any length. return NULL at EOF.
+ */
+static char* read_spec_line(FILE* fp)
+{
+    int capacity = BUFFER_SIZE;
+    int size = 0;
+    char* line = malloc(capacity);
+    if (line == NULL) {
+        perror("ERROR: could not allocate memory");
+        exit(1);
+    }
+    while (fgets(line + size, capacity - size, fp) != NULL) {
+        size += strlen(line + size);
+        if (size > 0 && line[size - 1] == '\n') {
+            line[--size] = '\0';
+            if (size > 0 && line[size - 1] == '\r') {
+                line[--size] = '\0';
+            }
+            return line;
+        }
+        capacity *= 2;
+        line = realloc(line, capacity);
+        if (line == NULL) {
+            perror("ERROR: could not allocate memory");
+            exit(1);
+        }
+    }
+    if (size > 0) { // last line without LF
+        return line;
+    }
+    free(line);
+    return NULL;
+}
+
+/*
+ * split a line into tokens in place like a shell: spaces separate tokens,
+ * 'single quotes' and "double quotes" keep spaces, and a backslash escapes
+ * a next character except in single quotes.
+ * return the number of tokens, or -1 if a quote isn't closed.
+ */
+static int split_spec_line(char* line, char** tokens)
+{
+    char* src = line;
+    char* dst = line;
+    int count = 0;
+
+    while (1) {
+        while (isspace((unsigned char) *src)) {
+            src++;
+        }
+        if (*src == '\0') {
+            return count;
+        }
+        tokens[count++] = dst;
+        char quote = '\0';
+        while (*src != '\0' && (quote != '\0' || !isspace((unsigned char) *src))) {
+            if (quote == '\0' && (*src == '\'' || *src == '"')) {
+                quote = *src++;
+            }
+            else if (quote != '\0' && *src == quote) {
+                quote = '\0';
+                src++;
+            }
+            else if (*src == '\\' && quote != '\'' && src[1] != '\0') {
+                *dst++ = src[1];
+                src += 2;
+            }
+            else {
+                *dst++ = *src++;
+            }
+        }
+        if (quote != '\0') {
+            return -1;
+        }
+        if (*src != '\0') {
+            src++;
+        }
+        *dst++ = '\0';
+    }
+}
+
+static struct job_t* new_job(int id)
+{
+    struct job_t* job = calloc(1, sizeof(struct job_t));
+    if (job == NULL) {
+        perror("ERROR: could not allocate memory");
+        exit(1);
+    }
+    job->id = id;
+    return job;
+}
+
+/*
+ * an invalid spec is returned as a job without argv of which storage has an error message.
+ */
+static struct job_t* invalid_job(struct job_t* job, const char* message, const char* token)
+{
+    char text[BUFFER_SIZE];
+    snprintf(text, sizeof(text), "%s%s", message, token);
+    free(job->invocation.argv);
+    free(job->invocation.envs);
+    free(job->storage);
+    job->invocation.argv = NULL;
+    job->invocation.envs = NULL;
+    job->storage = strdup(text);
+    return job;
+}
+
+/*
+ * A spec line consists of arguments for groovy, and the following options:
+ *   -Ccwd <dir>              current working directory of the job
+ *   -Csetenv <NAME=VALUE>    environment variable of the job
+ * Empty lines and lines starting with '#' are ignored, for which NULL is returned.
+ * Otherwise the line is owned by the returned job.
+ */
+struct job_t* parse_job_spec(char* line, int id)
+{
+    char* p = line;
+    while (isspace((unsigned char) *p)) {
+        p++;
+    }
+    if (*p == '\0' || *p == '#') {
+        return NULL;
+    }
+
+    struct job_t* job = new_job(id);
+    int max_tokens = strlen(line) / 2 + 2;
+    char** tokens = malloc(sizeof(char*) * max_tokens);
+    job->invocation.argv = malloc(sizeof(char*) * (max_tokens + 1));
+    job->invocation.envs = malloc(sizeof(char*) * (max_tokens + 1));
+    job->storage = line;
+    if (tokens == NULL || job->invocation.argv == NULL || job->invocation.envs == NULL) {
+        perror("ERROR: could not allocate memory");
+        exit(1);
+    }
+
+    int count = split_spec_line(line, tokens);
+    if (count < 0) {
+        free(tokens);
+        return invalid_job(job, "unterminated quote in batch spec", "");
+    }
+    int argc = 1, envc = 0, i;
+    job->invocation.argv[0] = "groovyclient";
+    for (i = 0; i < count; i++) {
+        if (strcmp(tokens[i], BATCH_OPTION_CWD) == 0 && i + 1 < count) {
+            job->invocation.cwd = tokens[++i];
+        }
+        else if (strcmp(tokens[i], BATCH_OPTION_SETENV) == 0 && i + 1 < count && strchr(tokens[i + 1], '=') != NULL) {
+            job->invocation.envs[envc++] = tokens[++i];
+        }
+        else if (strncmp(tokens[i], CLIENT_OPTION_PREFIX, strlen(CLIENT_OPTION_PREFIX)) == 0) {
+            char token[BUFFER_SIZE];
+            snprintf(token, sizeof(token), "%s", tokens[i]);
+            free(tokens);
+            return invalid_job(job, "invalid option in batch spec: ", token);
+        }
+        else {
+            job->invocation.argv[argc++] = tokens[i];
+        }
+    }
+    job->invocation.argv[argc] = NULL;
+    job->invocation.argc = argc;
+    job->invocation.envs[envc] = NULL;
+    free(tokens);
+    return job;
+}
+
+static struct job_t* next_batch_job(struct job_runner_t* runner)
+{
+    struct batch_t* batch = (struct batch_t*) runner->data;
+    char* line;
+
+    while ((line = read_spec_line(batch->fp)) != NULL) {
+        struct job_t* job = parse_job_spec(line, batch->next_id);
+        if (job == NULL) {
+            free(line);
+            continue;
+        }
+        batch->next_id++;
+        return job;
+    }
+    return NULL;
+}
+
+static void write_fully(int fd, const char* data, int size)
+{
+    while (size > 0) {
+        int ret = write(fd, data, size);
+        if (ret <= 0) {
+            perror("ERROR: could not write result");
+            exit(1);
+        }
+        data += ret;
+        size -= ret;
+    }
+}
+
+/*
+ * Results are written to stdout as a stream of chunks in the same framing as
+ * the protocol, each of which is tagged by the job number:
+ *   'Job:' <id> LF 'Channel:' <out|err> LF 'Size:' <size> LF LF <body>
+ *   'Job:' <id> LF 'Status:' <status> LF LF
+ */
+static void output_batch_chunk(struct job_runner_t* runner, struct job_t* job, const char* channel, const char* data, int size)
+{
+    char header[BUFFER_SIZE];
+    sprintf(header, "%s: %d\nChannel: %s\nSize: %d\n\n", HEADER_KEY_JOB, job->id, channel, size);
+    write_fully(fileno(stdout), header, strlen(header));
+    write_fully(fileno(stdout), data, size);
+}
+
+static void finish_batch_job(struct job_runner_t* runner, struct job_t* job)
+{
+    struct batch_t* batch = (struct batch_t*) runner->data;
+    char header[BUFFER_SIZE];
+    sprintf(header, "%s: %d\nStatus: %d\n\n", HEADER_KEY_JOB, job->id, job->status);
+    write_fully(fileno(stdout), header, strlen(header));
+    aggregate_exit_status(&batch->exit_status, job);
+}
+
+/*
+ * Run invocations which are specified one per line in the file ("-" means stdin).
+ */
+int run_batch(char* path, struct server_t* servers, int server_count, int concurrency, int first_fd)
+{
+    struct batch_t batch = { NULL, 1, { 0, 0 } };
+    struct job_runner_t runner = { next_batch_job, output_batch_chunk, finish_batch_job, &batch };
+
+    if (strcmp(path, "-") == 0) {
+        batch.fp = stdin;
+    } else {
+        batch.fp = fopen(path, "r");
+        if (batch.fp == NULL) {
+            fprintf(stderr, "ERROR: could not open batch file: %s\n", path);
+            exit(1);
+        }
+    }
+
+    run_jobs(&runner, servers, server_count, concurrency, first_fd);
+
+    if (batch.fp != stdin) {
+        fclose(batch.fp);
+    }
+    return batch.exit_status.status;
+}
+
+//--------------------------------------
+// Fan-out mode
+
+struct job_output_t {
+    char* data;     // sequence of records: channel(1 byte) size(int) body
+    int size;
+    int capacity;
+};
+
+struct fanout_t {
+    char** args;    // arguments given to all jobs
+    int arg_count;
+    char** inputs;  // each input is appended to the arguments of a job
+    int input_count;
+    int next_index;
+    int head_id;    // the first job in input order which isn't yet written out
+    BOOL* done;
+    struct job_output_t* outputs;
+    struct exit_status_t exit_status;
+};
+
+static int channel_fd(char channel)
+{
+    return (channel == 'e') ? fileno(stderr) : fileno(stdout);
+}
+
+static void buffer_output(struct job_output_t* output, char channel, const char* data, int size)
+{
+    int required = output->size + 1 + sizeof(int) + size;
+    if (required > output->capacity) {
+        output->capacity = (output->capacity == 0) ? BUFFER_SIZE : output->capacity;
+        while (required > output->capacity) {
+            output->capacity *= 2;
+        }
+        output->data = realloc(output->data, output->capacity);
+        if (output->data == NULL) {
+            perror("ERROR: could not allocate memory");
+            exit(1);
+        }
+    }
+    output->data[output->size] = channel;
+    memcpy(output->data + output->size + 1, &size, sizeof(int));
+    memcpy(output->data + output->size + 1 + sizeof(int), data, size);
+    output->size = required;
+}
+
+static void flush_output(struct job_output_t* output)
+{
+    int pos = 0;
+    while (pos < output->size) {
+        int size;
+        memcpy(&size, output->data + pos + 1, sizeof(int));
+        write_fully(channel_fd(output->data[pos]), output->data + pos + 1 + sizeof(int), size);
+        pos += 1 + sizeof(int) + size;
+    }
+    free(output->data);
+    output->data = NULL;
+    output->size = output->capacity = 0;
+}
+
+static struct job_t* next_fanout_job(struct job_runner_t* runner)
+{
+    struct fanout_t* fanout = (struct fanout_t*) runner->data;
+    if (fanout->next_index >= fanout->input_count) {
+        return NULL;
+    }
+    struct job_t* job = new_job(fanout->next_index + 1);
+    job->invocation.argv = malloc(sizeof(char*) * (fanout->arg_count + 3));
+    if (job->invocation.argv == NULL) {
+        perror("ERROR: could not allocate memory");
+        exit(1);
+    }
+    job->invocation.argv[0] = "groovyclient";
+    memcpy(job->invocation.argv + 1, fanout->args, sizeof(char*) * fanout->arg_count);
+    job->invocation.argv[fanout->arg_count + 1] = fanout->inputs[fanout->next_index++];
+    job->invocation.argv[fanout->arg_count + 2] = NULL;
+    job->invocation.argc = fanout->arg_count + 2;
+    return job;
+}
+
+/*
+ * Output of the head job is written out directly, and output of the others
+ * is buffered until all jobs before them are finished.
+ */
+static void output_fanout_chunk(struct job_runner_t* runner, struct job_t* job, const char* channel, const char* data, int size)
+{
+    struct fanout_t* fanout = (struct fanout_t*) runner->data;
+    char c = (strcmp(channel, "err") == 0) ? 'e' : 'o';
+    if (job->id == fanout->head_id) {
+        write_fully(channel_fd(c), data, size);
+    } else {
+        buffer_output(&fanout->outputs[job->id - 1], c, data, size);
+    }
+}
+
+static void finish_fanout_job(struct job_runner_t* runner, struct job_t* job)
+{
+    struct fanout_t* fanout = (struct fanout_t*) runner->data;
+    fanout->done[job->id - 1] = TRUE;
+    aggregate_exit_status(&fanout->exit_status, job);
+
+    while (fanout->head_id <= fanout->input_count && fanout->done[fanout->head_id - 1]) {
+        fanout->head_id++;
+        if (fanout->head_id <= fanout->input_count) {
+            flush_output(&fanout->outputs[fanout->head_id - 1]);
+        }
+    }
+}
+
+/*
+ * Run the same arguments for each input, of which output is grouped per job in input order.
+ */
+int run_fanout(char** args, int arg_count, char** inputs, int input_count, struct server_t* servers, int server_count, int concurrency, int first_fd)
+{
+    struct fanout_t fanout = { args, arg_count, inputs, input_count, 0, 1, NULL, NULL, { 0, 0 } };
+    struct job_runner_t runner = { next_fanout_job, output_fanout_chunk, finish_fanout_job, &fanout };
+
+    fanout.done = calloc(input_count + 1, sizeof(BOOL));
+    fanout.outputs = calloc(input_count + 1, sizeof(struct job_output_t));
+    if (fanout.done == NULL || fanout.outputs == NULL) {
+        perror("ERROR: could not allocate memory");
+        exit(1);
+    }
+
+    run_jobs(&runner, servers, server_count, concurrency, first_fd);
+
+    free(fanout.done);
+    free(fanout.outputs);
+    return fanout.exit_status.status;
+}
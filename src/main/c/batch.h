@@ -0,0 +1,63 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "session.h"
+
+#define HEADER_KEY_JOB "Job"
+#define DEFAULT_JOB_PRIORITY "batch"
+
+struct server_t {
+    char* host;
+    int port;
+    char* authtoken;
+    struct server_addr_t addr;  // resolved by run_jobs()
+    BOOL resolved;
+};
+
+struct job_t {
+    int id;                         // sequential number from 1 in input order
+    struct invocation_t invocation;
+    char* storage;                  // memory which args and envvars point to
+    int status;
+};
+
+struct exit_status_t {
+    int failed_id;  // 0 if all jobs succeeded
+    int status;
+};
+
+/*
+ * A source of jobs and handlers of their results for run_jobs().
+ */
+struct job_runner_t {
+    struct job_t* (*next)(struct job_runner_t* runner);
+    void (*output)(struct job_runner_t* runner, struct job_t* job, const char* channel, const char* data, int size);
+    void (*finished)(struct job_runner_t* runner, struct job_t* job);
+    void* data;
+};
+
+int run_jobs(struct job_runner_t* runner, struct server_t* servers, int server_count, int concurrency, int first_fd);
+struct job_t* parse_job_spec(char* line, int id);
+int run_batch(char* path, struct server_t* servers, int server_count, int concurrency, int first_fd);
+int run_fanout(char** args, int arg_count, char** inputs, int input_count, struct server_t* servers, int server_count, int concurrency, int first_fd);
+void aggregate_exit_status(struct exit_status_t* exit_status, struct job_t* job);
+void delete_job(struct job_t* job);
+int default_concurrency();
+
+#endif
@@ -45,8 +45,8 @@ buf* buf_init(buf* buf, int size, const char* const initial)
     buf->buffer_size = size;
     buf->buffer = malloc(size * sizeof(char));
     if (buf->buffer == NULL) {
-        fprintf(stderr, "\nERROR: failed to allocate memory\n");
-        exit(1);
+        buf->buffer_size = 0;
+        return NULL;
     }
     if (initial != NULL) {
         buf_strcopy(buf, initial);
@@ -61,6 +61,25 @@ buf buf_new(int size, const char* const initial)
     return result;
 }
 
+/*
+ * When memory allocation fails, the buffer is released and the buf turns
+ * into the failed state, in which all operations return NULL.
+ * So it's enough for a caller to check buf_failed() at the end.
+ */
+int buf_failed(const buf* const buf)
+{
+    return buf->buffer == NULL;
+}
+
+static buf* buf_fail(buf* buf)
+{
+    free(buf->buffer);
+    buf->size = 0;
+    buf->buffer = NULL;
+    buf->buffer_size = 0;
+    return NULL;
+}
+
 void buf_delete(buf* buf)
 {
     assert(buf != NULL);
@@ -76,10 +95,17 @@ buf* buf_offs_ncopy(buf* buf, int offs, const char* const str, int n)
     assert(str != NULL);
     assert(offs >= 0);
     assert(n >= 0);
+    if (buf_failed(buf)) {
+        return NULL;
+    }
     while (offs + n > buf->buffer_size) {
         buf->buffer_size *= 2;
     }
-    buf->buffer = realloc(buf->buffer, buf->buffer_size);
+    char* buffer = realloc(buf->buffer, buf->buffer_size);
+    if (buffer == NULL) {
+        return buf_fail(buf);
+    }
+    buf->buffer = buffer;
     strncpy(buf->buffer + offs, str, n);
     buf->size = offs + n;
     return buf;
@@ -100,6 +126,9 @@ buf* buf_nstrcopy(buf* buf, const char* const str, int n)
 buf* buf_add(buf* buf, const char* const str)
 {
     assert(str != NULL);
+    if (buf_failed(buf)) {
+        return NULL;
+    }
     return buf_offs_ncopy(buf, buf_strnlen(buf->buffer, buf->size), str, strlen(str) + 1);
 }
 
@@ -108,11 +137,18 @@ buf* buf_offs_vprintf(buf* buf, int offs, const char* const fmt, va_list vlist)
     va_list ap;
     int rest;
     int printf_output_size;
+    if (buf_failed(buf)) {
+        return NULL;
+    }
     rest = buf->buffer_size - offs;
     va_copy(ap, vlist);
     while ((printf_output_size = vsnprintf(buf->buffer + offs, rest, fmt, ap)) >= rest) {
         buf->buffer_size *= 2;
-        buf->buffer = realloc(buf->buffer, buf->buffer_size);
+        char* buffer = realloc(buf->buffer, buf->buffer_size);
+        if (buffer == NULL) {
+            return buf_fail(buf);
+        }
+        buf->buffer = buffer;
         rest = buf->buffer_size - offs;
         va_copy(ap, vlist);
     }
@@ -134,6 +170,9 @@ buf* buf_printf(buf* b, const char* const fmt, ...)
 {
     buf* result;
     va_list ap;
+    if (buf_failed(b)) {
+        return NULL;
+    }
     va_start(ap, fmt);
     result = buf_offs_vprintf(b, buf_strnlen(b->buffer, b->size), fmt, ap);
     va_end(ap);
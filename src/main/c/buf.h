@@ -34,6 +34,7 @@ typedef struct buf {
 int buf_strnlen(const char* const str, int n);
 buf* buf_init(buf* buf, int size, const char* const initial);
 buf buf_new(int size, const char* const initial);
+int buf_failed(const buf* const buf);
 void buf_delete(buf* buf);
 buf* buf_offs_ncopy(buf* buf, int pos, const char* const str, int n);
 buf* buf_strcopy(buf* buf, const char* const str);
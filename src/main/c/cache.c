@@ -0,0 +1,411 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifdef WINDOWS
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "bool.h"
+#include "buf.h"
+#include "option.h"
+#include "session.h"
+#include "sha256.h"
+#include "cache.h"
+
+#define CACHE_KEY_LENGTH (SHA256_HEX_SIZE - 1)
+#define STALE_TEMPORARY_SECONDS (24 * 60 * 60)
+
+static char tmp_path[MAXPATHLEN];
+
+static void cache_dir(char* path)
+{
+#ifdef WINDOWS
+    sprintf(path, "%s\\.groovy\\groovyserv\\cache", getenv("USERPROFILE"));
+#else
+    sprintf(path, "%s/.groovy/groovyserv/cache", getenv("HOME"));
+#endif
+}
+
+static void cache_path(char* path, const char* name)
+{
+    cache_dir(path);
+#ifdef WINDOWS
+    strcat(path, "\\");
+#else
+    strcat(path, "/");
+#endif
+    strcat(path, name);
+}
+
+static int make_dir(const char* path)
+{
+#ifdef WINDOWS
+    return mkdir(path);
+#else
+    return mkdir(path, 0700);
+#endif
+}
+
+static void make_cache_dir()
+{
+    char path[MAXPATHLEN];
+    char* p;
+
+    cache_dir(path);
+    for (p = path + 1; *p != '\0'; p++) {
+        if (*p == '/' || *p == '\\') {
+            char c = *p;
+            *p = '\0';
+            make_dir(path); // ignore error because it may already exist
+            *p = c;
+        }
+    }
+    make_dir(path);
+}
+
+/*
+ * Read whole data of stdin in advance, because it's a part of the cache key.
+ * stdin of a terminal is regarded as empty not to wait for interactive input.
+ */
+void read_cache_stdin(struct cache_input_t* input)
+{
+    int capacity = BUFFER_SIZE;
+    int ret;
+
+    input->size = 0;
+    input->data = malloc(capacity);
+    if (input->data == NULL) {
+        perror("ERROR: could not allocate memory");
+        exit(1);
+    }
+    if (isatty(fileno(stdin))) {
+        return;
+    }
+    while ((ret = read(fileno(stdin), input->data + input->size, capacity - input->size)) > 0) {
+        input->size += ret;
+        if (input->size == capacity) {
+            capacity *= 2;
+            input->data = realloc(input->data, capacity);
+            if (input->data == NULL) {
+                perror("ERROR: could not allocate memory");
+                exit(1);
+            }
+        }
+    }
+    if (ret == -1) {
+        perror("ERROR: could not read standard input");
+        exit(1);
+    }
+}
+
+static void digest_file(struct sha256_t* ctx, const char* label, const char* path)
+{
+    char read_buf[BUFFER_SIZE];
+    struct stat st;
+    int ret;
+
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        sha256_update(ctx, label, strlen(label));
+        sha256_update(ctx, ": (none) ", 9);
+        sha256_update(ctx, path, strlen(path) + 1);
+        return;
+    }
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: could not open file for cache key: %s\n", path);
+        exit(1);
+    }
+    sprintf(read_buf, "%s: %lld ", label, (long long) st.st_size);
+    sha256_update(ctx, read_buf, strlen(read_buf));
+    sha256_update(ctx, path, strlen(path) + 1);
+    while ((ret = fread(read_buf, 1, sizeof(read_buf), fp)) > 0) {
+        sha256_update(ctx, read_buf, ret);
+    }
+    fclose(fp);
+}
+
+/*
+ * The cache key is a digest of all inputs which can affect the result:
+ * the version, the request header except authtoken (cwd, args, envvars and classpath),
+ * contents of the files specified as arguments like the script file,
+ * contents of files specified by -Ccache-input, and stdin.
+ */
+void make_cache_key(char key[SHA256_HEX_SIZE], int argc, char** argv, struct cache_input_t* input)
+{
+    struct sha256_t ctx;
+    char size_buf[BUFFER_SIZE];
+    int i;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, "GroovyServ: " GROOVYSERV_VERSION "\n", strlen("GroovyServ: " GROOVYSERV_VERSION "\n"));
+
+    struct invocation_t invocation = { argc, argv };
+    invocation.env_all = client_option.env_all;
+    invocation.env_includes = client_option.env_include_mask;
+    invocation.env_excludes = client_option.env_exclude_mask;
+    buf header = buf_new(BUFFER_SIZE, NULL);
+    if (!make_invocation_header(&header, &invocation, NULL)) {
+        fprintf(stderr, "ERROR: could not make cache key\n");
+        exit(1);
+    }
+    sha256_update(&ctx, header.buffer, header.size);
+    buf_delete(&header);
+
+    for (i = 1; i < argc; i++) {
+        struct stat st;
+        if (argv[i] != NULL && stat(argv[i], &st) == 0 && S_ISREG(st.st_mode)) {
+            digest_file(&ctx, "File", argv[i]);
+        }
+    }
+    for (i = 0; i < MAX_MASK && client_option.cache_inputs[i] != NULL; i++) {
+        digest_file(&ctx, "Input", client_option.cache_inputs[i]);
+    }
+
+    sprintf(size_buf, "Stdin: %d\n", input->size);
+    sha256_update(&ctx, size_buf, strlen(size_buf));
+    sha256_update(&ctx, input->data, input->size);
+
+    sha256_final_hex(&ctx, key);
+#ifdef DEBUG
+    fprintf(stderr, "DEBUG: cache key: %s\n", key);
+#endif
+}
+
+/*
+ * Copy a chunk of the entry to the output.
+ * return FALSE if it fails to read or write, and then ferror() or feof() of fp
+ * tells whether the entry is broken.
+ */
+static BOOL copy_chunk(FILE* fp, int output_fd, int size)
+{
+    char read_buf[BUFFER_SIZE];
+    int ret, written, n;
+    while (size > 0) {
+        ret = fread(read_buf, 1, size < BUFFER_SIZE ? size : BUFFER_SIZE, fp);
+        if (ret <= 0) {
+            return FALSE;
+        }
+        for (written = 0; written < ret; written += n) {
+            n = write(output_fd, read_buf + written, ret - written);
+            if (n < 0 && errno == EINTR) {
+                n = 0;
+            } else if (n <= 0) {
+                return FALSE;
+            }
+        }
+        size -= ret;
+    }
+    return TRUE;
+}
+
+/*
+ * Replay chunks of stdout/stderr and the exit status which are recorded
+ * in a cache entry. Return FALSE when the entry doesn't exist.
+ */
+BOOL replay_cache_entry(const char* key, int* status)
+{
+    char path[MAXPATHLEN];
+    char line[BUFFER_SIZE];
+    int output_fd = -1;
+    int size = -1;
+
+    cache_path(path, key);
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return FALSE;
+    }
+#ifdef DEBUG
+    fprintf(stderr, "DEBUG: cache hit: %s\n", path);
+#endif
+    utime(path, NULL); // as recently used for eviction
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strcmp(line, "\n") == 0) { // end of header
+            if (output_fd == -1 || size < 0) {
+                break;
+            }
+            if (!copy_chunk(fp, output_fd, size)) {
+                if (ferror(fp) || feof(fp)) {
+                    break;
+                }
+                // the entry is kept because it's the output which cannot be written
+                fprintf(stderr, "ERROR: could not write output replayed from cache entry: %s\n", path);
+                fclose(fp);
+                *status = 1;
+                return TRUE;
+            }
+            output_fd = -1;
+            size = -1;
+        }
+        else if (strncmp(line, "Channel: out", 12) == 0) {
+            output_fd = fileno(stdout);
+        }
+        else if (strncmp(line, "Channel: err", 12) == 0) {
+            output_fd = fileno(stderr);
+        }
+        else if (strncmp(line, "Size: ", 6) == 0) {
+            size = atoi(line + 6);
+        }
+        else if (strncmp(line, "Status: ", 8) == 0) {
+            *status = atoi(line + 8);
+            fclose(fp);
+            return TRUE;
+        }
+    }
+
+    // a broken entry cannot be recovered because output might be already written.
+    fprintf(stderr, "ERROR: broken cache entry: %s\n", path);
+    fclose(fp);
+    remove(path);
+    *status = 1;
+    return TRUE;
+}
+
+/*
+ * Open a temporary file to record a session for the cache entry.
+ * It becomes visible to other clients only when it's committed.
+ */
+FILE* open_cache_entry(const char* key)
+{
+    char name[MAXPATHLEN];
+
+    make_cache_dir();
+    sprintf(name, "%s.tmp.%d", key, (int) getpid());
+    cache_path(tmp_path, name);
+    FILE* fp = fopen(tmp_path, "wb");
+    if (fp == NULL && !client_option.quiet) {
+        fprintf(stderr, "WARN: could not create cache entry: %s\n", tmp_path);
+    }
+    return fp;
+}
+
+struct cache_file_t {
+    char name[MAXPATHLEN];
+    long long size;
+    time_t mtime;
+};
+
+static int compare_by_mtime(const void* a, const void* b)
+{
+    time_t ta = ((const struct cache_file_t*) a)->mtime;
+    time_t tb = ((const struct cache_file_t*) b)->mtime;
+    return (ta < tb) ? -1 : (ta > tb) ? 1 : 0;
+}
+
+/*
+ * Remove least recently used entries until total size fits in max size.
+ */
+static void evict_cache_entries(long long max_size)
+{
+    char dir_path[MAXPATHLEN];
+    char path[MAXPATHLEN];
+    struct cache_file_t* files = NULL;
+    int count = 0, capacity = 0, i;
+    long long total_size = 0;
+    time_t now = time(NULL);
+    struct dirent* ent;
+    struct stat st;
+
+    cache_dir(dir_path);
+    DIR* dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        cache_path(path, ent->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (strlen(ent->d_name) != CACHE_KEY_LENGTH) { // temporary file
+            if (now - st.st_mtime > STALE_TEMPORARY_SECONDS) {
+                remove(path); // left by a killed client
+            }
+            continue;
+        }
+        if (count == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            files = realloc(files, sizeof(struct cache_file_t) * capacity);
+            if (files == NULL) {
+                perror("ERROR: could not allocate memory");
+                exit(1);
+            }
+        }
+        strcpy(files[count].name, ent->d_name);
+        files[count].size = st.st_size;
+        files[count].mtime = st.st_mtime;
+        total_size += st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    if (total_size > max_size) {
+        qsort(files, count, sizeof(struct cache_file_t), compare_by_mtime);
+        for (i = 0; i < count && total_size > max_size; i++) {
+            cache_path(path, files[i].name);
+            if (remove(path) == 0) {
+#ifdef DEBUG
+                fprintf(stderr, "DEBUG: cache entry evicted: %s\n", path);
+#endif
+                total_size -= files[i].size;
+            }
+        }
+    }
+    free(files);
+}
+
+/*
+ * Make the recorded entry visible by renaming it atomically.
+ * When keep is FALSE, the recorded entry is just discarded.
+ */
+void commit_cache_entry(FILE* fp, const char* key, BOOL keep)
+{
+    char path[MAXPATHLEN];
+
+    if (fp == NULL) {
+        return;
+    }
+    if (fclose(fp) != 0) {
+        keep = FALSE;
+    }
+    if (!keep) {
+        remove(tmp_path);
+        return;
+    }
+    cache_path(path, key);
+    if (rename(tmp_path, path) != 0) {
+        // another client may have committed the same entry at the same time.
+        remove(tmp_path);
+    }
+    evict_cache_entries(client_option.cache_max_size);
+}
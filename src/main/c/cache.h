@@ -0,0 +1,38 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdio.h>
+
+#include "bool.h"
+#include "sha256.h"
+
+#define DEFAULT_CACHE_MAX_SIZE (64LL * 1024 * 1024)
+
+struct cache_input_t {
+    char* data;
+    int size;
+};
+
+void read_cache_stdin(struct cache_input_t* input);
+void make_cache_key(char key[SHA256_HEX_SIZE], int argc, char** argv, struct cache_input_t* input);
+BOOL replay_cache_entry(const char* key, int* status);
+FILE* open_cache_entry(const char* key);
+void commit_cache_entry(FILE* fp, const char* key, BOOL keep);
+
+#endif
@@ -23,8 +23,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include <sys/param.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
 
@@ -39,6 +41,12 @@
 
 #include "option.h"
 #include "session.h"
+#include "cache.h"
+#include "batch.h"
+#include "trace.h"
+#include "watch.h"
+#include "record.h"
+#include "libgroovyclient.h"
 
 static void scriptdir(char* result_dir, char* script_path)
 {
@@ -142,14 +150,13 @@ void start_server(char* script_path, int port, char* authtoken)
     invoke_server(script_path, port, "", authtoken);
 }
 
-void kill_server(char* script_path, int port)
+static void authtoken_path(char* path, int port)
 {
-    invoke_server(script_path, port, "-k", NULL);
-}
-
-void restart_server(char* script_path, int port, char* authtoken)
-{
-    invoke_server(script_path, port, "-r", authtoken);
+#ifdef WINDOWS
+    sprintf(path, "%s\\.groovy\\groovyserv\\authtoken-%d", getenv("USERPROFILE"), port);
+#else
+    sprintf(path, "%s/.groovy/groovyserv/authtoken-%d", getenv("HOME"), port);
+#endif
 }
 
 /*
@@ -158,11 +165,7 @@ void restart_server(char* script_path, int port, char* authtoken)
 static void read_authtoken(char* authtoken, int size, int port)
 {
     char path[MAXPATHLEN];
-#ifdef WINDOWS
-    sprintf(path, "%s\\.groovy\\groovyserv\\authtoken-%d", getenv("USERPROFILE"), port);
-#else
-    sprintf(path, "%s/.groovy/groovyserv/authtoken-%d", getenv("HOME"), port);
-#endif
+    authtoken_path(path, port);
     FILE* fp = fopen(path, "r");
     if (fp != NULL) {
         if (fgets(authtoken, size, fp) == NULL) {
@@ -230,7 +233,7 @@ static int connect_server(char* script_path, char* host, int port, char* authtok
 {
     int fd;
     int failCount = 0;
-    while ((fd = open_socket(host, port)) == -1) {
+    while ((fd = open_socket(host, port)) == OPEN_SOCKET_REFUSED) {
         if (failCount >= 1) {
             fprintf(stderr, "ERROR: could not start server: %s\n", script_path);
             exit(1);
@@ -239,9 +242,321 @@ static int connect_server(char* script_path, char* host, int port, char* authtok
         start_server(script_path, port, authtoken);
         failCount++;
     }
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not connect to server: %s:%d\n", host, port);
+        exit(1);
+    }
     return fd;
 }
 
+#define MAX_POOL_SERVERS 16
+
+static char* get_server_authtoken(char* authtoken, int port)
+{
+    if (authtoken != NULL) {
+        return authtoken;
+    }
+    return strdup(get_authtoken_generated_by_server(port));
+}
+
+/*
+ * parse a pool of servers in the form of "host:port,host:port,...".
+ * a port can be omitted.
+ */
+static int parse_pool(char* pool, struct server_t* servers, char* authtoken)
+{
+    int count = 0;
+    char* token;
+    for (token = strtok(strdup(pool), ","); token != NULL; token = strtok(NULL, ",")) {
+        if (count == MAX_POOL_SERVERS) {
+            fprintf(stderr, "ERROR: too many servers in pool: %s\n", pool);
+            exit(1);
+        }
+        int port = SERVER_PORT;
+        char* colon = strrchr(token, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            if (sscanf(colon + 1, "%d", &port) != 1) {
+                fprintf(stderr, "ERROR: could not parse port number in pool: %s\n", pool);
+                exit(1);
+            }
+        }
+        servers[count].host = token;
+        servers[count].port = port;
+        servers[count].authtoken = get_server_authtoken(authtoken, port);
+        count++;
+    }
+    if (count == 0) {
+        fprintf(stderr, "ERROR: no server in pool: %s\n", pool);
+        exit(1);
+    }
+    return count;
+}
+
+static int find_fanout_separator(int argc, char** argv)
+{
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (argv[i] != NULL && strcmp(argv[i], FANOUT_SEPARATOR) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * invoke many scripts in batch or fan-out mode, sharing the setup of servers.
+ */
+static int invoke_jobs(char* script_path, int argc, char** argv, int separator, char* host, int port, char* authtoken)
+{
+    struct server_t servers[MAX_POOL_SERVERS];
+    int server_count;
+    int first_fd = -1;
+    int i;
+
+    if (client_option.pool != NULL) {
+        server_count = parse_pool(client_option.pool, servers, authtoken);
+    } else {
+        first_fd = connect_server(script_path, host, port, authtoken);
+        servers[0].host = host;
+        servers[0].port = port;
+        servers[0].authtoken = get_server_authtoken(authtoken, port);
+        server_count = 1;
+    }
+    int jobs = (client_option.jobs != JOBS_NOT_SPECIFIED) ? client_option.jobs : default_concurrency();
+
+    if (client_option.batch != NULL) {
+        return run_batch(client_option.batch, servers, server_count, jobs, first_fd);
+    }
+
+    // arguments before the separator are common to all jobs
+    char* args[argc];
+    char* inputs[argc];
+    int arg_count = 0, input_count = 0;
+    for (i = 1; i < argc; i++) {
+        if (argv[i] == NULL || i == separator) {
+            continue;
+        }
+        if (i < separator) {
+            args[arg_count++] = argv[i];
+        } else {
+            inputs[input_count++] = argv[i];
+        }
+    }
+    return run_fanout(args, arg_count, inputs, input_count, servers, server_count, jobs, first_fd);
+}
+
+static void write_command_output(struct session_t* session, const char* channel, const char* data, int size);
+
+// results of request_server_command() other than an exit status
+#define COMMAND_NOT_RUNNING -1
+#define COMMAND_SEND_FAILED -2
+#define COMMAND_BROKEN -3
+
+/*
+ * send a built-in command to the running server and receive its output by the handler.
+ * arg is passed to the command as the first argument unless it's NULL.
+ * return the exit status of the command, or COMMAND_* for errors.
+ */
+static int request_server_command(char* host, int port, char* authtoken, char* command, char* arg, chunk_handler_t handler)
+{
+    int fd = open_socket(host, port);
+    if (fd < 0) {
+        return (fd == OPEN_SOCKET_REFUSED) ? COMMAND_NOT_RUNNING : COMMAND_SEND_FAILED;
+    }
+    if (authtoken == NULL) {
+        authtoken = get_authtoken_generated_by_server(port);
+    }
+    char* argv[] = { "groovyclient", arg, NULL };
+    struct invocation_t invocation = { (arg != NULL) ? 2 : 1, argv, NULL, NULL, NULL, command, FALSE, NULL, 0, NULL, NULL };
+    if (!send_invocation_header(fd, &invocation, authtoken)) {
+        close(fd);
+        return COMMAND_SEND_FAILED;
+    }
+
+    struct session_t session;
+    int ret;
+    session_init(&session, fd, NULL);
+    while ((ret = session_receive(&session, handler)) == SESSION_RUNNING) {
+        ;
+    }
+    session_delete(&session);
+    close(fd);
+    return (ret == SESSION_BROKEN) ? COMMAND_BROKEN : session.status;
+}
+
+/*
+ * run a built-in command like "stats" on the running server without starting it,
+ * and print its output.
+ */
+static int run_server_command(char* host, int port, char* authtoken, char* command, char* arg)
+{
+    int status = request_server_command(host, port, authtoken, command, arg, write_command_output);
+    switch (status) {
+    case COMMAND_NOT_RUNNING:
+    case COMMAND_SEND_FAILED:
+        fprintf(stderr, "ERROR: could not connect to server: %s:%d\n", host, port);
+        return 1;
+    case COMMAND_BROKEN:
+        fprintf(stderr, "ERROR: %s\n", groovyclient_strerror(GROOVYCLIENT_ERROR_PROTOCOL));
+        return 1;
+    }
+    return status;
+}
+
+static void discard_command_output(struct session_t* session, const char* channel, const char* data, int size)
+{
+}
+
+static void sleep_millis(int millis)
+{
+#ifdef WINDOWS
+    Sleep(millis);
+#else
+    usleep(millis * 1000);
+#endif
+}
+
+#define SERVER_WAIT_TIMEOUT 30000 // msec
+#define SERVER_WAIT_MAX_INTERVAL 200 // msec
+
+static BOOL authtoken_exists(int port)
+{
+    char path[MAXPATHLEN];
+    authtoken_path(path, port);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return FALSE;
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+static BOOL is_server_down(char* host, int port)
+{
+    int fd = open_socket(host, port);
+    if (fd >= 0) {
+        close(fd);
+        return FALSE;
+    }
+    return fd == OPEN_SOCKET_REFUSED;
+}
+
+static BOOL is_server_up(char* host, int port, char* authtoken)
+{
+    // the server writes the authtoken file when it's ready
+    if (authtoken == NULL && !authtoken_exists(port)) {
+        return FALSE;
+    }
+    return request_server_command(host, port, authtoken, "ping", NULL, discard_command_output) == 0;
+}
+
+/*
+ * wait until the port is released, or the server is up and answers to ping.
+ * the interval of checks starts from 1 msec and is doubled up to SERVER_WAIT_MAX_INTERVAL.
+ * return TRUE if it has been so within SERVER_WAIT_TIMEOUT.
+ */
+static BOOL wait_for_server(char* host, int port, char* authtoken, BOOL up)
+{
+    int interval = 1;
+    int waited = 0;
+    while (waited < SERVER_WAIT_TIMEOUT) {
+        if (up ? is_server_up(host, port, authtoken) : is_server_down(host, port)) {
+            return TRUE;
+        }
+        sleep_millis(interval);
+        waited += interval;
+        interval = (interval * 2 < SERVER_WAIT_MAX_INTERVAL) ? interval * 2 : SERVER_WAIT_MAX_INTERVAL;
+    }
+    return FALSE;
+}
+
+/*
+ * shut down the running server by the protocol, without running groovyserver command.
+ */
+static int kill_server(char* host, int port, char* authtoken)
+{
+    int status = request_server_command(host, port, authtoken, "shutdown", NULL, discard_command_output);
+    if (status == COMMAND_NOT_RUNNING) {
+        if (!client_option.quiet) {
+            fprintf(stderr, "WARN: server is not running\n");
+        }
+        char path[MAXPATHLEN];
+        authtoken_path(path, port);
+        if (remove(path) == 0 && !client_option.quiet) {
+            fprintf(stderr, "WARN: old authtoken file is deleted: %s\n", path);
+        }
+        return 0;
+    }
+    if (status == ERROR_INVALID_AUTHTOKEN) {
+        fprintf(stderr, "ERROR: invalid authtoken\n");
+        fprintf(stderr, "Hint:  Specify a right authtoken or kill the process somehow.\n");
+        return 1;
+    }
+    if (status < 0) {
+        fprintf(stderr, "ERROR: could not kill server: %s:%d\n", host, port);
+        fprintf(stderr, "Hint:  Make sure the server process is still alive. If so, kill the process somehow.\n");
+        return 1;
+    }
+    if (!wait_for_server(host, port, NULL, FALSE)) {
+        fprintf(stderr, "ERROR: server is still running after shutdown: %s:%d\n", host, port);
+        return 1;
+    }
+    if (!client_option.quiet) {
+        fprintf(stderr, "Server is successfully shut down\n");
+    }
+    return 0;
+}
+
+static int restart_server(char* script_path, char* host, int port, char* authtoken)
+{
+    int status = kill_server(host, port, authtoken);
+    if (status != 0) {
+        return status;
+    }
+    start_server(script_path, port, authtoken);
+    if (!wait_for_server(host, port, authtoken, TRUE)) {
+        fprintf(stderr, "ERROR: could not start server: %s\n", script_path);
+        return 1;
+    }
+    return 0;
+}
+
+#define SERVER_STATUS_NOT_RUNNING 3 // the same as LSB init scripts
+
+/*
+ * show whether the server is running, by ping with the authtoken.
+ */
+static int show_server_status(char* host, int port, char* authtoken)
+{
+    if (authtoken == NULL && !authtoken_exists(port)) {
+        // without an authtoken file, the server cannot be accessed
+        if (is_server_down(host, port)) {
+            printf("stopped: %s:%d\n", host, port);
+            return SERVER_STATUS_NOT_RUNNING;
+        }
+        printf("unknown: no authtoken file for the port: %s:%d\n", host, port);
+        return 1;
+    }
+    int status = request_server_command(host, port, authtoken, "ping", NULL, discard_command_output);
+    switch (status) {
+    case 0:
+        printf("running: %s:%d\n", host, port);
+        return 0;
+    case COMMAND_NOT_RUNNING:
+        printf("stopped: %s:%d\n", host, port);
+        return SERVER_STATUS_NOT_RUNNING;
+    case ERROR_INVALID_AUTHTOKEN:
+        printf("unknown: invalid authtoken: %s:%d\n", host, port);
+        return 1;
+    case ERROR_CLIENT_NOT_ALLOWED:
+        printf("unknown: client address not allowed: %s:%d\n", host, port);
+        return 1;
+    }
+    printf("unknown: the server doesn't answer: %s:%d\n", host, port);
+    return 1;
+}
+
 static int fd_soc;
 
 static void signal_handler(int sig) {
@@ -255,6 +570,332 @@ static void signal_handler(int sig) {
     exit(1);
 }
 
+static void write_fully(int fd, const char* data, int size)
+{
+    while (size > 0) {
+        int ret = write(fd, data, size);
+        if (ret <= 0) {
+            return; // output is closed
+        }
+        data += ret;
+        size -= ret;
+    }
+}
+
+/*
+ * Write output of the session to stdout or stderr.
+ * When a file to record the session is given, it's also written to the file
+ * in the same framing as the server sends.
+ */
+static void write_output(groovyclient_session* session, const char* channel, const char* data, int size, void* record_fp)
+{
+    trace_mark(TRACE_FIRST_BYTE);
+    write_fully((strcmp(channel, "err") == 0) ? fileno(stderr) : fileno(stdout), data, size);
+    if (record_fp != NULL) {
+        fprintf((FILE*) record_fp, "Channel: %s\nSize: %d\n\n", channel, size);
+        fwrite(data, 1, size, (FILE*) record_fp);
+    }
+}
+
+static void write_command_output(struct session_t* session, const char* channel, const char* data, int size)
+{
+    write_fully((strcmp(channel, "err") == 0) ? fileno(stderr) : fileno(stdout), data, size);
+}
+
+static void record_status(groovyclient_session* session, int status, void* record_fp)
+{
+    trace_mark(TRACE_FIRST_BYTE);
+    trace_mark(TRACE_EXITED);
+    if (record_fp != NULL && status >= 0) {
+        fprintf((FILE*) record_fp, "Status: %d\n\n", status);
+    }
+}
+
+static void keep_server_trace(groovyclient_session* session, const char* entry, void* record_fp)
+{
+    trace_server_entry(entry);
+}
+
+static void ignore_eval_status(groovyclient_session* session, int status, void* record_fp)
+{
+}
+
+static struct record_t* recording; // the file of -Crecord
+
+static void record_response(groovyclient_session* session, const char* data, int size, void* record_fp)
+{
+    record_block(recording, data, size);
+}
+
+/*
+ * Copy data from stdin and send it to the server.
+ * return TRUE when stdin is closed.
+ */
+static BOOL send_to_server(groovyclient_session* session)
+{
+    char read_buf[BUFFER_SIZE];
+    int credit = groovyclient_session_stdin_credit(session);
+    int ret;
+
+    if ((ret = read(fileno(stdin), read_buf, (credit < BUFFER_SIZE) ? credit : BUFFER_SIZE)) == -1) { // TODO buffering
+        perror("ERROR: could not read standard input");
+        exit(1);
+    }
+#ifdef DEBUG
+    fprintf(stderr, "DEBUG: read from stdin: %.*s (size:%d)\n", ret, read_buf, ret);
+#endif
+    if (ret == 0) {
+        groovyclient_session_close_stdin(session);
+        return TRUE;
+    }
+    groovyclient_session_write_stdin(session, read_buf, ret);
+    return FALSE;
+}
+
+/*
+ * Code snippets of a shell session being read, which are sent one per line.
+ * A line ending with a backslash continues to the next line.
+ */
+static struct {
+    int fd;
+    char* data;
+    int size;
+    int scanned;
+    int capacity;
+} shell_input;
+
+static BOOL is_blank(const char* data, int size)
+{
+    int i;
+    for (i = 0; i < size; i++) {
+        if (!isspace((unsigned char) data[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void send_snippet(groovyclient_session* session, int size)
+{
+    if (!is_blank(shell_input.data, size)) {
+        groovyclient_session_eval(session, shell_input.data, size);
+    }
+    memmove(shell_input.data, shell_input.data + size, shell_input.size - size);
+    shell_input.size -= size;
+    shell_input.scanned = 0;
+}
+
+/*
+ * Read code snippets from the input of the shell and send them to the server.
+ * return TRUE when the input is closed.
+ */
+static BOOL send_snippets_to_server(groovyclient_session* session)
+{
+    if (shell_input.capacity - shell_input.size < BUFFER_SIZE) {
+        shell_input.capacity = (shell_input.capacity == 0) ? BUFFER_SIZE * 8 : shell_input.capacity * 2;
+        shell_input.data = realloc(shell_input.data, shell_input.capacity);
+        if (shell_input.data == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory\n");
+            exit(1);
+        }
+    }
+    int ret = read(shell_input.fd, shell_input.data + shell_input.size, shell_input.capacity - shell_input.size);
+    if (ret == -1) {
+        perror("ERROR: could not read code snippets");
+        exit(1);
+    }
+    if (ret == 0) {
+        send_snippet(session, shell_input.size); // the last line without LF
+        groovyclient_session_close_stdin(session);
+        free(shell_input.data);
+        return TRUE;
+    }
+    shell_input.size += ret;
+
+    char* eol;
+    while ((eol = memchr(shell_input.data + shell_input.scanned, '\n', shell_input.size - shell_input.scanned)) != NULL) {
+        int end = eol - shell_input.data;
+        if (end > 0 && shell_input.data[end - 1] == '\\') {
+            // remove the backslash and keep LF in the snippet
+            memmove(shell_input.data + end - 1, shell_input.data + end, shell_input.size - end);
+            shell_input.size--;
+            shell_input.scanned = end;
+            continue;
+        }
+        send_snippet(session, end + 1);
+    }
+    shell_input.scanned = shell_input.size;
+    return FALSE;
+}
+
+#ifdef WINDOWS
+static void copy_stdin_to_socket(groovyclient_session* session)
+{
+    while (!send_to_server(session)) {
+        ;
+    }
+}
+
+static void copy_snippets_to_socket(groovyclient_session* session)
+{
+    while (!send_snippets_to_server(session)) {
+        ;
+    }
+}
+
+static void invoke_thread(groovyclient_session* session)
+{
+    DWORD id = 1;
+    LPTHREAD_START_ROUTINE routine = client_option.shell
+        ? (LPTHREAD_START_ROUTINE) copy_snippets_to_socket
+        : (LPTHREAD_START_ROUTINE) copy_stdin_to_socket;
+    CreateThread(NULL, 0, routine, (LPVOID) session, 0, &id);
+}
+#endif
+
+/*
+ * asynchronus input (select) with the stdin and the socket connection
+ * to the server. copy input data from stdin to server, and
+ * copy received data from the server to stdout/stderr.
+ * when watch_stdin is FALSE, stdin is expected to be already sent.
+ * in a shell session, code snippets are read from the input of the shell instead.
+ */
+static int run_session(groovyclient_session* session, BOOL watch_stdin)
+{
+#ifdef WINDOWS
+    if (watch_stdin) {
+        invoke_thread(session);
+    }
+    return groovyclient_session_wait(session);
+#else
+    int fd = groovyclient_session_fd(session);
+    int in_fd = client_option.shell ? shell_input.fd : STDIN_FILENO;
+    BOOL stdin_closed = !watch_stdin;
+    int ret = GROOVYCLIENT_RUNNING;
+
+    while (ret == GROOVYCLIENT_RUNNING) {
+        fd_set read_set;
+
+        // watch stdin of client and socket.
+        FD_ZERO(&read_set);
+        // with flow control, stdin is read only while the server can accept it
+        if (!stdin_closed && (client_option.shell || groovyclient_session_stdin_credit(session) > 0)) {
+            FD_SET(in_fd, &read_set);
+        }
+        FD_SET(fd, &read_set);
+
+        if (select(((fd > in_fd) ? fd : in_fd) + 1, &read_set, (fd_set*)NULL, (fd_set*)NULL, NULL) == -1) {
+            perror("ERROR: could not select I/O");
+            exit(1);
+        }
+        if (!stdin_closed && FD_ISSET(in_fd, &read_set)) {
+            stdin_closed = client_option.shell ? send_snippets_to_server(session) : send_to_server(session);
+            continue;
+        }
+        if (FD_ISSET(fd, &read_set)) {
+            ret = groovyclient_session_process(session);
+        }
+    }
+    return (ret == GROOVYCLIENT_FINISHED) ? groovyclient_session_status(session) : ret;
+#endif
+}
+
+/*
+ * the script file of the invocation, which is the first arg except classpath options,
+ * or NULL if the first one isn't a script file.
+ */
+static char* find_script(int argc, char** argv)
+{
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (argv[i] == NULL) {
+            continue; // a client option
+        }
+        if (strcmp(argv[i], "-cp") == 0 || strcmp(argv[i], "-classpath") == 0 || strcmp(argv[i], "--classpath") == 0) {
+            i++;
+            continue;
+        }
+        return (argv[i][0] == '-') ? NULL : argv[i];
+    }
+    return NULL;
+}
+
+/*
+ * Watch the script, sources in its directory which groovyserver recompiles
+ * when they are changed, and inputs specified by options.
+ */
+static struct watch_t* start_watch(char* script)
+{
+    struct watch_t* watch = watch_new();
+    if (watch == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory\n");
+        exit(1);
+    }
+    char dir[strlen(script) + 1];
+    scriptdir(dir, script);
+    if (!watch_add_file(watch, script) || !watch_add_dir(watch, (*dir != '\0') ? dir : ".", WATCH_SOURCES)) {
+        fprintf(stderr, "ERROR: could not watch %s\n", script);
+        exit(1);
+    }
+    char** p;
+    for (p = client_option.watch_inputs; p - client_option.watch_inputs < MAX_MASK && *p != NULL; p++) {
+        struct stat st;
+        BOOL added = (stat(*p, &st) == 0 && S_ISDIR(st.st_mode))
+            ? watch_add_dir(watch, *p, WATCH_ANY)
+            : watch_add_file(watch, *p);
+        if (!added) {
+            fprintf(stderr, "ERROR: could not watch %s\n", *p);
+            exit(1);
+        }
+    }
+    return watch;
+}
+
+/*
+ * process a watch session until it's interrupted or closed, and let the server
+ * run the script again when watched files are changed. stdin isn't read.
+ */
+static int run_watch_session(groovyclient_session* session, struct watch_t* watch)
+{
+#ifdef WINDOWS
+    return groovyclient_session_wait(session); // not reached because -Cwatch isn't supported
+#else
+    int fd = groovyclient_session_fd(session);
+    int notify_fd = watch_fd(watch);
+    int ret = GROOVYCLIENT_RUNNING;
+
+    while (ret == GROOVYCLIENT_RUNNING) {
+        fd_set read_set;
+        struct timeval timeout;
+        int millis = watch_timeout(watch);
+
+        FD_ZERO(&read_set);
+        FD_SET(fd, &read_set);
+        if (notify_fd >= 0) {
+            FD_SET(notify_fd, &read_set);
+        }
+        timeout.tv_sec = millis / 1000;
+        timeout.tv_usec = (millis % 1000) * 1000;
+
+        int n = select(((fd > notify_fd) ? fd : notify_fd) + 1, &read_set, (fd_set*)NULL, (fd_set*)NULL, (millis >= 0) ? &timeout : NULL);
+        if (n == -1) {
+            perror("ERROR: could not select I/O");
+            exit(1);
+        }
+        if ((notify_fd >= 0) ? FD_ISSET(notify_fd, &read_set) : (n == 0)) {
+            watch_check(watch);
+        }
+        if (watch_settled(watch) && (ret = groovyclient_session_rerun(session)) != GROOVYCLIENT_OK) {
+            break;
+        }
+        if (FD_ISSET(fd, &read_set)) {
+            ret = groovyclient_session_process(session);
+        }
+    }
+    return (ret == GROOVYCLIENT_FINISHED) ? groovyclient_session_status(session) : ret;
+#endif
+}
+
 /*
  * open socket and initiate session.
  */
@@ -274,7 +915,13 @@ int main(int argc, char** argv)
     }
 #endif
 
-    scan_options(&client_option, argc, argv);
+    switch (scan_options(&client_option, argc, argv)) {
+    case OPTION_DONE:
+        exit(0);
+    case OPTION_ERROR:
+        exit(1);
+    }
+    trace_mark(TRACE_STARTED);
 
     char* host = get_host();
     int port = get_port();
@@ -286,15 +933,70 @@ int main(int argc, char** argv)
 
     // control server
     if (client_option.kill) {
-        kill_server(argv[0], port);
-        exit(0);
+        exit(kill_server(host, port, authtoken));
     }
     else if (client_option.restart) {
-        restart_server(argv[0], port, authtoken);
+        int status = restart_server(argv[0], host, port, authtoken);
+        if (status != 0) {
+            exit(status);
+        }
+    }
+    if (client_option.status) {
+        exit(show_server_status(host, port, authtoken));
+    }
+
+    if (client_option.stats) {
+        exit(run_server_command(host, port, authtoken, "stats", NULL));
+    }
+    if (client_option.invalidate_grapes) {
+        exit(run_server_command(host, port, authtoken, "invalidate-grapes", NULL));
+    }
+    if (client_option.job_status != NULL) {
+        exit(run_server_command(host, port, authtoken, "job-status", client_option.job_status));
+    }
+    if (client_option.job_log != NULL) {
+        exit(run_server_command(host, port, authtoken, "job-log", client_option.job_log));
+    }
+    if (client_option.job_wait != NULL) {
+        exit(run_server_command(host, port, authtoken, "job-wait", client_option.job_wait));
+    }
+
+    if (client_option.mode == MODE_BATCH || client_option.mode == MODE_FANOUT) {
+        int separator = find_fanout_separator(argc, argv);
+        exit(invoke_jobs(argv[0], argc, argv, separator, host, port, authtoken));
+    }
+
+    // a cached result of the same invocation is replayed without connecting to server
+    struct cache_input_t cache_input;
+    char cache_key[SHA256_HEX_SIZE];
+    if (client_option.cache) {
+        read_cache_stdin(&cache_input);
+        make_cache_key(cache_key, argc, argv, &cache_input);
+        int cached_status;
+        if (replay_cache_entry(cache_key, &cached_status)) {
+            exit(cached_status);
+        }
+    }
+
+    // files are watched from before the first run not to miss a change during it
+    struct watch_t* watch = NULL;
+    if (client_option.watch) {
+#ifdef WINDOWS
+        fprintf(stderr, "ERROR: -Cwatch isn't supported on Windows\n"); // stdin is sent by another thread
+        exit(1);
+#endif
+        char* script = find_script(argc, argv);
+        if (script == NULL) {
+            fprintf(stderr, "ERROR: -Cwatch requires a script file as the first argument\n");
+            exit(1);
+        }
+        watch = start_watch(script);
     }
 
     // connect to server
+    trace_mark(TRACE_CONNECTING);
     fd_soc = connect_server(argv[0], host, port, authtoken);
+    trace_mark(TRACE_CONNECTED);
     signal(SIGINT, signal_handler); // using fd_soc in handler
 
     // ~/.groovy/groovserv/authtoken-NNNN file data can use only for connection to server.
@@ -305,8 +1007,110 @@ int main(int argc, char** argv)
     }
 
     // invoke a script on server
-    send_header(fd_soc, argc, argv, authtoken);
-    int status = start_session(fd_soc);
+    groovyclient_session* session = groovyclient_session_new(host, port, authtoken);
+    if (session == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory\n");
+        exit(1);
+    }
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (argv[i] != NULL) {
+            groovyclient_session_add_arg(session, argv[i]);
+        }
+    }
+    if (client_option.env_all) {
+        groovyclient_session_include_env(session, NULL);
+    }
+    char** mask;
+    for (mask = client_option.env_include_mask; *mask != NULL; mask++) {
+        groovyclient_session_include_env(session, *mask);
+    }
+    for (mask = client_option.env_exclude_mask; *mask != NULL; mask++) {
+        groovyclient_session_exclude_env(session, *mask);
+    }
+    groovyclient_session_attach(session, fd_soc);
+    if (client_option.shell) {
+        shell_input.fd = (client_option.shell_fd != SHELL_FD_NOT_SPECIFIED) ? client_option.shell_fd : fileno(stdin);
+        groovyclient_session_set_shell(session, ignore_eval_status); // the error is printed by server
+    }
+    if (client_option.trace) {
+        groovyclient_session_set_trace(session, keep_server_trace);
+    }
+    if (client_option.shm && groovyclient_session_set_shm(session, 0) != GROOVYCLIENT_OK && !client_option.quiet) {
+        fprintf(stderr, "WARN: could not create shared memory, output is received via socket\n");
+    }
+    if (client_option.window != WINDOW_NOT_SPECIFIED) {
+#ifdef WINDOWS
+        fprintf(stderr, "ERROR: -Cwindow isn't supported on Windows\n"); // stdin is sent by another thread
+        exit(1);
+#endif
+        groovyclient_session_set_window(session, client_option.window);
+    }
+    if (client_option.priority != NULL) {
+        groovyclient_session_set_priority(session, client_option.priority);
+    }
+    if (client_option.detach) {
+        groovyclient_session_set_detach(session);
+    }
+    if (client_option.compress) {
+        groovyclient_session_set_compress(session);
+    }
+    if (client_option.watch) {
+        groovyclient_session_set_watch(session, ignore_eval_status); // the error is printed by server
+    }
+
+    // the session is recorded as a cache entry only when it succeeds
+    FILE* cache_fp = client_option.cache ? open_cache_entry(cache_key) : NULL;
+    groovyclient_session_set_callbacks(session, write_output, record_status, cache_fp);
+
+    // the delay of the first block is measured from just before the request is sent
+    if (client_option.record != NULL) {
+        if ((recording = record_create(client_option.record)) == NULL) {
+            fprintf(stderr, "ERROR: could not create record file: %s\n", client_option.record);
+            exit(1);
+        }
+        groovyclient_session_set_capture(session, record_response);
+    }
+
+    int status = groovyclient_session_start(session);
+    trace_mark(TRACE_REQUEST_SENT);
+    if (status == GROOVYCLIENT_OK && client_option.cache) {
+        // an error fails the session, which isn't recorded as a cache entry then
+        status = groovyclient_session_write_stdin(session, cache_input.data, cache_input.size);
+        if (status == GROOVYCLIENT_OK) {
+            status = groovyclient_session_close_stdin(session);
+        }
+        free(cache_input.data);
+    }
+    if (status == GROOVYCLIENT_OK) {
+        status = client_option.watch
+            ? run_watch_session(session, watch)
+            : run_session(session, !client_option.cache && !client_option.detach);
+    }
+    watch_delete(watch);
+    if (recording != NULL && !record_close(recording)) {
+        fprintf(stderr, "ERROR: could not write record file: %s\n", client_option.record);
+        if (status >= 0) {
+            status = 1;
+        }
+    }
+    if (client_option.cache) {
+        commit_cache_entry(cache_fp, cache_key, status == 0);
+    }
+    if (client_option.compress) {
+        long long raw_bytes, wire_bytes, micros;
+        groovyclient_session_compression(session, &raw_bytes, &wire_bytes, &micros);
+        trace_compression(raw_bytes, wire_bytes, micros);
+    }
+    groovyclient_session_free(session);
+    trace_report(status);
+
+    if (status == GROOVYCLIENT_ERROR_CLOSED) {
+        status = 0; // as normal exit if closed without exit status
+    } else if (status < 0) {
+        fprintf(stderr, "ERROR: %s\n", groovyclient_strerror(status));
+        status = 1;
+    }
 
     // print particular error status message
     // FIXME it's strongly bound to exit status of ExitStatus on groovyserver.
@@ -0,0 +1,679 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "config.h"
+
+#include <sys/types.h>
+#ifdef WINDOWS
+#include <windows.h>
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#endif
+
+#include <unistd.h>
+
+#include "bool.h"
+#include "session.h"
+#include "shm.h"
+#include "libgroovyclient.h"
+
+enum session_state {
+    STATE_NEW,
+    STATE_CONNECTED,
+    STATE_STARTED,
+    STATE_FINISHED,
+};
+
+struct string_list {
+    char** items;   // NULL terminated
+    int count;
+};
+
+struct groovyclient_session {
+    char* host;
+    int port;
+    char* authtoken;
+    char* cwd;
+    char* classpath;
+    char* priority;
+    struct string_list args;    // args.items[0] is a placeholder as argv[0]
+    struct string_list envs;
+    BOOL env_all;
+    struct string_list env_includes;
+    struct string_list env_excludes;
+
+    enum session_state state;
+    BOOL stdin_closed;
+    struct session_t session;
+    int status;
+
+    groovyclient_output_callback on_output;
+    groovyclient_exit_callback on_exit;
+    groovyclient_eval_callback on_eval;     // not NULL in a shell or watch session
+    groovyclient_trace_callback on_trace;   // not NULL when timings on the server are requested
+    groovyclient_capture_callback on_capture; // not NULL when the response is captured
+    BOOL detach;
+    BOOL compress;
+    BOOL watch;
+    int runs;           // runs requested in a watch session
+    int finished_runs;  // runs of which the status is received
+    void* user_data;
+};
+
+static int list_add(struct string_list* list, const char* item)
+{
+    char* copy = strdup(item);
+    char** items = realloc(list->items, sizeof(char*) * (list->count + 2));
+    if (copy == NULL || items == NULL) {
+        free(copy);
+        if (items != NULL) {
+            list->items = items;
+        }
+        return GROOVYCLIENT_ERROR_MEMORY;
+    }
+    items[list->count++] = copy;
+    items[list->count] = NULL;
+    list->items = items;
+    return GROOVYCLIENT_OK;
+}
+
+static void list_delete(struct string_list* list)
+{
+    int i;
+    for (i = 0; i < list->count; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+}
+
+static int replace_string(char** field, const char* value)
+{
+    char* copy = NULL;
+    if (value != NULL && (copy = strdup(value)) == NULL) {
+        return GROOVYCLIENT_ERROR_MEMORY;
+    }
+    free(*field);
+    *field = copy;
+    return GROOVYCLIENT_OK;
+}
+
+static void close_fd(int fd)
+{
+#ifdef WINDOWS
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+/*
+ * Create a session to invoke a script on the server.
+ * authtoken can be NULL if it's set later by groovyclient_session_set_authtoken().
+ * return NULL if memory isn't available.
+ */
+groovyclient_session* groovyclient_session_new(const char* host, int port, const char* authtoken)
+{
+    groovyclient_session* session = calloc(1, sizeof(groovyclient_session));
+    if (session == NULL) {
+        return NULL;
+    }
+    session->port = port;
+    session->state = STATE_NEW;
+    session_init(&session->session, -1, session);
+    if (replace_string(&session->host, host) != GROOVYCLIENT_OK
+        || replace_string(&session->authtoken, authtoken) != GROOVYCLIENT_OK
+        || list_add(&session->args, "groovyclient") != GROOVYCLIENT_OK) {
+        groovyclient_session_free(session);
+        return NULL;
+    }
+    return session;
+}
+
+void groovyclient_session_free(groovyclient_session* session)
+{
+    if (session == NULL) {
+        return;
+    }
+    if (session->session.fd >= 0) {
+        close_fd(session->session.fd);
+    }
+    session_delete(&session->session);
+    shm_delete(session->session.shm);
+    list_delete(&session->args);
+    list_delete(&session->envs);
+    list_delete(&session->env_includes);
+    list_delete(&session->env_excludes);
+    free(session->host);
+    free(session->authtoken);
+    free(session->cwd);
+    free(session->classpath);
+    free(session->priority);
+    free(session);
+}
+
+int groovyclient_session_add_arg(groovyclient_session* session, const char* arg)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return list_add(&session->args, arg);
+}
+
+/*
+ * name_value is in the form of "NAME=VALUE".
+ */
+int groovyclient_session_add_env(groovyclient_session* session, const char* name_value)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return list_add(&session->envs, name_value);
+}
+
+/*
+ * Pass envvars of this process of which the name includes substr,
+ * or all of them if substr is NULL. None of them are passed by default.
+ */
+int groovyclient_session_include_env(groovyclient_session* session, const char* substr)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    if (substr == NULL) {
+        session->env_all = TRUE;
+        return GROOVYCLIENT_OK;
+    }
+    return list_add(&session->env_includes, substr);
+}
+
+/*
+ * Don't pass envvars of this process of which the name includes substr,
+ * even if they are included. Ones added by groovyclient_session_add_env() are passed.
+ */
+int groovyclient_session_exclude_env(groovyclient_session* session, const char* substr)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return list_add(&session->env_excludes, substr);
+}
+
+/*
+ * the current working directory of the process is used by default.
+ */
+int groovyclient_session_set_cwd(groovyclient_session* session, const char* cwd)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return replace_string(&session->cwd, cwd);
+}
+
+/*
+ * CLASSPATH environment variable of the process is used by default.
+ */
+int groovyclient_session_set_classpath(groovyclient_session* session, const char* classpath)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return replace_string(&session->classpath, classpath);
+}
+
+int groovyclient_session_set_authtoken(groovyclient_session* session, const char* authtoken)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return replace_string(&session->authtoken, authtoken);
+}
+
+void groovyclient_session_set_callbacks(groovyclient_session* session,
+                                        groovyclient_output_callback on_output,
+                                        groovyclient_exit_callback on_exit,
+                                        void* user_data)
+{
+    session->on_output = on_output;
+    session->on_exit = on_exit;
+    session->user_data = user_data;
+}
+
+/*
+ * TRUE while output of a run which is already superseded comes in a watch session.
+ */
+static BOOL is_superseded(groovyclient_session* session)
+{
+    return session->watch && session->finished_runs + 1 < session->runs;
+}
+
+static void dispatch_eval(struct session_t* s, int status)
+{
+    groovyclient_session* session = (groovyclient_session*) s->data;
+    BOOL superseded = is_superseded(session);
+    if (session->watch) {
+        session->finished_runs++;
+    }
+    if (!superseded) {
+        session->on_eval(session, status, session->user_data);
+    }
+}
+
+/*
+ * Make the session a shell session, in which snippets are evaluated instead of a script.
+ * Args are passed to the binding of the shell.
+ */
+int groovyclient_session_set_shell(groovyclient_session* session, groovyclient_eval_callback on_eval)
+{
+    if (session->state >= STATE_STARTED || on_eval == NULL || session->detach || session->watch) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->on_eval = on_eval;
+    session->session.eval_handler = dispatch_eval;
+    return GROOVYCLIENT_OK;
+}
+
+/*
+ * Make the session a watch session, in which the script of the first arg is run again
+ * by groovyclient_session_rerun() without reconnecting, and only changed sources are
+ * recompiled. The eval callback is called with the status of each run which isn't
+ * superseded. stdin isn't read by the script.
+ */
+int groovyclient_session_set_watch(groovyclient_session* session, groovyclient_eval_callback on_eval)
+{
+    if (session->state >= STATE_STARTED || on_eval == NULL || session->detach || session->on_eval != NULL) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->on_eval = on_eval;
+    session->session.eval_handler = dispatch_eval;
+    session->watch = TRUE;
+    session->runs = 1;
+    return GROOVYCLIENT_OK;
+}
+
+static void dispatch_trace(struct session_t* s, const char* entry)
+{
+    groovyclient_session* session = (groovyclient_session*) s->data;
+    session->on_trace(session, entry, session->user_data);
+}
+
+/*
+ * Request timings of phases on the server, which are passed to the callback.
+ */
+int groovyclient_session_set_trace(groovyclient_session* session, groovyclient_trace_callback on_trace)
+{
+    if (session->state >= STATE_STARTED || on_trace == NULL) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->on_trace = on_trace;
+    session->session.trace_handler = dispatch_trace;
+    return GROOVYCLIENT_OK;
+}
+
+static void dispatch_capture(struct session_t* s, const char* data, int size)
+{
+    groovyclient_session* session = (groovyclient_session*) s->data;
+    session->on_capture(session, data, size, session->user_data);
+}
+
+/*
+ * Pass raw bytes of the response to the callback as they are received, including
+ * headers of frames and compressed bodies. Output through shared memory isn't passed.
+ */
+int groovyclient_session_set_capture(groovyclient_session* session, groovyclient_capture_callback on_capture)
+{
+    if (session->state >= STATE_STARTED || on_capture == NULL) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->on_capture = on_capture;
+    session->session.capture_handler = dispatch_capture;
+    return GROOVYCLIENT_OK;
+}
+
+/*
+ * Receive output through rings on memory shared with the server instead of the socket,
+ * which is available only when the server runs on the same host. capacity is the size
+ * of each ring of 'out' and 'err' in bytes, which must be a power of 2, or 0 for default.
+ * Output is received via the socket as usual if the server cannot map the rings.
+ * It cannot be used with groovyclient_session_set_window().
+ */
+int groovyclient_session_set_shm(groovyclient_session* session, int capacity)
+{
+    if (session->state >= STATE_STARTED || session->session.shm != NULL || session->session.window > 0) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->session.shm = shm_create((capacity == 0) ? SHM_DEFAULT_CAPACITY : capacity);
+    return (session->session.shm != NULL) ? GROOVYCLIENT_OK : GROOVYCLIENT_ERROR_SHM;
+}
+
+/*
+ * Enable credit-based flow control. The server sends output of each channel no more
+ * than window bytes ahead of the output callback, and stdin can be written no more
+ * than groovyclient_session_stdin_credit() granted by the server.
+ * The server must support it, or stdin is never granted.
+ * It cannot be used with groovyclient_session_set_shm().
+ */
+int groovyclient_session_set_window(groovyclient_session* session, int window)
+{
+    if (session->state >= STATE_STARTED || window <= 0 || session->session.shm != NULL) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->session.window = window;
+    return GROOVYCLIENT_OK;
+}
+
+/*
+ * Request the session to be scheduled as "interactive" (default) or "batch" on the server.
+ * Batch sessions run concurrently up to their own limit at low priority.
+ */
+int groovyclient_session_set_priority(groovyclient_session* session, const char* priority)
+{
+    if (session->state >= STATE_STARTED
+        || (strcmp(priority, GROOVYCLIENT_PRIORITY_INTERACTIVE) != 0 && strcmp(priority, GROOVYCLIENT_PRIORITY_BATCH) != 0)) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return replace_string(&session->priority, priority);
+}
+
+/*
+ * Submit the invocation as a job which runs on the server without the client.
+ * The output of the session is the id of the job, and stdin isn't read.
+ */
+int groovyclient_session_set_detach(groovyclient_session* session)
+{
+    if (session->state >= STATE_STARTED || session->on_eval != NULL) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->detach = TRUE;
+    return GROOVYCLIENT_OK;
+}
+
+/*
+ * Request compression of output and stdin, which is worth it over a slow link.
+ * Frames are sent raw until the server accepts it, or if the server doesn't support it.
+ * The output callback is called with decompressed data.
+ */
+int groovyclient_session_set_compress(groovyclient_session* session)
+{
+    if (session->state >= STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->compress = TRUE;
+    return GROOVYCLIENT_OK;
+}
+
+/*
+ * Get sizes of data compressed or decompressed so far, and CPU time for them in microseconds.
+ * Data which doesn't get smaller is counted as the same size on the wire.
+ * It's available even after the session finishes.
+ */
+void groovyclient_session_compression(groovyclient_session* session, long long* raw_bytes, long long* wire_bytes, long long* micros)
+{
+    *raw_bytes = session->session.raw_bytes;
+    *wire_bytes = session->session.wire_bytes;
+    *micros = session->session.compress_micros;
+}
+
+/*
+ * Use a socket already connected to the server instead of connecting by the session.
+ * The socket is closed by the session.
+ */
+int groovyclient_session_attach(groovyclient_session* session, int fd)
+{
+    if (session->state != STATE_NEW) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->session.fd = fd;
+    session->state = STATE_CONNECTED;
+    return GROOVYCLIENT_OK;
+}
+
+/*
+ * Connect to the server. GROOVYCLIENT_ERROR_CONNECTION_REFUSED is returned
+ * when the server isn't running, and then it can be retried.
+ */
+int groovyclient_session_connect(groovyclient_session* session)
+{
+    if (session->state != STATE_NEW) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    int fd = open_socket(session->host, session->port);
+    if (fd == OPEN_SOCKET_REFUSED) {
+        return GROOVYCLIENT_ERROR_CONNECTION_REFUSED;
+    }
+    if (fd < 0) {
+        return GROOVYCLIENT_ERROR_CONNECT;
+    }
+    return groovyclient_session_attach(session, fd);
+}
+
+/*
+ * Send the request to invoke a script. It connects to the server if not yet.
+ */
+int groovyclient_session_start(groovyclient_session* session)
+{
+    int ret;
+    if (session->state == STATE_NEW && (ret = groovyclient_session_connect(session)) != GROOVYCLIENT_OK) {
+        return ret;
+    }
+    if (session->state != STATE_CONNECTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    struct invocation_t invocation = {
+        session->args.count,
+        session->args.items,
+        session->cwd,
+        session->envs.items,
+        session->classpath,
+        session->watch ? "watch" : ((session->on_eval != NULL) ? "shell" : (session->detach ? "detach" : NULL)),
+        session->on_trace != NULL,
+        (session->session.shm != NULL) ? session->session.shm->spec : NULL,
+        session->session.window,
+        session->priority,
+        session->compress ? COMPRESS_CODEC : NULL,
+        session->env_all,
+        session->env_includes.items,
+        session->env_excludes.items
+    };
+    if (!send_invocation_header(session->session.fd, &invocation, session->authtoken)) {
+        return GROOVYCLIENT_ERROR_IO;
+    }
+    session->state = STATE_STARTED;
+    return GROOVYCLIENT_OK;
+}
+
+int groovyclient_session_write_stdin(groovyclient_session* session, const char* data, int size)
+{
+    if (session->state != STATE_STARTED || session->stdin_closed) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    if (size <= 0) {
+        return GROOVYCLIENT_OK; // size 0 means EOF in the protocol
+    }
+    if (session->session.window > 0) {
+        if (size > session->session.stdin_credit) {
+            return GROOVYCLIENT_ERROR_STATE;
+        }
+        session->session.stdin_credit -= size;
+    }
+    return send_stdin_frames(&session->session, data, size) ? GROOVYCLIENT_OK : GROOVYCLIENT_ERROR_IO;
+}
+
+int groovyclient_session_close_stdin(groovyclient_session* session)
+{
+    if (session->state != STATE_STARTED || session->stdin_closed) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->stdin_closed = TRUE;
+    return send_stdin_chunk(session->session.fd, NULL, 0) ? GROOVYCLIENT_OK : GROOVYCLIENT_ERROR_IO;
+}
+
+/*
+ * Request the server to interrupt the script. The session finishes when the server closes it.
+ */
+int groovyclient_session_interrupt(groovyclient_session* session)
+{
+    const char* command = "Cmd: interrupt\n\n";
+    if (session->state != STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return send_fully(session->session.fd, command, strlen(command)) ? GROOVYCLIENT_OK : GROOVYCLIENT_ERROR_IO;
+}
+
+/*
+ * Send a snippet to be evaluated in a shell session.
+ * The eval callback is called with its status later.
+ */
+int groovyclient_session_eval(groovyclient_session* session, const char* source, int size)
+{
+    if (session->state != STATE_STARTED || session->stdin_closed || session->on_eval == NULL || session->watch || size <= 0) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    return send_eval_request(session->session.fd, source, size) ? GROOVYCLIENT_OK : GROOVYCLIENT_ERROR_IO;
+}
+
+/*
+ * Run the script again in a watch session. Output of the current run is discarded
+ * from now on, and the server stops it before the next run starts.
+ */
+int groovyclient_session_rerun(groovyclient_session* session)
+{
+    const char* command = "Cmd: rerun\n\n";
+    if (session->state != STATE_STARTED || session->stdin_closed || !session->watch) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    session->runs++;
+    return send_fully(session->session.fd, command, strlen(command)) ? GROOVYCLIENT_OK : GROOVYCLIENT_ERROR_IO;
+}
+
+/*
+ * the size of stdin which can be written now. It's increased by
+ * groovyclient_session_process() with flow control, or unlimited without it.
+ */
+int groovyclient_session_stdin_credit(groovyclient_session* session)
+{
+    if (session->session.window == 0 || session->session.stdin_credit > INT_MAX) {
+        return INT_MAX;
+    }
+    return (int) session->session.stdin_credit;
+}
+
+/*
+ * the socket to watch for reading, or -1 if not connected.
+ */
+int groovyclient_session_fd(groovyclient_session* session)
+{
+    return (session->state == STATE_FINISHED) ? -1 : session->session.fd;
+}
+
+static void dispatch_output(struct session_t* s, const char* channel, const char* data, int size)
+{
+    groovyclient_session* session = (groovyclient_session*) s->data;
+    if (session->on_output != NULL && !is_superseded(session)) {
+        session->on_output(session, channel, data, size, session->user_data);
+    }
+}
+
+static void finish(groovyclient_session* session, int status)
+{
+    session->status = status;
+    session->state = STATE_FINISHED;
+    close_fd(session->session.fd);
+    session->session.fd = -1;
+    session_delete(&session->session);
+    if (session->on_exit != NULL) {
+        session->on_exit(session, status, session->user_data);
+    }
+}
+
+/*
+ * Receive data which is available on the socket, and dispatch it to the callbacks.
+ * It blocks only if no data is available yet.
+ * return GROOVYCLIENT_RUNNING, GROOVYCLIENT_FINISHED, or an error.
+ */
+int groovyclient_session_process(groovyclient_session* session)
+{
+    if (session->state != STATE_STARTED) {
+        return GROOVYCLIENT_ERROR_STATE;
+    }
+    switch (session_receive(&session->session, dispatch_output)) {
+    case SESSION_RUNNING:
+        return GROOVYCLIENT_RUNNING;
+    case SESSION_FINISHED:
+        finish(session, session->session.status);
+        return GROOVYCLIENT_FINISHED;
+    case SESSION_CLOSED:
+        finish(session, GROOVYCLIENT_ERROR_CLOSED);
+        return GROOVYCLIENT_ERROR_CLOSED;
+    default:
+        finish(session, GROOVYCLIENT_ERROR_PROTOCOL);
+        return GROOVYCLIENT_ERROR_PROTOCOL;
+    }
+}
+
+/*
+ * Process the session until it finishes, and return the exit status or an error.
+ */
+int groovyclient_session_wait(groovyclient_session* session)
+{
+    int ret;
+    do {
+        ret = groovyclient_session_process(session);
+    } while (ret == GROOVYCLIENT_RUNNING);
+    return (ret == GROOVYCLIENT_FINISHED) ? session->status : ret;
+}
+
+/*
+ * the exit status of the finished session, or an error.
+ */
+int groovyclient_session_status(groovyclient_session* session)
+{
+    return (session->state == STATE_FINISHED) ? session->status : GROOVYCLIENT_ERROR_STATE;
+}
+
+const char* groovyclient_strerror(int error)
+{
+    switch (error) {
+    case GROOVYCLIENT_OK:
+        return "no error";
+    case GROOVYCLIENT_ERROR_CONNECTION_REFUSED:
+        return "connection refused";
+    case GROOVYCLIENT_ERROR_CONNECT:
+        return "could not connect to server";
+    case GROOVYCLIENT_ERROR_IO:
+        return "could not send to server";
+    case GROOVYCLIENT_ERROR_PROTOCOL:
+        return "invalid response from server";
+    case GROOVYCLIENT_ERROR_CLOSED:
+        return "connection closed by server";
+    case GROOVYCLIENT_ERROR_MEMORY:
+        return "could not allocate memory";
+    case GROOVYCLIENT_ERROR_STATE:
+        return "invalid state of session";
+    case GROOVYCLIENT_ERROR_SHM:
+        return "could not create shared memory";
+    default:
+        return "unknown error";
+    }
+}
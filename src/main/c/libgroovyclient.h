@@ -0,0 +1,166 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * libgroovyclient: an API to invoke scripts on groovyserver from a program.
+ *
+ * A typical usage is:
+ *
+ *   groovyclient_session* session = groovyclient_session_new("localhost", 1961, authtoken);
+ *   groovyclient_session_add_arg(session, "script.groovy");
+ *   groovyclient_session_set_callbacks(session, on_output, on_exit, user_data);
+ *   groovyclient_session_start(session);
+ *   groovyclient_session_close_stdin(session);
+ *   status = groovyclient_session_wait(session);
+ *   groovyclient_session_free(session);
+ *
+ * Instead of groovyclient_session_wait(), a program which runs many sessions
+ * at once can watch groovyclient_session_fd() of each session by select() or
+ * poll(), and call groovyclient_session_process() when it's readable.
+ * Sessions are independent of each other, but a session must not be used
+ * by two threads at the same time.
+ *
+ * A shell session, which is set by groovyclient_session_set_shell() before
+ * starting, evaluates snippets sent by groovyclient_session_eval() one by one
+ * against the same binding on the server, and the eval callback is called with
+ * the status of each snippet. groovyclient_session_close_stdin() ends it.
+ *
+ * A watch session, which is set by groovyclient_session_set_watch(), runs the
+ * script again by groovyclient_session_rerun() over the same connection, and
+ * the server recompiles only sources changed since the last run. Output of a
+ * run superseded by the next one is discarded at once.
+ *
+ * When the server runs on the same host, groovyclient_session_set_shm() lets
+ * output come through rings on shared memory, and the socket carries only
+ * small frames to notify it. The output callback is called in the same way.
+ *
+ * With groovyclient_session_set_window(), output is sent no faster than the
+ * output callback returns, and stdin must be written within
+ * groovyclient_session_stdin_credit(), which is renewed as the script reads it.
+ *
+ * groovyclient_session_set_compress() compresses output and stdin in the LZ4
+ * block format when the server accepts it, for a server over a slow link.
+ *
+ * groovyclient_session_set_capture() passes the response of the server as
+ * received on the socket, so that a session can be recorded and replayed.
+ *
+ * No function calls exit(). Errors are returned as negative values.
+ */
+
+#ifndef _LIBGROOVYCLIENT_H
+#define _LIBGROOVYCLIENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GROOVYCLIENT_OK 0
+#define GROOVYCLIENT_ERROR_CONNECTION_REFUSED -1    // groovyserver isn't running
+#define GROOVYCLIENT_ERROR_CONNECT -2
+#define GROOVYCLIENT_ERROR_IO -3
+#define GROOVYCLIENT_ERROR_PROTOCOL -4
+#define GROOVYCLIENT_ERROR_CLOSED -5                // closed by server without exit status
+#define GROOVYCLIENT_ERROR_MEMORY -6
+#define GROOVYCLIENT_ERROR_STATE -7                 // called in a wrong state of session
+#define GROOVYCLIENT_ERROR_SHM -8                   // shared memory isn't available
+
+// priority classes of groovyclient_session_set_priority()
+#define GROOVYCLIENT_PRIORITY_INTERACTIVE "interactive"
+#define GROOVYCLIENT_PRIORITY_BATCH "batch"
+
+// results of groovyclient_session_process()
+#define GROOVYCLIENT_RUNNING 0
+#define GROOVYCLIENT_FINISHED 1
+
+typedef struct groovyclient_session groovyclient_session;
+
+/*
+ * called for each fragment of output. channel is "out" or "err".
+ */
+typedef void (*groovyclient_output_callback)(groovyclient_session* session, const char* channel, const char* data, int size, void* user_data);
+
+/*
+ * called once when the session ends. status is the exit status of the script, or an error.
+ */
+typedef void (*groovyclient_exit_callback)(groovyclient_session* session, int status, void* user_data);
+
+/*
+ * called for each snippet evaluated in a shell session, or each run which isn't superseded
+ * in a watch session. status is the exit status of the snippet or the run.
+ */
+typedef void (*groovyclient_eval_callback)(groovyclient_session* session, int status, void* user_data);
+
+/*
+ * called for each block of raw bytes received from the server as it is, before it's parsed.
+ */
+typedef void (*groovyclient_capture_callback)(groovyclient_session* session, const char* data, int size, void* user_data);
+
+/*
+ * called for each timing of phases on the server before the exit callback.
+ * entry is "<phase> <start> <duration>", "cpu-time <duration>" or "allocated <bytes>",
+ * where times are microseconds from accepting the connection on the server.
+ */
+typedef void (*groovyclient_trace_callback)(groovyclient_session* session, const char* entry, void* user_data);
+
+groovyclient_session* groovyclient_session_new(const char* host, int port, const char* authtoken);
+void groovyclient_session_free(groovyclient_session* session);
+
+// request settings which can be changed before starting
+int groovyclient_session_add_arg(groovyclient_session* session, const char* arg);
+int groovyclient_session_add_env(groovyclient_session* session, const char* name_value);
+int groovyclient_session_include_env(groovyclient_session* session, const char* substr);
+int groovyclient_session_exclude_env(groovyclient_session* session, const char* substr);
+int groovyclient_session_set_cwd(groovyclient_session* session, const char* cwd);
+int groovyclient_session_set_classpath(groovyclient_session* session, const char* classpath);
+int groovyclient_session_set_authtoken(groovyclient_session* session, const char* authtoken);
+void groovyclient_session_set_callbacks(groovyclient_session* session,
+                                        groovyclient_output_callback on_output,
+                                        groovyclient_exit_callback on_exit,
+                                        void* user_data);
+int groovyclient_session_set_shell(groovyclient_session* session, groovyclient_eval_callback on_eval);
+int groovyclient_session_set_watch(groovyclient_session* session, groovyclient_eval_callback on_eval);
+int groovyclient_session_set_trace(groovyclient_session* session, groovyclient_trace_callback on_trace);
+int groovyclient_session_set_capture(groovyclient_session* session, groovyclient_capture_callback on_capture);
+int groovyclient_session_set_shm(groovyclient_session* session, int capacity);
+int groovyclient_session_set_window(groovyclient_session* session, int window);
+int groovyclient_session_set_priority(groovyclient_session* session, const char* priority);
+int groovyclient_session_set_detach(groovyclient_session* session);
+int groovyclient_session_set_compress(groovyclient_session* session);
+
+int groovyclient_session_attach(groovyclient_session* session, int fd);
+int groovyclient_session_connect(groovyclient_session* session);
+int groovyclient_session_start(groovyclient_session* session);
+
+int groovyclient_session_write_stdin(groovyclient_session* session, const char* data, int size);
+int groovyclient_session_close_stdin(groovyclient_session* session);
+int groovyclient_session_interrupt(groovyclient_session* session);
+int groovyclient_session_eval(groovyclient_session* session, const char* source, int size);
+int groovyclient_session_rerun(groovyclient_session* session);
+
+int groovyclient_session_stdin_credit(groovyclient_session* session);
+int groovyclient_session_fd(groovyclient_session* session);
+int groovyclient_session_process(groovyclient_session* session);
+int groovyclient_session_wait(groovyclient_session* session);
+int groovyclient_session_status(groovyclient_session* session);
+void groovyclient_session_compression(groovyclient_session* session, long long* raw_bytes, long long* wire_bytes, long long* micros);
+
+const char* groovyclient_strerror(int error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compression in the LZ4 block format for stream frames, which is the same as
+ * Lz4Codec of the server. It's self-contained not to depend on liblz4.
+ */
+
+#include <string.h>
+#include "lz4.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 // the last bytes are always literals
+#define MF_LIMIT 12     // a match never starts in the last bytes
+#define MAX_DISTANCE 65535
+#define SKIP_TRIGGER 6  // to skip faster over incompressible data
+
+static unsigned int read_int(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static int hash(unsigned int sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/*
+ * write bytes which follow a token for a length of 15 or more.
+ */
+static unsigned char* write_length(unsigned char* op, int length)
+{
+    if (length < 15) {
+        return op;
+    }
+    length -= 15;
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = length;
+    return op;
+}
+
+static unsigned char* write_sequence(const unsigned char* literal, int literals, unsigned char* op, int distance, int match_length)
+{
+    unsigned char* token = op++;
+    op = write_length(op, literals);
+    *token = ((literals < 15) ? literals : 15) << 4;
+    memcpy(op, literal, literals);
+    op += literals;
+    if (match_length == 0) {
+        return op; // the last sequence
+    }
+    *op++ = distance & 0xff;
+    *op++ = distance >> 8;
+    op = write_length(op, match_length - MIN_MATCH);
+    *token |= (match_length - MIN_MATCH < 15) ? match_length - MIN_MATCH : 15;
+    return op;
+}
+
+/*
+ * dest must have LZ4_MAX_COMPRESSED_SIZE(size) bytes.
+ * return the compressed size.
+ */
+int lz4_compress(struct lz4_t* ctx, const char* src, int size, char* dest)
+{
+    const unsigned char* base = (const unsigned char*) src;
+    int anchor = 0;
+    unsigned char* op = (unsigned char*) dest;
+    if (size > MF_LIMIT) {
+        int mf_limit = size - MF_LIMIT;
+        int match_limit = size - LAST_LITERALS;
+        int ip = 0;
+        memset(ctx->table, -1, sizeof(ctx->table));
+        while (ip < mf_limit) {
+            unsigned int sequence = read_int(base + ip);
+            int h = hash(sequence);
+            int ref = ctx->table[h];
+            ctx->table[h] = ip;
+            if (ref < 0 || ip - ref > MAX_DISTANCE || read_int(base + ref) != sequence) {
+                ip += 1 + ((ip - anchor) >> SKIP_TRIGGER);
+                continue;
+            }
+            while (ip > anchor && ref > 0 && base[ip - 1] == base[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            int length = MIN_MATCH;
+            while (ip + length < match_limit && base[ip + length] == base[ref + length]) {
+                length++;
+            }
+            op = write_sequence(base + anchor, ip - anchor, op, ip - ref, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+    op = write_sequence(base + anchor, size - anchor, op, 0, 0);
+    return op - (unsigned char*) dest;
+}
+
+/*
+ * return the decompressed size, or -1 if the block is broken or larger than capacity.
+ */
+int lz4_decompress(const char* src, int size, char* dest, int capacity)
+{
+    const unsigned char* ip = (const unsigned char*) src;
+    const unsigned char* src_end = ip + size;
+    unsigned char* op = (unsigned char*) dest;
+    unsigned char* dest_end = op + capacity;
+    while (ip < src_end) {
+        int token = *ip++;
+        int literals = token >> 4;
+        if (literals == 15) {
+            int b;
+            do {
+                if (ip >= src_end) {
+                    return -1;
+                }
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > src_end - ip || literals > dest_end - op) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == src_end) {
+            break; // the last sequence has only literals
+        }
+        if (src_end - ip < 2) {
+            return -1;
+        }
+        int distance = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (distance == 0 || distance > op - (unsigned char*) dest) {
+            return -1;
+        }
+        int length = token & 15;
+        if (length == 15) {
+            int b;
+            do {
+                if (ip >= src_end) {
+                    return -1;
+                }
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        length += MIN_MATCH;
+        if (length > dest_end - op) {
+            return -1;
+        }
+        const unsigned char* ref = op - distance;
+        while (length-- > 0) {
+            *op++ = *ref++; // may overlap
+        }
+    }
+    return op - (unsigned char*) dest;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LZ4_H
+#define _LZ4_H
+
+#define LZ4_HASH_LOG 12
+#define LZ4_MAX_COMPRESSED_SIZE(size) ((size) + (size) / 255 + 16)
+
+struct lz4_t {
+    int table[1 << LZ4_HASH_LOG];
+};
+
+int lz4_compress(struct lz4_t* ctx, const char* src, int size, char* dest);
+int lz4_decompress(const char* src, int size, char* dest, int capacity);
+
+#endif
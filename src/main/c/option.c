@@ -23,28 +23,54 @@
 #include "option.h"
 #include "bool.h"
 #include "config.h"
+#include "cache.h"
+#include "libgroovyclient.h"
 
 struct option_info_t option_info[] = {
-    { "s", OPT_HOST, TRUE },
-    { "host", OPT_HOST, TRUE },
-    { "p", OPT_PORT, TRUE },
-    { "port", OPT_PORT, TRUE },
-    { "a", OPT_AUTHTOKEN, TRUE },
-    { "authtoken", OPT_AUTHTOKEN, TRUE },
-    { "k", OPT_KILL_SERVER, FALSE },
-    { "kill-server", OPT_KILL_SERVER, FALSE },
-    { "r", OPT_RESTART_SERVER, FALSE },
-    { "restart-server", OPT_RESTART_SERVER, FALSE },
-    { "env", OPT_ENV, TRUE },
-    { "env-all", OPT_ENV_ALL, FALSE },
-    { "env-exclude", OPT_ENV_EXCLUDE, TRUE },
-    { "q", OPT_QUIET, FALSE },
-    { "quiet", OPT_QUIET, FALSE },
-    { "help", OPT_HELP, FALSE },
-    { "h", OPT_HELP, FALSE },
-    { "", OPT_HELP, FALSE },
-    { "version", OPT_VERSION, FALSE },
-    { "v", OPT_VERSION, FALSE },
+    { "s", OPT_HOST, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "host", OPT_HOST, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "p", OPT_PORT, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "port", OPT_PORT, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "a", OPT_AUTHTOKEN, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "authtoken", OPT_AUTHTOKEN, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "k", OPT_KILL_SERVER, FALSE, MODE_KILL, IN(MODE_KILL) },
+    { "kill-server", OPT_KILL_SERVER, FALSE, MODE_KILL, IN(MODE_KILL) },
+    { "r", OPT_RESTART_SERVER, FALSE, MODE_NONE, IN_INVOKING_MODES & ~IN(MODE_CACHE) },
+    { "restart-server", OPT_RESTART_SERVER, FALSE, MODE_NONE, IN_INVOKING_MODES & ~IN(MODE_CACHE) },
+    { "env", OPT_ENV, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "env-all", OPT_ENV_ALL, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "env-exclude", OPT_ENV_EXCLUDE, TRUE, MODE_NONE, IN_ANY_MODE },
+    { "q", OPT_QUIET, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "quiet", OPT_QUIET, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "help", OPT_HELP, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "h", OPT_HELP, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "", OPT_HELP, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "version", OPT_VERSION, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "v", OPT_VERSION, FALSE, MODE_NONE, IN_ANY_MODE },
+    { "cache", OPT_CACHE, FALSE, MODE_CACHE, IN(MODE_CACHE) },
+    { "cache-input", OPT_CACHE_INPUT, TRUE, MODE_NONE, IN(MODE_CACHE) },
+    { "cache-max-size", OPT_CACHE_MAX_SIZE, TRUE, MODE_NONE, IN(MODE_CACHE) },
+    { "batch", OPT_BATCH, TRUE, MODE_BATCH, IN(MODE_BATCH) },
+    { "jobs", OPT_JOBS, TRUE, MODE_NONE, IN(MODE_BATCH) | IN(MODE_FANOUT) },
+    { "pool", OPT_POOL, TRUE, MODE_NONE, IN(MODE_BATCH) | IN(MODE_FANOUT) },
+    { "shell", OPT_SHELL, FALSE, MODE_SHELL, IN(MODE_SHELL) },
+    { "shell-fd", OPT_SHELL_FD, TRUE, MODE_SHELL, IN(MODE_SHELL) },
+    { "stats", OPT_STATS, FALSE, MODE_STATS, IN(MODE_STATS) },
+    { "trace", OPT_TRACE, FALSE, MODE_NONE, IN(MODE_NORMAL) | IN(MODE_SHELL) | IN(MODE_WATCH) },
+    { "trace-file", OPT_TRACE_FILE, TRUE, MODE_NONE, IN(MODE_NORMAL) | IN(MODE_SHELL) | IN(MODE_WATCH) },
+    { "shm", OPT_SHM, FALSE, MODE_NONE, IN(MODE_NORMAL) | IN(MODE_CACHE) | IN(MODE_SHELL) | IN(MODE_WATCH) },
+    { "window", OPT_WINDOW, TRUE, MODE_NONE, IN(MODE_NORMAL) | IN(MODE_SHELL) | IN(MODE_WATCH) },
+    { "priority", OPT_PRIORITY, TRUE, MODE_NONE, IN_INVOKING_MODES },
+    { "invalidate-grapes", OPT_INVALIDATE_GRAPES, FALSE, MODE_INVALIDATE_GRAPES, IN(MODE_INVALIDATE_GRAPES) },
+    { "status", OPT_STATUS, FALSE, MODE_STATUS, IN(MODE_STATUS) },
+    { "detach", OPT_DETACH, FALSE, MODE_DETACH, IN(MODE_DETACH) },
+    { "job-status", OPT_JOB_STATUS, TRUE, MODE_JOB_STATUS, IN(MODE_JOB_STATUS) },
+    { "job-log", OPT_JOB_LOG, TRUE, MODE_JOB_LOG, IN(MODE_JOB_LOG) },
+    { "job-wait", OPT_JOB_WAIT, TRUE, MODE_JOB_WAIT, IN(MODE_JOB_WAIT) },
+    { "compress", OPT_COMPRESS, FALSE, MODE_NONE, IN(MODE_NORMAL) | IN(MODE_CACHE) | IN(MODE_SHELL) | IN(MODE_WATCH) | IN(MODE_DETACH) },
+    { "watch", OPT_WATCH, FALSE, MODE_WATCH, IN(MODE_WATCH) },
+    { "watch-input", OPT_WATCH_INPUT, TRUE, MODE_WATCH, IN(MODE_WATCH) },
+    { "record", OPT_RECORD, TRUE, MODE_NONE, IN(MODE_NORMAL) | IN(MODE_SHELL) | IN(MODE_WATCH) | IN(MODE_DETACH) },
 };
 
 struct option_t client_option = {
@@ -59,6 +85,32 @@ struct option_t client_option = {
     {},     // env_exclude_mask; each array elements are expected to be filled with NULLs
     FALSE,  // help
     FALSE,  // version
+    FALSE,  // cache
+    {},     // cache_inputs; each array elements are expected to be filled with NULLs
+    DEFAULT_CACHE_MAX_SIZE, // cache_max_size
+    NULL,   // batch
+    JOBS_NOT_SPECIFIED, // jobs
+    NULL,   // pool
+    FALSE,  // shell
+    SHELL_FD_NOT_SPECIFIED, // shell_fd
+    FALSE,  // stats
+    FALSE,  // trace
+    NULL,   // trace_file
+    FALSE,  // shm
+    WINDOW_NOT_SPECIFIED, // window
+    NULL,   // priority
+    FALSE,  // invalidate_grapes
+    FALSE,  // status
+    FALSE,  // detach
+    NULL,   // job_status
+    NULL,   // job_log
+    NULL,   // job_wait
+    FALSE,  // compress
+    FALSE,  // watch
+    {},     // watch_inputs; each array elements are expected to be filled with NULLs
+    NULL,   // record
+    MODE_NORMAL, // mode
+    NULL,   // mode_option
 };
 
 void usage()
@@ -78,6 +130,53 @@ void usage()
            "  -Cenv-exclude <substr>           don't pass environment variables of which a\n" \
            "                                   name includes specified substr\n" \
            "  -Cv,-Cversion                    display the GroovyServ version\n" \
+           "  -Ccache                          replay a cached result of the same invocation\n" \
+           "                                   without connecting to groovyserver\n" \
+           "  -Ccache-input <path>             specify a file which the result depends on\n" \
+           "  -Ccache-max-size <size>          specify max total size of cached results\n" \
+           "                                   (suffix K/M/G is available)\n" \
+           "  -Cbatch <file>                   run invocations specified one per line in the\n" \
+           "                                   file (\"-\" means stdin) over one client\n" \
+           "  -Cjobs <n>                       specify max number of concurrent invocations\n" \
+           "                                   in batch or fan-out mode (default: number of CPUs)\n" \
+           "  -Cpool <host:port,...>           distribute invocations in batch or fan-out mode\n" \
+           "                                   over the running groovyservers\n" \
+           "  -Cshell                          evaluate code snippets from stdin one per line\n" \
+           "                                   (a trailing \\ continues the line) against\n" \
+           "                                   the same binding kept on groovyserver\n" \
+           "  -Cshell-fd <fd>                  read code snippets of -Cshell from the fd\n" \
+           "  -Cstats                          show live counters of the running groovyserver\n" \
+           "  -Cstatus                         show whether groovyserver is running, and exit\n" \
+           "                                   with 0 if so, or 3 if not\n" \
+           "  -Ctrace                          print timings of phases of the invocation on\n" \
+           "                                   client and server to stderr\n" \
+           "  -Ctrace-file <path>              write the timings as a Chrome trace JSON file\n" \
+           "  -Cshm                            receive output through shared memory from\n" \
+           "                                   groovyserver on the same host\n" \
+           "  -Cwindow <size>                  let groovyserver send output no more than the\n" \
+           "                                   size ahead of writing it out (suffix K/M/G)\n" \
+           "  -Cpriority <class>               let groovyserver schedule the invocation as\n" \
+           "                                   'interactive' or 'batch' (default: 'interactive',\n" \
+           "                                   or 'batch' in batch or fan-out mode)\n" \
+           "  -Cinvalidate-grapes              clear @Grab dependencies resolved and cached by\n" \
+           "                                   the running groovyserver\n" \
+           "  -Cdetach                         run the invocation as a job on groovyserver\n" \
+           "                                   without stdin, and exit after printing its id\n" \
+           "  -Cjob-status <id>                show the state and the output size of the job\n" \
+           "  -Cjob-log <id>[:<offset>]        print output of the job logged so far, skipping\n" \
+           "                                   the offset bytes of output\n" \
+           "  -Cjob-wait <id>[:<offset>]       print output of the job until it finishes, and\n" \
+           "                                   exit with its exit status\n" \
+           "  -Ccompress                       compress output and stdin between groovyserver\n" \
+           "                                   over a slow link\n" \
+           "  -Cwatch                          run the script again whenever it or a source in\n" \
+           "                                   its directory is changed, until interrupted\n" \
+           "  -Cwatch-input <path>             specify a file or directory which also makes\n" \
+           "                                   -Cwatch run the script again\n" \
+           "  -Crecord <file>                  record responses of groovyserver with timings\n" \
+           "                                   to the file, which src/bench/c/replay serves\n" \
+           "  [args] ::: <input>...            run args with each input appended as the last\n" \
+           "                                   arg concurrently, and print output in input order\n" \
            "");
 }
 
@@ -105,7 +204,7 @@ static BOOL is_groovy_version_option(char* s)
     return FALSE;
 }
 
-static void set_mask_option(char ** env_mask, char* opt, char* value)
+static BOOL set_mask_option(char ** env_mask, char* opt, char* value)
 {
     char** p;
     for (p = env_mask; p-env_mask < MAX_MASK && *p != NULL; p++) {
@@ -114,9 +213,37 @@ static void set_mask_option(char ** env_mask, char* opt, char* value)
     if (p-env_mask == MAX_MASK) {
         fprintf(stderr, "ERROR: too many options: %s %s\n", opt, value);
         usage();
-        exit(1);
+        return FALSE;
     }
     *p = value;
+    return TRUE;
+}
+
+/*
+ * return -1 if the size is invalid.
+ */
+static long long parse_size(char* opt, char* value)
+{
+    long long size;
+    char unit = '\0';
+    if (sscanf(value, "%lld%c", &size, &unit) < 1 || size < 0) {
+        fprintf(stderr, "ERROR: could not parse size: %s %s\n", opt, value);
+        return -1;
+    }
+    switch (unit) {
+    case 'G': case 'g':
+        size *= 1024; // fall through
+    case 'M': case 'm':
+        size *= 1024; // fall through
+    case 'K': case 'k':
+        size *= 1024; // fall through
+    case '\0':
+        break;
+    default:
+        fprintf(stderr, "ERROR: unrecognized unit of size: %s %s\n", opt, value);
+        return -1;
+    }
+    return size;
 }
 
 static struct option_info_t* what_option(char* name)
@@ -130,12 +257,89 @@ static struct option_info_t* what_option(char* name)
     return NULL;
 }
 
-void scan_options(struct option_t* option, int argc, char **argv)
+/*
+ * At most one option selects the mode, which can be specified more than once
+ * like -Cwatch and -Cwatch-input.
+ */
+static BOOL select_mode(struct option_t* option, enum client_mode_t mode, char* name)
 {
+    if (option->mode != MODE_NORMAL && option->mode != mode) {
+        fprintf(stderr, "ERROR: cannot specify both of %s and %s\n", option->mode_option, name);
+        return FALSE;
+    }
+    if (option->mode_option == NULL) {
+        option->mode = mode;
+        option->mode_option = name;
+    }
+    return TRUE;
+}
+
+/*
+ * print options which select any of the modes, like "-Cbatch or :::".
+ */
+static void print_mode_options(int modes)
+{
+    char* prefixes[MODE_JOB_WAIT + 1];
+    char* names[MODE_JOB_WAIT + 1];
+    int count = 0, mode, i;
+    for (mode = MODE_NORMAL + 1; mode <= MODE_JOB_WAIT; mode++) {
+        if (!(modes & IN(mode))) {
+            continue;
+        }
+        if (mode == MODE_FANOUT) {
+            prefixes[count] = "";
+            names[count++] = FANOUT_SEPARATOR;
+            continue;
+        }
+        for (i = 0; i < sizeof(option_info)/sizeof(struct option_info_t); i++) {
+            if (option_info[i].selects == mode) {
+                prefixes[count] = CLIENT_OPTION_PREFIX;
+                names[count++] = option_info[i].name;
+                break;
+            }
+        }
+    }
+    for (i = 0; i < count; i++) {
+        fprintf(stderr, "%s%s%s",
+            (i == 0) ? "" : (i == count - 1) ? " or " : ", ",
+            prefixes[i], names[i]);
+    }
+}
+
+/*
+ * check that all given options are available in the selected mode.
+ */
+static BOOL check_modes(struct option_t* option, char** given)
+{
+    int i;
+    for (i = 0; i < sizeof(option_info)/sizeof(struct option_info_t); i++) {
+        char* name = given[option_info[i].type];
+        if (name == NULL || (option_info[i].modes & IN(option->mode))) {
+            continue;
+        }
+        if (option->mode == MODE_NORMAL) {
+            fprintf(stderr, "ERROR: %s is available only with ", name);
+            print_mode_options(option_info[i].modes);
+            fprintf(stderr, "\n");
+        } else {
+            fprintf(stderr, "ERROR: cannot specify %s with %s\n", name, option->mode_option);
+        }
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * return OPTION_OK to continue, OPTION_DONE when nothing remains to do
+ * because a usage or version is printed, or OPTION_ERROR.
+ */
+int scan_options(struct option_t* option, int argc, char **argv)
+{
+    char* given[OPT_COUNT] = { NULL }; // options as specified
     int i;
     if (argc <= 1) {
         option->help = TRUE;
-        return;
+        return OPTION_OK;
     }
     for (i = 1; i < argc; i++) {
         if (is_groovy_help_option(argv[i])) {
@@ -146,6 +350,10 @@ void scan_options(struct option_t* option, int argc, char **argv)
             option->version = TRUE;
         }
 
+        if (strcmp(argv[i], FANOUT_SEPARATOR) == 0 && !select_mode(option, MODE_FANOUT, FANOUT_SEPARATOR)) {
+            return OPTION_ERROR;
+        }
+
         if (is_client_option(argv[i])) {
             char* name = argv[i] + strlen(CLIENT_OPTION_PREFIX);
             char* argvi_copy = argv[i];
@@ -155,7 +363,7 @@ void scan_options(struct option_t* option, int argc, char **argv)
             if (opt == NULL) {
                 fprintf(stderr, "ERROR: unrecognized option %s\n", argvi_copy);
                 usage();
-                exit(1);
+                return OPTION_ERROR;
             }
 
             char* value = NULL;
@@ -163,13 +371,18 @@ void scan_options(struct option_t* option, int argc, char **argv)
                 if (i >= argc-1) {
                     fprintf(stderr, "ERROR: option %s requires param\n", argvi_copy);
                     usage();
-                    exit(1);
+                    return OPTION_ERROR;
                 }
                 i++;
                 value = argv[i];
                 argv[i] = NULL;
             }
 
+            given[opt->type] = argvi_copy;
+            if (opt->selects != MODE_NONE && !select_mode(option, opt->selects, argvi_copy)) {
+                return OPTION_ERROR;
+            }
+
             switch (opt->type) {
             case OPT_HOST:
                 assert(opt->take_value == TRUE);
@@ -179,7 +392,7 @@ void scan_options(struct option_t* option, int argc, char **argv)
                 assert(opt->take_value == TRUE);
                 if (sscanf(value, "%d", &option->port) != 1) {
                     fprintf(stderr, "ERROR: could not parse port number: %s\n", value);
-                    exit(1);
+                    return OPTION_ERROR;
                 }
                 break;
             case OPT_AUTHTOKEN:
@@ -197,22 +410,138 @@ void scan_options(struct option_t* option, int argc, char **argv)
                 break;
             case OPT_ENV:
                 assert(opt->take_value == TRUE);
-                set_mask_option(option->env_include_mask, name, value);
+                if (!set_mask_option(option->env_include_mask, name, value)) {
+                    return OPTION_ERROR;
+                }
                 break;
             case OPT_ENV_ALL:
                 option->env_all = TRUE;
                 break;
             case OPT_ENV_EXCLUDE:
                 assert(opt->take_value == TRUE);
-                set_mask_option(option->env_exclude_mask, name, value);
+                if (!set_mask_option(option->env_exclude_mask, name, value)) {
+                    return OPTION_ERROR;
+                }
                 break;
             case OPT_HELP:
                 usage();
-                exit(0); // because client's usage is printable without server communication
+                return OPTION_DONE; // because client's usage is printable without server communication
                 break;
             case OPT_VERSION:
                 version();
-                exit(0); // because client's version is printable without server communication
+                return OPTION_DONE; // because client's version is printable without server communication
+                break;
+            case OPT_CACHE:
+                option->cache = TRUE;
+                break;
+            case OPT_CACHE_INPUT:
+                assert(opt->take_value == TRUE);
+                if (!set_mask_option(option->cache_inputs, name, value)) {
+                    return OPTION_ERROR;
+                }
+                break;
+            case OPT_CACHE_MAX_SIZE:
+                assert(opt->take_value == TRUE);
+                option->cache_max_size = parse_size(argvi_copy, value);
+                if (option->cache_max_size < 0) {
+                    return OPTION_ERROR;
+                }
+                break;
+            case OPT_BATCH:
+                assert(opt->take_value == TRUE);
+                option->batch = value;
+                break;
+            case OPT_JOBS:
+                assert(opt->take_value == TRUE);
+                if (sscanf(value, "%d", &option->jobs) != 1 || option->jobs <= 0) {
+                    fprintf(stderr, "ERROR: could not parse number of jobs: %s\n", value);
+                    return OPTION_ERROR;
+                }
+                break;
+            case OPT_POOL:
+                assert(opt->take_value == TRUE);
+                option->pool = value;
+                break;
+            case OPT_SHELL:
+                option->shell = TRUE;
+                break;
+            case OPT_SHELL_FD:
+                assert(opt->take_value == TRUE);
+                if (sscanf(value, "%d", &option->shell_fd) != 1 || option->shell_fd < 0) {
+                    fprintf(stderr, "ERROR: could not parse fd: %s\n", value);
+                    return OPTION_ERROR;
+                }
+                option->shell = TRUE;
+                break;
+            case OPT_STATS:
+                option->stats = TRUE;
+                break;
+            case OPT_TRACE:
+                option->trace = TRUE;
+                break;
+            case OPT_TRACE_FILE:
+                assert(opt->take_value == TRUE);
+                option->trace_file = value;
+                option->trace = TRUE;
+                break;
+            case OPT_SHM:
+                option->shm = TRUE;
+                break;
+            case OPT_WINDOW: {
+                assert(opt->take_value == TRUE);
+                long long window = parse_size(argvi_copy, value);
+                if (window < 0) {
+                    return OPTION_ERROR;
+                }
+                if (window == 0 || window > MAX_WINDOW) {
+                    fprintf(stderr, "ERROR: invalid window size: %s\n", value);
+                    return OPTION_ERROR;
+                }
+                option->window = (int) window;
+                break;
+            }
+            case OPT_PRIORITY:
+                assert(opt->take_value == TRUE);
+                if (strcmp(value, GROOVYCLIENT_PRIORITY_INTERACTIVE) != 0 && strcmp(value, GROOVYCLIENT_PRIORITY_BATCH) != 0) {
+                    fprintf(stderr, "ERROR: invalid priority: %s\n", value);
+                    return OPTION_ERROR;
+                }
+                option->priority = value;
+                break;
+            case OPT_INVALIDATE_GRAPES:
+                option->invalidate_grapes = TRUE;
+                break;
+            case OPT_STATUS:
+                option->status = TRUE;
+                break;
+            case OPT_DETACH:
+                option->detach = TRUE;
+                break;
+            case OPT_JOB_STATUS:
+                option->job_status = value;
+                break;
+            case OPT_JOB_LOG:
+                option->job_log = value;
+                break;
+            case OPT_JOB_WAIT:
+                option->job_wait = value;
+                break;
+            case OPT_COMPRESS:
+                option->compress = TRUE;
+                break;
+            case OPT_WATCH:
+                option->watch = TRUE;
+                break;
+            case OPT_WATCH_INPUT:
+                assert(opt->take_value == TRUE);
+                if (!set_mask_option(option->watch_inputs, name, value)) {
+                    return OPTION_ERROR;
+                }
+                option->watch = TRUE;
+                break;
+            case OPT_RECORD:
+                assert(opt->take_value == TRUE);
+                option->record = value;
                 break;
             default:
                 assert(FALSE);
@@ -221,18 +550,30 @@ void scan_options(struct option_t* option, int argc, char **argv)
     }
 
     // check unavailable combination of options
-    if (option->kill && option->restart) {
-        fprintf(stderr, "ERROR: cannot specify both of -Ckill-server and -Crestart-server options\n");
-        exit(1);
+    if (!check_modes(option, given)) {
+        return OPTION_ERROR;
+    }
+    if (option->shm && option->record != NULL) {
+        fprintf(stderr, "ERROR: cannot specify both of -Cshm and -Crecord\n"); // output through shm isn't recorded
+        return OPTION_ERROR;
+    }
+    if (option->shm && option->window != WINDOW_NOT_SPECIFIED) {
+        fprintf(stderr, "ERROR: cannot specify both of -Cshm and -Cwindow\n"); // output through shm isn't flow-controlled
+        return OPTION_ERROR;
+    }
+    if (option->pool != NULL && option->restart) {
+        fprintf(stderr, "ERROR: cannot specify -Crestart-server with -Cpool\n");
+        return OPTION_ERROR;
     }
     if (option->host != NULL) {
         if (option->restart) {
             fprintf(stderr, "ERROR: cannot specify -Crestart-server with explicitly specified host\n");
-            exit(1);
+            return OPTION_ERROR;
         }
         if (option->kill) {
             fprintf(stderr, "ERROR: cannot specify -Ckill-server with explicitly specified host\n");
-            exit(1);
+            return OPTION_ERROR;
         }
     }
+    return OPTION_OK;
 }
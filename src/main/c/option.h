@@ -22,6 +22,42 @@
 #define MAX_MASK 10
 #define CLIENT_OPTION_PREFIX "-C"
 #define PORT_NOT_SPECIFIED -1
+#define JOBS_NOT_SPECIFIED 0
+#define SHELL_FD_NOT_SPECIFIED -1
+#define WINDOW_NOT_SPECIFIED 0
+#define MAX_WINDOW (1024 * 1024 * 1024)
+#define FANOUT_SEPARATOR ":::"
+
+// results of scan_options()
+#define OPTION_OK 0
+#define OPTION_DONE 1
+#define OPTION_ERROR 2
+
+/*
+ * What the client does, which is selected by at most one option (or FANOUT_SEPARATOR).
+ * Other options declare the modes in which they are available.
+ */
+enum client_mode_t {
+    MODE_NONE = -1,     // for an option which doesn't select a mode
+    MODE_NORMAL,        // invoke a script
+    MODE_CACHE,
+    MODE_BATCH,
+    MODE_FANOUT,
+    MODE_SHELL,
+    MODE_WATCH,
+    MODE_DETACH,
+    MODE_KILL,
+    MODE_STATUS,
+    MODE_STATS,
+    MODE_INVALIDATE_GRAPES,
+    MODE_JOB_STATUS,
+    MODE_JOB_LOG,
+    MODE_JOB_WAIT,
+};
+
+#define IN(mode) (1 << (mode))
+#define IN_ANY_MODE (~0)
+#define IN_INVOKING_MODES (IN(MODE_NORMAL) | IN(MODE_CACHE) | IN(MODE_BATCH) | IN(MODE_FANOUT) | IN(MODE_SHELL) | IN(MODE_WATCH) | IN(MODE_DETACH))
 
 struct option_t {
     char* host;
@@ -31,10 +67,36 @@ struct option_t {
     BOOL restart;
     BOOL quiet;
     BOOL env_all;
-    char* env_include_mask[MAX_MASK];
-    char* env_exclude_mask[MAX_MASK];
+    char* env_include_mask[MAX_MASK + 1]; // NULL terminated
+    char* env_exclude_mask[MAX_MASK + 1];
     BOOL help;
     BOOL version;
+    BOOL cache;
+    char* cache_inputs[MAX_MASK];
+    long long cache_max_size;
+    char* batch;
+    int jobs;
+    char* pool;
+    BOOL shell;
+    int shell_fd;
+    BOOL stats;
+    BOOL trace;
+    char* trace_file;
+    BOOL shm;
+    int window;
+    char* priority;
+    BOOL invalidate_grapes;
+    BOOL status;
+    BOOL detach;
+    char* job_status;
+    char* job_log;
+    char* job_wait;
+    BOOL compress;
+    BOOL watch;
+    char* watch_inputs[MAX_MASK];
+    char* record;
+    enum client_mode_t mode;
+    char* mode_option;  // the option which selects the mode
 };
 
 enum OPTION_TYPE {
@@ -49,19 +111,46 @@ enum OPTION_TYPE {
     OPT_ENV_EXCLUDE,
     OPT_HELP,
     OPT_VERSION,
+    OPT_CACHE,
+    OPT_CACHE_INPUT,
+    OPT_CACHE_MAX_SIZE,
+    OPT_BATCH,
+    OPT_JOBS,
+    OPT_POOL,
+    OPT_SHELL,
+    OPT_SHELL_FD,
+    OPT_STATS,
+    OPT_TRACE,
+    OPT_TRACE_FILE,
+    OPT_SHM,
+    OPT_WINDOW,
+    OPT_PRIORITY,
+    OPT_INVALIDATE_GRAPES,
+    OPT_STATUS,
+    OPT_DETACH,
+    OPT_JOB_STATUS,
+    OPT_JOB_LOG,
+    OPT_JOB_WAIT,
+    OPT_COMPRESS,
+    OPT_WATCH,
+    OPT_WATCH_INPUT,
+    OPT_RECORD,
+    OPT_COUNT,
 };
 
 struct option_info_t {
     char* name;
     enum OPTION_TYPE type;
     BOOL take_value;
+    enum client_mode_t selects;
+    int modes;  // modes in which the option is available
 };
 
 extern struct option_t client_option;
 
 void usage();
 void version();
-void scan_options(struct option_t* option, int argc, char **argv);
+int scan_options(struct option_t* option, int argc, char **argv);
 void print_client_options(struct option_t *opt);
 
 #endif
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+
+#ifdef WINDOWS
+#include <windows.h>
+#endif
+
+#include "bool.h"
+#include "record.h"
+
+#define MAX_BLOCK_SIZE (64 * 1024 * 1024) // not to allocate too much for a broken file
+
+struct record_t {
+    FILE* fp;
+    long long last_micros;  // when the previous block was received
+    BOOL failed;
+};
+
+static long long now_micros()
+{
+#ifdef WINDOWS
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void write_varint(FILE* fp, unsigned long long value)
+{
+    do {
+        unsigned char b = value & 0x7f;
+        value >>= 7;
+        fputc(value ? (b | 0x80) : b, fp);
+    } while (value);
+}
+
+/*
+ * return FALSE at the end of file or for a broken varint.
+ */
+static BOOL read_varint(FILE* fp, unsigned long long* value)
+{
+    int shift;
+    *value = 0;
+    for (shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(fp);
+        if (c == EOF) {
+            return FALSE;
+        }
+        *value |= (unsigned long long) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Create a file to record a session. It should be called just before the request
+ * is sent, because the delay of the first block is measured from here.
+ * return NULL if the file cannot be created.
+ */
+struct record_t* record_create(const char* path)
+{
+    struct record_t* record = calloc(1, sizeof(struct record_t));
+    if (record == NULL) {
+        return NULL;
+    }
+    if ((record->fp = fopen(path, "wb")) == NULL) {
+        free(record);
+        return NULL;
+    }
+    fputs(RECORD_MAGIC, record->fp);
+    fputc(RECORD_VERSION, record->fp);
+    record->last_micros = now_micros();
+    return record;
+}
+
+/*
+ * Append a block received now. A failure is reported by record_close().
+ */
+BOOL record_block(struct record_t* record, const char* data, int size)
+{
+    long long now = now_micros();
+    write_varint(record->fp, now - record->last_micros);
+    write_varint(record->fp, size);
+    if (fwrite(data, 1, size, record->fp) != size) {
+        record->failed = TRUE;
+    }
+    record->last_micros = now;
+    return !record->failed;
+}
+
+/*
+ * return FALSE if any block couldn't be written.
+ */
+BOOL record_close(struct record_t* record)
+{
+    BOOL ok = !record->failed && !ferror(record->fp);
+    ok = (fclose(record->fp) == 0) && ok;
+    free(record);
+    return ok;
+}
+
+/*
+ * Load all blocks of a recorded session into memory.
+ * return NULL if the file cannot be read or is broken.
+ */
+struct record_block_t* record_load(const char* path, int* count)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    char magic[sizeof(RECORD_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+        || memcmp(magic, RECORD_MAGIC, sizeof(magic) - 1) != 0 || magic[sizeof(magic) - 1] != RECORD_VERSION) {
+        fclose(fp);
+        return NULL;
+    }
+
+    struct record_block_t* blocks = NULL;
+    int capacity = 0;
+    BOOL broken = FALSE;
+    unsigned long long delay, size;
+    int c;
+    *count = 0;
+    while (!broken && (c = fgetc(fp)) != EOF) {
+        ungetc(c, fp);
+        if (*count == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            struct record_block_t* expanded = realloc(blocks, sizeof(struct record_block_t) * capacity);
+            if (expanded == NULL) {
+                broken = TRUE;
+                break;
+            }
+            blocks = expanded;
+        }
+        struct record_block_t* block = &blocks[*count];
+        if (!read_varint(fp, &delay) || !read_varint(fp, &size)
+            || size > MAX_BLOCK_SIZE || (block->data = malloc(size + 1)) == NULL) { // not NULL even for 0
+            broken = TRUE;
+            break;
+        }
+        block->delay = delay;
+        block->size = size;
+        if (fread(block->data, 1, size, fp) != size) {
+            free(block->data);
+            broken = TRUE;
+            break;
+        }
+        (*count)++;
+    }
+    broken = broken || ferror(fp);
+    fclose(fp);
+    if (broken) {
+        record_free(blocks, *count);
+        return NULL;
+    }
+    if (blocks == NULL) {
+        blocks = malloc(sizeof(struct record_block_t)); // an empty session
+    }
+    return blocks;
+}
+
+void record_free(struct record_block_t* blocks, int count)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        free(blocks[i].data);
+    }
+    free(blocks);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include "bool.h"
+
+/*
+ * A recorded session is the raw bytes received from the server in blocks as they
+ * were received, with the time of each one:
+ *
+ *   "GSRC" <version>
+ *   ( <delay> <size> <bytes> ) *
+ *
+ * where <version> is a byte of RECORD_VERSION, and <delay> is microseconds since
+ * the previous block, or since the request was sent for the first one. <delay>
+ * and <size> are unsigned LEB128 varints.
+ */
+#define RECORD_MAGIC "GSRC"
+#define RECORD_VERSION 1
+
+struct record_t;
+
+struct record_block_t {
+    long long delay;    // microseconds
+    int size;
+    char* data;
+};
+
+struct record_t* record_create(const char* path);
+BOOL record_block(struct record_t* record, const char* data, int size);
+BOOL record_close(struct record_t* record);
+
+struct record_block_t* record_load(const char* path, int* count);
+void record_free(struct record_block_t* blocks, int count);
+
+#endif
@@ -26,12 +26,13 @@
 #ifdef WINDOWS
 #include <windows.h>
 #include <winsock2.h>
+#include <ws2tcpip.h>   // getaddrinfo
 #include <process.h>
 #include <sys/fcntl.h>
 #else
 #include <sys/socket.h> // AF_INET
 #include <netinet/in.h> // sockaddr_in
-#include <netdb.h>      // gethostbyname
+#include <netdb.h>      // getaddrinfo
 #include <sys/uio.h>
 #include <sys/errno.h>
 #endif
@@ -40,27 +41,38 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #include "base64.h"
 #include "buf.h"
-#include "option.h"
+#include "lz4.h"
 #include "bool.h"
 #include "session.h"
+#include "shm.h"
 
 // request headers
 const char * const HEADER_KEY_CURRENT_WORKING_DIR = "Cwd";
 const char * const HEADER_KEY_ARG = "Arg";
+const char * const HEADER_KEY_ARG_STREAM = "ArgStream";
 const char * const HEADER_KEY_ENV = "Env";
 const char * const HEADER_KEY_CP = "Cp";
 const char * const HEADER_KEY_AUTHTOKEN = "Auth";
+const char * const HEADER_KEY_COMMAND = "Cmd";
+const char * const HEADER_KEY_TRACE = "Trace";
+const char * const HEADER_KEY_SHM = "Shm";
+const char * const HEADER_KEY_WINDOW = "Window";
+const char * const HEADER_KEY_PRIORITY = "Priority";
+const char * const HEADER_KEY_CLIENT = "Client";
+const char * const HEADER_KEY_COMPRESS = "Compress"; // also a response
 
 // response headers
 const char * const HEADER_KEY_CHANNEL = "Channel";
 const char * const HEADER_KEY_SIZE = "Size";
 const char * const HEADER_KEY_STATUS = "Status";
-
-const int CR = 0x0d;
-const int CANCEL = 0x18;
+const char * const HEADER_KEY_EVAL_STATUS = "EvalStatus";
+const char * const HEADER_KEY_RING = "Ring";
+const char * const HEADER_KEY_CREDIT = "Credit";
+const char * const HEADER_KEY_COMPRESSED = "Compressed"; // also a request
 
 #ifdef WINDOWS
 extern char __declspec(dllimport) **environ;
@@ -68,63 +80,90 @@ extern char __declspec(dllimport) **environ;
 extern char **environ;
 #endif
 
+// arguments are sent as frames after the header part instead of Arg headers,
+// when either of these is reached.
+#define ARG_STREAM_MIN_COUNT 64
+#define ARG_STREAM_MIN_SIZE 4096
+
 /*
- * Make socket and connect to the server.
+ * Lookup IPv4 address of the host. A client which runs many sessions to the same
+ * server should resolve it once and connect by connect_server_addr() for each.
+ * It's thread-safe, and doesn't keep anything shared between sessions.
+ * return 0, or OPEN_SOCKET_FAILED if the host is unknown.
  */
-int open_socket(char* server_host, int server_port)
+int resolve_server(const char* host, int port, struct server_addr_t* server)
 {
-    struct hostent *hostent;
-    struct sockaddr_in server;
-
-    // FIXME to use getaddressinfo or getnameinfo
-    hostent = gethostbyname(server_host); // lookup IP
-    if (hostent == NULL) {
-        fprintf(stderr, "ERROR: could not resolve host address: %s\n", server_host);
-        exit(1);
+    struct addrinfo hints;
+    struct addrinfo* result;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET; // groovyserver listens on IPv4
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+        return OPEN_SOCKET_FAILED;
     }
+    memset(server, 0, sizeof(struct server_addr_t));
+    memcpy(&server->addr, result->ai_addr, sizeof(struct sockaddr_in));
+    server->addr.sin_port = htons(port);
+    freeaddrinfo(result);
+    return 0;
+}
 
-    memset(&server, 0, sizeof(server)); // zero clear struct
-
-    server.sin_family = PF_INET;        // server.sin_addr = hostent->h_addr
-    memcpy(&server.sin_addr, hostent->h_addr, hostent->h_length);
-    server.sin_port = htons(server_port);
-
+/*
+ * Make socket and connect to the resolved server.
+ * return OPEN_SOCKET_REFUSED if the server isn't running,
+ * or OPEN_SOCKET_FAILED for other errors.
+ */
+int connect_server_addr(const struct server_addr_t* server)
+{
     int fd;
 #ifdef WINDOWS
     if ((fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET) {
 #else
     if ((fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
 #endif
-        fprintf(stderr, "ERROR: could not open socket: %s:%d", server_host, server_port);
-        exit(1);
+        return OPEN_SOCKET_FAILED;
     }
 
 #ifdef WINDOWS
-    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
-        return -1;
+    if (connect(fd, (struct sockaddr *)&server->addr, sizeof(server->addr)) == SOCKET_ERROR) {
+        closesocket(fd);
+        return OPEN_SOCKET_REFUSED;
     }
 #else
-    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
-        if (errno == ECONNREFUSED) {
-            return -1;
-        }
-        perror("ERROR: could not connect to server");
-        exit(1);
+    if (connect(fd, (struct sockaddr *)&server->addr, sizeof(server->addr)) < 0) {
+        int error = errno;
+        close(fd);
+        return (error == ECONNREFUSED) ? OPEN_SOCKET_REFUSED : OPEN_SOCKET_FAILED;
     }
 #endif
     return fd;
 }
 
+/*
+ * Make socket and connect to the server.
+ * return OPEN_SOCKET_REFUSED if the server isn't running,
+ * or OPEN_SOCKET_FAILED for other errors.
+ */
+int open_socket(char* server_host, int server_port)
+{
+    struct server_addr_t server;
+    if (resolve_server(server_host, server_port, &server) != 0) {
+        return OPEN_SOCKET_FAILED;
+    }
+    return connect_server_addr(&server);
+}
+
 /*
  * return TRUE if the NAME part of str("NAME=VALUE") matches the pattern.
+ * an invalid environment variable doesn't match any pattern.
  */
 static BOOL mask_match(char* pattern, const char* str)
 {
     char* pos = strchr(str, '=');
 
     if (pos == NULL) {
-        fprintf(stderr, "ERROR: invalid environment variable: %s\n", str);
-        exit(1);
+        return FALSE;
     }
     *pos = '\0';
     BOOL result = strstr(str, pattern) != NULL;
@@ -135,7 +174,7 @@ static BOOL mask_match(char* pattern, const char* str)
 static BOOL masks_match(char** masks, char* str)
 {
     char** p;
-    for (p = masks; p-masks < MAX_MASK && *p != NULL; p++) {
+    for (p = masks; p != NULL && *p != NULL; p++) {
         if (mask_match(*p, str)) {
             return TRUE;
         }
@@ -143,12 +182,12 @@ static BOOL masks_match(char** masks, char* str)
     return FALSE;
 }
 
-static void make_env_headers(buf* read_buf, char** env, char** inc_mask, char** exc_mask)
+static void make_env_headers(buf* read_buf, char** env, struct invocation_t* invocation)
 {
     int i;
     for (i = 0; env[i] != NULL; i++) {
-        if (client_option.env_all || masks_match(client_option.env_include_mask, env[i])) {
-            if (!masks_match(client_option.env_exclude_mask, env[i])) {
+        if (invocation->env_all || masks_match(invocation->env_includes, env[i])) {
+            if (!masks_match(invocation->env_excludes, env[i])) {
                 buf_printf(read_buf, "%s: %s\n", HEADER_KEY_ENV, env[i]);
             }
         }
@@ -156,372 +195,533 @@ static void make_env_headers(buf* read_buf, char** env, char** inc_mask, char**
 }
 
 /*
- * Send header information which includes current working direcotry,
- * command line arguments, and CLASSPATH environment variable
- * to the server.
+ * Make header information which includes current working direcotry,
+ * command line arguments, and CLASSPATH environment variable.
+ * The authtoken line is omitted when authtoken is NULL.
  */
-void send_header(int fd, int argc, char** argv, char* authtoken)
+BOOL make_header(buf* read_buf, int argc, char** argv, char* authtoken)
+{
+    struct invocation_t invocation = { argc, argv, NULL, NULL, NULL, NULL, FALSE, NULL, 0, NULL, NULL };
+    return make_invocation_header(read_buf, &invocation, authtoken);
+}
+
+static int client_identity()
+{
+#ifdef WINDOWS
+    return (int) getpid(); // a parent isn't known
+#else
+    return (int) getppid();
+#endif
+}
+
+/*
+ * Make header information of the invocation.
+ * When cwd of the invocation is NULL, the current working directory is used.
+ * Envvars of the invocation are sent in addition to ones of the process selected by
+ * env_all and env_includes of it.
+ * return FALSE if it fails.
+ */
+BOOL make_invocation_header(buf* read_buf, struct invocation_t* invocation, char* authtoken)
 {
     char path_buffer[MAXPATHLEN];
-    buf read_buf = buf_new(BUFFER_SIZE, NULL);
+    int argc = invocation->argc;
+    char** argv = invocation->argv;
     int i;
 
     // send current working directory.
-    buf_printf(&read_buf, "%s: ", HEADER_KEY_CURRENT_WORKING_DIR);
-    char* cwd = getcwd(path_buffer, MAXPATHLEN);
+    buf_printf(read_buf, "%s: ", HEADER_KEY_CURRENT_WORKING_DIR);
+    char* cwd = invocation->cwd;
     if (cwd == NULL) {
-        perror("ERROR: could not get cwd");
-        exit(1);
+        cwd = getcwd(path_buffer, MAXPATHLEN);
+        if (cwd == NULL) {
+            return FALSE;
+        }
+    }
+
+    buf_add(read_buf, cwd);
+    buf_add(read_buf, "\n");
+
+    if (authtoken != NULL) {
+        buf_printf(read_buf, "%s: %s\n", HEADER_KEY_AUTHTOKEN, authtoken);
     }
 
-    buf_add(&read_buf, cwd);
-    buf_add(&read_buf, "\n");
+    if (invocation->command != NULL) {
+        buf_printf(read_buf, "%s: %s\n", HEADER_KEY_COMMAND, invocation->command);
+    }
+
+    if (invocation->trace) {
+        buf_printf(read_buf, "%s: on\n", HEADER_KEY_TRACE);
+    }
+
+    if (invocation->shm != NULL) {
+        buf_printf(read_buf, "%s: %s\n", HEADER_KEY_SHM, invocation->shm);
+    }
+
+    if (invocation->window > 0) {
+        buf_printf(read_buf, "%s: %d\n", HEADER_KEY_WINDOW, invocation->window);
+    }
+
+    if (invocation->priority != NULL) {
+        buf_printf(read_buf, "%s: %s\n", HEADER_KEY_PRIORITY, invocation->priority);
+    }
 
-    buf_printf(&read_buf, "%s: %s\n", HEADER_KEY_AUTHTOKEN, authtoken);
+    if (invocation->compress != NULL) {
+        buf_printf(read_buf, "%s: %s\n", HEADER_KEY_COMPRESS, invocation->compress);
+    }
+
+    // identify the shell which runs the client, so that the server shares slots fairly
+    // among shells even though all of them connect from the loopback address.
+    buf_printf(read_buf, "%s: %d\n", HEADER_KEY_CLIENT, client_identity());
 
     // send command line arguments.
-    char *encoded_ptr, *encoded_work;
+    int arg_count = 0;
+    long arg_stream_size = 0;
     for (i = 1; i < argc; i++) {
+        if (argv[i] != NULL) {
+            int length = strlen(argv[i]);
+            arg_count++;
+            arg_stream_size += snprintf(NULL, 0, "%d\n", length) + length;
+        }
+    }
+    BOOL arg_stream = (arg_count >= ARG_STREAM_MIN_COUNT || arg_stream_size >= ARG_STREAM_MIN_SIZE);
+    if (arg_stream) {
+        buf_printf(read_buf, "%s: %d %ld\n", HEADER_KEY_ARG_STREAM, arg_count, arg_stream_size);
+    }
+    char *encoded_ptr, *encoded_work;
+    for (i = 1; i < argc && !arg_stream; i++) {
         if (argv[i] != NULL) {
             // base64 encoded data is less "(original size) * 1.5 + 5" as much as raw data
             // "+5" is a extra space for '=' padding and NULL as the end of string
             encoded_ptr = malloc(sizeof(char) * strlen(argv[i]) * 1.5 + 5);
             if (encoded_ptr == NULL) {
-                perror("ERROR: could not allocate memory");
-                exit(1);
+                return FALSE;
             }
             encoded_work = encoded_ptr; // copy for free
             base64_encode(encoded_work, (unsigned char*) argv[i]);
-            buf_printf(&read_buf, "%s: %s\n", HEADER_KEY_ARG, encoded_work);
+            buf_printf(read_buf, "%s: %s\n", HEADER_KEY_ARG, encoded_work);
             free(encoded_ptr);
         }
     }
 
     // send envvars.
-    if (client_option.env_include_mask != NULL) {
-        make_env_headers(&read_buf,
-                         environ,
-                         client_option.env_include_mask,
-                         client_option.env_exclude_mask);
+    if (invocation->env_all || invocation->env_includes != NULL) {
+        make_env_headers(read_buf, environ, invocation);
+    }
+    if (invocation->envs != NULL) {
+        for (i = 0; invocation->envs[i] != NULL; i++) {
+            buf_printf(read_buf, "%s: %s\n", HEADER_KEY_ENV, invocation->envs[i]);
+        }
     }
 
-    char* cp = getenv("CLASSPATH");
+    char* cp = (invocation->classpath != NULL) ? invocation->classpath : getenv("CLASSPATH");
     if (cp != NULL) {
-        buf_printf(&read_buf, "%s: %s\n", HEADER_KEY_CP, cp);
+        buf_printf(read_buf, "%s: %s\n", HEADER_KEY_CP, cp);
     }
 
-    buf_printf(&read_buf, "\n");
-    read_buf.size--; /* remove trailing '\0' */
+    buf_printf(read_buf, "\n");
+
+    // frames of arguments follow the header part.
+    // each is appended at the known end, because scanning the whole buffer
+    // for every argument would be quadratic.
+    for (i = 1; i < argc && arg_stream; i++) {
+        if (argv[i] != NULL && !buf_failed(read_buf)) {
+            buf_offs_printf(read_buf, read_buf->size - 1, "%d\n%s", (int) strlen(argv[i]), argv[i]);
+        }
+    }
+
+    if (buf_failed(read_buf)) {
+        return FALSE;
+    }
+    read_buf->size--; /* remove trailing '\0' */
+    return TRUE;
+}
 
+/*
+ * Write all of data to the socket.
+ */
+BOOL send_fully(int fd, const char* data, int size)
+{
+    while (size > 0) {
 #ifdef WINDOWS
-    send(fd, read_buf.buffer, read_buf.size, 0);
+        int ret = send(fd, data, size, 0);
 #else
-    write(fd, read_buf.buffer, read_buf.size);
+        int ret = write(fd, data, size);
 #endif
+        if (ret <= 0) {
+            return FALSE;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return TRUE;
+}
+
+/*
+ * Send header information to the server.
+ */
+BOOL send_header(int fd, int argc, char** argv, char* authtoken)
+{
+    struct invocation_t invocation = { argc, argv, NULL, NULL, NULL, NULL, FALSE, NULL, 0, NULL, NULL };
+    return send_invocation_header(fd, &invocation, authtoken);
+}
+
+BOOL send_invocation_header(int fd, struct invocation_t* invocation, char* authtoken)
+{
+    buf read_buf = buf_new(BUFFER_SIZE, NULL);
+    BOOL result = make_invocation_header(&read_buf, invocation, authtoken)
+        && send_fully(fd, read_buf.buffer, read_buf.size);
     buf_delete(&read_buf);
+    return result;
+}
+
+static int min_int(int a,int b) {
+    return (a < b) ? a : b;
 }
 
 /*
- * parse server response header.
+ * Send a chunk of standard input to the server.
+ * A chunk of size 0 means that standard input is closed.
  */
-static void read_header(char* buf, struct header_t* header)
+BOOL send_stdin_chunk(int fd, const char* data, int size)
 {
-#ifdef DEBUG
-    fprintf(stderr, "DEBUG: read_header: line: %s<EOL> (size:%zu)\n", buf, strlen(buf));
-#endif
+    char write_buf[BUFFER_SIZE];
+    sprintf(write_buf, "%s: %d\n\n", HEADER_KEY_SIZE, size);
+    return send_fully(fd, write_buf, strlen(write_buf)) && send_fully(fd, data, size);
+}
 
-    // key
-    char* p = strtok(buf, " :");
-    if (p == NULL) {
-        fprintf(stderr, "ERROR: invalid header: key is NULL\n");
-        exit(1);
-    }
-    if (strlen(p) > MAX_HEADER_KEY_LEN) {
-        fprintf(stderr, "ERROR: invalid header: key \"%s\" is too long\n", p);
-        exit(1);
+static long long cpu_micros_since(clock_t started)
+{
+    return (long long) (clock() - started) * 1000000 / CLOCKS_PER_SEC;
+}
+
+/*
+ * Send standard input as chunks, which are compressed when the server has accepted
+ * compression and they get smaller. size must not be 0, which means EOF.
+ */
+BOOL send_stdin_frames(struct session_t* session, const char* data, int size)
+{
+    char write_buf[BUFFER_SIZE];
+
+    if (!session->compress || size < COMPRESS_MIN_FRAME_SIZE) {
+        return send_stdin_chunk(session->fd, data, size);
     }
-    int i;
-    for (i = 0; i < strlen(p); i++) {
-        if (p[i] == CANCEL) {
-            exit(0);
-        }
-        if (isspace((unsigned char) p[i])) {
-            // if invoked "groovyclient" without arguments, it should works
-            // as error message command and print usage by delegated groovy command
-            return;
+    if (session->lz4 == NULL) {
+        session->lz4 = malloc(sizeof(struct lz4_t));
+        session->pack_buf = malloc(LZ4_MAX_COMPRESSED_SIZE(COMPRESS_MAX_FRAME_SIZE));
+        if (session->lz4 == NULL || session->pack_buf == NULL) {
+            return FALSE;
         }
-        if (!isalnum((unsigned char) p[i])) {
-            fprintf(stderr, "ERROR: invalid header: key \"%s\" is invalid: %x\n", p, p[i]);
-            exit(1);
+    }
+    while (size > 0) {
+        int chunk_size = min_int(size, COMPRESS_MAX_FRAME_SIZE);
+        clock_t started = clock();
+        int packed_size = lz4_compress(session->lz4, data, chunk_size, session->pack_buf);
+        session->compress_micros += cpu_micros_since(started);
+        session->raw_bytes += chunk_size;
+        if (packed_size < chunk_size) {
+            session->wire_bytes += packed_size;
+            sprintf(write_buf, "%s: %d\n%s: %d\n\n", HEADER_KEY_SIZE, chunk_size, HEADER_KEY_COMPRESSED, packed_size);
+            if (!send_fully(session->fd, write_buf, strlen(write_buf)) || !send_fully(session->fd, session->pack_buf, packed_size)) {
+                return FALSE;
+            }
+        } else {
+            session->wire_bytes += chunk_size;
+            if (!send_stdin_chunk(session->fd, data, chunk_size)) {
+                return FALSE;
+            }
         }
+        data += chunk_size;
+        size -= chunk_size;
     }
-    strncpy(header->key, p, MAX_HEADER_KEY_LEN);
+    return TRUE;
+}
 
-    // value
-    p = strtok(NULL, "\n");
-    if (p == NULL) {
-        fprintf(stderr, "ERROR: invalid header: value of key \"%s\" is NULL: %s\n", header->key, p);
-        exit(1);
-    }
-    while (isspace((unsigned char) *p)) { // ignore spaces
-        p++;
-    }
-    if (strlen(p) > MAX_HEADER_VALUE_LEN) {
-        fprintf(stderr, "ERROR: invalid header: value of key \"%s\" is too long: %s\n", header->key, p);
-        exit(1);
-    }
-    strncpy(header->value, p, MAX_HEADER_VALUE_LEN);
+/*
+ * Send a code snippet to be evaluated in a shell session.
+ */
+BOOL send_eval_request(int fd, const char* source, int size)
+{
+    char write_buf[BUFFER_SIZE];
+    sprintf(write_buf, "%s: eval\n%s: %d\n\n", HEADER_KEY_COMMAND, HEADER_KEY_SIZE, size);
+    return send_fully(fd, write_buf, strlen(write_buf)) && send_fully(fd, source, size);
+}
 
-#ifdef DEBUG
-    fprintf(stderr, "DEBUG: read_header: parsed: \"%s\"(size:%zu) => \"%s\"(size:%zu)\n", header->key, strlen(header->key), header->value, strlen(header->value));
-#endif
+/*
+ * Grant the server credit of the output channel for flow control.
+ */
+BOOL send_credit(int fd, const char* channel, int size)
+{
+    char write_buf[BUFFER_SIZE];
+    sprintf(write_buf, "%s: %s\n%s: %d\n\n", HEADER_KEY_CHANNEL, channel, HEADER_KEY_CREDIT, size);
+    return send_fully(fd, write_buf, strlen(write_buf));
 }
 
-static char* read_line(int fd, char* buf, int size)
+/*
+ * Initialize a session which receives response from the server incrementally.
+ * Many sessions can be handled at once by select() on their sockets.
+ */
+void session_init(struct session_t* session, int fd, void* data)
 {
-     int i;
-     for (i = 0; i < size; i++) {
-#ifdef WINDOWS
-         int ret = recv(fd, buf + i, 1, 0);
-         if (ret == -1) {
-             fprintf(stderr, "ERROR: could not read line of header: %zu\n", WSAGetLastError());
-             exit(1);
-         }
-         if (ret != 1) {
-             // signal handler output breaks stream.
-#ifdef DEBUG
-             fprintf(stderr, "DEBUG: read_line (maybe by signal handler): %zu\n", ret);
-#endif
-             return NULL;
-         }
-#else
-         read(fd, buf + i, 1);
-#endif
-         if (buf[i] == '\n') {
-#ifdef DEBUG
-             fprintf(stderr, "DEBUG: read_line (until LF): %s<EOL> (size:%zu)\n", buf, strlen(buf));
-#endif
-             return buf;
-         }
-     }
-#ifdef DEBUG
-     fprintf(stderr, "DEBUG: read_line (size over): %s<EOL> (size:%zu)\n", buf, strlen(buf));
-#endif
-     return buf;
- }
+    session->fd = fd;
+    session->in_buf = NULL;
+    session->in_size = 0;
+    session->in_capacity = 0;
+    session->channel[0] = '\0';
+    session->chunk_remained = 0;
+    session->status = 0;
+    session->eval_handler = NULL;
+    session->trace_handler = NULL;
+    session->capture_handler = NULL;
+    session->shm = NULL;
+    session->window = 0;
+    session->stdin_credit = 0;
+    session->out_consumed = 0;
+    session->err_consumed = 0;
+    session->compress = FALSE;
+    session->chunk_packed = 0;
+    session->lz4 = NULL;
+    session->pack_buf = NULL;
+    session->unpack_buf = NULL;
+    session->raw_bytes = 0;
+    session->wire_bytes = 0;
+    session->compress_micros = 0;
+    session->data = data;
+}
 
 /*
- * read server response headers.
+ * free buffers. stats of compression are kept to be reported after the session.
  */
-static int read_headers(int fd, struct header_t headers[])
+void session_delete(struct session_t* session)
 {
-    char read_buf[BUFFER_SIZE];
-    char *p;
-    int pos = 0;
-    while (1) {
-        memset(read_buf, 0, sizeof(read_buf));
-        p = read_line(fd, read_buf, BUFFER_SIZE);
-        if (p == NULL) {
-          return 0;
+    free(session->in_buf);
+    session->in_buf = NULL;
+    session->in_size = 0;
+    session->in_capacity = 0;
+    free(session->lz4);
+    free(session->pack_buf);
+    free(session->unpack_buf);
+    session->lz4 = NULL;
+    session->pack_buf = NULL;
+    session->unpack_buf = NULL;
+}
+
+/*
+ * parse a header block "Key: value\n...\n" of which the terminating empty line is excluded.
+ * output written to the shared rings is dispatched to the handler here.
+ */
+static BOOL parse_frame_header(struct session_t* session, char* block, int* finished, chunk_handler_t handler)
+{
+    char* channel = NULL;
+    int size = -1;
+    long long ring_position = -1;
+    long long credit = -1;
+    int packed_size = -1;
+    char* line = block;
+
+    while (*line != '\0') {
+        char* eol = strchr(line, '\n');
+        if (eol != NULL) {
+            *eol = '\0';
+        }
+        char* value = strchr(line, ':');
+        if (value == NULL) {
+            return FALSE;
+        }
+        *value++ = '\0';
+        while (isspace((unsigned char) *value)) {
+            value++;
+        }
+        if (strcmp(line, HEADER_KEY_STATUS) == 0) {
+            session->status = atoi(value);
+            *finished = TRUE;
+        }
+        else if (strcmp(line, HEADER_KEY_EVAL_STATUS) == 0) {
+            if (session->eval_handler == NULL) {
+                return FALSE;
+            }
+            session->eval_handler(session, atoi(value));
+            return TRUE; // a frame without body
+        }
+        else if (strcmp(line, HEADER_KEY_CHANNEL) == 0) {
+            channel = value;
+        }
+        else if (strcmp(line, HEADER_KEY_SIZE) == 0) {
+            size = atoi(value);
+        }
+        else if (strcmp(line, HEADER_KEY_RING) == 0) {
+            ring_position = atoll(value);
         }
-        if (*p == '\0') {
-            return 0;
+        else if (strcmp(line, HEADER_KEY_CREDIT) == 0) {
+            credit = atoll(value);
         }
-        if (*p == CR) { // FIXME For what is it worth?
-            p++;
+        else if (strcmp(line, HEADER_KEY_COMPRESS) == 0) {
+            if (strcmp(value, COMPRESS_CODEC) != 0) {
+                return FALSE;
+            }
+            session->compress = TRUE;
+            return TRUE; // a frame without body
+        }
+        else if (strcmp(line, HEADER_KEY_COMPRESSED) == 0) {
+            packed_size = atoi(value);
+        }
+        else if (strcmp(line, HEADER_KEY_TRACE) == 0 && session->trace_handler != NULL) {
+            session->trace_handler(session, value);
         }
-        if (*p == '\n') { // if empty line
+        if (eol == NULL) {
             break;
         }
-        read_header(read_buf, headers + pos);
-        if (pos > MAX_HEADER) {
-            fprintf(stderr, "ERROR: too many headers\n");
-            exit(1);
+        line = eol + 1;
+    }
+    if (*finished) {
+        return TRUE;
+    }
+    if (credit >= 0) {
+        if (channel == NULL || strcmp(channel, "in") != 0) {
+            return FALSE;
         }
-        pos++;
+        session->stdin_credit += credit;
+        return TRUE;
+    }
+    if (ring_position >= 0) {
+        return channel != NULL && session->shm != NULL
+            && shm_drain(session->shm, session, channel, ring_position, handler);
     }
-    return pos;
+    if (channel == NULL || size < 0 || strlen(channel) >= sizeof(session->channel)) {
+        return FALSE;
+    }
+    if (packed_size >= 0 && (!session->compress || size == 0 || size > COMPRESS_MAX_FRAME_SIZE
+                             || packed_size == 0 || packed_size > LZ4_MAX_COMPRESSED_SIZE(size))) {
+        return FALSE;
+    }
+    strcpy(session->channel, channel);
+    session->chunk_remained = size;
+    session->chunk_packed = (packed_size > 0) ? packed_size : 0;
+    return TRUE;
 }
 
 /*
- * find header value.
+ * Dispatch a fragment of the current chunk to the handler.
  */
-static char* find_header(struct header_t headers[], const char* key, int header_size)
+static void dispatch_chunk(struct session_t* session, chunk_handler_t handler, const char* data, int size)
 {
-    int i;
-    for (i = 0; i < header_size; i++) {
-        if (strcmp(headers[i].key, key) == 0) {
-            return headers[i].value;
-        }
+    handler(session, session->channel, data, size);
+    if (session->window > 0) {
+        *((strcmp(session->channel, "err") == 0) ? &session->err_consumed : &session->out_consumed) += size;
     }
-    return NULL;
-}
-
-static int min_int(int a,int b) {
-    return (a < b) ? a : b;
+    session->chunk_remained -= size;
 }
 
 /*
- * Receive a chunk, and write it to stdout or stderr.
+ * Decompress the whole body of the current chunk and dispatch it at once.
  */
-static int receive_from_server(int socket, char* channel, int size)
+static BOOL unpack_chunk(struct session_t* session, chunk_handler_t handler, const char* data)
 {
-    // select output stream
-    int output_fd;
-    if (strcmp(channel, "out") == 0) {
-        output_fd = fileno(stdout);
-    }
-    else if (strcmp(channel, "err") == 0) {
-        output_fd = fileno(stderr);
-    }
-    else {
-        fprintf(stderr, "ERROR: unrecognized stream channel: %s\n", channel);
-        exit(1);
-    }
-
-    // copy to stream
-    char read_buf[BUFFER_SIZE];
-    int remained_size = size;
-    int ret;
-    while (min_int(remained_size, BUFFER_SIZE) > 0 && (ret = recv(socket, read_buf, min_int(remained_size, BUFFER_SIZE), 0)) > 0) {
-        write(output_fd, read_buf, ret);
-        remained_size -= ret;
-#ifdef DEBUG
-        fprintf(stderr, "DEBUG: read and write from server: %d (remained: %d)\n", ret, min_int(remained_size, BUFFER_SIZE));
-#endif
+    if (session->unpack_buf == NULL && (session->unpack_buf = malloc(COMPRESS_MAX_FRAME_SIZE)) == NULL) {
+        return FALSE;
     }
-    return 0;
+    clock_t started = clock();
+    int size = lz4_decompress(data, session->chunk_packed, session->unpack_buf, COMPRESS_MAX_FRAME_SIZE);
+    session->compress_micros += cpu_micros_since(started);
+    if (size != session->chunk_remained) {
+        return FALSE;
+    }
+    session->raw_bytes += size;
+    session->wire_bytes += session->chunk_packed;
+    session->chunk_packed = 0;
+    dispatch_chunk(session, handler, session->unpack_buf, size);
+    return TRUE;
 }
 
 /*
- * Copy data from stdin and send it to the server.
+ * Return credits of output written out to the server in a lump.
+ * An error is ignored because the server may have finished already.
  */
-static int send_to_server(int fd)
+static void grant_credits(struct session_t* session)
 {
-    char read_buf[BUFFER_SIZE+1];
-    int ret;
-
-    if ((ret = read(fileno(stdin), read_buf, BUFFER_SIZE)) == -1){ // TODO buffering
-        perror("ERROR: could not read standard input");
-        exit(1);
+    if (session->window == 0) {
+        return;
     }
-    read_buf[ret] = '\0';
-#ifdef DEBUG
-        fprintf(stderr, "DEBUG: read from stdin: %s (size:%zu)\n", read_buf, strlen(read_buf));
-#endif
-
-    char write_buf[BUFFER_SIZE];
-    sprintf(write_buf, "Size: %d\n\n", ret); // TODO: check size
-#ifdef WINDOWS
-    send(fd, write_buf, strlen(write_buf), 0);
-    send(fd, read_buf, ret, 0);
-#else
-    write(fd, write_buf, strlen(write_buf));
-    write(fd, read_buf, ret);
-#endif
-
-    if (ret == 0) {
-        return 1;
+    if (session->out_consumed > 0 && session->out_consumed >= session->window / 2) {
+        send_credit(session->fd, "out", session->out_consumed);
+        session->out_consumed = 0;
     }
-    return 0;
-}
-
-#ifdef WINDOWS
-static void copy_stdin_to_socket(int fd)
-{
-    while (1) {
-        send_to_server(fd);
+    if (session->err_consumed > 0 && session->err_consumed >= session->window / 2) {
+        send_credit(session->fd, "err", session->err_consumed);
+        session->err_consumed = 0;
     }
 }
 
-static void invoke_thread(int fd)
-{
-    DWORD id = 1;
-    CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) copy_stdin_to_socket, (LPVOID)fd, 0, &id);
-}
-#endif
-
 /*
- * asynchronus input (select) with the stdin and the socket connection
- * to the server. copy input data from stdin to server, and
- * copy received data from the server to stdout/stderr.
- * destination of output is stdout or stderr are distinguished by
- * stream identifier(sid) header is 'out' or 'err'.
+ * Receive data which is available on the socket of the session, and
+ * dispatch chunks to the handler as soon as they are received.
+ * A chunk may be dispatched as several fragments.
+ *
+ * return SESSION_RUNNING while the session continues,
+ * SESSION_FINISHED when the exit status is received (see session->status),
+ * SESSION_CLOSED when the connection is closed between chunks without the exit status,
+ * or SESSION_BROKEN when the connection is broken or an invalid response is received.
  */
-int start_session(int fd)
+int session_receive(struct session_t* session, chunk_handler_t handler)
 {
-    struct header_t headers[MAX_HEADER];
-
-#ifdef WINDOWS
-    invoke_thread(fd);
-#else
-    fd_set read_set;
-    int ret;
-    int stdin_closed = 0;
-#endif
-
-    while (1) {
-#ifdef UNIX
-        // initialize the set of file descriptor
-        FD_ZERO(&read_set);
-
-        // watch stdin of client and socket.
-        FD_SET(STDIN_FILENO, &read_set);
-        FD_SET(fd, &read_set);
-
-        if ((ret = select(fd + 1, &read_set, (fd_set*)NULL, (fd_set*)NULL, NULL)) == -1) {
-            perror("ERROR: could not select I/O");
-            exit(1);
-        }
-        if (ret == 0) {
-            fprintf(stderr, "ERROR: could not receive return value (might timeout)\n");
-            continue;
+    if (session->in_capacity - session->in_size < BUFFER_SIZE) {
+        int capacity = (session->in_capacity == 0) ? BUFFER_SIZE * 8 : session->in_capacity * 2;
+        char* in_buf = realloc(session->in_buf, capacity);
+        if (in_buf == NULL) {
+            return SESSION_BROKEN;
         }
+        session->in_buf = in_buf;
+        session->in_capacity = capacity;
+    }
+    int ret = recv(session->fd, session->in_buf + session->in_size, session->in_capacity - session->in_size - 1, 0);
+    if (ret <= 0) {
+        return (ret == 0 && session->in_size == 0 && session->chunk_remained == 0) ? SESSION_CLOSED : SESSION_BROKEN;
+    }
+    if (session->capture_handler != NULL) {
+        session->capture_handler(session, session->in_buf + session->in_size, ret);
+    }
+    session->in_size += ret;
 
-        // detect changed descriptor
-        if (!stdin_closed && FD_ISSET(STDIN_FILENO, &read_set)) { // stdin
-#ifdef DEBUG
-            fprintf(stderr, "DEBUG: detect stdin\n");
-#endif
-            stdin_closed = send_to_server(fd);
+    int pos = 0;
+    int finished = FALSE;
+    while (pos < session->in_size) {
+        if (session->chunk_packed > 0) {
+            if (session->in_size - pos < session->chunk_packed) {
+                break; // wait for the rest of the compressed body
+            }
+            int packed_size = session->chunk_packed;
+            if (!unpack_chunk(session, handler, session->in_buf + pos)) {
+                return SESSION_BROKEN;
+            }
+            pos += packed_size;
             continue;
         }
-        if (FD_ISSET(fd, &read_set) == FALSE){ // socket
-#ifdef DEBUG
-            fprintf(stderr, "DEBUG: detect nothing\n");
-#endif
+        if (session->chunk_remained > 0) {
+            int size = min_int(session->chunk_remained, session->in_size - pos);
+            dispatch_chunk(session, handler, session->in_buf + pos, size);
+            pos += size;
             continue;
         }
-#ifdef DEBUG
-        fprintf(stderr, "DEBUG: detect socket\n");
-#endif
-#endif
-
-        int size = read_headers(fd, headers);
-        if (size == 0) {
-            return 0; // as normal exit if header size 0
-        }
-
-        // Process exit
-        char* status = find_header(headers, HEADER_KEY_STATUS, size);
-        if (status != NULL) {
-            int stat = atoi(status);
-            return stat;
-        }
-
-        // Dispatch data from server to stdout/err.
-        char* sid = find_header(headers, HEADER_KEY_CHANNEL, size);
-        if (sid == NULL) {
-            fprintf(stderr, "ERROR: required header %s not found\n", HEADER_KEY_CHANNEL);
-            return 1;
+        session->in_buf[session->in_size] = '\0';
+        char* end = strstr(session->in_buf + pos, "\n\n");
+        if (end == NULL) {
+            if (memchr(session->in_buf + pos, '\0', session->in_size - pos) != NULL) {
+                return SESSION_BROKEN; // binary data where a header is expected
+            }
+            break; // wait for the rest of the header
         }
-        char* chunk_size = find_header(headers, HEADER_KEY_SIZE, size);
-        if (chunk_size == NULL) {
-            fprintf(stderr, "ERROR: required header %s not found\n", HEADER_KEY_SIZE);
-            return 1;
+        *end = '\0';
+        if (!parse_frame_header(session, session->in_buf + pos, &finished, handler)) {
+            return SESSION_BROKEN;
         }
-        if (receive_from_server(fd, sid, atoi(chunk_size)) == EOF) {
-            return 0;
+        pos = end + 2 - session->in_buf;
+        if (finished) {
+            return SESSION_FINISHED;
         }
     }
+
+    // keep only an incomplete header
+    memmove(session->in_buf, session->in_buf + pos, session->in_size - pos);
+    session->in_size -= pos;
+    grant_credits(session);
+    return SESSION_RUNNING;
 }
@@ -17,19 +17,111 @@
 #ifndef _SESSION_H
 #define _SESSION_H
 
+#include <stdio.h>
+
+#include "config.h"
+
+#ifdef WINDOWS
+#include <winsock2.h>
+#else
+#include <netinet/in.h> // sockaddr_in
+#endif
+
+#include "bool.h"
+#include "buf.h"
+
 #define BUFFER_SIZE 512
 
 #define MAX_HEADER_KEY_LEN 30
-#define MAX_HEADER_VALUE_LEN 512
-#define MAX_HEADER 10
 
-struct header_t {
-    char key[MAX_HEADER_KEY_LEN + 1];
-    char value[MAX_HEADER_VALUE_LEN + 1];
+// a compressed frame has no more than this size of data.
+// a smaller one is sent raw because compression costs more than it saves.
+#define COMPRESS_MAX_FRAME_SIZE (64 * 1024)
+#define COMPRESS_MIN_FRAME_SIZE 512
+#define COMPRESS_CODEC "lz4"
+
+// results of open_socket() other than a connected socket
+#define OPEN_SOCKET_REFUSED -1
+#define OPEN_SOCKET_FAILED -2
+
+// an address of the server, which is resolved once for many connections
+struct server_addr_t {
+    struct sockaddr_in addr;
 };
 
+struct invocation_t {
+    int argc;
+    char** argv;    // argv[0] is ignored as well as main()
+    char* cwd;      // current working directory is used if NULL
+    char** envs;    // NULL terminated "NAME=VALUE" envvars (optional)
+    char* classpath; // CLASSPATH envvar is used if NULL
+    char* command;  // "shell" or "watch" to start a shell or watch session (optional)
+    BOOL trace;     // request timings of phases on the server
+    char* shm;      // "<path> <capacity>" of rings to receive output through (optional)
+    int window;     // initial credit of each output channel for flow control, or 0
+    char* priority; // "interactive" or "batch" to be scheduled on the server (optional)
+    char* compress; // "lz4" to compress stream frames in both directions (optional)
+    BOOL env_all;   // pass all envvars of the process
+    char** env_includes; // NULL terminated substrings of names of envvars of the process to pass (optional)
+    char** env_excludes; // NULL terminated substrings of names not to pass even if included (optional)
+};
+
+#define SESSION_RUNNING 0
+#define SESSION_FINISHED 1
+#define SESSION_CLOSED 2
+#define SESSION_BROKEN -1
+
+struct session_t;
+struct shm_t;
+struct lz4_t;
+
+typedef void (*eval_handler_t)(struct session_t* session, int status);
+typedef void (*trace_handler_t)(struct session_t* session, const char* entry);
+typedef void (*capture_handler_t)(struct session_t* session, const char* data, int size);
+
+struct session_t {
+    int fd;
+    char* in_buf;
+    int in_size;
+    int in_capacity;
+    char channel[MAX_HEADER_KEY_LEN + 1];
+    int chunk_remained;
+    int status;
+    eval_handler_t eval_handler;  // called for each EvalStatus in a shell or watch session (optional)
+    trace_handler_t trace_handler; // called for each Trace with the exit status (optional)
+    capture_handler_t capture_handler; // called for raw bytes as received before parsed (optional)
+    struct shm_t* shm;            // rings of output shared with the server (optional)
+    int window;                   // not 0 when flow control is requested
+    long long stdin_credit;       // size of stdin which can be sent with flow control
+    int out_consumed;             // size of output written out but not granted yet
+    int err_consumed;
+    BOOL compress;                // TRUE after the server accepts compression
+    int chunk_packed;             // size of the compressed body of the current chunk, or 0
+    struct lz4_t* lz4;            // buffers of compression, allocated when used
+    char* pack_buf;               // to send stdin
+    char* unpack_buf;             // to receive output
+    long long raw_bytes;          // sizes of frames compressed or decompressed
+    long long wire_bytes;
+    long long compress_micros;    // CPU time to compress and decompress
+    void* data;
+};
+
+typedef void (*chunk_handler_t)(struct session_t* session, const char* channel, const char* data, int size);
+
+int resolve_server(const char* host, int port, struct server_addr_t* server);
+int connect_server_addr(const struct server_addr_t* server);
 int open_socket(char* server_name, int server_port);
-void send_header(int fd, int argc, char** argv, char* authtoken);
-int start_session(int fd);
+BOOL make_header(buf* read_buf, int argc, char** argv, char* authtoken);
+BOOL make_invocation_header(buf* read_buf, struct invocation_t* invocation, char* authtoken);
+BOOL send_fully(int fd, const char* data, int size);
+BOOL send_header(int fd, int argc, char** argv, char* authtoken);
+BOOL send_invocation_header(int fd, struct invocation_t* invocation, char* authtoken);
+BOOL send_stdin_chunk(int fd, const char* data, int size);
+BOOL send_stdin_frames(struct session_t* session, const char* data, int size);
+BOOL send_eval_request(int fd, const char* source, int size);
+BOOL send_credit(int fd, const char* channel, int size);
+void session_init(struct session_t* session, int fd, void* data);
+void session_delete(struct session_t* session);
+int session_receive(struct session_t* session, chunk_handler_t handler);
 
 #endif
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SHA256_H
+#define _SHA256_H
+
+#include <stddef.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+struct sha256_t {
+    unsigned int state[8];
+    unsigned long long length;
+    unsigned char block[64];
+    int block_size;
+};
+
+void sha256_init(struct sha256_t* ctx);
+void sha256_update(struct sha256_t* ctx, const void* data, size_t size);
+void sha256_final(struct sha256_t* ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+void sha256_final_hex(struct sha256_t* ctx, char hex[SHA256_HEX_SIZE]);
+
+#endif
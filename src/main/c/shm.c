@@ -0,0 +1,154 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef WINDOWS
+#include <sys/mman.h>
+#endif
+
+#include "bool.h"
+#include "session.h"
+#include "shm.h"
+
+#define MAX_CREATE_RETRY 16
+
+#ifdef WINDOWS
+
+struct shm_t* shm_create(int capacity)
+{
+    return NULL; // not supported
+}
+
+void shm_delete(struct shm_t* shm)
+{
+}
+
+BOOL shm_drain(struct shm_t* shm, struct session_t* session, const char* channel, long long position, chunk_handler_t handler)
+{
+    return FALSE;
+}
+
+#else
+
+static BOOL is_power_of_2(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+static int create_file(struct shm_t* shm)
+{
+    static int counter = 0;
+    int i;
+    for (i = 0; i < MAX_CREATE_RETRY; i++) {
+        snprintf(shm->path, sizeof(shm->path), "%s/.groovy/groovyserv/shm-%d-%d", getenv("HOME"), (int) getpid(), counter++);
+        int fd = open(shm->path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0 || errno != EEXIST) {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Create a file of rings to receive output from a server on the same host,
+ * and map it. The server maps the file named by shm->spec and removes it.
+ * return NULL if it fails, and then output should be received via socket.
+ */
+struct shm_t* shm_create(int capacity)
+{
+    if (!is_power_of_2(capacity) || capacity > SHM_MAX_CAPACITY) {
+        return NULL;
+    }
+    struct shm_t* shm = calloc(1, sizeof(struct shm_t));
+    if (shm == NULL) {
+        return NULL;
+    }
+    int fd = create_file(shm);
+    if (fd < 0) {
+        free(shm);
+        return NULL;
+    }
+    shm->capacity = capacity;
+    shm->size = 2 * ((long long) SHM_CONTROL_SIZE + capacity);
+    if (ftruncate(fd, shm->size) != 0
+        || (shm->base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        unlink(shm->path);
+        free(shm);
+        return NULL;
+    }
+    close(fd); // the mapping is kept
+
+    shm->out.tail = (volatile long long*) shm->base;
+    shm->out.data = shm->base + SHM_CONTROL_SIZE;
+    shm->err.tail = (volatile long long*) (shm->base + SHM_CONTROL_SIZE + capacity);
+    shm->err.data = shm->base + SHM_CONTROL_SIZE * 2 + capacity;
+    snprintf(shm->spec, sizeof(shm->spec), "%s %d", shm->path, capacity);
+    return shm;
+}
+
+void shm_delete(struct shm_t* shm)
+{
+    if (shm == NULL) {
+        return;
+    }
+    unlink(shm->path); // usually already removed by server
+    munmap(shm->base, shm->size);
+    free(shm);
+}
+
+/*
+ * Dispatch data of the channel up to the position written by the server,
+ * and release the space for the server.
+ * return FALSE if the position is invalid.
+ */
+BOOL shm_drain(struct shm_t* shm, struct session_t* session, const char* channel, long long position, chunk_handler_t handler)
+{
+    struct shm_ring_t* ring;
+    if (strcmp(channel, "out") == 0) {
+        ring = &shm->out;
+    } else if (strcmp(channel, "err") == 0) {
+        ring = &shm->err;
+    } else {
+        return FALSE;
+    }
+
+    long long tail = *ring->tail;
+    if (position < tail || position - tail > shm->capacity) {
+        return FALSE;
+    }
+    while (tail < position) {
+        int index = (int) (tail & (shm->capacity - 1));
+        int size = (int) ((position - tail < shm->capacity - index) ? position - tail : shm->capacity - index);
+        handler(session, channel, ring->data + index, size);
+        tail += size;
+    }
+    __sync_synchronize(); // the data must be read before the server reuses the space
+    *ring->tail = tail;
+    return TRUE;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include <sys/param.h>
+
+#include "bool.h"
+#include "session.h"
+
+/*
+ * Layout of a file shared with a server on the same host:
+ *
+ *   [ring of 'out'][ring of 'err']
+ *
+ * where each ring is a control block of SHM_CONTROL_SIZE bytes, of which
+ * the first 8 bytes are the tail (read position) in native byte order,
+ * followed by data of the capacity. The capacity must be a power of 2.
+ */
+#define SHM_CONTROL_SIZE 64
+#define SHM_DEFAULT_CAPACITY (4 * 1024 * 1024)
+#define SHM_MAX_CAPACITY (64 * 1024 * 1024)
+#define SHM_SPEC_SIZE (MAXPATHLEN + 32)
+
+struct shm_ring_t {
+    volatile long long* tail;   // written only by client
+    char* data;
+};
+
+struct shm_t {
+    char spec[SHM_SPEC_SIZE];   // "<path> <capacity>" to send as a header
+    char path[MAXPATHLEN];
+    char* base;
+    long long size;
+    int capacity;
+    struct shm_ring_t out;
+    struct shm_ring_t err;
+};
+
+struct shm_t* shm_create(int capacity);
+void shm_delete(struct shm_t* shm);
+BOOL shm_drain(struct shm_t* shm, struct session_t* session, const char* channel, long long position, chunk_handler_t handler);
+
+#endif
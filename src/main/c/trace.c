@@ -0,0 +1,218 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "option.h"
+#include "trace.h"
+
+#define MAX_SERVER_PHASES 16
+#define MAX_PHASE_NAME_LEN 31
+
+struct phase_t {
+    char name[MAX_PHASE_NAME_LEN + 1];
+    long long start;    // microseconds
+    long long duration; // microseconds
+};
+
+static const struct {
+    const char* name;
+    enum trace_point from;
+    enum trace_point to;
+} client_phases[] = {
+    { "startup", TRACE_STARTED, TRACE_CONNECTING },
+    { "connect", TRACE_CONNECTING, TRACE_CONNECTED },
+    { "send", TRACE_CONNECTED, TRACE_REQUEST_SENT },
+    { "wait", TRACE_REQUEST_SENT, TRACE_FIRST_BYTE },
+    { "receive", TRACE_FIRST_BYTE, TRACE_EXITED },
+};
+
+static long long marks[TRACE_POINT_COUNT];  // 0 if not marked
+
+static struct phase_t server_phases[MAX_SERVER_PHASES];
+static int server_phase_count = 0;
+static long long server_cpu_time = -1;
+static long long server_allocated = -1;
+static long long compress_raw_bytes = -1; // -1 unless compression is requested
+static long long compress_wire_bytes = -1;
+static long long compress_micros = -1;
+
+static long long now_micros()
+{
+#ifdef WINDOWS
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/*
+ * Record the time of the point at the first time.
+ * It does nothing unless tracing is enabled by options.
+ */
+void trace_mark(enum trace_point point)
+{
+    if (!client_option.trace || marks[point] != 0) {
+        return;
+    }
+    marks[point] = now_micros();
+}
+
+/*
+ * Keep an entry of 'Trace' header which the server sends with the exit status.
+ */
+void trace_server_entry(const char* entry)
+{
+    char name[MAX_PHASE_NAME_LEN + 1];
+    long long first, second;
+    int count = sscanf(entry, "%31s %lld %lld", name, &first, &second);
+    if (count == 3 && server_phase_count < MAX_SERVER_PHASES) {
+        struct phase_t* phase = &server_phases[server_phase_count++];
+        strcpy(phase->name, name);
+        phase->start = first;
+        phase->duration = second;
+    }
+    else if (count == 2 && strcmp(name, "cpu-time") == 0) {
+        server_cpu_time = first;
+    }
+    else if (count == 2 && strcmp(name, "allocated") == 0) {
+        server_allocated = first;
+    }
+}
+
+/*
+ * Keep sizes of frames compressed or decompressed on the client and CPU time for them.
+ */
+void trace_compression(long long raw_bytes, long long wire_bytes, long long micros)
+{
+    compress_raw_bytes = raw_bytes;
+    compress_wire_bytes = wire_bytes;
+    compress_micros = micros;
+}
+
+static double compress_ratio()
+{
+    return (compress_raw_bytes > 0) ? (double) compress_wire_bytes / compress_raw_bytes : 1.0;
+}
+
+static long long elapsed(enum trace_point from, enum trace_point to)
+{
+    return (marks[from] == 0 || marks[to] == 0) ? -1 : marks[to] - marks[from];
+}
+
+static void print_summary(int status)
+{
+    int i;
+    fprintf(stderr, "TRACE: status %d, total %.3fms:", status, elapsed(TRACE_STARTED, TRACE_EXITED) / 1000.0);
+    for (i = 0; i < sizeof(client_phases) / sizeof(client_phases[0]); i++) {
+        long long duration = elapsed(client_phases[i].from, client_phases[i].to);
+        if (duration >= 0) {
+            fprintf(stderr, " %s %.3fms", client_phases[i].name, duration / 1000.0);
+        }
+    }
+    if (server_phase_count > 0) {
+        fprintf(stderr, "; server:");
+        for (i = 0; i < server_phase_count; i++) {
+            fprintf(stderr, " %s %.3fms", server_phases[i].name, server_phases[i].duration / 1000.0);
+        }
+    }
+    if (server_cpu_time >= 0) {
+        fprintf(stderr, " cpu-time %.3fms", server_cpu_time / 1000.0);
+    }
+    if (server_allocated >= 0) {
+        fprintf(stderr, " allocated %lld bytes", server_allocated);
+    }
+    if (compress_raw_bytes >= 0) {
+        fprintf(stderr, "; compress: ratio %.3f (%lld -> %lld bytes) cpu-time %.3fms",
+                compress_ratio(), compress_raw_bytes, compress_wire_bytes, compress_micros / 1000.0);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void write_event(FILE* fp, BOOL* first, const char* name, int pid, long long ts, long long duration)
+{
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": 1, \"ts\": %lld, \"dur\": %lld}",
+            *first ? "" : ",", name, pid, ts, duration);
+    *first = FALSE;
+}
+
+/*
+ * Write a timeline in Chrome trace event format, which can be opened by chrome://tracing.
+ * Timings on the server are placed from the time when connected to the server.
+ */
+static void write_chrome_trace(const char* path, int status)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: could not open trace file: %s\n", path);
+        return;
+    }
+    BOOL first = TRUE;
+    int i;
+    fprintf(fp, "{\n  \"traceEvents\": [");
+    fprintf(fp, "\n    {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"groovyclient\"}},");
+    fprintf(fp, "\n    {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 2, \"args\": {\"name\": \"groovyserver\"}},");
+    for (i = 0; i < sizeof(client_phases) / sizeof(client_phases[0]); i++) {
+        long long duration = elapsed(client_phases[i].from, client_phases[i].to);
+        if (duration >= 0) {
+            write_event(fp, &first, client_phases[i].name, 1, marks[client_phases[i].from] - marks[TRACE_STARTED], duration);
+        }
+    }
+    long long server_origin = elapsed(TRACE_STARTED, TRACE_CONNECTED);
+    for (i = 0; i < server_phase_count; i++) {
+        write_event(fp, &first, server_phases[i].name, 2, server_origin + server_phases[i].start, server_phases[i].duration);
+    }
+    fprintf(fp, "\n  ],\n  \"displayTimeUnit\": \"ms\",\n");
+    fprintf(fp, "  \"otherData\": {\"status\": %d, \"server.cpu-time.us\": %lld, \"server.allocated.bytes\": %lld",
+            status, server_cpu_time, server_allocated);
+    if (compress_raw_bytes >= 0) {
+        fprintf(fp, ", \"compress.raw.bytes\": %lld, \"compress.wire.bytes\": %lld, \"compress.ratio\": %.3f, \"compress.cpu-time.us\": %lld",
+                compress_raw_bytes, compress_wire_bytes, compress_ratio(), compress_micros);
+    }
+    fprintf(fp, "}\n}\n");
+    fclose(fp);
+}
+
+/*
+ * Report the timeline as a summary line to stderr, or to a file by -Ctrace-file.
+ */
+void trace_report(int status)
+{
+    if (!client_option.trace) {
+        return;
+    }
+    trace_mark(TRACE_EXITED);
+    if (client_option.trace_file != NULL) {
+        write_chrome_trace(client_option.trace_file, status);
+    } else {
+        print_summary(status);
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+enum trace_point {
+    TRACE_STARTED,
+    TRACE_CONNECTING,
+    TRACE_CONNECTED,
+    TRACE_REQUEST_SENT,
+    TRACE_FIRST_BYTE,
+    TRACE_EXITED,
+    TRACE_POINT_COUNT,
+};
+
+void trace_mark(enum trace_point point);
+void trace_server_entry(const char* entry);
+void trace_compression(long long raw_bytes, long long wire_bytes, long long micros);
+void trace_report(int status);
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Detection of changes of files for watch mode.
+ *
+ * A file is watched through its directory, because editors often replace
+ * a file by renaming a new one instead of writing it. On Linux, changes are
+ * notified by inotify through watch_fd(). Elsewhere watch_fd() is -1, and
+ * modification times and sizes are compared each time watch_check() is called.
+ * Files of a watched directory are compared one by one, because writing a file
+ * doesn't change the directory. Subdirectories aren't watched.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#ifdef WINDOWS
+#include <windows.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "bool.h"
+#include "watch.h"
+
+#define EVENT_BUFFER_SIZE 4096
+
+// FNV-1a to fold states of files into a stamp
+#define STAMP_SEED 14695981039346656037ULL
+#define STAMP_PRIME 1099511628211ULL
+
+struct watch_entry_t {
+    int wd;         // inotify watch of the directory, or -1 when polled
+    char* dir;
+    char* name;     // a name in the directory, a pattern like "*.groovy", or NULL for any
+    unsigned long long stamp; // of the file, or the matching files in the directory; when polled
+};
+
+struct watch_t {
+    int fd;         // inotify instance, or -1 when polled
+    struct watch_entry_t* entries;
+    int count;
+    long long settle_at; // milliseconds when the last change settles, or 0 if no change
+};
+
+static long long now_millis()
+{
+#ifdef WINDOWS
+    return GetTickCount();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+struct watch_t* watch_new()
+{
+    struct watch_t* watch = calloc(1, sizeof(struct watch_t));
+    if (watch == NULL) {
+        return NULL;
+    }
+#ifdef __linux__
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+    watch->fd = -1;
+#endif
+    return watch;
+}
+
+void watch_delete(struct watch_t* watch)
+{
+    int i;
+    if (watch == NULL) {
+        return;
+    }
+    for (i = 0; i < watch->count; i++) {
+        free(watch->entries[i].dir);
+        free(watch->entries[i].name);
+    }
+    free(watch->entries);
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+    free(watch);
+}
+
+static BOOL matches(struct watch_entry_t* entry, const char* name)
+{
+    if (entry->name == WATCH_ANY) {
+        return TRUE;
+    }
+    if (entry->name[0] == '*') {
+        int name_len = strlen(name);
+        int suffix_len = strlen(entry->name + 1);
+        return name_len >= suffix_len && strcmp(name + name_len - suffix_len, entry->name + 1) == 0;
+    }
+    return strcmp(entry->name, name) == 0;
+}
+
+static unsigned long long stamp_bytes(unsigned long long stamp, const void* data, size_t size)
+{
+    const unsigned char* p = data;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        stamp = (stamp ^ p[i]) * STAMP_PRIME;
+    }
+    return stamp;
+}
+
+/*
+ * A file which doesn't exist is taken as the one of time 0 and size -1.
+ */
+static unsigned long long stamp_file(const char* path, const char* name)
+{
+    struct stat st;
+    long long state[2] = { 0, -1 };
+    if (stat(path, &st) == 0) {
+        state[0] = st.st_mtime;
+        state[1] = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+    }
+    unsigned long long stamp = stamp_bytes(STAMP_SEED, state, sizeof(state));
+    return (name != NULL) ? stamp_bytes(stamp, name, strlen(name)) : stamp;
+}
+
+/*
+ * return TRUE if the modification time or the size is changed since the last check.
+ * Stamps of files in a directory are summed up not to depend on their order.
+ */
+static BOOL poll_entry(struct watch_entry_t* entry)
+{
+    char path[MAXPATHLEN];
+    unsigned long long stamp;
+    if (entry->name != WATCH_ANY && entry->name[0] != '*') {
+        snprintf(path, sizeof(path), "%s/%s", entry->dir, entry->name);
+        stamp = stamp_file(path, NULL);
+    } else {
+        stamp = 0; // files added or removed are found by their names
+        DIR* dir = opendir(entry->dir);
+        if (dir != NULL) {
+            struct dirent* ent;
+            while ((ent = readdir(dir)) != NULL) {
+                if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0 || !matches(entry, ent->d_name)) {
+                    continue;
+                }
+                snprintf(path, sizeof(path), "%s/%s", entry->dir, ent->d_name);
+                stamp += stamp_file(path, ent->d_name);
+            }
+            closedir(dir);
+        }
+    }
+    BOOL changed = (stamp != entry->stamp);
+    entry->stamp = stamp;
+    return changed;
+}
+
+static BOOL add_entry(struct watch_t* watch, const char* dir, int dir_len, const char* name)
+{
+    struct watch_entry_t* entries = realloc(watch->entries, sizeof(struct watch_entry_t) * (watch->count + 1));
+    if (entries == NULL) {
+        return FALSE;
+    }
+    watch->entries = entries;
+
+    struct watch_entry_t* entry = &entries[watch->count];
+    memset(entry, 0, sizeof(struct watch_entry_t));
+    entry->wd = -1;
+    entry->dir = malloc(dir_len + 1);
+    entry->name = (name != NULL) ? strdup(name) : NULL;
+    if (entry->dir == NULL || (name != NULL && entry->name == NULL)) {
+        free(entry->dir);
+        free(entry->name);
+        return FALSE;
+    }
+    memcpy(entry->dir, dir, dir_len);
+    entry->dir[dir_len] = '\0';
+
+    struct stat st;
+    if (stat(entry->dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        free(entry->dir);
+        free(entry->name);
+        return FALSE;
+    }
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        // the same directory gets the same watch descriptor
+        entry->wd = inotify_add_watch(watch->fd, entry->dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+        if (entry->wd < 0) {
+            free(entry->dir);
+            free(entry->name);
+            return FALSE;
+        }
+    }
+#endif
+    poll_entry(entry); // as the initial state
+    watch->count++;
+    return TRUE;
+}
+
+/*
+ * Watch a file, which doesn't have to exist yet but its directory does.
+ * return FALSE if it cannot be watched.
+ */
+BOOL watch_add_file(struct watch_t* watch, const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        return add_entry(watch, ".", 1, path);
+    }
+    if (slash[1] == '\0') {
+        return FALSE; // not a file
+    }
+    return add_entry(watch, path, (slash == path) ? 1 : slash - path, slash + 1);
+}
+
+/*
+ * Watch files of the pattern in a directory. The pattern is WATCH_ANY or "*.<extension>".
+ * return FALSE if it cannot be watched.
+ */
+BOOL watch_add_dir(struct watch_t* watch, const char* path, const char* pattern)
+{
+    return add_entry(watch, path, strlen(path), pattern);
+}
+
+/*
+ * the descriptor to select for reading, which becomes readable when any change
+ * may have happened. -1 means that watch_check() must be called after watch_timeout().
+ */
+int watch_fd(struct watch_t* watch)
+{
+    return watch->fd;
+}
+
+#ifdef __linux__
+static BOOL read_events(struct watch_t* watch)
+{
+    char buf[EVENT_BUFFER_SIZE] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    BOOL changed = FALSE;
+    int len;
+    while ((len = read(watch->fd, buf, sizeof(buf))) > 0) {
+        char* p;
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event*) p)->len) {
+            struct inotify_event* event = (struct inotify_event*) p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed = TRUE; // some events are lost
+                continue;
+            }
+            int i;
+            for (i = 0; i < watch->count && !changed; i++) {
+                changed = (watch->entries[i].wd == event->wd && event->len > 0 && matches(&watch->entries[i], event->name));
+            }
+        }
+    }
+    return changed;
+}
+#endif
+
+static BOOL poll_entries(struct watch_t* watch)
+{
+    BOOL changed = FALSE;
+    int i;
+    for (i = 0; i < watch->count; i++) {
+        changed |= poll_entry(&watch->entries[i]);
+    }
+    return changed;
+}
+
+/*
+ * Look for changes since the last check without blocking. It should be called
+ * when watch_fd() is readable, or when watch_timeout() has passed.
+ */
+void watch_check(struct watch_t* watch)
+{
+#ifdef __linux__
+    BOOL changed = (watch->fd >= 0) ? read_events(watch) : poll_entries(watch);
+#else
+    BOOL changed = poll_entries(watch);
+#endif
+    if (changed) {
+        watch->settle_at = now_millis() + WATCH_SETTLE_MILLIS;
+    }
+}
+
+/*
+ * milliseconds to wait for watch_fd() before calling watch_check() or watch_settled(),
+ * or -1 for no timeout.
+ */
+int watch_timeout(struct watch_t* watch)
+{
+    if (watch->settle_at > 0) {
+        long long remained = watch->settle_at - now_millis();
+        return (remained > 0) ? (int) remained : 0;
+    }
+    return (watch->fd >= 0) ? -1 : WATCH_POLL_MILLIS;
+}
+
+/*
+ * return TRUE once when changes have been found and no more change comes
+ * within WATCH_SETTLE_MILLIS.
+ */
+BOOL watch_settled(struct watch_t* watch)
+{
+    if (watch->settle_at == 0 || now_millis() < watch->settle_at) {
+        return FALSE;
+    }
+    watch->settle_at = 0;
+    return TRUE;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include "bool.h"
+
+// events which come within this time after a change are taken as the same change,
+// like ones of an editor which writes a temporary file and renames it.
+#define WATCH_SETTLE_MILLIS 20
+
+// interval to check modification times where inotify isn't available
+#define WATCH_POLL_MILLIS 200
+
+// a pattern of names to watch in a directory
+#define WATCH_ANY NULL
+#define WATCH_SOURCES "*.groovy"
+
+struct watch_t;
+
+struct watch_t* watch_new();
+void watch_delete(struct watch_t* watch);
+BOOL watch_add_file(struct watch_t* watch, const char* path);
+BOOL watch_add_dir(struct watch_t* watch, const char* path, const char* pattern);
+int watch_fd(struct watch_t* watch);
+void watch_check(struct watch_t* watch);
+int watch_timeout(struct watch_t* watch);
+BOOL watch_settled(struct watch_t* watch);
+
+#endif
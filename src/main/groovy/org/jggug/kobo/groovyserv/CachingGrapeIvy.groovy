@@ -0,0 +1,87 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import groovy.grape.GrapeIvy
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+/**
+ * GrapeIvy which looks up GrapeResolutionCache before resolving by Ivy.
+ * Only resolution is cached. Adding jars to a class loader and registering
+ * extension modules of them are done by GrapeIvy#grab() as usual.
+ *
+ * This class is loaded only by GrapeResolutionCache#install(), because it needs Ivy.
+ */
+class CachingGrapeIvy extends GrapeIvy {
+
+    private static final List<String> VOLATILE_ARGS = ['calleeDepth', 'classLoader', 'refObject']
+
+    private final Set<String> resolvers = new TreeSet<String>()
+
+    @Override
+    void addResolver(Map<String, Object> args) {
+        super.addResolver(args)
+        synchronized (resolvers) {
+            resolvers << new TreeMap(args).toString()
+        }
+    }
+
+    @Override
+    URI[] resolve(ClassLoader loader, Map args, List depsInfo, Map... dependencies) {
+        if (depsInfo != null) { // a report is required
+            return super.resolve(loader, args, depsInfo, dependencies)
+        }
+        def records = dependencies.collect { createGrabRecord(it) }
+        if (records.any { it.changing }) {
+            return super.resolve(loader, args, depsInfo, dependencies)
+        }
+        def localDeps = getLoadedDepsForLoader(loader)
+        String key = keyOf(args, localDeps + records)
+        def uris = GrapeResolutionCache.instance.get(key)
+        if (uris == null) {
+            uris = resolveByIvy(loader, args, dependencies) as List<URI>
+            GrapeResolutionCache.instance.put(key, uris)
+            return uris as URI[]
+        }
+        LogUtils.debugLog "Grapes are resolved by cache: ${records*.mrid}"
+        // the same bookkeeping as GrapeIvy#resolve() for following grabs into the loader
+        grabRecordsForCurrDependencies.addAll(records)
+        localDeps.addAll(records)
+        return uris as URI[]
+    }
+
+    protected URI[] resolveByIvy(ClassLoader loader, Map args, Map... dependencies) {
+        super.resolve(loader, args, null, dependencies)
+    }
+
+    private String keyOf(Map args, Collection records) {
+        def grabArgs = new TreeMap(args.findAll { key, value -> !(key in VOLATILE_ARGS) })
+        def deps = records.collect { "${it.mrid}:${it.conf}:${it.classifier}:${it.ext}:${it.type}:${it.transitive}:${it.force}" }.sort()
+        List<String> resolverList
+        synchronized (resolvers) {
+            resolverList = resolvers.toList()
+        }
+        [grabArgs, deps, resolverList, configState()].join('|')
+    }
+
+    /**
+     * Resolution depends on grapeConfig.xml and the grape root, which is the local repository.
+     */
+    private static String configState() {
+        def config = new File(System.getProperty('grape.config') ?: "${System.getProperty('user.home')}/.groovy/grapeConfig.xml")
+        "${config.path}:${config.lastModified()}:${config.length()}:${System.getProperty('grape.root')}"
+    }
+}
@@ -20,18 +20,29 @@ import org.jggug.kobo.groovyserv.exception.GServIOException
 import org.jggug.kobo.groovyserv.exception.GServIllegalStateException
 import org.jggug.kobo.groovyserv.exception.InvalidAuthTokenException
 import org.jggug.kobo.groovyserv.exception.InvalidRequestHeaderException
+import org.jggug.kobo.groovyserv.stream.FrameCodec
 import org.jggug.kobo.groovyserv.stream.StreamRequestInputStream
+import org.jggug.kobo.groovyserv.stream.OutputWindow
+import org.jggug.kobo.groovyserv.stream.SharedMemoryRing
+import org.jggug.kobo.groovyserv.stream.SpillBuffer
+import org.jggug.kobo.groovyserv.stream.StandardStreams
 import org.jggug.kobo.groovyserv.stream.StreamResponseOutputStream
 import org.jggug.kobo.groovyserv.utils.LogUtils
 import org.jggug.kobo.groovyserv.utils.Holders
 import org.jggug.kobo.groovyserv.utils.IOUtils
 
+import java.util.concurrent.BlockingQueue
+import java.util.concurrent.LinkedBlockingQueue
+
 /**
  * @author NAKANO Yasuharu
  */
 class ClientConnection implements Closeable {
 
     private static InheritableThreadLocal<ClientConnection> connectionHolder = new InheritableThreadLocal<ClientConnection>()
+    private static final Object END_OF_EVAL_REQUESTS = new Object()
+    private static final Object RERUN_REQUEST = new Object()
+    private static final int STDIN_BUFFER_SIZE = 64 * 1024 // also the credit of 'in' with flow control
 
     final AuthToken authToken
     Socket socket
@@ -39,10 +50,15 @@ class ClientConnection implements Closeable {
     private PipedOutputStream pipedOutputStream // to transfer from socket.inputStream
     private PipedInputStream pipedInputStream   // connected to socket.inputStream indirectly via pipedInputStream and used as System.in
     private OutputStream socketOutputStream
+    private PushbackInputStream socketInputStream // raw stream of socket, which can take back a byte probed
 
     private boolean closed = false
     boolean toreDownPipes = false
     private boolean silentExitStatus = false
+    private final Object frameLock = new Object() // to write frames from several threads, e.g. spilled output by granted credit
+    private long stdinConsumed = 0 // not granted to the client yet
+    private BlockingQueue evalRequests = new LinkedBlockingQueue()
+    InvocationTrace trace // null unless requested by client
 
     // They are used as System.xxx
     final InputStream ins
@@ -54,7 +70,7 @@ class ClientConnection implements Closeable {
         this.socket = socket
 
         this.pipedOutputStream = new PipedOutputStream()
-        this.pipedInputStream = new PipedInputStream(pipedOutputStream)
+        this.pipedInputStream = new PipedInputStream(pipedOutputStream, STDIN_BUFFER_SIZE)
         this.socketOutputStream = new BufferedOutputStream(socket.outputStream)
 
         this.ins = StreamRequestInputStream.newIn(pipedInputStream)
@@ -62,6 +78,7 @@ class ClientConnection implements Closeable {
         this.err = new PrintStream(StreamResponseOutputStream.newErr(socketOutputStream))
 
         connectionHolder.set(this)
+        StandardStreams.invalidateCache()
     }
 
     /**
@@ -79,9 +96,144 @@ class ClientConnection implements Closeable {
             this.out.out.noHeader = true
             this.err.out.noHeader = true
         }
+        else if (request.shm) {
+            def rings = SharedMemoryRing.map(request.shm)
+            if (rings) {
+                LogUtils.debugLog "Output is passed through shared memory: ${request.shm}"
+                this.out.out.ring = rings.out
+                this.err.out.ring = rings.err
+                this.out.out.frameLock = frameLock
+                this.err.out.frameLock = frameLock
+            }
+        }
+        if (request.compress == FrameCodec.LZ4 && !silentExitStatus && !this.out.out.ring) {
+            setUpCompression()
+        }
+        if (request.window > 0 && !silentExitStatus) {
+            setUpFlowControl(request.window)
+        }
         request
     }
 
+    /**
+     * To accept compression before any StreamResponse is sent.
+     * The client may send compressed StreamRequest after receiving CompressResponse.
+     */
+    private void setUpCompression() {
+        LogUtils.debugLog "Stream frames are compressed: ${FrameCodec.LZ4}"
+        this.out.out.codec = new FrameCodec()
+        this.err.out.codec = new FrameCodec()
+        try {
+            synchronized (frameLock) {
+                socketOutputStream.write(ClientProtocols.formatAsCompressHeader(FrameCodec.LZ4))
+                socketOutputStream.flush()
+            }
+        } catch (IOException e) {
+            throw new GServIOException("Failed to accept compression", e)
+        }
+    }
+
+    private void setUpFlowControl(int window) {
+        long spillSize = Holders.groovyServer?.spillSize ?: 0
+        LogUtils.debugLog "Flow control: window=${window}, spill=${spillSize}"
+        this.out.out.window = new OutputWindow('out', socketOutputStream, frameLock, window, spillSize ? new SpillBuffer(spillSize, WorkFiles.DATA_DIR) : null, this.out.out.codec)
+        this.err.out.window = new OutputWindow('err', socketOutputStream, frameLock, window, spillSize ? new SpillBuffer(spillSize, WorkFiles.DATA_DIR) : null, this.err.out.codec)
+        this.ins.onConsumed = { int size -> consumedStdin(size) }
+        sendCredit('in', STDIN_BUFFER_SIZE)
+    }
+
+    /**
+     * Requests are read from this stream instead of socket.inputStream, not to lose
+     * a byte read by {@link #isClientAlive()}.
+     */
+    synchronized InputStream getSocketInputStream() {
+        if (!socketInputStream) {
+            socketInputStream = new PushbackInputStream(socket.inputStream)
+        }
+        return socketInputStream
+    }
+
+    /**
+     * To probe whether the client is still connected while nobody reads the socket,
+     * e.g. a session waiting for admission. It's alive unless the end of stream is
+     * found within a moment.
+     */
+    synchronized boolean isClientAlive() {
+        if (closed || socket.closed || socket.inputShutdown) return false
+        def ins = (PushbackInputStream) getSocketInputStream()
+        try {
+            if (ins.available() > 0) return true
+            int timeout = socket.soTimeout
+            socket.soTimeout = 1
+            try {
+                int b = ins.read()
+                if (b == -1) return false
+                ins.unread(b)
+                return true
+            } catch (SocketTimeoutException e) {
+                return true
+            } finally {
+                socket.soTimeout = timeout
+            }
+        } catch (IOException e) {
+            LogUtils.debugLog "Client seems to be disconnected: ${e.message}"
+            return false
+        }
+    }
+
+    /**
+     * To pass the credit of CreditRequest to the window of the channel.
+     */
+    void grantCredit(String channel, long size) {
+        def window = (channel == 'out') ? out.out.window : err.out.window
+        window?.grant(size)
+    }
+
+    /**
+     * To grant the client credit of 'in' for the size read by a script.
+     * It's sent in a lump not to send a frame for each read.
+     */
+    private void consumedStdin(int size) {
+        synchronized (frameLock) {
+            stdinConsumed += size
+            if (stdinConsumed >= STDIN_BUFFER_SIZE / 2) {
+                sendCredit('in', stdinConsumed)
+                stdinConsumed = 0
+            }
+        }
+    }
+
+    private void sendCredit(String channel, long size) {
+        try {
+            synchronized (frameLock) {
+                socketOutputStream.write(ClientProtocols.formatAsCreditHeader(channel, size))
+                socketOutputStream.flush()
+            }
+        } catch (IOException e) {
+            throw new GServIOException("Failed to send credit", e)
+        }
+    }
+
+    /**
+     * To wait until output buffered for a slow client is sent.
+     */
+    private void awaitOutputDrained() {
+        try {
+            out.out.window?.awaitDrained()
+            err.out.window?.awaitDrained()
+        } catch (InterruptedException e) {
+            LogUtils.debugLog "Interrupted to wait for output drained"
+        }
+    }
+
+    /**
+     * To stop waiting for credit, when the client doesn't send CreditRequest any more.
+     */
+    void closeOutputWindows() {
+        out.out.window?.close()
+        err.out.window?.close()
+    }
+
     /**
      * @throws InvalidRequestHeaderException
      * @throws GServIOException
@@ -104,16 +256,78 @@ class ClientConnection implements Closeable {
         }
     }
 
+    /**
+     * To pass a code snippet of EvalRequest to a shell session.
+     */
+    void transferEvalRequest(String source) {
+        evalRequests.put(source)
+    }
+
+    /**
+     * To notify a shell or watch session that no more request comes.
+     */
+    void endEvalRequests() {
+        evalRequests.put(END_OF_EVAL_REQUESTS)
+    }
+
+    /**
+     * @return a code snippet, or null when no more EvalRequest comes
+     * @throws InterruptedException
+     */
+    String takeEvalRequest() {
+        def request = evalRequests.take()
+        return request.is(END_OF_EVAL_REQUESTS) ? null : request
+    }
+
+    /**
+     * To pass RerunRequest to a watch session.
+     */
+    void transferRerunRequest() {
+        evalRequests.put(RERUN_REQUEST)
+    }
+
+    /**
+     * @return true for RerunRequest, or false when no more RerunRequest comes
+     * @throws InterruptedException
+     */
+    boolean takeRerunRequest() {
+        evalRequests.take().is(RERUN_REQUEST)
+    }
+
+    /**
+     * @return true if RerunRequest has already come after the one taken last
+     */
+    boolean hasRerunRequest() {
+        RERUN_REQUEST.is(evalRequests.peek())
+    }
+
+    /**
+     * @throws GServIOException
+     */
+    void sendEvalStatus(int status) {
+        awaitOutputDrained() // output of the snippet must come before its status
+        try {
+            synchronized (frameLock) {
+                socketOutputStream.write(ClientProtocols.formatAsEvalStatusHeader(status))
+                socketOutputStream.flush()
+            }
+            LogUtils.debugLog "Sent eval status: ${status}"
+        } catch (IOException e) {
+            throw new GServIOException("Failed to send eval status", e)
+        }
+    }
+
     /**
      * @throws GServIOException
      */
     void sendExit(int status, String message = null) {
         if (silentExitStatus) return
+        awaitOutputDrained()
         try {
-            socketOutputStream.with { // not to close yet
-                def data = ClientProtocols.formatAsExitHeader(status, message)
-                write(data)
-                flush()
+            trace?.phase('drain')
+            synchronized (frameLock) { // not to close yet
+                socketOutputStream.write(ClientProtocols.formatAsExitHeader(status, message, trace?.entries))
+                socketOutputStream.flush()
             }
             LogUtils.debugLog "Sent exit status: ${status} ${message ? " with the message: $message" : ""}"
         } catch (IOException e) {
@@ -131,6 +345,7 @@ class ClientConnection implements Closeable {
             return
         }
         tearDownTransferringPipes()
+        closeOutputWindows()
         if (pipedInputStream) {
             IOUtils.close(pipedInputStream)
             LogUtils.debugLog "PipedInputStream is closed"
@@ -144,6 +359,7 @@ class ClientConnection implements Closeable {
             socket = null
         }
         connectionHolder.set(null)
+        StandardStreams.invalidateCache()
         closed = true
     }
 
@@ -169,7 +385,7 @@ class ClientConnection implements Closeable {
         toreDownPipes = true
     }
 
-    static getCurrentConnection() {
+    static ClientConnection getCurrentConnection() {
         def connection = connectionHolder.get()
         if (connection == null) {
             throw new GServIllegalStateException("Not found client connection: ${Thread.currentThread()}")
@@ -18,6 +18,7 @@ package org.jggug.kobo.groovyserv
 import org.jggug.kobo.groovyserv.exception.GServIOException
 import org.jggug.kobo.groovyserv.exception.InvalidAuthTokenException
 import org.jggug.kobo.groovyserv.exception.InvalidRequestHeaderException
+import org.jggug.kobo.groovyserv.stream.LimitedInputStream
 import org.jggug.kobo.groovyserv.utils.IOUtils
 import org.jggug.kobo.groovyserv.utils.LogUtils
 
@@ -35,6 +36,7 @@ import org.jggug.kobo.groovyserv.utils.LogUtils
  *    'Arg:' <arg2> LF
  *      :
  *    'Arg:' <argN> LF
+ *    'ArgStream:' <count> <size> LF
  *    'Env:' <env1>=<value1> LF
  *    'Env:' <env2>=<value2> LF
  *      :
@@ -42,32 +44,120 @@ import org.jggug.kobo.groovyserv.utils.LogUtils
  *    'Cp:' <classpath> LF
  *    'Auth:' <authToken> LF
  *    'Cmd:' <cmd> LF
+ *    'Trace:' 'on' LF
+ *    'Shm:' <path> <capacity> LF
+ *    'Window:' <window> LF
+ *    'Warmup:' 'on' LF
+ *    'Priority:' <priority> LF
+ *    'Client:' <client> LF
+ *    'Compress:' <codec> LF
  *    LF
+ *    ( ArgFrame ) *
  *
  *   where:
  *     <protocol> is a type of protocol, like 'simple'. (optional)
  *     <cwd> is current working directory. (optional)
  *     <arg1>,<arg2>..<argN> are commandline arguments which must be encoded by Base64. (optional)
+ *     <count> is the number of ArgFrame which follow the header part, and <size> is
+ *             their total size in bytes. They are commandline arguments after the
+ *             ones of 'Arg:', which a client sends instead of 'Arg:' when there are
+ *             many or large ones. (optional)
  *     <env1>,<env2>..<envN> are environment variable names which sent to the server. (optional)
  *     <value1>,<value2>..<valueN> are environment variable values which sent to the server. (optional)
  *     <classpath> is the value of environment variable CLASSPATH. (optional)
  *     <authToken> is authentication value which a request is from a valid user who invoked the server. (required)
  *     <cmd> is a command to operate a server from client via port. (optional)
+ *           'shell' starts a shell session which evaluates code snippets sent by
+ *           EvalRequest against the same binding, instead of invoking groovy.
+ *           'watch' starts a watch session which runs the script of the first
+ *           argument, and runs it again for each RerunRequest. Only sources changed
+ *           since the last run are recompiled.
+ *           'stats' responds live counters of the server as lines of "key: value"
+ *           in StreamResponse of 'out'.
+ *           'invalidate-grapes' clears resolved @Grab dependencies cached by the server.
+ *           'detach' invokes groovy as a job which runs without the client, and
+ *           responds the id of the job in StreamResponse of 'out'. stdin isn't read.
+ *           'job-status', 'job-log' and 'job-wait' take "<id>[:<offset>]" of a job
+ *           as the first argument. 'job-status' responds the state of the job.
+ *           'job-log' responds output of the job from <offset> as StreamResponse of
+ *           each channel, and 'job-wait' does it until the job finishes and responds
+ *           the exit status of the job. <offset> is the total size of output of
+ *           both channels to skip.
+ *     'Trace: on' requests timings of phases in InvocationResponse. (optional)
+ *     <path> is a file under ~/.groovy/groovyserv which has rings of 'out' and 'err'
+ *            of <capacity> bytes each. When the server can map it, output is
+ *            written to the rings and notified by RingResponse instead of
+ *            StreamResponse. (optional)
+ *     <window> enables credit-based flow control. The server sends StreamResponse
+ *              of each channel no more than the credit, which starts at <window>
+ *              bytes and is granted by CreditRequest. The client sends StreamRequest
+ *              no more than the credit of 'in' granted by CreditResponse. (optional)
+ *     'Warmup: on' marks a replay by the server itself, which runs at low priority
+ *                  and isn't recorded to the warm-up manifest. (optional)
+ *     <priority> is 'interactive' (default) or 'batch'. Sessions of each class run
+ *                concurrently up to the limit of the class, and a slot is shared
+ *                fairly among clients. (optional)
+ *     <client> identifies a client among ones from the same address, like the id of
+ *              the parent process of the native client, which is the shell running it.
+ *              Slots of each priority class are shared fairly by the address and it. (optional)
+ *     <codec> requests compression of stream frames in both directions. Only 'lz4',
+ *             which is the LZ4 block format, is available. The server accepts it by
+ *             CompressResponse, and the client must not compress frames before it. (optional)
  *     LF is line feed (0x0a, '\n').
  *
+ * ArgFrame ::=
+ *    <length> LF
+ *    <arg>
+ *
+ *   where:
+ *     <length> is the size of <arg> in bytes, in decimal.
+ *     <arg> is a raw byte sequence of a commandline argument, which isn't encoded.
+ *
  * StreamRequest ::=
  *    'Size:' <size> LF
+ *    'Compressed:' <compressed size> LF
  *    LF
  *    <body from STDIN>
  *
  *   where:
  *     <size> is the size of body to send to server.
  *            <size>==-1 means client exited.
+ *     <compressed size> is the size of body compressed by the negotiated codec,
+ *                       which is sent instead of the raw body. (optional)
  *     <body from STDIN> is byte sequence from standard input.
  *
+ * CreditRequest ::= (only with flow control)
+ *    'Channel:' <id> LF
+ *    'Credit:' <size> LF
+ *    LF
+ *
+ *   where:
+ *     <id> is 'out' or 'err'.
+ *     <size> is the size of data which the client has written out since the last grant.
+ *
+ * EvalRequest ::= (only in a shell session)
+ *    'Cmd: eval' LF
+ *    'Size:' <size> LF
+ *    LF
+ *    <code snippet>
+ *
+ *   where:
+ *     <size> is the size of the code snippet, which is evaluated in order.
+ *     A StreamRequest of <size>==0 ends the shell session.
+ *
+ * RerunRequest ::= (only in a watch session)
+ *    'Cmd: rerun' LF
+ *    LF
+ *
+ *   where:
+ *     The running script is superseded: its EvalResponse is sent as interrupted without
+ *     output following, and the script is run again. A StreamRequest of <size>==0
+ *     ends the watch session after the last run.
+ *
  * StreamResponse ::=
  *    'Channel:' <id> LF
  *    'Size:' <size> LF
+ *    'Compressed:' <compressed size> LF
  *    LF
  *    <body for STDERR/STDOUT>
  *
@@ -75,13 +165,54 @@ import org.jggug.kobo.groovyserv.utils.LogUtils
  *     <id> is 'out' or 'err', where 'out' means standard output of the program.
  *          'err' means standard error of the program.
  *     <size> is the size of chunk.
+ *     <compressed size> is the same as StreamRequest. A chunk of compressed
+ *                       StreamResponse is no more than 64KB. (optional)
  *     <body from STDERR/STDOUT> is byte sequence from standard output/error.
  *
+ * RingResponse ::=
+ *    'Channel:' <id> LF
+ *    'Ring:' <position> LF
+ *    LF
+ *
+ *   where:
+ *     <position> is the total size of data written to the ring of the channel,
+ *                which the client can read up to. The client releases the space
+ *                by advancing the tail of the ring.
+ *
+ * CompressResponse ::= (only with compression)
+ *    'Compress:' <codec> LF
+ *    LF
+ *
+ *   where:
+ *     <codec> is the requested one. It's sent just after InvocationRequest is accepted.
+ *
+ * CreditResponse ::= (only with flow control)
+ *    'Channel: in' LF
+ *    'Credit:' <size> LF
+ *    LF
+ *
+ *   where:
+ *     <size> is the size of stdin which the client can send additionally.
+ *            The first one is sent just after InvocationRequest is accepted.
+ *
  * InvocationResponse ::=
  *    'Status:' <status> LF
+ *    'Trace:' <phase> <start> <duration> LF
+ *    'Trace:' 'cpu-time' <duration> LF
+ *    'Trace:' 'allocated' <bytes> LF
  *
  *   where:
  *     <status> is exit status of invoked groovy script.
+ *     'Trace:' lines are sent only when requested. <start> and <duration>
+ *     are microseconds from accepting the connection.
+ *
+ * EvalResponse ::= (only in a shell or watch session)
+ *    'EvalStatus:' <status> LF
+ *    LF
+ *
+ *   where:
+ *     <status> is exit status of each EvalRequest, or each run of a watch session
+ *              in order, including the first one and superseded ones.
  *
  * </pre>
  *
@@ -92,15 +223,29 @@ class ClientProtocols {
 
     private final static String HEADER_CURRENT_WORKING_DIR = "Cwd"
     private final static String HEADER_ARG = "Arg"
+    private final static String HEADER_ARG_STREAM = "ArgStream"
     private final static String HEADER_CP = "Cp"
     private final static String HEADER_STATUS = "Status"
+    private final static String HEADER_EVAL_STATUS = "EvalStatus"
     private final static String HEADER_AUTHTOKEN = "Auth"
     private final static String HEADER_STREAM_ID = "Channel"
     private final static String HEADER_SIZE = "Size"
     private final static String HEADER_ENV = "Env"
     private final static String HEADER_PROTOCOL = "Protocol"
     private final static String HEADER_COMMAND = "Cmd"
+    private final static String HEADER_TRACE = "Trace"
+    private final static String HEADER_SHM = "Shm"
+    private final static String HEADER_RING = "Ring"
+    private final static String HEADER_WINDOW = "Window"
+    private final static String HEADER_CREDIT = "Credit"
+    private final static String HEADER_WARMUP = "Warmup"
+    private final static String HEADER_PRIORITY = "Priority"
+    private final static String HEADER_CLIENT = "Client"
+    private final static String HEADER_COMPRESS = "Compress"
+    private final static String HEADER_COMPRESSED = "Compressed"
     private final static String LINE_SEPARATOR = "\n"
+    private final static long MAX_ARG_STREAM_SIZE = 256 * 1024 * 1024 // bytes
+    private final static int ARG_STREAM_BUFFER_SIZE = 64 * 1024 // bytes
 
     /**
      * @throws InvalidAuthTokenException
@@ -113,17 +258,32 @@ class ClientProtocols {
             port: conn.socket.port,
             cwd: headers[HEADER_CURRENT_WORKING_DIR]?.getAt(0),
             classpath: headers[HEADER_CP]?.getAt(0),
-            args: decodeArgs(headers[HEADER_ARG]),
+            args: decodeArgs(headers[HEADER_ARG]) + readArgStream(conn, headers[HEADER_ARG_STREAM]?.getAt(0)),
             clientAuthToken: headers[HEADER_AUTHTOKEN]?.getAt(0),
             serverAuthToken: conn.authToken,
             envVars: headers[HEADER_ENV],
             protocol: headers[HEADER_PROTOCOL]?.getAt(0),
             command: headers[HEADER_COMMAND]?.getAt(0),
+            trace: headers[HEADER_TRACE]?.getAt(0) == 'on',
+            shm: headers[HEADER_SHM]?.getAt(0),
+            window: headers[HEADER_WINDOW]?.getAt(0)?.isInteger() ? (headers[HEADER_WINDOW][0] as int) : 0,
+            warmup: headers[HEADER_WARMUP]?.getAt(0) == 'on',
+            priority: readPriority(headers[HEADER_PRIORITY]?.getAt(0)),
+            client: headers[HEADER_CLIENT]?.getAt(0),
+            compress: headers[HEADER_COMPRESS]?.getAt(0),
         )
         request.check()
         return request
     }
 
+    private static String readPriority(String priority) {
+        if (priority == null) return SessionScheduler.INTERACTIVE
+        if (!(priority in SessionScheduler.PRIORITIES)) {
+            throw new InvalidRequestHeaderException("Found invalid priority: ${priority}")
+        }
+        return priority
+    }
+
     private static List<String> decodeArgs(List<String> encoded) {
         encoded.collect {
             try {
@@ -134,6 +294,53 @@ class ClientProtocols {
         }
     }
 
+    /**
+     * Decodes frames of arguments one by one through a buffer, which is limited to
+     * the size of them not to take StreamRequest following them.
+     *
+     * @throws InvalidRequestHeaderException
+     * @throws GServIOException
+     */
+    private static List<String> readArgStream(ClientConnection conn, String argStream) {
+        if (argStream == null) return []
+        def tokens = argStream.tokenize(' ')
+        if (tokens.size() != 2 || !tokens.every { it.isLong() }) {
+            throw new InvalidRequestHeaderException("Found invalid argument stream: ${argStream}")
+        }
+        long count = tokens[0] as long
+        long size = tokens[1] as long
+        if (count < 0 || size < 0 || size > MAX_ARG_STREAM_SIZE || count * 2 > size) { // a frame has 2 bytes at least
+            throw new InvalidRequestHeaderException("Found invalid argument stream: ${argStream}")
+        }
+        def limited = new LimitedInputStream(conn.socketInputStream, size) // raw stream
+        def ins = new DataInputStream(new BufferedInputStream(limited, (int) Math.min(size, ARG_STREAM_BUFFER_SIZE) + 1))
+        try {
+            def args = []
+            for (long i = 0; i < count; i++) {
+                String length = IOUtils.readLine(ins)
+                if (!length.isInteger() || (length as int) < 0 || (length as int) > size) { // not to allocate more than the stream
+                    throw new InvalidRequestHeaderException("Found invalid argument length: ${length}")
+                }
+                def buff = new byte[length as int]
+                ins.readFully(buff)
+                args << new String(buff) // using default encoding
+            }
+            if (limited.remaining > 0 || ins.available() > 0) {
+                throw new InvalidRequestHeaderException("Found extra bytes in argument stream: ${argStream}")
+            }
+            return args
+        }
+        catch (EOFException e) {
+            throw new InvalidRequestHeaderException("Argument stream is shorter than its header: ${argStream}", e)
+        }
+        catch (InterruptedIOException e) {
+            throw new GServIOException("Interrupted to read argument stream", e)
+        }
+        catch (IOException e) {
+            throw new GServIOException("Failed to read argument stream: ${e.message}", e)
+        }
+    }
+
     /**
      * @throws InvalidRequestHeaderException
      * @throws GServIOException
@@ -144,13 +351,16 @@ class ClientProtocols {
             port: conn.socket.port,
             size: headers[HEADER_SIZE]?.getAt(0),
             command: headers[HEADER_COMMAND]?.getAt(0),
+            channel: headers[HEADER_STREAM_ID]?.getAt(0),
+            credit: headers[HEADER_CREDIT]?.getAt(0),
+            compressed: headers[HEADER_COMPRESSED]?.getAt(0),
         )
         request.check()
         return request
     }
 
     private static Map<String, List<String>> readHeaders(ClientConnection conn) {
-        def ins = conn.socket.inputStream // raw stream
+        def ins = conn.socketInputStream // raw stream
         return parseHeaders(ins)
     }
 
@@ -184,19 +394,72 @@ class ClientProtocols {
         return buff
     }
 
-    static byte[] formatAsResponseHeader(streamId, size) {
+    /**
+     * Formats an invocation which the server sends to itself as a client does, like
+     * a replay of WarmUpRunner or a detached job, followed by an empty StreamRequest
+     * which closes stdin.
+     */
+    static byte[] formatAsLoopbackRequest(InvocationRequest request) {
+        def header = [:]
+        header[HEADER_AUTHTOKEN] = request.clientAuthToken
+        header[HEADER_ARG] = request.args.collect { it.bytes.encodeBase64().toString() } // using default encoding
+        if (request.cwd) header[HEADER_CURRENT_WORKING_DIR] = request.cwd
+        if (request.envVars) header[HEADER_ENV] = request.envVars
+        if (request.classpath) header[HEADER_CP] = request.classpath
+        if (request.priority) header[HEADER_PRIORITY] = request.priority
+        if (request.warmup) header[HEADER_WARMUP] = 'on'
+        def stdin = [:]
+        stdin[HEADER_SIZE] = 0
+        def buff = new ByteArrayOutputStream()
+        buff << formatAsHeader(header) << formatAsHeader(stdin)
+        buff.toByteArray()
+    }
+
+    static byte[] formatAsResponseHeader(streamId, size, int compressedSize = -1) {
         def header = [:]
         header[HEADER_STREAM_ID] = streamId
         header[HEADER_SIZE] = size
+        if (compressedSize >= 0) {
+            header[HEADER_COMPRESSED] = compressedSize
+        }
+        formatAsHeader(header)
+    }
+
+    static byte[] formatAsCompressHeader(String codec) {
+        def header = [:]
+        header[HEADER_COMPRESS] = codec
+        formatAsHeader(header)
+    }
+
+    static byte[] formatAsCreditHeader(streamId, long size) {
+        def header = [:]
+        header[HEADER_STREAM_ID] = streamId
+        header[HEADER_CREDIT] = size
         formatAsHeader(header)
     }
 
-    static byte[] formatAsExitHeader(int status, String body = null) {
+    static byte[] formatAsRingHeader(streamId, long position) {
+        def header = [:]
+        header[HEADER_STREAM_ID] = streamId
+        header[HEADER_RING] = position
+        formatAsHeader(header)
+    }
+
+    static byte[] formatAsExitHeader(int status, String body = null, List<String> trace = null) {
         def header = [:]
         header[HEADER_STATUS] = status
+        if (trace) {
+            header[HEADER_TRACE] = trace
+        }
         formatAsHeader(header, body)
     }
 
+    static byte[] formatAsEvalStatusHeader(int status) {
+        def header = [:]
+        header[HEADER_EVAL_STATUS] = status
+        formatAsHeader(header)
+    }
+
     private static byte[] formatAsHeader(Map map, String body = null) {
         def buff = new StringBuilder()
         map.each { key, value ->
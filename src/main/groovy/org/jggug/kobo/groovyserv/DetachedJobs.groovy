@@ -0,0 +1,267 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.utils.IOUtils
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+import java.util.concurrent.atomic.AtomicLong
+
+/**
+ * Invocations which run without their clients.
+ *
+ * A detached job is invoked through the server as a client does, like a replay of
+ * WarmUpRunner, so it's scheduled and run in the same way as others. Its stdin is closed.
+ * 'out' and 'err' are spooled to a log file under WorkFiles.JOBS_DIR, which keeps
+ * no more than MAX_LOG_SIZE bytes of output and counts the rest as dropped.
+ * The log of a finished job is removed when more than MAX_FINISHED_JOBS jobs have finished after it.
+ *
+ * An offset of the log is the total size of output of both channels before it,
+ * so a client can resume the log by the size which it has written out.
+ */
+@Singleton
+class DetachedJobs {
+
+    static final List<String> COMMANDS = ['job-status', 'job-log', 'job-wait']
+    private static final long MAX_LOG_SIZE = 64 * 1024 * 1024 // bytes of output for each job
+    private static final int MAX_FINISHED_JOBS = 100
+    private static final int RECORD_OUT = 1
+    private static final int RECORD_ERR = 2
+
+    static class Job {
+        final String id
+        final InvocationRequest request
+        final File logFile
+        final long submittedAt = System.currentTimeMillis()
+        long finishedAt = 0
+        Integer exitStatus // null while running
+        long logged = 0  // bytes of the log file which can be read
+        long output = 0  // bytes of output written to the log
+        long dropped = 0 // bytes of output over MAX_LOG_SIZE
+
+        private Job(String id, InvocationRequest request, File logFile) {
+            this.id = id
+            this.request = request
+            this.logFile = logFile
+        }
+
+        boolean isRunning() {
+            exitStatus == null
+        }
+
+        String getState() {
+            running ? "running" : "exited ${exitStatus}"
+        }
+    }
+
+    private final AtomicLong lastId = new AtomicLong(0)
+    private final Map<String, Job> jobs = [:] // in submitted order
+    private int port
+
+    /**
+     * Logs of the previous server are removed, because its jobs cannot be seen any more.
+     */
+    void setUp(int port) {
+        this.port = port
+        WorkFiles.JOBS_DIR.deleteDir()
+        WorkFiles.JOBS_DIR.mkdirs()
+    }
+
+    /**
+     * Starts the invocation of the request as a job on a new thread.
+     */
+    Job submit(InvocationRequest request) {
+        String id = lastId.incrementAndGet() as String
+        def job = new Job(id, request, new File(WorkFiles.JOBS_DIR, "${id}.log"))
+        job.logFile.bytes = new byte[0]
+        synchronized (this) {
+            jobs[id] = job
+        }
+        def thread = new Thread({ run(job) } as Runnable, "DetachedJob:${id}")
+        thread.daemon = true
+        thread.start()
+        LogUtils.infoLog "Job ${id} is submitted: ${request.args}"
+        return job
+    }
+
+    synchronized Job find(String id) {
+        jobs[id]
+    }
+
+    private void run(Job job) {
+        int status
+        try {
+            status = invoke(job)
+        } catch (Exception e) {
+            LogUtils.errorLog "Failed to run job ${job.id}", e
+            status = ExitStatus.IO_ERROR.code
+        }
+        synchronized (job) {
+            job.exitStatus = status
+            job.finishedAt = System.currentTimeMillis()
+            job.notifyAll()
+        }
+        LogUtils.infoLog "Job ${job.id} is finished: ${status}"
+        removeOldJobs()
+    }
+
+    private int invoke(Job job) {
+        def request = job.request
+        def socket = new Socket("localhost", port)
+        try {
+            socket.outputStream.with {
+                write(ClientProtocols.formatAsLoopbackRequest(request)) // authenticated by the same token
+                flush()
+            }
+            def ins = new DataInputStream(new BufferedInputStream(socket.inputStream))
+            def log = new DataOutputStream(new BufferedOutputStream(new FileOutputStream(job.logFile, true)))
+            try {
+                while (true) {
+                    def response = ClientProtocols.parseHeaders(ins)
+                    if (response.Status) {
+                        return response.Status[0] as int // a message may follow without size
+                    }
+                    if (!response.Channel) {
+                        throw new IOException("Connection is closed without exit status")
+                    }
+                    def buff = new byte[response.Size[0] as int]
+                    ins.readFully(buff)
+                    append(job, log, response.Channel[0], buff)
+                }
+            } finally {
+                IOUtils.close(log)
+            }
+        } finally {
+            socket.close()
+        }
+    }
+
+    /**
+     * A record of the log is a channel as byte, a size as int and output.
+     */
+    private static void append(Job job, DataOutputStream log, String channel, byte[] buff) {
+        int size = (int) Math.min(buff.length, Math.max(MAX_LOG_SIZE - job.output, 0))
+        if (size > 0) {
+            log.writeByte(channel == 'err' ? RECORD_ERR : RECORD_OUT)
+            log.writeInt(size)
+            log.write(buff, 0, size)
+            log.flush()
+        }
+        synchronized (job) {
+            job.logged += (size > 0) ? 5 + size : 0
+            job.output += size
+            job.dropped += buff.length - size
+            job.notifyAll()
+        }
+    }
+
+    private void removeOldJobs() {
+        List<Job> removed
+        synchronized (this) {
+            def finished = jobs.values().findAll { !it.running }
+            removed = finished.take(Math.max(finished.size() - MAX_FINISHED_JOBS, 0))
+            removed.each { jobs.remove(it.id) }
+        }
+        removed.each { it.logFile.delete() }
+    }
+
+    /**
+     * Handles a command for a job which is specified by the first argument as "id[:offset]".
+     *
+     * @return exit status of the command
+     */
+    int handle(String command, List<String> args, ClientConnection conn) {
+        def (String id, String offset) = (args ? args[0] : "").tokenize(':') + [null, null]
+        def job = id ? find(id) : null
+        if (job == null || (offset != null && !offset.isLong())) {
+            conn.err.println("Unknown job: ${args ? args[0] : ''}")
+            return ExitStatus.INVALID_REQUEST.code
+        }
+        switch (command) {
+            case 'job-status':
+                synchronized (job) {
+                    conn.out.println("${job.id} ${job.state} output=${job.output} dropped=${job.dropped}")
+                }
+                return ExitStatus.SUCCESS.code
+            case 'job-log':
+                replay(job, (offset ?: '0') as long, false, conn)
+                return ExitStatus.SUCCESS.code
+            case 'job-wait':
+                replay(job, (offset ?: '0') as long, true, conn)
+                return job.exitStatus
+        }
+        throw new IllegalArgumentException("Unknown command: ${command}")
+    }
+
+    /**
+     * Writes output in the log from the offset to the client.
+     * When following, it returns after the job is finished.
+     */
+    private static void replay(Job job, long offset, boolean follow, ClientConnection conn) {
+        def raf = new RandomAccessFile(job.logFile, 'r')
+        try {
+            long position = 0 // in the log file
+            long output = 0   // total size of output before the position
+            def buff = new byte[8192]
+            while (true) {
+                long logged = awaitLogged(job, position, follow)
+                if (position >= logged) break
+                raf.seek(position)
+                while (position < logged) {
+                    def out = (raf.readByte() == RECORD_ERR) ? conn.err : conn.out
+                    int size = raf.readInt()
+                    position += 5 + size
+                    int skip = (int) Math.min(Math.max(offset - output, 0), size)
+                    raf.skipBytes(skip)
+                    for (int rest = size - skip; rest > 0;) {
+                        int length = Math.min(rest, buff.length)
+                        raf.readFully(buff, 0, length)
+                        out.write(buff, 0, length)
+                        rest -= length
+                    }
+                    output += size
+                }
+                conn.out.flush()
+                conn.err.flush()
+            }
+        } finally {
+            raf.close()
+        }
+    }
+
+    /**
+     * @return the size of the log file which can be read
+     */
+    private static long awaitLogged(Job job, long position, boolean follow) {
+        synchronized (job) {
+            while (follow && job.running && job.logged <= position) {
+                job.wait()
+            }
+            return job.logged
+        }
+    }
+
+    /**
+     * @return stats in the same form as ServerStats
+     */
+    synchronized Map<String, Object> report() {
+        def stats = [:]
+        stats['jobs.submitted'] = lastId.get()
+        stats['jobs.running'] = jobs.values().count { it.running }
+        stats['jobs.retained'] = jobs.size()
+        return stats
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import groovy.grape.Grape
+import groovy.grape.GrapeEngine
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+/**
+ * Jar URIs of resolved @Grab dependencies, which are shared by all sessions
+ * through the Grape engine of the server, so that a hit doesn't touch Ivy at all.
+ *
+ * A key consists of grab arguments, dependencies including ones already grabbed into
+ * the same class loader, resolvers added by @GrabResolver, and the state of grapeConfig.xml.
+ * An entry is dropped when any of its jars is gone. Entries are saved to
+ * WorkFiles.GRAPE_CACHE_FILE at shutdown and loaded at startup, so resolution works
+ * offline after a restart as well. All entries are invalidated by 'invalidate-grapes' command.
+ */
+@Singleton
+class GrapeResolutionCache {
+
+    private static final String ENGINE_CLASS_NAME = 'org.jggug.kobo.groovyserv.CachingGrapeIvy'
+    private static final int MAX_ENTRIES = 1000
+
+    private final Map<String, List<URI>> entries = new LinkedHashMap<String, List<URI>>(16, 0.75f, true) // in access order
+    private long hits = 0
+    private long misses = 0
+    private boolean installed = false
+
+    /**
+     * Replaces the Grape engine by the caching one.
+     * The engine is loaded by name, because Ivy isn't always available.
+     */
+    void install() {
+        try {
+            def engine = Class.forName(ENGINE_CLASS_NAME, true, getClass().classLoader).newInstance() as GrapeEngine
+            synchronized (Grape) {
+                def field = Grape.getDeclaredField('instance')
+                field.accessible = true
+                field.set(null, engine)
+            }
+            installed = true
+            load()
+            LogUtils.infoLog "Grape resolution cache is installed: ${entries.size()} entries"
+        } catch (Throwable e) {
+            LogUtils.errorLog "Failed to install Grape resolution cache, so @Grab is resolved by Ivy every time", e
+        }
+    }
+
+    /**
+     * @return URIs of jars, or null if not cached
+     */
+    synchronized List<URI> get(String key) {
+        def uris = entries[key]
+        if (uris != null && !uris.every { new File(it).exists() }) {
+            LogUtils.debugLog "Cached grapes are gone: ${uris}"
+            entries.remove(key)
+            uris = null
+        }
+        if (uris == null) {
+            misses++
+        } else {
+            hits++
+        }
+        return uris
+    }
+
+    synchronized void put(String key, List<URI> uris) {
+        entries[key] = uris
+        if (entries.size() > MAX_ENTRIES) {
+            entries.remove(entries.keySet().iterator().next()) // least recently used
+        }
+    }
+
+    /**
+     * @return the number of invalidated entries
+     */
+    synchronized int invalidate() {
+        int size = entries.size()
+        entries.clear()
+        WorkFiles.GRAPE_CACHE_FILE.delete()
+        LogUtils.infoLog "Grape resolution cache is invalidated: ${size} entries"
+        return size
+    }
+
+    synchronized void load() {
+        if (!WorkFiles.GRAPE_CACHE_FILE.isFile()) return
+        try {
+            WorkFiles.GRAPE_CACHE_FILE.eachLine { String line ->
+                def fields = line.split('\t') as List
+                if (fields.size() < 2) return
+                entries[new String(fields[0].decodeBase64(), 'UTF-8')] = fields.drop(1).collect { new URI(it) }
+            }
+        } catch (IOException e) {
+            LogUtils.errorLog "Failed to load Grape resolution cache: ${WorkFiles.GRAPE_CACHE_FILE}", e
+        } catch (URISyntaxException e) {
+            LogUtils.errorLog "Broken Grape resolution cache is ignored: ${WorkFiles.GRAPE_CACHE_FILE}", e
+            entries.clear()
+        }
+    }
+
+    synchronized void save() {
+        if (!installed) return
+        try {
+            WorkFiles.GRAPE_CACHE_FILE.text = entries.collect { key, uris ->
+                ([key.getBytes('UTF-8').encodeBase64()] + uris).join('\t') + '\n'
+            }.join()
+        } catch (IOException e) {
+            LogUtils.errorLog "Failed to save Grape resolution cache: ${WorkFiles.GRAPE_CACHE_FILE}", e
+        }
+    }
+
+    /**
+     * @return stats in the same form as ServerStats
+     */
+    synchronized Map<String, Object> report() {
+        def stats = [:]
+        stats['grapes.cached'] = entries.size()
+        stats['grapes.hits'] = hits
+        stats['grapes.misses'] = misses
+        return stats
+    }
+}
@@ -29,7 +29,8 @@ class GroovyInvokeHandler implements Runnable {
     private static final long TIMEOUT_FOR_JOINING_SUBTHREADS = 1000 // sec
     private static final CLASSPATH_OPTIONS = ["--classpath", "-cp", "-classpath"]
 
-    private InvocationRequest request
+    protected InvocationRequest request
+    protected final List<ClassLoader> sessionLoaders = [] // to track their lifecycle by SessionClassLoaders
     private boolean interrupted = false
 
     GroovyInvokeHandler(request) {
@@ -51,6 +52,7 @@ class GroovyInvokeHandler implements Runnable {
         Thread.currentThread().name = "Thread:${GroovyInvokeHandler.simpleName}"
         LogUtils.debugLog "Thread started"
         boolean shouldResetCurrentDir = false
+        def trace = ClientConnection.currentConnection.trace
         try {
             if (request.cwd) {
                 shouldResetCurrentDir = true
@@ -58,8 +60,21 @@ class GroovyInvokeHandler implements Runnable {
             }
             setupEnvVars(request.envVars)
             def classpath = removeClasspathFromArgs(request)
-            invokeGroovy(request.args, classpath)
-            awaitAllSubThreads()
+            if (!request.warmup && !request.command) {
+                WarmUpManifest.instance.record(request.cwd, classpath, request.args)
+            }
+            trace?.phase('setup')
+            long invokedAt = System.nanoTime()
+            try {
+                if (trace) {
+                    trace.phase('invoke') { invokeGroovy(request.args, classpath) }
+                } else {
+                    invokeGroovy(request.args, classpath)
+                }
+                awaitAllSubThreads()
+            } finally {
+                if (!request.warmup) ServerStats.instance.invoked(invokedAt)
+            }
         }
         catch (InterruptedException e) {
             interrupted = true
@@ -78,6 +93,7 @@ class GroovyInvokeHandler implements Runnable {
         }
         finally {
             killAllSubThreadsIfExist()
+            SessionClassLoaders.instance.finished(sessionLabel(), sessionLoaders)
             if (shouldResetCurrentDir) {
                 // only if not throwing any exception
                 CurrentDirHolder.instance.reset()
@@ -86,6 +102,13 @@ class GroovyInvokeHandler implements Runnable {
         }
     }
 
+    /**
+     * Args of a script are omitted because they can be long or secret.
+     */
+    private String sessionLabel() {
+        request.command ?: WarmUpManifest.shapeOf(request.args).join(' ')
+    }
+
     private void setupEnvVars(List<String> envVars) {
         envVars.each { envVar ->
             LogUtils.debugLog "putenv(${envVar})"
@@ -128,9 +151,9 @@ class GroovyInvokeHandler implements Runnable {
         return paths.join(File.pathSeparator)
     }
 
-    private invokeGroovy(args, classpath) {
+    protected invokeGroovy(args, classpath) {
         LogUtils.debugLog "Invoking groovy: ${args} with classpath=${classpath}"
-        GroovyMain2.processArgs(args as String[], System.out, classpath)
+        GroovyMain2.processArgs(args as String[], System.out, classpath, sessionLoaders)
         appendServerVersion(args)
     }
 
@@ -166,7 +189,7 @@ class GroovyInvokeHandler implements Runnable {
         LogUtils.debugLog "All sub threads joined"
     }
 
-    private killAllSubThreadsIfExist() {
+    protected killAllSubThreadsIfExist() {
         def threads = getAllAliveSubThreads()
         if (!threads) {
             return
@@ -20,6 +20,12 @@ import org.jggug.kobo.groovyserv.platform.EnvironmentVariables
 import org.jggug.kobo.groovyserv.stream.StandardStreams
 import org.jggug.kobo.groovyserv.utils.LogUtils
 
+import java.lang.management.ManagementFactory
+import java.util.concurrent.Callable
+import java.util.concurrent.ExecutionException
+import java.util.concurrent.Executors
+import java.util.concurrent.Future
+
 /**
  * GroovyServer runs groovy command background.
  * This makes groovy response time at startup very quicker.
@@ -35,20 +41,42 @@ class GroovyServer {
     ServerSocket serverSocket
     AuthToken authToken
     List<String> allowFrom = []
+    long spillSize = 0 // max size of output buffered in memory for each channel of a slow client
+    String warmUpMode  // null means no warm-up (see WarmUpRunner)
+    long memoryBudget = 0 // bytes of heap and metaspace in use to reclaim while idle (see SessionClassLoaders)
+    Map<String, Integer> sessionLimits = [:] // by priority class, or default (see SessionScheduler)
+
+    private long startedAt
+    private final Map<String, Long> bootTimes = [:] // msec by phase of start()
 
     void start() {
         assert port != null
+        startedAt = System.currentTimeMillis()
         try {
             // Preparing
+            // Initializations independent of each other run in parallel while the socket is bound,
+            // because each of them takes time to compile and load classes.
             WorkFiles.setUp(port)
-            EnvironmentVariables.setUp()
-            StandardStreams.setUp()
+            def initializer = Executors.newFixedThreadPool(2)
+            def initializations = [
+                initializer.submit(bootPhase('environment') { EnvironmentVariables.setUp() }),
+                initializer.submit(bootPhase('streams') { StandardStreams.setUp() }),
+            ]
+            initializer.shutdown()
             setupSecurityManager()
             setupRunningMode()
+            setupAuthToken()
+            sessionLimits.each { priority, limit -> SessionScheduler.instance.setLimit(priority, limit) }
 
             // Starting
-            startServer()
-            setupAuthToken()
+            bootPhase('socket') { startServer() }.call()
+            initializations.each { awaitInitialization(it) }
+            bootPhase('warmup') { startWarmUp() }.call()
+            DetachedJobs.instance.setUp(port)
+            SessionClassLoaders.instance.start(memoryBudget)
+            authToken.save() // the authtoken file tells the server script that the server is ready
+            logBootTimes()
+            startLazyInitialization()
             handleRequest()
         }
         catch (GServException e) {
@@ -60,11 +88,13 @@ class GroovyServer {
             exit ExitStatus.UNEXPECTED_ERROR
         }
         finally {
-            authToken.delete()
+            authToken?.delete()
         }
     }
 
     void shutdown() {
+        WarmUpManifest.instance.save()
+        GrapeResolutionCache.instance.save()
         authToken.delete()
         LogUtils.infoLog "Server is shut down"
         exit ExitStatus.FORCELY_SHUTDOWN
@@ -93,7 +123,46 @@ class GroovyServer {
         if (authToken == null) {
             authToken = new AuthToken()
         }
-        authToken.save()
+    }
+
+    private Callable bootPhase(String name, Closure closure) {
+        return {
+            long startedAt = System.nanoTime()
+            try {
+                closure.call()
+            } finally {
+                synchronized (bootTimes) {
+                    bootTimes[name] = ((System.nanoTime() - startedAt) / 1000000) as long
+                }
+            }
+        } as Callable
+    }
+
+    private static void awaitInitialization(Future initialization) {
+        try {
+            initialization.get()
+        } catch (ExecutionException e) {
+            throw e.cause
+        }
+    }
+
+    private void logBootTimes() {
+        long total = System.currentTimeMillis() - ManagementFactory.runtimeMXBean.startTime
+        synchronized (bootTimes) {
+            def phases = ["until-start": startedAt - ManagementFactory.runtimeMXBean.startTime] + bootTimes
+            LogUtils.infoLog "Server is ready in ${total} ms: " + phases.collect { name, time -> "${name}=${time}ms" }.join(" ")
+        }
+    }
+
+    /**
+     * Initializations which aren't necessary to accept requests are done after the server is ready.
+     */
+    private static void startLazyInitialization() {
+        def thread = new Thread({
+            GrapeResolutionCache.instance.install()
+        } as Runnable, "LazyInitializer")
+        thread.daemon = true
+        thread.start()
     }
 
     private void startServer() {
@@ -102,6 +171,13 @@ class GroovyServer {
         LogUtils.infoLog "Default classpath: ${System.getenv('CLASSPATH')}"
     }
 
+    private void startWarmUp() {
+        WarmUpManifest.instance.load()
+        if (warmUpMode) {
+            new WarmUpRunner(warmUpMode, port, authToken).start()
+        }
+    }
+
     private void handleRequest() {
         while (true) {
             def socket = serverSocket.accept()
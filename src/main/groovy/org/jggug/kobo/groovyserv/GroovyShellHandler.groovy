@@ -0,0 +1,104 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.codehaus.groovy.control.CompilationFailedException
+import org.codehaus.groovy.control.CompilerConfiguration
+import org.codehaus.groovy.runtime.InvokerInvocationException
+import org.codehaus.groovy.runtime.StackTraceUtils
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+/**
+ * Handler of a shell session, which evaluates code snippets sent by EvalRequest
+ * one by one against a single GroovyShell and Binding kept through the session.
+ * So the state which a snippet sets up, like variables of the binding and
+ * loaded classes, is reused by following snippets without setting it up again.
+ */
+class GroovyShellHandler extends GroovyInvokeHandler {
+
+    private static final int EVAL_FAILED = 1
+
+    GroovyShellHandler(request) {
+        super(request)
+    }
+
+    @Override
+    protected invokeGroovy(args, classpath) {
+        LogUtils.debugLog "Starting shell: ${args} with classpath=${classpath}"
+        def conn = ClientConnection.currentConnection
+        def config = new CompilerConfiguration(System.getProperties())
+        config.classpath = classpath
+        def binding = new Binding(args as String[])
+        def shell = new GroovyShell(Thread.currentThread().contextClassLoader, binding, config)
+        sessionLoaders << shell.classLoader
+
+        int count = 0
+        int status = ExitStatus.SUCCESS.code
+        String source
+        while ((source = conn.takeEvalRequest()) != null) {
+            status = evaluate(shell, source, "Shell${++count}.groovy")
+            System.out.flush()
+            System.err.flush()
+            conn.sendEvalStatus(status)
+        }
+        LogUtils.debugLog "Shell finished after ${count} evaluation(s)"
+
+        // the exit status of the session is the one of the last snippet
+        if (status != ExitStatus.SUCCESS.code) {
+            throw new SystemExitException(status, "Last evaluation failed in shell")
+        }
+    }
+
+    private static int evaluate(GroovyShell shell, String source, String name) {
+        statusOf { shell.evaluate(source, name) }
+    }
+
+    /**
+     * Runs user code, printing its error like groovy does.
+     *
+     * @return the exit status of the code
+     * @throws RuntimeException When interrupted in user code
+     */
+    static int statusOf(Closure code) {
+        try {
+            code.call()
+            return ExitStatus.SUCCESS.code
+        }
+        catch (CompilationFailedException e) {
+            System.err.println(e)
+            return EVAL_FAILED
+        }
+        catch (SystemExitException e) {
+            // System.exit() ends only the snippet, not the session.
+            return e.exitStatus
+        }
+        catch (ThreadDeath e) {
+            throw e // stopped by force, which isn't an error of user code
+        }
+        catch (Throwable e) {
+            if (e instanceof InterruptedException) {
+                throw new RuntimeException("Interrupted in user script", e)
+            }
+            if (e instanceof InvokerInvocationException) {
+                e = e.cause
+            }
+            System.err.println("Caught: " + e)
+            StackTraceUtils.deepSanitize(e)
+            e.printStackTrace()
+            return EVAL_FAILED
+        }
+    }
+}
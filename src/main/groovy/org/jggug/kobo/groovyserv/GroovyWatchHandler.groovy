@@ -0,0 +1,140 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.codehaus.groovy.control.CompilerConfiguration
+import org.jggug.kobo.groovyserv.exception.InvalidRequestHeaderException
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+/**
+ * Handler of a watch session, which runs a script again for each RerunRequest
+ * sent by a client when it detects changes of files.
+ *
+ * A run which hasn't finished yet is superseded by the next one. It's interrupted,
+ * and stopped by force unless it finishes soon, before the next one starts.
+ * The script and sources which it depends on are compiled by a GroovyScriptEngine
+ * kept through the session, so only ones changed since the last run are recompiled.
+ */
+class GroovyWatchHandler extends GroovyInvokeHandler {
+
+    private static final long GRACE_FOR_SUPERSEDED_RUN = 100 // msec
+
+    private int reportedRuns = 0
+    private int lastStatus = ExitStatus.SUCCESS.code
+
+    GroovyWatchHandler(request) {
+        super(request)
+    }
+
+    /**
+     * @throws InvalidRequestHeaderException When a script file isn't specified
+     */
+    @Override
+    protected invokeGroovy(args, classpath) {
+        LogUtils.debugLog "Starting watch: ${args} with classpath=${classpath}"
+        if (!args || args[0].startsWith('-')) {
+            throw new InvalidRequestHeaderException("Watch session requires a script file as the first argument: ${args}")
+        }
+        def conn = ClientConnection.currentConnection
+        def script = resolve(args[0])
+        def engine = createEngine(script.parentFile, classpath)
+        def scriptArgs = args.drop(1) as String[]
+
+        int count = 0
+        def runner = startRun(engine, script.name, scriptArgs, ++count)
+        while (conn.takeRerunRequest()) {
+            supersede(runner, count)
+            while (conn.hasRerunRequest()) { // only the latest one is worth running
+                conn.takeRerunRequest()
+                report(++count, ExitStatus.INTERRUPTED.code)
+            }
+            runner = startRun(engine, script.name, scriptArgs, ++count)
+        }
+        runner.join()
+        LogUtils.debugLog "Watch finished after ${count} run(s)"
+
+        // the exit status of the session is the one of the last run
+        if (lastStatus != ExitStatus.SUCCESS.code) {
+            throw new SystemExitException(lastStatus, "Last run failed in watch")
+        }
+    }
+
+    private File resolve(String path) {
+        def file = new File(path)
+        (file.absolute || !request.cwd) ? file : new File(request.cwd, path)
+    }
+
+    private GroovyScriptEngine createEngine(File scriptDir, String classpath) {
+        def config = new CompilerConfiguration(System.getProperties())
+        config.classpath = classpath
+        config.minimumRecompilationInterval = 0 // a change just after the last run is also detected
+        def roots = ([scriptDir] + classpath.split(File.pathSeparator).collect { resolve(it) }.findAll { it.directory })
+        def loader = new GroovyClassLoader(Thread.currentThread().contextClassLoader, config)
+        def engine = new GroovyScriptEngine(roots*.canonicalFile.unique()*.toURI()*.toURL() as URL[], loader)
+        engine.config = config
+        sessionLoaders << loader << engine.groovyClassLoader
+        return engine
+    }
+
+    private Thread startRun(GroovyScriptEngine engine, String scriptName, String[] args, int run) {
+        LogUtils.debugLog "Starting run ${run}: ${scriptName}"
+        def runner = new Thread({
+            int status
+            try {
+                status = GroovyShellHandler.statusOf { engine.createScript(scriptName, new Binding(args)).run() }
+                System.out.flush()
+                System.err.flush()
+            } catch (RuntimeException e) {
+                LogUtils.debugLog "Run ${run} is interrupted: ${e.message}"
+                status = ExitStatus.INTERRUPTED.code
+            } catch (ThreadDeath e) {
+                LogUtils.debugLog "Run ${run} is stopped"
+                status = ExitStatus.INTERRUPTED.code
+            }
+            report(run, status)
+        } as Runnable, "Thread:${GroovyWatchHandler.simpleName}:${run}")
+        runner.start()
+        return runner
+    }
+
+    /**
+     * Ends the run and threads started by it. Its status is reported here
+     * unless it has finished by itself, so that no output of the run follows it.
+     */
+    private void supersede(Thread runner, int run) {
+        if (runner.alive) {
+            runner.interrupt()
+            runner.join(GRACE_FOR_SUPERSEDED_RUN)
+        }
+        if (runner.alive) {
+            runner.stop() // by force
+            runner.join(GRACE_FOR_SUPERSEDED_RUN)
+        }
+        killAllSubThreadsIfExist()
+        report(run, ExitStatus.INTERRUPTED.code)
+    }
+
+    /**
+     * Sends EvalResponse of each run once and in order.
+     */
+    private synchronized void report(int run, int status) {
+        if (run <= reportedRuns) return
+        reportedRuns = run
+        lastStatus = status
+        ClientConnection.currentConnection.sendEvalStatus(status)
+        LogUtils.debugLog "Run ${run} finished: ${status}"
+    }
+}
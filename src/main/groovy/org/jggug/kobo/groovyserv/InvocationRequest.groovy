@@ -34,6 +34,13 @@ class InvocationRequest {
     List<String> envVars       // optional
     String protocol            // optional
     String command             // optional
+    boolean trace              // optional
+    String shm                 // optional
+    int window                 // optional: 0 means no flow control
+    boolean warmup             // optional: replayed by WarmUpRunner
+    String priority            // optional: a class of SessionScheduler, 'interactive' if not specified
+    String client              // optional: identity of a client among ones from the same address
+    String compress            // optional: a codec of stream frames
 
     /**
      * @throws InvalidAuthTokenException
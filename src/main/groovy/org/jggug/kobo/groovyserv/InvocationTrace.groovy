@@ -0,0 +1,80 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import java.lang.management.ManagementFactory
+
+/**
+ * Timings of phases of an invocation on the server, which are sent with
+ * the exit status when a client requests them by 'Trace' header.
+ * All times are microseconds from accepting the socket.
+ */
+class InvocationTrace {
+
+    private final long acceptedAt
+    private final List<String> entries = [].asSynchronized()
+    private long lastPhaseEndedAt
+
+    InvocationTrace(long acceptedAt) {
+        this.acceptedAt = acceptedAt
+        this.lastPhaseEndedAt = acceptedAt
+    }
+
+    /**
+     * To record a phase from the end of the last phase to now.
+     */
+    void phase(String name) {
+        long now = System.nanoTime()
+        entries << "${name} ${micros(lastPhaseEndedAt - acceptedAt)} ${micros(now - lastPhaseEndedAt)}".toString()
+        lastPhaseEndedAt = now
+    }
+
+    /**
+     * To run a closure as a phase, recording CPU time and allocated bytes of the current thread.
+     */
+    def phase(String name, Closure closure) {
+        def threads = ManagementFactory.threadMXBean
+        long cpuTime = threads.currentThreadCpuTime
+        long allocated = allocatedBytes(threads)
+        try {
+            return closure.call()
+        } finally {
+            phase(name)
+            entries << "cpu-time ${micros(threads.currentThreadCpuTime - cpuTime)}".toString()
+            if (allocated >= 0) {
+                entries << "allocated ${allocatedBytes(threads) - allocated}".toString()
+            }
+        }
+    }
+
+    /**
+     * @return values of 'Trace' header in the exit frame
+     */
+    List<String> getEntries() {
+        entries
+    }
+
+    private static long allocatedBytes(threads) {
+        if (threads instanceof com.sun.management.ThreadMXBean && threads.threadAllocatedMemoryEnabled) {
+            return threads.getThreadAllocatedBytes(Thread.currentThread().id)
+        }
+        return -1
+    }
+
+    private static long micros(long nanos) {
+        (long) (nanos / 1000)
+    }
+}
@@ -41,13 +41,17 @@ class RequestWorker extends ThreadPoolExecutor implements Runnable {
     private static final int POOL_SIZE = 2
 
     private ClientConnection conn
+    private final long acceptedAt = System.nanoTime()
+    private long startedAt = 0
     private Future invokeFuture
     private Future streamFuture
+    private SessionScheduler.Ticket ticket
 
     RequestWorker(AuthToken authToken, Socket socket) {
         // API: ThreadPoolExecutor(int corePoolSize, int maximumPoolSize, long keepAliveTime, TimeUnit unit, BlockingQueue<Runnable> workQueue)
         super(POOL_SIZE, POOL_SIZE, 0, TimeUnit.SECONDS, new LinkedBlockingQueue<Runnable>())
         this.conn = new ClientConnection(authToken, socket)
+        ServerStats.instance.sessionAccepted()
 
         // for management sub threads in invoke handler.
         setThreadFactory(
@@ -75,8 +79,15 @@ class RequestWorker extends ThreadPoolExecutor implements Runnable {
         InvocationRequest request = parseRequest()
         if (request == null) {
             LogUtils.debugLog "Empty request"
+            ServerStats.instance.sessionRejected()
             return
         }
+        startedAt = System.nanoTime()
+        ServerStats.instance.sessionStarted(acceptedAt)
+        if (request.trace) {
+            conn.trace = new InvocationTrace(acceptedAt)
+            conn.trace.phase('header')
+        }
 
         // Handling built-in commands
         if (request.command == 'ping') {
@@ -90,11 +101,80 @@ class RequestWorker extends ThreadPoolExecutor implements Runnable {
             Holders.groovyServer.shutdown()
             return
         }
+        if (request.command == 'stats') {
+            LogUtils.debugLog "Stats command is accepted"
+            conn.out.print(ServerStats.instance.report())
+            conn.out.flush()
+            closeSafely(ExitStatus.SUCCESS.code)
+            return
+        }
+        if (request.command == 'invalidate-grapes') {
+            LogUtils.debugLog "Invalidate-grapes command is accepted"
+            conn.out.println("${GrapeResolutionCache.instance.invalidate()} resolved grapes are invalidated")
+            conn.out.flush()
+            closeSafely(ExitStatus.SUCCESS.code)
+            return
+        }
+
+        if (request.command == 'detach') {
+            LogUtils.debugLog "Detach command is accepted"
+            conn.out.println(DetachedJobs.instance.submit(request).id)
+            conn.out.flush()
+            closeSafely(ExitStatus.SUCCESS.code)
+            return
+        }
+        if (request.command in DetachedJobs.COMMANDS) {
+            LogUtils.debugLog "Job command is accepted: ${request.command}"
+            int status
+            try {
+                status = DetachedJobs.instance.handle(request.command, request.args, conn)
+            } catch (InterruptedException e) {
+                LogUtils.debugLog "Interrupted while waiting for the job: ${e.message}"
+                status = ExitStatus.INTERRUPTED.code
+            } catch (IOException e) {
+                LogUtils.errorLog "Failed to read the log of the job", e
+                status = ExitStatus.IO_ERROR.code
+            }
+            conn.out.flush()
+            conn.err.flush()
+            closeSafely(status)
+            return
+        }
 
         // Handling normal invocation request
+        if (!admit(request)) {
+            return
+        }
+        conn.trace?.phase('queue')
         handleRequest(request)
     }
 
+    private boolean admit(InvocationRequest request) {
+        String priority = request.warmup ? SessionScheduler.BATCH : request.priority
+        if (priority == SessionScheduler.BATCH) {
+            Thread.currentThread().priority = Thread.MIN_PRIORITY // inherited by handler threads
+        }
+        try {
+            def connection = conn // not to be cleared by closing while waiting
+            ticket = SessionScheduler.instance.acquire(priority, clientOf(request), { connection.clientAlive })
+            if (!ticket) {
+                LogUtils.debugLog "Client disconnected while waiting for admission"
+                closeSafely(ExitStatus.INTERRUPTED.code)
+                return false
+            }
+            return true
+        } catch (InterruptedException e) {
+            LogUtils.debugLog "Interrupted while waiting for admission: ${e.message}"
+            closeSafely(ExitStatus.INTERRUPTED.code)
+            return false
+        }
+    }
+
+    private String clientOf(InvocationRequest request) {
+        String address = conn.socket.inetAddress.hostAddress
+        return request.client ? "${address}/${request.client}".toString() : address
+    }
+
     private InvocationRequest parseRequest() {
         try {
             return conn.openSession()
@@ -110,7 +190,15 @@ class RequestWorker extends ThreadPoolExecutor implements Runnable {
     private void handleRequest(InvocationRequest request) {
         try {
             streamFuture = submit(new StreamRequestHandler(conn))
-            invokeFuture = submit(new GroovyInvokeHandler(request))
+            if (request.command == 'shell') {
+                LogUtils.debugLog "Shell command is accepted"
+                invokeFuture = submit(new GroovyShellHandler(request))
+            } else if (request.command == 'watch') {
+                LogUtils.debugLog "Watch command is accepted"
+                invokeFuture = submit(new GroovyWatchHandler(request))
+            } else {
+                invokeFuture = submit(new GroovyInvokeHandler(request))
+            }
 
             // when all tasks will finish, executor will be shut down.
             shutdown()
@@ -171,6 +259,13 @@ class RequestWorker extends ThreadPoolExecutor implements Runnable {
         }
         IOUtils.close(conn)
         conn = null
+        if (ticket) {
+            SessionScheduler.instance.release(ticket)
+            ticket = null
+        }
+        if (startedAt) {
+            ServerStats.instance.sessionFinished(startedAt)
+        }
         LogUtils.debugLog "Closed safely: ${exitStatus} ${message ? " with the message: $message" : ""}"
     }
 
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.utils.LatencyHistogram
+
+import java.lang.management.ManagementFactory
+import java.util.concurrent.atomic.AtomicInteger
+import java.util.concurrent.atomic.AtomicLong
+
+/**
+ * Live counters of the server, which are reported by 'stats' command.
+ * They are updated by every session, so only lock-free atomic operations are used here.
+ */
+@Singleton
+class ServerStats {
+
+    private static final List<Integer> PERCENTILES = [50, 90, 99]
+    static final List<String> METASPACE_POOLS = ['Metaspace', 'Perm Gen', 'PS Perm Gen', 'CMS Perm Gen']
+
+    private final long startedAt = System.nanoTime()
+
+    private final AtomicLong acceptedSessions = new AtomicLong()
+    private final AtomicInteger queuedSessions = new AtomicInteger()
+    private final AtomicInteger activeSessions = new AtomicInteger()
+    private final AtomicLong frames = new AtomicLong()
+    private final Map<String, AtomicLong> bytes = [in: new AtomicLong(), out: new AtomicLong(), err: new AtomicLong()].asImmutable()
+    private final Map<String, LatencyHistogram> latencies = [
+        'accept-to-start': new LatencyHistogram(), // from accepting a socket to parsing its invocation request
+        invoke: new LatencyHistogram(),            // running a script
+        session: new LatencyHistogram(),           // from starting to closing a session
+        'queue-interactive': new LatencyHistogram(), // from parsing a request to admission by SessionScheduler
+        'queue-batch': new LatencyHistogram(),       // the same for batch sessions
+    ].asImmutable()
+
+    private final AtomicLong compressRawBytes = new AtomicLong()
+    private final AtomicLong compressWireBytes = new AtomicLong()
+    private final AtomicLong compressNanos = new AtomicLong()
+
+    private final AtomicLong firstInvokeNanos = new AtomicLong(-1) // to measure the effect of warm-up
+    private volatile String warmUpState = 'off'
+    private final AtomicInteger warmUpReplayed = new AtomicInteger()
+
+    private long lastReportedAt = startedAt
+    private long lastReportedFrames = 0
+
+    void sessionAccepted() {
+        acceptedSessions.incrementAndGet()
+        queuedSessions.incrementAndGet()
+    }
+
+    void sessionStarted(long acceptedAt) {
+        queuedSessions.decrementAndGet()
+        activeSessions.incrementAndGet()
+        latencies['accept-to-start'].recordNanos(System.nanoTime() - acceptedAt)
+    }
+
+    void sessionRejected() {
+        queuedSessions.decrementAndGet()
+    }
+
+    void sessionFinished(long sessionStartedAt) {
+        activeSessions.decrementAndGet()
+        latencies.session.recordNanos(System.nanoTime() - sessionStartedAt)
+    }
+
+    void sessionAdmitted(String priority, long queuedAt) {
+        latencies["queue-${priority}".toString()].recordNanos(System.nanoTime() - queuedAt)
+    }
+
+    int getActiveSessionCount() {
+        activeSessions.get()
+    }
+
+    void invoked(long invokedAt) {
+        long nanos = System.nanoTime() - invokedAt
+        latencies.invoke.recordNanos(nanos)
+        firstInvokeNanos.compareAndSet(-1, nanos)
+    }
+
+    void warmUpStarted() {
+        warmUpState = 'running'
+    }
+
+    void warmUpReplayed() {
+        warmUpReplayed.incrementAndGet()
+    }
+
+    void warmUpFinished() {
+        warmUpState = 'done'
+    }
+
+    /**
+     * @param channel 'in', 'out' or 'err'
+     */
+    void transferred(String channel, int size) {
+        frames.incrementAndGet()
+        bytes[channel].addAndGet(size)
+    }
+
+    /**
+     * Called for each frame which is compressed or decompressed, including ones sent raw
+     * because they don't get smaller.
+     */
+    void compressed(int rawSize, int wireSize, long nanos) {
+        compressRawBytes.addAndGet(rawSize)
+        compressWireBytes.addAndGet(wireSize)
+        compressNanos.addAndGet(nanos)
+    }
+
+    /**
+     * @return lines of "key: value" in the same way as a header of protocol
+     */
+    synchronized String report() {
+        long now = System.nanoTime()
+        long currentFrames = frames.get()
+        def stats = [:]
+
+        stats['uptime.sec'] = format(seconds(now - startedAt))
+        stats['sessions.accepted'] = acceptedSessions.get()
+        stats['sessions.queued'] = queuedSessions.get()
+        stats['sessions.active'] = activeSessions.get()
+        latencies.each { phase, histogram ->
+            stats["latency.${phase}.count"] = histogram.count
+            stats["latency.${phase}.mean.ms"] = format(histogram.meanMillis)
+            PERCENTILES.each { percent ->
+                stats["latency.${phase}.p${percent}.ms"] = format(histogram.percentileMillis(percent))
+            }
+            stats["latency.${phase}.max.ms"] = format(histogram.maxMillis)
+        }
+        stats['latency.first-invoke.ms'] = format(Math.max(firstInvokeNanos.get(), 0) / 1000000)
+        stats['warmup.state'] = warmUpState
+        stats['warmup.replayed'] = warmUpReplayed.get()
+        bytes.each { channel, size ->
+            stats["bytes.${channel}"] = size.get()
+        }
+        stats['frames'] = currentFrames
+        stats['compress.raw.bytes'] = compressRawBytes.get()
+        stats['compress.wire.bytes'] = compressWireBytes.get()
+        stats['compress.ratio'] = format(compressRawBytes.get() ? compressWireBytes.get() / compressRawBytes.get() : 1)
+        stats['compress.time.ms'] = format(compressNanos.get() / 1000000)
+        stats['frames.per.sec'] = format((currentFrames - lastReportedFrames) / Math.max(seconds(now - lastReportedAt), 0.001))
+
+        def classLoading = ManagementFactory.classLoadingMXBean
+        stats['classes.loaded'] = classLoading.loadedClassCount
+        stats['classes.total.loaded'] = classLoading.totalLoadedClassCount
+        stats['classes.unloaded'] = classLoading.unloadedClassCount
+
+        def heap = ManagementFactory.memoryMXBean.heapMemoryUsage
+        stats['heap.used'] = heap.used
+        stats['heap.committed'] = heap.committed
+        stats['heap.max'] = heap.max
+        def metaspace = ManagementFactory.memoryPoolMXBeans.find { it.name in METASPACE_POOLS }
+        if (metaspace) {
+            stats['metaspace.used'] = metaspace.usage.used
+            stats['metaspace.committed'] = metaspace.usage.committed
+        }
+        stats.putAll(SessionClassLoaders.instance.report())
+        stats.putAll(SessionScheduler.instance.report())
+        stats.putAll(GrapeResolutionCache.instance.report())
+        stats.putAll(DetachedJobs.instance.report())
+
+        def threads = ManagementFactory.threadMXBean
+        stats['threads.live'] = threads.threadCount
+        stats['threads.daemon'] = threads.daemonThreadCount
+        stats['threads.peak'] = threads.peakThreadCount
+
+        lastReportedAt = now
+        lastReportedFrames = currentFrames
+        return stats.collect { key, value -> "${key}: ${value}\n" }.join()
+    }
+
+    private static double seconds(long nanos) {
+        nanos / 1000000000
+    }
+
+    private static String format(double value) {
+        String.format(Locale.ENGLISH, "%.3f", value)
+    }
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+import java.beans.Introspector
+import java.lang.management.ManagementFactory
+import java.lang.ref.WeakReference
+
+/**
+ * Lifecycle of class loaders which each session creates to compile scripts.
+ *
+ * When a session finishes, meta classes of its script classes are removed from the registry
+ * and its class loaders are tracked by weak references, so they should be collected with
+ * their classes by the next full GC. If they are still reachable after a reclamation and
+ * LEAK_AGE, the session is reported as a leak. Typical causes are threads left alive,
+ * meta class changes of JDK classes and static caches which refer to script classes.
+ *
+ * While the server is idle, a reclaimer runs a full GC to unload classes and to let the JVM
+ * shrink the heap, when sessions have finished since the last reclamation or the memory
+ * usage is over the budget.
+ */
+@Singleton
+class SessionClassLoaders implements Runnable {
+
+    private static final long CHECK_INTERVAL = 10 * 1000 // msec
+    private static final long IDLE_TIME = 30 * 1000 // msec
+    private static final long OVER_BUDGET_INTERVAL = 10 * 60 * 1000 // msec between reclamations only for the budget
+    private static final long LEAK_AGE = 5 * 60 * 1000 // msec
+    private static final int MAX_REPORTED_LEAKS = 10
+
+    private static class Session {
+        String label
+        long finishedAt
+        int classCount
+        List<WeakReference<ClassLoader>> loaders
+        boolean leakReported = false
+
+        boolean isUnloaded() {
+            loaders.every { it.get() == null }
+        }
+    }
+
+    private final List<Session> sessions = []
+    private long budget = 0 // bytes of heap and metaspace in use, or 0 for no budget
+    private volatile long lastActiveAt = System.currentTimeMillis()
+    private boolean finishedSinceReclaimed = false
+    private long trackedCount = 0
+    private long unloadedCount = 0
+    private long reclaimedCount = 0
+    private long lastReclaimedAt = 0
+    private long lastFreedBytes = 0
+
+    /**
+     * Starts the reclaimer on a daemon thread.
+     *
+     * @param budget bytes of heap and metaspace in use to reclaim over, or 0 for no budget
+     */
+    void start(long budget) {
+        this.budget = budget
+        def thread = new Thread(this, "SessionClassLoaders")
+        thread.priority = Thread.MIN_PRIORITY
+        thread.daemon = true
+        thread.start()
+    }
+
+    /**
+     * Called when a session finishes, after its sub threads are stopped.
+     */
+    synchronized void finished(String label, Collection<ClassLoader> loaders) {
+        lastActiveAt = System.currentTimeMillis()
+        if (!loaders) return
+        int classCount = 0
+        loaders.each { loader ->
+            if (loader instanceof GroovyClassLoader) {
+                loader.loadedClasses.each { Class cls ->
+                    GroovySystem.metaClassRegistry.removeMetaClass(cls)
+                    classCount++
+                }
+            }
+        }
+        sessions << new Session(
+            label: label,
+            finishedAt: lastActiveAt,
+            classCount: classCount,
+            loaders: loaders.collect { new WeakReference<ClassLoader>(it) },
+        )
+        trackedCount++
+        finishedSinceReclaimed = true
+    }
+
+    @Override
+    void run() {
+        LogUtils.debugLog "Reclaimer is started: budget=${budget}"
+        while (true) {
+            try {
+                Thread.sleep(CHECK_INTERVAL)
+            } catch (InterruptedException e) {
+                LogUtils.debugLog "Reclaimer is interrupted"
+                return
+            }
+            if (ServerStats.instance.activeSessionCount > 0) {
+                lastActiveAt = System.currentTimeMillis()
+                continue
+            }
+            if (System.currentTimeMillis() - lastActiveAt < IDLE_TIME) continue
+            if (shouldReclaim()) {
+                reclaim()
+            }
+        }
+    }
+
+    private synchronized boolean shouldReclaim() {
+        if (finishedSinceReclaimed) return true
+        budget > 0 && usedMemory() > budget && System.currentTimeMillis() - lastReclaimedAt > OVER_BUDGET_INTERVAL
+    }
+
+    /**
+     * Runs a full GC to unload classes of finished sessions.
+     * The heap shrinks according to -XX:MaxHeapFreeRatio of the JVM.
+     */
+    void reclaim() {
+        long before = usedMemory()
+        Introspector.flushCaches()
+        System.gc()
+        long after = usedMemory()
+        synchronized (this) {
+            finishedSinceReclaimed = false
+            reclaimedCount++
+            lastReclaimedAt = System.currentTimeMillis()
+            lastFreedBytes = Math.max(before - after, 0)
+            sweep()
+            reportLeaks()
+        }
+        LogUtils.debugLog "Reclaimed ${lastFreedBytes} bytes: used=${after}"
+        if (budget > 0 && after > budget) {
+            LogUtils.infoLog "Memory in use is still over the budget after reclamation: ${after} > ${budget}"
+        }
+    }
+
+    private void sweep() {
+        for (def it = sessions.iterator(); it.hasNext();) {
+            if (it.next().unloaded) {
+                it.remove()
+                unloadedCount++
+            }
+        }
+    }
+
+    private List<Session> getLeaks() {
+        sessions.findAll { it.finishedAt < lastReclaimedAt && lastReclaimedAt - it.finishedAt > LEAK_AGE }
+    }
+
+    private void reportLeaks() {
+        leaks.findAll { !it.leakReported }.each { session ->
+            session.leakReported = true
+            LogUtils.infoLog "Classes of a finished session are not unloaded: ${session.classCount} classes of ${session.label}"
+        }
+    }
+
+    /**
+     * @return stats in the same form as ServerStats
+     */
+    synchronized Map<String, Object> report() {
+        sweep()
+        def leaks = getLeaks()
+        def stats = [:]
+        stats['classloaders.tracked'] = trackedCount
+        stats['classloaders.alive'] = sessions.size()
+        stats['classloaders.unloaded'] = unloadedCount
+        stats['classloaders.leaked'] = leaks.size()
+        leaks.sort { it.finishedAt }.take(MAX_REPORTED_LEAKS).eachWithIndex { Session session, int i ->
+            long age = (System.currentTimeMillis() - session.finishedAt) / 1000
+            stats["classloaders.leak.${i + 1}"] = "${age}s ${session.classCount} classes ${session.label}"
+        }
+        stats['reclaim.count'] = reclaimedCount
+        stats['reclaim.last.freed'] = lastFreedBytes
+        stats['reclaim.budget'] = budget
+        return stats
+    }
+
+    private static long usedMemory() {
+        long used = ManagementFactory.memoryMXBean.heapMemoryUsage.used
+        def metaspace = ManagementFactory.memoryPoolMXBeans.find { it.name in ServerStats.METASPACE_POOLS }
+        if (metaspace) used += metaspace.usage.used
+        return used
+    }
+}
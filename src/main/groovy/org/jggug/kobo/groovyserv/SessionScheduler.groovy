@@ -0,0 +1,167 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+/**
+ * Admission of sessions by priority class and client.
+ *
+ * Each class has its own limit of concurrent sessions, so batch sessions never take
+ * slots of interactive ones. By default batch sessions can use all cores but one, which
+ * is left for interactive sessions. When a slot of a class is freed, it's given to the
+ * waiting client which has the fewest running sessions of the class, and then to the
+ * one which has waited longest, so a client which sends many sessions at once cannot
+ * starve the others. A session whose client has gone while waiting is dropped instead
+ * of being admitted.
+ */
+@Singleton
+class SessionScheduler {
+
+    static final String INTERACTIVE = 'interactive'
+    static final String BATCH = 'batch'
+    static final List<String> PRIORITIES = [INTERACTIVE, BATCH]
+
+    static class Ticket {
+        final String priority
+        final String client
+        final Closure<Boolean> alive
+        final long queuedAt = System.nanoTime()
+        boolean admitted = false
+        boolean dropped = false
+
+        Ticket(String priority, String client, Closure<Boolean> alive) {
+            this.priority = priority
+            this.client = client
+            this.alive = alive
+        }
+    }
+
+    private static class PriorityClass {
+        int limit
+        int running = 0
+        int queued = 0
+        final Map<String, Integer> runningByClient = [:]
+        final Map<String, LinkedList<Ticket>> waitingByClient = [:]
+    }
+
+    private final Map<String, PriorityClass> classes = [
+        (INTERACTIVE): new PriorityClass(limit: Runtime.runtime.availableProcessors() * 4),
+        (BATCH): new PriorityClass(limit: Math.max(Runtime.runtime.availableProcessors() - 1, 1)),
+    ].asImmutable()
+
+    synchronized void setLimit(String priority, int limit) {
+        assert limit > 0
+        classes[priority].limit = limit
+    }
+
+    /**
+     * Waits until the session is admitted.
+     *
+     * @param client identity of a client to share slots fairly
+     * @param alive checked just before admitting whether the client still waits
+     * @return null if the session is dropped because the client has gone
+     * @throws InterruptedException
+     */
+    synchronized Ticket acquire(String priority, String client, Closure<Boolean> alive = { true }) {
+        def priorityClass = classes[priority]
+        def ticket = new Ticket(priority, client, alive)
+        priorityClass.waitingByClient.get(client, new LinkedList<Ticket>()) << ticket
+        priorityClass.queued++
+        dispatch(priorityClass, ticket)
+        try {
+            while (!ticket.admitted && !ticket.dropped) {
+                wait()
+            }
+        } catch (InterruptedException e) {
+            if (ticket.admitted) {
+                release(ticket)
+            } else if (!ticket.dropped) {
+                def tickets = priorityClass.waitingByClient[client]
+                tickets.remove(ticket)
+                if (tickets.empty) priorityClass.waitingByClient.remove(client)
+                priorityClass.queued--
+            }
+            throw e
+        }
+        if (ticket.dropped) return null
+        ServerStats.instance.sessionAdmitted(priority, ticket.queuedAt)
+        return ticket
+    }
+
+    synchronized void release(Ticket ticket) {
+        def priorityClass = classes[ticket.priority]
+        priorityClass.running--
+        int running = priorityClass.runningByClient[ticket.client] - 1
+        if (running > 0) {
+            priorityClass.runningByClient[ticket.client] = running
+        } else {
+            priorityClass.runningByClient.remove(ticket.client)
+        }
+        dispatch(priorityClass)
+    }
+
+    /**
+     * @param arriving a ticket of the client just read, which isn't probed
+     */
+    private void dispatch(PriorityClass priorityClass, Ticket arriving = null) {
+        boolean changed = false
+        while (priorityClass.running < priorityClass.limit && priorityClass.queued > 0) {
+            String client = nextClient(priorityClass)
+            def tickets = priorityClass.waitingByClient[client]
+            def ticket = tickets.removeFirst()
+            if (tickets.empty) priorityClass.waitingByClient.remove(client)
+            priorityClass.queued--
+            changed = true
+            if (ticket != arriving && !ticket.alive()) {
+                ticket.dropped = true
+                continue
+            }
+            priorityClass.running++
+            priorityClass.runningByClient[client] = (priorityClass.runningByClient[client] ?: 0) + 1
+            ticket.admitted = true
+        }
+        if (changed) notifyAll()
+    }
+
+    private static String nextClient(PriorityClass priorityClass) {
+        String next = null
+        int nextRunning = Integer.MAX_VALUE
+        long nextQueuedAt = Long.MAX_VALUE
+        for (entry in priorityClass.waitingByClient) {
+            int running = priorityClass.runningByClient[entry.key] ?: 0
+            long queuedAt = entry.value.first.queuedAt
+            if (running < nextRunning || (running == nextRunning && queuedAt < nextQueuedAt)) {
+                next = entry.key
+                nextRunning = running
+                nextQueuedAt = queuedAt
+            }
+        }
+        return next
+    }
+
+    /**
+     * @return stats in the same form as ServerStats
+     */
+    synchronized Map<String, Object> report() {
+        def stats = [:]
+        classes.each { priority, priorityClass ->
+            stats["scheduler.${priority}.limit"] = priorityClass.limit
+            stats["scheduler.${priority}.running"] = priorityClass.running
+            stats["scheduler.${priority}.queued"] = priorityClass.queued
+            stats["scheduler.${priority}.waiting-clients"] = priorityClass.waitingByClient.size()
+        }
+        return stats
+    }
+}
@@ -25,6 +25,9 @@ class StreamRequest {
     int port        // required
     String size     // optional: size of input stream
     String command  // optional
+    String channel  // optional: 'out' or 'err' of CreditRequest
+    String credit   // optional: size granted by CreditRequest
+    String compressed // optional: size of the compressed body
 
     boolean isEmpty() {
         getSize() == 0
@@ -34,17 +37,48 @@ class StreamRequest {
         command == "interrupt"
     }
 
+    boolean isEval() {
+        command == "eval"
+    }
+
+    boolean isRerun() {
+        command == "rerun"
+    }
+
+    boolean isCredit() {
+        credit != null
+    }
+
     int getSize() {
         size?.isInteger() ? (size as int) : 0
     }
 
+    boolean isCompressed() {
+        compressed != null
+    }
+
+    int getCompressedSize() {
+        compressed?.isInteger() ? (compressed as int) : 0
+    }
+
+    long getCreditSize() {
+        credit?.isLong() ? (credit as long) : 0
+    }
+
     /**
      * @throws InvalidRequestHeaderException
      */
     void check() {
-        if ((!empty && command) || (empty && !command)) {
+        // 'Size: 0' without a command means that stdin of the client is closed.
+        if ((!empty && command && !eval) || (empty && eval)) {
             throw new InvalidRequestHeaderException("Invalid StreamRequest: size=${size}, command=${command}")
         }
+        if (compressed && (empty || command || compressedSize <= 0)) {
+            throw new InvalidRequestHeaderException("Invalid StreamRequest: size=${size}, compressed=${compressed}")
+        }
+        if (credit && (command || size || !(channel in ['out', 'err']) || creditSize <= 0)) {
+            throw new InvalidRequestHeaderException("Invalid CreditRequest: channel=${channel}, credit=${credit}")
+        }
     }
 }
 
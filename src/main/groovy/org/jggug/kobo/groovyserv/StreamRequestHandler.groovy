@@ -18,6 +18,7 @@ package org.jggug.kobo.groovyserv
 import org.jggug.kobo.groovyserv.exception.GServIOException
 import org.jggug.kobo.groovyserv.exception.GServInterruptedException
 import org.jggug.kobo.groovyserv.exception.InvalidRequestHeaderException
+import org.jggug.kobo.groovyserv.stream.FrameCodec
 import org.jggug.kobo.groovyserv.utils.LogUtils
 
 /**
@@ -49,20 +50,50 @@ class StreamRequestHandler implements Runnable {
                     LogUtils.debugLog "Recieved interruption request from client"
                     throw new GServInterruptedException("By client request")
                 }
+                if (request.isRerun()) {
+                    LogUtils.debugLog "Recieved rerun request from client"
+                    conn.transferRerunRequest()
+                    continue
+                }
+                if (request.isCredit()) {
+                    conn.grantCredit(request.channel, request.creditSize)
+                    continue
+                }
                 if (request.isEmpty()) {
                     LogUtils.debugLog "Recieved empty request from client (Closed stdin on client)"
                     conn.tearDownTransferringPipes()
+                    conn.endEvalRequests()
                     continue // continue to check the client interruption
                 }
+                if (request.isEval()) {
+                    def source = new byte[request.size]
+                    new DataInputStream(conn.socketInputStream).readFully(source) // read from raw stream
+                    readLog(source, 0, source.length, request.size)
+                    ServerStats.instance.transferred('in', source.length)
+                    conn.transferEvalRequest(new String(source)) // using default encoding
+                    continue
+                }
+                if (request.isCompressed()) {
+                    def source = readCompressedFrame(request)
+                    readLog(source, 0, source.length, request.size)
+                    ServerStats.instance.transferred('in', source.length)
+                    if (conn.toreDownPipes) {
+                        LogUtils.errorLog "Already tore down pipes. So the above data is just ignored."
+                    } else {
+                        conn.transferStreamRequest(source, 0, source.length)
+                    }
+                    continue
+                }
 
                 def buff = new byte[request.size]
                 int offset = 0
-                int result = conn.socket.inputStream.read(buff, offset, request.size) // read from raw stream
+                int result = conn.socketInputStream.read(buff, offset, request.size) // read from raw stream
                 if (result == -1) {
                     LogUtils.debugLog "EOF of input stream of socket (Half-closed by the client)"
                     throw new GServInterruptedException("By EOF of input stream of socket")
                 }
                 readLog(buff, offset, result, request.size)
+                ServerStats.instance.transferred('in', result)
                 if (conn.toreDownPipes) {
                     LogUtils.errorLog "Already tore down pipes. So the above data is just ignored."
                 } else {
@@ -88,10 +119,26 @@ class StreamRequestHandler implements Runnable {
         }
         finally {
             conn.tearDownTransferringPipes()
+            conn.closeOutputWindows() // not to wait for credit from the client any more
             LogUtils.debugLog "Thread is dead"
         }
     }
 
+    /**
+     * A broken frame interrupts the session in the same way as an invalid request,
+     * because the following requests cannot be read any more.
+     */
+    private byte[] readCompressedFrame(StreamRequest request) {
+        try {
+            return FrameCodec.readFrame(conn.socketInputStream, request.size, request.compressedSize) // read from raw stream
+        } catch (EOFException e) {
+            throw e
+        } catch (IOException e) {
+            LogUtils.errorLog "Broken compressed frame: ${e.message}"
+            throw new GServInterruptedException("By receiving broken compressed frame")
+        }
+    }
+
     private static readLog(byte[] buff, int offset, int readSize, int sizeHeader) {
         LogUtils.debugLog """\
             |>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+/**
+ * Frequencies of invocations by (cwd, classpath, shape of args), which are
+ * replayed by {@link WarmUpRunner} when the server starts next time.
+ *
+ * The shape of args is groovy options and a script, without args for the script,
+ * because they are usually different for each invocation.
+ * The manifest is saved to WorkFiles.WARMUP_FILE as lines of:
+ * <pre>
+ * count TAB cwd TAB classpath TAB base64(arg1) TAB base64(arg2) ...
+ * </pre>
+ */
+@Singleton
+class WarmUpManifest {
+
+    static final int MAX_SAVED_ENTRIES = 20
+    private static final int MAX_TRACKED_ENTRIES = 1000
+    private static final long SAVE_INTERVAL = 60 * 1000 // msec
+    private static final List<String> OPTIONS_WITH_VALUE = ['-c', '--encoding', '-i', '-l', '-b', '--basescript', '--configscript']
+
+    static class Entry {
+        String cwd
+        String classpath
+        List<String> args
+        int count
+    }
+
+    private final Map<String, Entry> entries = [:]
+    private long lastSavedAt = System.currentTimeMillis()
+
+    /**
+     * @param args args of groovy from which classpath options are removed
+     */
+    synchronized void record(String cwd, String classpath, List<String> args) {
+        def shape = shapeOf(args)
+        if (!shape) return
+        def key = [cwd ?: '', classpath ?: '', *shape].join('\t')
+        def entry = entries[key]
+        if (!entry) {
+            if (entries.size() >= MAX_TRACKED_ENTRIES) {
+                entries.remove(entries.min { it.value.count }.key)
+            }
+            entry = entries[key] = new Entry(cwd: cwd ?: '', classpath: classpath ?: '', args: shape)
+        }
+        entry.count++
+        if (System.currentTimeMillis() - lastSavedAt > SAVE_INTERVAL) {
+            save()
+        }
+    }
+
+    /**
+     * @return the most frequent entries in descending order
+     */
+    synchronized List<Entry> getTopEntries() {
+        entries.values().sort { -it.count }.take(MAX_SAVED_ENTRIES)
+    }
+
+    synchronized void load() {
+        if (!WorkFiles.WARMUP_FILE.isFile()) return
+        try {
+            WorkFiles.WARMUP_FILE.eachLine { String line ->
+                def fields = line.split('\t', -1) as List
+                if (fields.size() < 4 || !fields[0].isInteger()) return
+                def args = fields.drop(3).collect { new String(it.decodeBase64()) } // using default encoding
+                def key = [fields[1], fields[2], *args].join('\t')
+                entries[key] = new Entry(cwd: fields[1], classpath: fields[2], args: args, count: fields[0] as int)
+            }
+            LogUtils.debugLog "Warm-up manifest is loaded: ${entries.size()} entries"
+        } catch (IOException e) {
+            LogUtils.errorLog "Failed to load warm-up manifest: ${WorkFiles.WARMUP_FILE}", e
+        }
+    }
+
+    synchronized void save() {
+        lastSavedAt = System.currentTimeMillis()
+        try {
+            WorkFiles.WARMUP_FILE.text = topEntries.collect { entry ->
+                ([entry.count, entry.cwd, entry.classpath] + entry.args.collect { it.bytes.encodeBase64() }).join('\t') + '\n'
+            }.join()
+        } catch (IOException e) {
+            LogUtils.errorLog "Failed to save warm-up manifest: ${WorkFiles.WARMUP_FILE}", e
+        }
+    }
+
+    /**
+     * @return groovy options and a script of args, or empty if no script is specified
+     */
+    static List<String> shapeOf(List<String> args) {
+        def shape = []
+        for (def it = args.iterator(); it.hasNext();) {
+            String arg = it.next()
+            shape << arg
+            if (arg == '-e') {
+                return it.hasNext() ? shape + it.next() : []
+            }
+            if (arg in OPTIONS_WITH_VALUE) {
+                if (it.hasNext()) shape << it.next()
+                continue
+            }
+            if (!arg.startsWith('-')) {
+                return shape // a script, and the rest are args for it
+            }
+        }
+        return []
+    }
+}
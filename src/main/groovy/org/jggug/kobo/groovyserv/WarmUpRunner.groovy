@@ -0,0 +1,136 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+/**
+ * Replays entries of {@link WarmUpManifest} on a low-priority thread after the server starts,
+ * so that classes are loaded and the JIT is warm before real invocations arrive.
+ *
+ * Modes:
+ * <ul>
+ * <li>'compile' only compiles each script with its classpath in a throwaway class loader.
+ *     It's safe for any script.</li>
+ * <li>'run' invokes each script through the server as a client does, with stdin closed
+ *     and output discarded, and without changing the current directory. It exercises the code of scripts too, so it's only for
+ *     scripts without side effects.</li>
+ * </ul>
+ */
+class WarmUpRunner implements Runnable {
+
+    static final List<String> MODES = ['compile', 'run']
+    private static final int ROUNDS = 3
+    private static final int TIMEOUT = 60 * 1000 // msec for each invocation
+
+    private final String mode
+    private final int port
+    private final AuthToken authToken
+
+    WarmUpRunner(String mode, int port, AuthToken authToken) {
+        assert mode in MODES
+        this.mode = mode
+        this.port = port
+        this.authToken = authToken
+    }
+
+    void start() {
+        def thread = new Thread(this, "WarmUpRunner")
+        thread.priority = Thread.MIN_PRIORITY
+        thread.daemon = true
+        ServerStats.instance.warmUpStarted() // before the server accepts requests, to be seen by stats
+        thread.start()
+    }
+
+    @Override
+    void run() {
+        def entries = WarmUpManifest.instance.topEntries
+        LogUtils.infoLog "Warm-up is started in '${mode}' mode: ${entries.size()} entries"
+        long startedAt = System.nanoTime()
+        ROUNDS.times {
+            entries.each { entry ->
+                try {
+                    if (mode == 'run') {
+                        invoke(entry)
+                    } else {
+                        compile(entry)
+                    }
+                    ServerStats.instance.warmUpReplayed()
+                } catch (Exception e) {
+                    LogUtils.debugLog "Failed to warm up: ${entry.args}", e
+                }
+            }
+        }
+        ServerStats.instance.warmUpFinished()
+        LogUtils.infoLog "Warm-up is finished in ${(System.nanoTime() - startedAt) / 1000000} ms"
+    }
+
+    private void compile(WarmUpManifest.Entry entry) {
+        def loader = new GroovyClassLoader(getClass().classLoader)
+        try {
+            classpathOf(entry).each { loader.addClasspath(it) }
+            int inline = entry.args.indexOf('-e')
+            if (inline >= 0) {
+                loader.parseClass(entry.args[inline + 1])
+                return
+            }
+            def script = resolve(entry.cwd, entry.args.last())
+            if (!script.isFile()) script = new File(script.path + ".groovy") // the same as groovy command
+            if (script.isFile()) loader.parseClass(script)
+        } finally {
+            loader.clearCache()
+        }
+    }
+
+    private static File resolve(String cwd, String path) {
+        def file = new File(path)
+        (file.absolute || !cwd) ? file : new File(cwd, path)
+    }
+
+    private static List<String> classpathOf(WarmUpManifest.Entry entry) {
+        entry.classpath.split(File.pathSeparator).findAll { it }.collect { resolve(entry.cwd, it).path }
+    }
+
+    /**
+     * A script is invoked without Cwd, because a session on a different current directory
+     * cannot run at the same time and it would block real invocations.
+     */
+    private static List<String> absoluteArgs(WarmUpManifest.Entry entry) {
+        if (entry.args.contains('-e')) return entry.args
+        entry.args.take(entry.args.size() - 1) + resolve(entry.cwd, entry.args.last()).path
+    }
+
+    private void invoke(WarmUpManifest.Entry entry) {
+        def socket = new Socket("localhost", port)
+        try {
+            socket.soTimeout = TIMEOUT
+            socket.outputStream.with {
+                write(ClientProtocols.formatAsLoopbackRequest(new InvocationRequest(
+                    clientAuthToken: authToken.token,
+                    args: absoluteArgs(entry),
+                    classpath: classpathOf(entry).join(File.pathSeparator),
+                    warmup: true,
+                )))
+                flush()
+            }
+            // output is discarded until the server closes the connection
+            def buff = new byte[8192]
+            while (socket.inputStream.read(buff) != -1) {}
+        } finally {
+            socket.close()
+        }
+    }
+}
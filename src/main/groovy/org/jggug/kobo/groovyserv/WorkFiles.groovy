@@ -23,6 +23,9 @@ class WorkFiles {
     static final File DATA_DIR = new File("${System.getProperty('user.home')}/.groovy/groovyserv")
     static File LOG_FILE
     static File AUTHTOKEN_FILE
+    static File WARMUP_FILE
+    static File GRAPE_CACHE_FILE
+    static File JOBS_DIR
 
     static {
         setUp(GroovyServer.DEFAULT_PORT)
@@ -38,6 +41,9 @@ class WorkFiles {
         initWorkDir()
         LOG_FILE = new File(DATA_DIR, "groovyserver-${port}.log")
         AUTHTOKEN_FILE = new File(DATA_DIR, "authtoken-${port}")
+        WARMUP_FILE = new File(DATA_DIR, "warmup-${port}")
+        GRAPE_CACHE_FILE = new File(DATA_DIR, "grapes-${port}")
+        JOBS_DIR = new File(DATA_DIR, "jobs-${port}")
     }
 }
 
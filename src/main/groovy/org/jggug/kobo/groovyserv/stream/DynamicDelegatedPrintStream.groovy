@@ -15,22 +15,53 @@
  */
 package org.jggug.kobo.groovyserv.stream
 
+import groovy.transform.CompileStatic
+import org.jggug.kobo.groovyserv.ClientConnection
+
 /**
- * Dynamically delegatable PrintStream.
+ * Dynamically delegatable PrintStream, which delegates to the stream of the
+ * connection of the current thread.
+ *
+ * The stream is resolved once per thread and kept in a thread local, so that
+ * threads of sessions printing at the same time don't look up the connection
+ * for each call. A thread-local connection is changed only by the thread itself,
+ * which calls invalidate() at the time. Methods are statically compiled not to
+ * dispatch dynamically.
  *
  * @author NAKANO Yasuharu
  */
+@CompileStatic
 class DynamicDelegatedPrintStream extends PrintStream {
 
-    private Closure delegate
+    static final String OUT = 'out'
+    static final String ERR = 'err'
+
+    private final String channel
+    private final ThreadLocal<PrintStream> resolved = new ThreadLocal<PrintStream>()
 
-    DynamicDelegatedPrintStream(Closure delegate) {
+    DynamicDelegatedPrintStream(String channel) {
         super(new ByteArrayOutputStream()) // dummy for instantiation
-        this.delegate = delegate
+        assert channel in [OUT, ERR]
+        this.channel = channel
+    }
+
+    /**
+     * Called by a thread when its connection is changed.
+     * It also releases the stream of a finished session.
+     * Streams resolved by other threads are kept.
+     */
+    void invalidate() {
+        resolved.remove()
     }
 
     private PrintStream getPrintStream() {
-        delegate.call()
+        PrintStream stream = resolved.get()
+        if (stream == null) {
+            ClientConnection conn = ClientConnection.currentConnection
+            stream = (channel == ERR) ? conn.err : conn.out
+            resolved.set(stream)
+        }
+        return stream
     }
 
     @Override
@@ -175,7 +206,7 @@ class DynamicDelegatedPrintStream extends PrintStream {
 
     @Override
     PrintStream append(CharSequence csq) {
-        getPrintStream().append()
+        getPrintStream().append(csq)
     }
 
     @Override
@@ -189,4 +220,3 @@ class DynamicDelegatedPrintStream extends PrintStream {
     }
 
 }
-
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.ClientProtocols
+import org.jggug.kobo.groovyserv.ServerStats
+
+/**
+ * Compression of stream frames negotiated by 'Compress: lz4'.
+ *
+ * A frame smaller than MIN_SIZE, or which doesn't get smaller, is sent raw, because
+ * compression costs more than it saves. A compressed frame has no more than MAX_SIZE
+ * bytes of data, so that the client can decompress it in a bounded buffer.
+ * An instance is used by a channel, because Lz4Codec isn't thread-safe.
+ */
+class FrameCodec {
+
+    static final String LZ4 = 'lz4'
+    static final int MIN_SIZE = 512 // bytes
+    static final int MAX_SIZE = 64 * 1024 // bytes
+
+    private final Lz4Codec lz4 = new Lz4Codec()
+    private final byte[] packed = new byte[Lz4Codec.maxCompressedLength(MAX_SIZE)]
+
+    /**
+     * Writes data as StreamResponse of the channel, compressed if it's worth it.
+     */
+    synchronized void writeFrames(OutputStream outputStream, String streamId, byte[] b, int offset, int length) {
+        while (length > 0) {
+            int size = Math.min(length, MAX_SIZE)
+            int packedSize = (size >= MIN_SIZE) ? compress(b, offset, size) : -1
+            if (packedSize >= 0 && packedSize < size) {
+                outputStream.write(ClientProtocols.formatAsResponseHeader(streamId, size, packedSize))
+                outputStream.write(packed, 0, packedSize)
+            } else {
+                outputStream.write(ClientProtocols.formatAsResponseHeader(streamId, size))
+                outputStream.write(b, offset, size)
+            }
+            offset += size
+            length -= size
+        }
+    }
+
+    private int compress(byte[] b, int offset, int size) {
+        long startedAt = System.nanoTime()
+        int packedSize = lz4.compress(b, offset, size, packed, 0)
+        ServerStats.instance.compressed(size, Math.min(packedSize, size), System.nanoTime() - startedAt)
+        return packedSize
+    }
+
+    /**
+     * Reads a compressed body of StreamRequest.
+     *
+     * @throws IOException when the body is broken
+     */
+    static byte[] readFrame(InputStream ins, int size, int packedSize) {
+        if (size <= 0 || size > MAX_SIZE || packedSize <= 0 || packedSize > Lz4Codec.maxCompressedLength(size)) {
+            throw new IOException("Invalid compressed frame: size=${size}, compressed=${packedSize}")
+        }
+        def packed = new byte[packedSize]
+        new DataInputStream(ins).readFully(packed)
+        long startedAt = System.nanoTime()
+        def buff = new byte[size]
+        try {
+            if (Lz4Codec.decompress(packed, 0, packedSize, buff, 0, size) != size) {
+                throw new IOException("Compressed frame is shorter than its header: size=${size}")
+            }
+        } catch (IllegalArgumentException e) {
+            throw new IOException(e.message, e)
+        }
+        ServerStats.instance.compressed(size, packedSize, System.nanoTime() - startedAt)
+        return buff
+    }
+}
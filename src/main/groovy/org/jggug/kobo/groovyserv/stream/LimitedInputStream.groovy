@@ -0,0 +1,63 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+/**
+ * InputStream which reads no more than the limit from the underlying stream,
+ * so that a buffer over it never takes bytes of the following request.
+ * Closing this stream doesn't close the underlying one.
+ */
+class LimitedInputStream extends InputStream {
+
+    private final InputStream ins
+    private long remaining
+
+    LimitedInputStream(InputStream ins, long limit) {
+        this.ins = ins
+        this.remaining = limit
+    }
+
+    long getRemaining() {
+        remaining
+    }
+
+    @Override
+    int read() {
+        if (remaining <= 0) return -1
+        int ch = ins.read()
+        if (ch != -1) remaining--
+        return ch
+    }
+
+    @Override
+    int read(byte[] buf, int offset, int length) {
+        if (length == 0) return 0
+        if (remaining <= 0) return -1
+        int size = ins.read(buf, offset, (int) Math.min(length, remaining))
+        if (size > 0) remaining -= size
+        return size
+    }
+
+    @Override
+    int available() {
+        (int) Math.min(ins.available(), remaining)
+    }
+
+    @Override
+    void close() {
+        // the underlying stream is still used
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.ClientProtocols
+
+/**
+ * Credit-based flow control of StreamResponse for a channel.
+ * The server sends no more data than the credit which the client grants by
+ * CreditRequest after writing received data out.
+ *
+ * Without a spill buffer, a writer waits for credit. With a spill buffer,
+ * data over the credit is buffered and a writer never waits, and buffered
+ * data is sent when credit is granted.
+ */
+class OutputWindow {
+
+    private static final int SPILL_READ_SIZE = 8192
+
+    private final String streamId
+    private final OutputStream outputStream
+    private final Object frameLock // shared by all windows on the socket
+    private final SpillBuffer spill // null unless spilling is enabled
+    private final FrameCodec codec  // null unless compression is negotiated
+    private long credit
+    private boolean closed = false
+
+    OutputWindow(String streamId, OutputStream outputStream, Object frameLock, long credit, SpillBuffer spill = null, FrameCodec codec = null) {
+        this.streamId = streamId
+        this.outputStream = outputStream
+        this.frameLock = frameLock
+        this.credit = credit
+        this.spill = spill
+        this.codec = codec
+    }
+
+    /**
+     * @throws IOException When the window is closed
+     * @throws InterruptedIOException When interrupted while waiting for credit
+     */
+    synchronized void write(byte[] b, int offset, int length) {
+        if (closed) throw new IOException("Window of channel '$streamId' already closed")
+        if (spill != null) {
+            if (spill.empty && credit > 0) {
+                int size = (int) Math.min(credit, length)
+                sendFrame(b, offset, size)
+                offset += size
+                length -= size
+            }
+            if (length > 0) spill.append(b, offset, length)
+            return
+        }
+        while (length > 0) {
+            awaitCredit()
+            int size = (int) Math.min(credit, length)
+            sendFrame(b, offset, size)
+            offset += size
+            length -= size
+        }
+    }
+
+    /**
+     * Called when CreditRequest is received. Spilled data is sent here.
+     */
+    synchronized void grant(long size) {
+        if (closed) return
+        credit += size
+        if (spill != null) {
+            def buf = new byte[SPILL_READ_SIZE]
+            while (credit > 0 && !spill.empty) {
+                sendFrame(buf, 0, spill.read(buf, (int) Math.min(credit, buf.length)))
+            }
+        }
+        notifyAll()
+    }
+
+    /**
+     * To wait until all spilled data is sent, before sending the exit status.
+     *
+     * @throws InterruptedException
+     */
+    synchronized void awaitDrained() {
+        while (!closed && spill != null && !spill.empty) {
+            wait()
+        }
+    }
+
+    synchronized void close() {
+        closed = true
+        spill?.close()
+        notifyAll()
+    }
+
+    private void awaitCredit() {
+        while (credit <= 0) {
+            if (closed) throw new IOException("Window of channel '$streamId' already closed")
+            try {
+                wait()
+            } catch (InterruptedException e) {
+                throw new InterruptedIOException("Interrupted to wait for credit of channel '$streamId'")
+            }
+        }
+    }
+
+    private void sendFrame(byte[] b, int offset, int length) {
+        synchronized (frameLock) {
+            if (codec) {
+                codec.writeFrames(outputStream, streamId, b, offset, length)
+            } else {
+                outputStream.write(ClientProtocols.formatAsResponseHeader(streamId, length))
+                outputStream.write(b, offset, length)
+            }
+            outputStream.flush()
+        }
+        credit -= length
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.WorkFiles
+import org.jggug.kobo.groovyserv.utils.LogUtils
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.channels.FileChannel
+
+/**
+ * A single-producer single-consumer ring on a file mapped by both of a client
+ * and the server on the same host, to pass output without copying it through
+ * the socket.
+ *
+ * The server only writes data and the client only advances the tail, so no lock
+ * is needed between them. The written position is notified to the client by a
+ * Ring frame on the socket, which also makes the data visible to the client.
+ * The layout must be the same as shm.h of the client.
+ */
+class SharedMemoryRing {
+
+    static final int CONTROL_SIZE = 64 // the tail in native byte order, padded to a cache line
+    static final int MAX_CAPACITY = 64 * 1024 * 1024
+
+    private static final int SPIN_COUNT = 100
+
+    private final ByteBuffer control
+    private final ByteBuffer data
+    private final int capacity
+    private long head = 0
+
+    private SharedMemoryRing(ByteBuffer buffer, int capacity) {
+        this.capacity = capacity
+        buffer.limit(CONTROL_SIZE)
+        this.control = buffer.slice().order(ByteOrder.nativeOrder())
+        buffer.limit(CONTROL_SIZE + capacity).position(CONTROL_SIZE)
+        this.data = buffer.slice()
+    }
+
+    /**
+     * To map rings of 'out' and 'err' from the value of Shm header, "<path> <capacity>".
+     * The file is removed after mapping, because the client already has mapped it.
+     *
+     * @return a map of streamId to ring, or null when the rings are unavailable
+     */
+    static Map<String, SharedMemoryRing> map(String spec) {
+        try {
+            def (path, capacityText) = spec.tokenize(' ')
+            int capacity = capacityText as int
+            def file = new File(path)
+            long size = 2L * (CONTROL_SIZE + capacity)
+            if (capacity <= 0 || capacity > MAX_CAPACITY || (capacity & (capacity - 1)) != 0
+                || file.canonicalFile.parentFile != WorkFiles.DATA_DIR.canonicalFile
+                || file.length() != size) {
+                LogUtils.errorLog "Invalid shared memory: ${spec}"
+                return null
+            }
+            def buffer
+            def raf = new RandomAccessFile(file, "rw")
+            try {
+                buffer = raf.channel.map(FileChannel.MapMode.READ_WRITE, 0, size) // kept after closing
+            } finally {
+                raf.close()
+            }
+            file.delete()
+            buffer.position(CONTROL_SIZE + capacity)
+            def errBuffer = buffer.slice()
+            buffer.position(0)
+            return [out: new SharedMemoryRing(buffer, capacity), err: new SharedMemoryRing(errBuffer, capacity)]
+        } catch (Exception e) {
+            LogUtils.errorLog "Failed to map shared memory: ${spec}", e
+            return null
+        }
+    }
+
+    /**
+     * @return the position up to which data is written
+     */
+    long getHead() {
+        head
+    }
+
+    /**
+     * To copy as much data as the free space allows.
+     * It waits until the client frees some space if the ring is full.
+     *
+     * @return the size of copied data
+     * @throws InterruptedIOException
+     */
+    synchronized int write(byte[] b, int offset, int length) {
+        int size = Math.min(length, waitForFreeSpace())
+        int index = (int) (head & (capacity - 1))
+        int first = Math.min(size, capacity - index)
+        data.position(index)
+        data.put(b, offset, first)
+        if (first < size) {
+            data.position(0)
+            data.put(b, offset + first, size - first)
+        }
+        head += size
+        return size
+    }
+
+    private int waitForFreeSpace() {
+        int spin = 0
+        while (true) {
+            long free = capacity - (head - control.getLong(0))
+            if (free > 0) return (int) free
+            if (Thread.interrupted()) {
+                throw new InterruptedIOException("Interrupted to wait for the client to read the ring")
+            }
+            if (spin++ < SPIN_COUNT) {
+                Thread.yield()
+            } else {
+                try {
+                    Thread.sleep(1)
+                } catch (InterruptedException e) {
+                    throw new InterruptedIOException("Interrupted to wait for the client to read the ring")
+                }
+            }
+        }
+    }
+}
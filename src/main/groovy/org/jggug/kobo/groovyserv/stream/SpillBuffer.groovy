@@ -0,0 +1,110 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+/**
+ * A FIFO buffer of output which a client cannot receive yet.
+ * Data is kept in memory up to the limit, and the rest is spilled to a temporary file.
+ * It isn't thread-safe.
+ */
+class SpillBuffer {
+
+    private final long memoryLimit
+    private final File dir
+
+    private final LinkedList<byte[]> chunks = new LinkedList<byte[]>()
+    private int chunkOffset = 0 // read offset in the first chunk
+    private long memorySize = 0
+
+    private File file
+    private RandomAccessFile fileAccess
+    private long fileWritten = 0
+    private long fileRead = 0
+
+    SpillBuffer(long memoryLimit, File dir) {
+        this.memoryLimit = memoryLimit
+        this.dir = dir
+    }
+
+    boolean isEmpty() {
+        memorySize == 0 && fileRead == fileWritten
+    }
+
+    long getSize() {
+        memorySize + fileWritten - fileRead
+    }
+
+    /**
+     * Data goes to the file while the file has unread data, to keep the order.
+     */
+    void append(byte[] b, int offset, int length) {
+        if (fileRead == fileWritten && memorySize + length <= memoryLimit) {
+            def chunk = new byte[length]
+            System.arraycopy(b, offset, chunk, 0, length)
+            chunks << chunk
+            memorySize += length
+            return
+        }
+        if (!fileAccess) {
+            file = File.createTempFile("spill-", ".tmp", dir)
+            file.deleteOnExit()
+            fileAccess = new RandomAccessFile(file, "rw")
+        }
+        fileAccess.seek(fileWritten)
+        fileAccess.write(b, offset, length)
+        fileWritten += length
+    }
+
+    /**
+     * @return the size of read data, or 0 when empty
+     */
+    int read(byte[] buf, int length) {
+        if (memorySize > 0) {
+            def chunk = chunks.first
+            int size = Math.min(length, chunk.length - chunkOffset)
+            System.arraycopy(chunk, chunkOffset, buf, 0, size)
+            chunkOffset += size
+            memorySize -= size
+            if (chunkOffset == chunk.length) {
+                chunks.removeFirst()
+                chunkOffset = 0
+            }
+            return size
+        }
+        if (fileRead < fileWritten) {
+            fileAccess.seek(fileRead)
+            int size = fileAccess.read(buf, 0, (int) Math.min(length, fileWritten - fileRead))
+            fileRead += size
+            if (fileRead == fileWritten) { // to reuse the file from the beginning
+                fileAccess.setLength(0)
+                fileRead = fileWritten = 0
+            }
+            return size
+        }
+        return 0
+    }
+
+    void close() {
+        chunks.clear()
+        memorySize = 0
+        if (fileAccess) {
+            fileAccess.close()
+            file.delete()
+            fileAccess = null
+        }
+        fileRead = fileWritten = 0
+    }
+}
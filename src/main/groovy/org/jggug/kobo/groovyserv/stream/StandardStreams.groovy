@@ -42,16 +42,24 @@ class StandardStreams {
         System.err = ALTERNATES.err
     }
 
+    /**
+     * Called by a thread when its connection is set or cleared.
+     */
+    static void invalidateCache() {
+        ALTERNATES.out.invalidate()
+        ALTERNATES.err.invalidate()
+    }
+
     private static InputStream newInAsInputStream() {
         new DynamicDelegatedInputStream({ -> ClientConnection.currentConnection.ins })
     }
 
     private static PrintStream newOutAsPrintStream() {
-        new DynamicDelegatedPrintStream({ -> ClientConnection.currentConnection.out })
+        new DynamicDelegatedPrintStream(DynamicDelegatedPrintStream.OUT)
     }
 
     private static PrintStream newErrAsPrintStream() {
-        new DynamicDelegatedPrintStream({ -> ClientConnection.currentConnection.err })
+        new DynamicDelegatedPrintStream(DynamicDelegatedPrintStream.ERR)
     }
 
 }
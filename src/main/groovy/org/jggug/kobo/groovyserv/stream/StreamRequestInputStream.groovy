@@ -27,6 +27,7 @@ class StreamRequestInputStream extends InputStream {
 
     private InputStream inputStream
     private boolean closed = false
+    private Closure onConsumed // called with the size of read data for flow control (optional)
 
     private StreamRequestInputStream() { /* preventing from instantiation */ }
 
@@ -41,7 +42,9 @@ class StreamRequestInputStream extends InputStream {
     int read() {
         if (closed) throw new IOException("Stream of channel 'in' already closed")
         try {
-            return inputStream.read()
+            int b = inputStream.read()
+            if (b != -1) onConsumed?.call(1)
+            return b
         } catch (InterruptedIOException e) {
             LogUtils.debugLog "StreamRequestInputStream:read(): Interrupted I/O"
             return -1
@@ -55,7 +58,9 @@ class StreamRequestInputStream extends InputStream {
     int read(byte[] buf, int offset, int length) {
         if (closed) throw new IOException("Stream of channel 'in' already closed")
         try {
-            return inputStream.read(buf, offset, length)
+            int size = inputStream.read(buf, offset, length)
+            if (size > 0) onConsumed?.call(size)
+            return size
         } catch (InterruptedIOException e) {
             LogUtils.debugLog "StreamRequestInputStream:read(byte[], int, int): Interrupted I/O"
             return -1
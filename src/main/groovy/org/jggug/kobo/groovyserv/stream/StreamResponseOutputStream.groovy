@@ -17,6 +17,7 @@ package org.jggug.kobo.groovyserv.stream
 
 import org.jggug.kobo.groovyserv.ClientConnection
 import org.jggug.kobo.groovyserv.ClientProtocols
+import org.jggug.kobo.groovyserv.ServerStats
 import org.jggug.kobo.groovyserv.utils.LogUtils
 
 /**
@@ -30,6 +31,10 @@ class StreamResponseOutputStream extends OutputStream {
     private String streamId
     private boolean closed = false
     private boolean noHeader = false
+    private SharedMemoryRing ring // null unless output is passed through shared memory
+    private Object frameLock      // shared with other writers of frames on the socket when using a ring
+    private OutputWindow window   // null unless flow control is requested
+    private FrameCodec codec      // null unless compression is negotiated
 
     private StreamResponseOutputStream() { /* preventing from instantiation */ }
 
@@ -59,7 +64,22 @@ class StreamResponseOutputStream extends OutputStream {
     void write(byte[] b, int offset, int length) {
         if (closed) throw new IOException("Stream of channel '$streamId' already closed")
         writeVerboseLog(b, offset, length)
+        if (ring && !noHeader) {
+            writeToRing(b, offset, length)
+            return
+        }
+        if (window && !noHeader) {
+            window.write(b, offset, length)
+            ServerStats.instance.transferred(streamId, length)
+            return
+        }
         // FIXME When System.exit to a sub thread which in infinte loop, following synchronized occures IllegalMonitorStateException.
+        if (codec && !noHeader) {
+            codec.writeFrames(outputStream, streamId, b, offset, length)
+            outputStream.flush()
+            ServerStats.instance.transferred(streamId, length)
+            return
+        }
         //synchronized(outputStream) { // to keep independency of 'out' and 'err' on socket stream
         byte[] header = ClientProtocols.formatAsResponseHeader(streamId, length)
         outputStream.with {
@@ -68,6 +88,19 @@ class StreamResponseOutputStream extends OutputStream {
             flush()
         }
         //}
+        ServerStats.instance.transferred(streamId, length)
+    }
+
+    private void writeToRing(byte[] b, int offset, int length) {
+        int written = 0
+        while (written < length) {
+            written += ring.write(b, offset + written, length - written)
+            synchronized (frameLock) {
+                outputStream.write(ClientProtocols.formatAsRingHeader(streamId, ring.head))
+                outputStream.flush()
+            }
+        }
+        ServerStats.instance.transferred(streamId, length)
     }
 
     /**
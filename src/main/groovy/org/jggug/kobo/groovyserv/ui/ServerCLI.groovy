@@ -19,6 +19,8 @@ import org.jggug.kobo.groovyserv.AuthToken
 import org.jggug.kobo.groovyserv.ExitStatus
 import org.jggug.kobo.groovyserv.GroovyClient
 import org.jggug.kobo.groovyserv.GroovyServer
+import org.jggug.kobo.groovyserv.SessionScheduler
+import org.jggug.kobo.groovyserv.WarmUpRunner
 import org.jggug.kobo.groovyserv.WorkFiles
 import org.jggug.kobo.groovyserv.platform.PlatformMethods
 import org.jggug.kobo.groovyserv.utils.Holders
@@ -69,6 +71,10 @@ class ServerCLI {
                 shutdownServer()
                 return
             }
+            if (options.detached) {
+                startServerInThisProcess() // infinite blocking operation unless it cannot start
+                return
+            }
             startServerAsDaemon()
         }
         catch (Throwable e) {
@@ -149,14 +155,40 @@ class ServerCLI {
 
     private void startServerAsDaemon() {
         def client = newGroovyClient()
+        if (!isReadyToStart(client)) return
+
+        // Starting
+        print "Starting server..."
+        daemonize() // start daemon process
+
+        // Waiting for server up
+        // The authtoken file is written when the server is ready to accept requests.
+        while (!WorkFiles.AUTHTOKEN_FILE.exists() || !client.isServerAvailable()) {
+            print "."
+            sleep 200
+        }
+        println "" // clear for print
+        println "Server is successfully started up on $port port"
+    }
 
+    /**
+     * Starts a server in this process, which the server script has run in background.
+     * The script waits for the authtoken file instead of this process, so it takes only one JVM.
+     */
+    private void startServerInThisProcess() {
+        if (!isReadyToStart(newGroovyClient())) return
+        println "Starting server..."
+        startServerDirectlyAndWaitFor()
+    }
+
+    private boolean isReadyToStart(GroovyClient client) {
         // For usability, the following code checks status in detail and shows an appropriate message.
 
         // If server is already running, it needs to do nothing.
         if (client.canConnect()) {
             makeSureServerAvailableOrDie(client)
             println "WARN: server is already running on ${port} port"
-            return
+            return false
         }
 
         // If there is authtoken file, it must be old and unnecessary.
@@ -166,19 +198,7 @@ class ServerCLI {
         }
 
         // From here, the port is unused by any process.
-
-        // Starting
-        print "Starting server..."
-        daemonize() // start daemon process
-
-        // Waiting for server up
-        sleep 2000
-        while (!WorkFiles.AUTHTOKEN_FILE.exists() || !client.isServerAvailable()) {
-            print "."
-            sleep 200
-        }
-        println "" // clear for print
-        println "Server is successfully started up on $port port"
+        return true
     }
 
     private void startServerDirectlyAndWaitFor() {
@@ -186,11 +206,18 @@ class ServerCLI {
             die "ERROR: GroovyServer is already started in the same JVM"
         }
 
+        recordClassPathForClassDataSharing()
+
         // Setup GroovyServer instance
         def groovyServer = new GroovyServer()
         groovyServer.port = port
         if (options.authtoken) groovyServer.authToken = new AuthToken(options.authtoken)
         if (options."allow-from") groovyServer.allowFrom = options["allow-from"]?.split(',')
+        if (options.spill) groovyServer.spillSize = parseSize(options.spill)
+        if (options.warmup) groovyServer.warmUpMode = options.warmup
+        if (options."memory-budget") groovyServer.memoryBudget = parseSize(options."memory-budget")
+        if (options."max-interactive") groovyServer.sessionLimits[SessionScheduler.INTERACTIVE] = parseLimit(options."max-interactive")
+        if (options."max-batch") groovyServer.sessionLimits[SessionScheduler.BATCH] = parseLimit(options."max-batch")
 
         // Set holders for global access
         // This is necessary for RequestWorker's call of shutdown.
@@ -200,6 +227,21 @@ class ServerCLI {
         groovyServer.start()
     }
 
+    /**
+     * While a server script is training class data sharing, it needs the JVM and classpath
+     * of this process to build the archive. The file is written at exit, after the list of
+     * loaded classes is complete.
+     */
+    private void recordClassPathForClassDataSharing() {
+        def path = System.getProperty("groovyserv.cds.classpathFile")
+        if (!path) return
+        def javaHome = System.getProperty("java.home")
+        def classPath = System.getProperty("java.class.path")
+        Runtime.runtime.addShutdownHook(new Thread({
+            new File(path).text = "${javaHome}\n${classPath}\n"
+        } as Runnable))
+    }
+
     private GroovyClient newGroovyClient() {
         return new GroovyClient(host: "localhost", port: port)
     }
@@ -215,11 +257,22 @@ class ServerCLI {
             p longOpt: 'port', args: 1, argName: 'port', "specify the port to listen"
             _ longOpt: 'allow-from', args: 1, argName: 'addresses', "specify optional acceptable client addresses (delimiter: comma)"
             _ longOpt: 'authtoken', args: 1, argName: 'authtoken', "specify authtoken (which is automatically generated if not specified)"
+            _ longOpt: 'spill', args: 1, argName: 'size', "buffer output for a slow client up to the size (suffix K/M/G) in memory and the rest in a file"
+            _ longOpt: 'warmup', args: 1, argName: 'mode', "replay frequent invocations at startup to warm up ('compile' or 'run')"
+            _ longOpt: 'memory-budget', args: 1, argName: 'size', "reclaim memory while idle when heap and metaspace in use are over the size (suffix K/M/G)"
+            _ longOpt: 'max-interactive', args: 1, argName: 'n', "specify max number of concurrent interactive sessions (default: 4 per CPU)"
+            _ longOpt: 'max-batch', args: 1, argName: 'n', "specify max number of concurrent batch sessions (default: number of CPUs - 1)"
+            _ longOpt: 'cds-train', "record loaded classes to build a class data sharing archive at the next start (JDK 10 or later)"
             _ longOpt: 'daemonized', "run a groovyserver as daemon (INTERNAL USE ONLY)"
+            _ longOpt: 'detached', "run a groovyserver in this process which the script has detached (INTERNAL USE ONLY)"
         }
         def opt = cli.parse(args)
         if (!opt) die "ERROR: could not parse arguments: ${args.join(' ')}"
         assert !opt.help: "help usage should be shown by a front script"
+        if (opt.warmup && !(opt.warmup in WarmUpRunner.MODES)) {
+            die "ERROR: invalid warm-up mode: ${opt.warmup}",
+                "Hint: Specify 'compile' to only compile scripts, or 'run' to also run scripts without side effects."
+        }
         if (opt.kill && opt.restart) {
             die "ERROR: invalid arguments: ${args.join(' ')}",
                 "Hint: You cannot specify --kill and --restart options at the same time."
@@ -227,6 +280,23 @@ class ServerCLI {
         return opt
     }
 
+    private static long parseSize(String value) {
+        def matcher = value =~ /^(\d+)([KkMmGg]?)$/
+        if (!matcher) die "ERROR: could not parse size: ${value}"
+        long size = matcher[0][1] as long
+        switch (matcher[0][2].toUpperCase()) {
+            case 'G': size *= 1024 // fall through
+            case 'M': size *= 1024 // fall through
+            case 'K': size *= 1024
+        }
+        return size
+    }
+
+    private static int parseLimit(String value) {
+        if (!value.isInteger() || (value as int) <= 0) die "ERROR: invalid number of sessions: ${value}"
+        return value as int
+    }
+
     private boolean isDaemonized() {
         return options.daemonized
     }
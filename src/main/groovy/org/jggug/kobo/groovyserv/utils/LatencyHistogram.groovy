@@ -0,0 +1,85 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.utils
+
+import java.util.concurrent.atomic.AtomicLong
+import java.util.concurrent.atomic.AtomicLongArray
+
+/**
+ * Histogram of latencies which is recorded by many threads without locking.
+ * Each bucket covers a range of power of two in microseconds, so that
+ * a percentile is approximated by the upper bound of its bucket.
+ */
+class LatencyHistogram {
+
+    private static final int BUCKET_COUNT = 40
+
+    private final AtomicLongArray buckets = new AtomicLongArray(BUCKET_COUNT)
+    private final AtomicLong count = new AtomicLong()
+    private final AtomicLong totalMicros = new AtomicLong()
+    private final AtomicLong maxMicros = new AtomicLong()
+
+    void recordNanos(long nanos) {
+        long micros = Math.max(0L, (long) (nanos / 1000))
+        buckets.incrementAndGet(bucketOf(micros))
+        count.incrementAndGet()
+        totalMicros.addAndGet(micros)
+        long max
+        while (micros > (max = maxMicros.get()) && !maxMicros.compareAndSet(max, micros)) {
+            // retry
+        }
+    }
+
+    long getCount() {
+        count.get()
+    }
+
+    double getMeanMillis() {
+        long n = count.get()
+        return (n == 0) ? 0 : totalMicros.get() / n / 1000
+    }
+
+    double getMaxMillis() {
+        maxMicros.get() / 1000
+    }
+
+    /**
+     * @param percent from 0 to 100
+     * @return the upper bound of the bucket in which the percentile is, or 0 if nothing is recorded
+     */
+    double percentileMillis(double percent) {
+        long n = count.get()
+        if (n == 0) return 0
+        long rank = Math.max(1L, (long) Math.ceil(n * percent / 100))
+        long seen = 0
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += buckets.get(i)
+            if (seen >= rank) {
+                return Math.min(upperBoundOf(i), maxMicros.get()) / 1000
+            }
+        }
+        return maxMillis
+    }
+
+    private static int bucketOf(long micros) {
+        int bucket = 64 - Long.numberOfLeadingZeros(micros) // 0 for 0us, 1 for 1us, 2 for 2-3us, ...
+        return Math.min(bucket, BUCKET_COUNT - 1)
+    }
+
+    private static long upperBoundOf(int bucket) {
+        return (1L << bucket) - 1
+    }
+}
@@ -49,6 +49,7 @@ import java.io.PrintStream;
 import java.io.PrintWriter;
 import java.math.BigInteger;
 import java.net.URL;
+import java.util.Collection;
 import java.util.Iterator;
 import java.util.List;
 
@@ -101,18 +102,21 @@ public class GroovyMain2 {
     // Compiler configuration, used to set the encodings of the scripts/classes
     private CompilerConfiguration conf = new CompilerConfiguration(System.getProperties());
 
+    // for GroovyServ: class loaders of created shells are added to track their lifecycle
+    private Collection<ClassLoader> loaders;
+
     /**
      * Main CLI interface.
      *
      * @param args all command line args.
      */
     public static void main(String args[]) {
-        processArgs(args, System.out, null);
+        processArgs(args, System.out, null, null);
     }
 
     // package-level visibility for testing purposes (just usage/errors at this stage)
     // TODO: should we have an 'err' printstream too for ParseException?
-    static void processArgs(String[] args, final PrintStream out, String classpath) { // for GroovyServ
+    static void processArgs(String[] args, final PrintStream out, String classpath, Collection<ClassLoader> loaders) { // for GroovyServ
         Options options = buildOptions();
 
         try {
@@ -127,7 +131,7 @@ public class GroovyMain2 {
             } else {
                 // If we fail, then exit with an error so scripting frameworks can catch it
                 // TODO: pass printstream(s) down through process
-                if (!process(cmd, classpath)) {
+                if (!process(cmd, classpath, loaders)) {
                     //System.exit(1); // for GroovyServ: disabled because this causes a secondary disaster
                 }
             }
@@ -288,7 +292,7 @@ public class GroovyMain2 {
      * @param line the parsed command line.
      * @throws ParseException if invalid options are chosen
      */
-    private static boolean process(CommandLine line, String classpath) throws ParseException, IOException { // for GroovyServ
+    private static boolean process(CommandLine line, String classpath, Collection<ClassLoader> loaders) throws ParseException, IOException { // for GroovyServ
         List args = line.getArgList();
 
         if (line.hasOption('D')) {
@@ -300,6 +304,7 @@ public class GroovyMain2 {
         }
 
         GroovyMain2 main = new GroovyMain2();
+        main.loaders = loaders; // for GroovyServ
 
         // add the ability to parse scripts with a specified encoding
         main.conf.setSourceEncoding(line.getOptionValue('c',main.conf.getSourceEncoding()));
@@ -364,6 +369,7 @@ public class GroovyMain2 {
              configuratorConfig.addCompilationCustomizers(customizer);
 
              GroovyShell shell = new GroovyShell(binding, configuratorConfig);
+             if (loaders != null) loaders.add(shell.getClassLoader()); // for GroovyServ
              shell.evaluate(groovyConfigurator);
          }
 
@@ -413,11 +419,19 @@ public class GroovyMain2 {
         }
     }
 
+    private GroovyShell newShell() { // for GroovyServ
+        GroovyShell groovy = new GroovyShell(conf);
+        if (loaders != null) {
+            loaders.add(groovy.getClassLoader());
+        }
+        return groovy;
+    }
+
     /**
      * Process Sockets.
      */
     private void processSockets() throws CompilationFailedException, IOException {
-        GroovyShell groovy = new GroovyShell(conf);
+        GroovyShell groovy = newShell(); // for GroovyServ
         //check the script is currently valid before starting a server against the script
         if (isScriptFile) {
             groovy.parse(getText(script));
@@ -472,7 +486,7 @@ public class GroovyMain2 {
      * Process the input files.
      */
     private void processFiles() throws CompilationFailedException, IOException {
-        GroovyShell groovy = new GroovyShell(conf);
+        GroovyShell groovy = newShell(); // for GroovyServ
 
         Script s;
 
@@ -600,7 +614,7 @@ public class GroovyMain2 {
      * Process the standard, single script with args.
      */
     private void processOnce() throws CompilationFailedException, IOException {
-        GroovyShell groovy = new GroovyShell(conf);
+        GroovyShell groovy = newShell(); // for GroovyServ
 
         if (isScriptFile) {
             if (isScriptUrl(script)) {
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream;
+
+import java.util.Arrays;
+
+/**
+ * Compression in the LZ4 block format for stream frames, which is the same as lz4.c of the client.
+ * It's self-contained not to depend on a library which Groovy of a user may not have.
+ * It's written in Java because it's a loop over bytes.
+ *
+ * An instance keeps a hash table to compress, so it must not be shared by threads.
+ */
+public class Lz4Codec {
+
+    private static final int MIN_MATCH = 4;
+    private static final int LAST_LITERALS = 5;  // the last bytes are always literals
+    private static final int MF_LIMIT = 12;      // a match never starts in the last bytes
+    private static final int MAX_DISTANCE = 65535;
+    private static final int HASH_LOG = 12;
+    private static final int SKIP_TRIGGER = 6;   // to skip faster over incompressible data
+
+    private final int[] table = new int[1 << HASH_LOG];
+
+    public static int maxCompressedLength(int length) {
+        return length + length / 255 + 16;
+    }
+
+    /**
+     * @param dest must have maxCompressedLength(srcLen) bytes from destOff
+     * @return the compressed length
+     */
+    public int compress(byte[] src, int srcOff, int srcLen, byte[] dest, int destOff) {
+        int srcEnd = srcOff + srcLen;
+        int anchor = srcOff;
+        int op = destOff;
+        if (srcLen > MF_LIMIT) {
+            Arrays.fill(table, -1);
+            int mfLimit = srcEnd - MF_LIMIT;
+            int matchLimit = srcEnd - LAST_LITERALS;
+            int ip = srcOff;
+            while (ip < mfLimit) {
+                int sequence = readInt(src, ip);
+                int h = hash(sequence);
+                int ref = table[h];
+                table[h] = ip;
+                if (ref < 0 || ip - ref > MAX_DISTANCE || readInt(src, ref) != sequence) {
+                    ip += 1 + ((ip - anchor) >>> SKIP_TRIGGER);
+                    continue;
+                }
+                while (ip > anchor && ref > srcOff && src[ip - 1] == src[ref - 1]) {
+                    ip--;
+                    ref--;
+                }
+                int length = MIN_MATCH;
+                while (ip + length < matchLimit && src[ip + length] == src[ref + length]) {
+                    length++;
+                }
+                op = writeSequence(src, anchor, ip - anchor, dest, op, ip - ref, length);
+                ip += length;
+                anchor = ip;
+            }
+        }
+        return writeSequence(src, anchor, srcEnd - anchor, dest, op, 0, 0);
+    }
+
+    /**
+     * @return the decompressed length
+     * @throws IllegalArgumentException when the block is broken or larger than destLen
+     */
+    public static int decompress(byte[] src, int srcOff, int srcLen, byte[] dest, int destOff, int destLen) {
+        int ip = srcOff;
+        int srcEnd = srcOff + srcLen;
+        int op = destOff;
+        int destEnd = destOff + destLen;
+        while (ip < srcEnd) {
+            int token = src[ip++] & 0xff;
+            int literals = token >>> 4;
+            if (literals == 15) {
+                int b;
+                do {
+                    if (ip >= srcEnd) throw new IllegalArgumentException("Broken LZ4 block: literal length");
+                    b = src[ip++] & 0xff;
+                    literals += b;
+                } while (b == 255);
+            }
+            if (literals > srcEnd - ip || literals > destEnd - op) {
+                throw new IllegalArgumentException("Broken LZ4 block: literals overrun");
+            }
+            System.arraycopy(src, ip, dest, op, literals);
+            ip += literals;
+            op += literals;
+            if (ip == srcEnd) break; // the last sequence has only literals
+            if (srcEnd - ip < 2) throw new IllegalArgumentException("Broken LZ4 block: offset");
+            int distance = (src[ip] & 0xff) | ((src[ip + 1] & 0xff) << 8);
+            ip += 2;
+            if (distance == 0 || distance > op - destOff) {
+                throw new IllegalArgumentException("Broken LZ4 block: distance " + distance);
+            }
+            int length = token & 15;
+            if (length == 15) {
+                int b;
+                do {
+                    if (ip >= srcEnd) throw new IllegalArgumentException("Broken LZ4 block: match length");
+                    b = src[ip++] & 0xff;
+                    length += b;
+                } while (b == 255);
+            }
+            length += MIN_MATCH;
+            if (length > destEnd - op) throw new IllegalArgumentException("Broken LZ4 block: match overrun");
+            for (int ref = op - distance, end = op + length; op < end; ) {
+                dest[op++] = dest[ref++]; // may overlap
+            }
+        }
+        return op - destOff;
+    }
+
+    private static int writeSequence(byte[] src, int literalOff, int literals, byte[] dest, int op, int distance, int matchLength) {
+        int token = op++;
+        op = writeLength(dest, op, literals);
+        dest[token] = (byte) (Math.min(literals, 15) << 4);
+        System.arraycopy(src, literalOff, dest, op, literals);
+        op += literals;
+        if (matchLength == 0) return op; // the last sequence
+        dest[op++] = (byte) distance;
+        dest[op++] = (byte) (distance >>> 8);
+        op = writeLength(dest, op, matchLength - MIN_MATCH);
+        dest[token] |= (byte) Math.min(matchLength - MIN_MATCH, 15);
+        return op;
+    }
+
+    /**
+     * Writes bytes which follow a token for a length of 15 or more.
+     */
+    private static int writeLength(byte[] dest, int op, int length) {
+        if (length < 15) return op;
+        length -= 15;
+        while (length >= 255) {
+            dest[op++] = (byte) 255;
+            length -= 255;
+        }
+        dest[op++] = (byte) length;
+        return op;
+    }
+
+    private static int readInt(byte[] b, int i) {
+        return (b[i] & 0xff) | ((b[i + 1] & 0xff) << 8) | ((b[i + 2] & 0xff) << 16) | ((b[i + 3] & 0xff) << 24);
+    }
+
+    private static int hash(int sequence) {
+        return (sequence * -1640531535) >>> (32 - HASH_LOG); // 2654435761 as int
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.ui;
+
+import groovy.lang.GroovyClassLoader;
+
+import java.lang.reflect.InvocationTargetException;
+
+/**
+ * A main class of groovyserver which is run by GroovyStarter directly,
+ * instead of compiling a script of "groovy -e" to call ServerCLI.
+ * ServerCLI is loaded by name, because it's compiled from its source in the jar
+ * after this class is compiled.
+ */
+public class ServerMain {
+
+    private static final String CLI_CLASS_NAME = "org.jggug.kobo.groovyserv.ui.ServerCLI";
+
+    public static void main(String[] args) throws Throwable {
+        GroovyClassLoader loader = new GroovyClassLoader(ServerMain.class.getClassLoader());
+        Thread.currentThread().setContextClassLoader(loader);
+        Class<?> cli = loader.loadClass(CLI_CLASS_NAME);
+        try {
+            cli.getMethod("main", String[].class).invoke(null, (Object) args);
+        } catch (InvocationTargetException e) {
+            throw e.getCause();
+        }
+    }
+}
@@ -87,12 +87,139 @@ setup_classpath() {
 setup_java_opts() {
     # -server: for performance (experimental)
     # -Djava.awt.headless=true: without this, annoying to switch an active process to it when new process is created as daemon
-    export JAVA_OPTS="$JAVA_OPTS -server -Djava.awt.headless=true"
+    # -XX:MinHeapFreeRatio/MaxHeapFreeRatio: to shrink the heap by a full GC which reclaims memory while idle (overridable by JAVA_OPTS)
+    export JAVA_OPTS="-XX:MinHeapFreeRatio=20 -XX:MaxHeapFreeRatio=40 $JAVA_OPTS -server -Djava.awt.headless=true"
+}
+
+#
+# Class data sharing (JDK 10 or later)
+#
+# A server started with --cds-train records classes loaded by its JVM, and the next start
+# builds an archive from them. After that, JVMs of groovyserver map the archive instead
+# of loading the classes from jars. Files are named by a fingerprint of the jars and the JVM,
+# so when any of them is changed, the next server records classes again.
+#
+cds_fingerprint() {
+    local groovy_lib="$(dirname "$(expand_path "$GROOVY_CMD")")/../lib"
+    local java_cmd="${JAVA_HOME:+$JAVA_HOME/bin/java}"
+    (
+        ls -lL "$GROOVYSERV_HOME"/lib/*.jar "$groovy_lib"/*.jar "${java_cmd:-$(which java)}"
+        echo "$JAVA_HOME"
+    ) 2>/dev/null | cksum | cut -d' ' -f1
+}
+
+build_cds_archive() {
+    local java_home class_path
+    { read java_home; read class_path; } < "$CDS_BASE.classpath"
+    if [ ! -f "$CDS_BASE.classlist" ]; then
+        info_log "WARN: class data sharing isn't supported by the JVM: $java_home"
+        rm -f "$CDS_BASE.classpath"
+        return
+    fi
+    info_log "Building class data sharing archive: $CDS_BASE.jsa"
+    if ! "$java_home/bin/java" -Xshare:dump -XX:SharedClassListFile="$CDS_BASE.classlist" \
+            -XX:SharedArchiveFile="$CDS_BASE.jsa" -cp "$class_path" >/dev/null 2>&1; then
+        error_log "WARN: failed to build class data sharing archive, so it's disabled until --cds-train"
+        rm -f "$CDS_BASE".*
+    fi
+}
+
+setup_cds() {
+    local training=$1
+    local server_process=$2
+    if [ "$GROOVYSERV_CDS" = "off" ]; then
+        return
+    fi
+    CDS_BASE="$GROOVYSERV_WORK_DIR/cds-$(cds_fingerprint)"
+
+    if $training; then
+        rm -f "$GROOVYSERV_WORK_DIR"/cds-*
+        if $server_process; then
+            record_cds_classes
+        fi
+        return
+    fi
+    if [ -f "$CDS_BASE.classpath" ] && [ ! -f "$CDS_BASE.jsa" ]; then
+        # the training server has exited
+        build_cds_archive
+    fi
+    if [ -f "$CDS_BASE.jsa" ]; then
+        info_log "Class data sharing archive: $CDS_BASE.jsa"
+        export JAVA_OPTS="$JAVA_OPTS -XX:SharedArchiveFile=$CDS_BASE.jsa -Xshare:auto"
+        return
+    fi
+
+    # An archive for old jars means that class data sharing is in use, so it's retrained.
+    if $server_process && is_file_exists "$GROOVYSERV_WORK_DIR/cds-*.jsa"; then
+        rm -f "$GROOVYSERV_WORK_DIR"/cds-*
+        record_cds_classes
+    fi
+}
+
+# Only the server process records classes, because it loads all classes which the others do.
+record_cds_classes() {
+    info_log "Recording loaded classes for class data sharing: $CDS_BASE.classlist"
+    # -XX:+IgnoreUnrecognizedVMOptions: JDKs before 10 don't have -XX:DumpLoadedClassList
+    export JAVA_OPTS="$JAVA_OPTS -XX:+IgnoreUnrecognizedVMOptions -XX:DumpLoadedClassList=$CDS_BASE.classlist -Dgroovyserv.cds.classpathFile=$CDS_BASE.classpath"
 }
 
 invoke_server() {
     local groovyserv_script_path="$(expand_path $0)"
-    exec "$GROOVY_CMD" $GROOVYSERV_OPTS -e "org.jggug.kobo.groovyserv.ui.ServerCLI.main(args)" -- "$groovyserv_script_path" "$@"
+    local groovy_home="$(dirname "$(dirname "$(expand_path "$GROOVY_CMD")")")"
+    local starter_jar="$(ls "$groovy_home"/lib/groovy-[0-9]*.jar 2>/dev/null | head -1)"
+    local java_cmd="${JAVA_HOME:+$JAVA_HOME/bin/java}"
+    if [ "$starter_jar" = "" ] || [ "$GROOVYSERV_OPTS" != "" ] || $OS_CYGWIN; then
+        exec "$GROOVY_CMD" $GROOVYSERV_OPTS -e "org.jggug.kobo.groovyserv.ui.ServerCLI.main(args)" -- "$groovyserv_script_path" "$@"
+    fi
+    # The same as groovy command except that ServerMain is run instead of compiling a script of -e
+    local starter_conf="$groovy_home/conf/groovy-starter.conf"
+    exec "${java_cmd:-java}" $JAVA_OPTS -classpath "$starter_jar" \
+        -Dprogram.name=groovyserver -Dgroovy.home="$groovy_home" -Dgroovy.starter.conf="$starter_conf" \
+        org.codehaus.groovy.tools.GroovyStarter --main org.jggug.kobo.groovyserv.ui.ServerMain \
+        --conf "$starter_conf" --classpath "$CLASSPATH" "$groovyserv_script_path" "$@"
+}
+
+#
+# A server is run in background by this script instead of being daemonized by a second JVM.
+# It writes the authtoken file when it's ready to accept requests, so this script waits for
+# the file not older than the start. Output of the server until then is shown after that.
+# The file written in the same second as the start counts, because -nt of some shells
+# compares only seconds. A stale file is deleted by the server before it starts.
+#
+# stderr of the server is appended to the server log for its whole life, so that it
+# doesn't pile up anywhere else. Entries written by the server's logger are not shown.
+#
+start_server_in_background() {
+    local authtoken_file="$GROOVYSERV_WORK_DIR/authtoken-$SERVER_PORT"
+    local starting_file="$GROOVYSERV_WORK_DIR/starting-$SERVER_PORT"
+    local log_file="$GROOVYSERV_WORK_DIR/groovyserver-$SERVER_PORT.log"
+    touch "$starting_file" "$log_file"
+    local log_offset=$(( $(wc -c < "$log_file") + 1 ))
+
+    # SIGHUP is ignored so that the server outlives the terminal
+    (trap '' HUP; invoke_server --detached "$@") < /dev/null > /dev/null 2>> "$log_file" &
+    local pid=$!
+    while kill -0 $pid 2>/dev/null; do
+        if [ -f "$authtoken_file" ] && [ ! "$starting_file" -nt "$authtoken_file" ]; then
+            rm -f "$starting_file"
+            show_server_output "$log_file" $log_offset
+            info_log "Server is successfully started up on $SERVER_PORT port"
+            return 0
+        fi
+        sleep 0.1
+    done
+
+    # The server has exited without being ready, e.g. it's already running or failed.
+    wait $pid
+    local status=$?
+    rm -f "$starting_file"
+    show_server_output "$log_file" $log_offset
+    return $status
+}
+
+# Show what the server wrote to stderr since the offset, except entries of its logger
+show_server_output() {
+    tail -c +$2 "$1" | grep -v '^[0-9]\{4\}/[0-9][0-9]/[0-9][0-9] [0-9:,]* \[[A-Z]*\] ' 1>&2
 }
 
 usage() {
@@ -108,6 +235,12 @@ options:
   -v,--verbose                  verbose output to a log file
      --allow-from <addresses>   specify optional acceptable client addresses (delimiter: comma)
      --authtoken <authtoken>    specify authtoken (which is automatically generated if not specified)
+     --spill <size>             buffer output for a slow client up to the size (suffix K/M/G) in memory and the rest in a file
+     --warmup <mode>            replay frequent invocations at startup to warm up ('compile' or 'run')
+     --memory-budget <size>     reclaim memory while idle when heap and metaspace in use are over the size (suffix K/M/G)
+     --max-interactive <n>      specify max number of concurrent interactive sessions (default: 4 per CPU)
+     --max-batch <n>            specify max number of concurrent batch sessions (default: number of CPUs - 1)
+     --cds-train                record loaded classes to build a class data sharing archive at the next start (JDK 10 or later)
 EOF
 }
 
@@ -116,8 +249,19 @@ EOF
 #-------------------------------------------
 
 # Parse arguments
+CDS_TRAINING=false
+DAEMONIZED=false
+KILL=false
+SERVER_PORT=1961 # the same as GroovyServer.DEFAULT_PORT
+prev_arg=
 for arg in "$@"; do
     # Must not consume original arguments because they needs for invoke_server
+    case $prev_arg in
+        -p | --port)
+            SERVER_PORT=$arg
+            ;;
+    esac
+    prev_arg=$arg
     case $arg in
         -q | --quiet)
             QUIET=true
@@ -126,6 +270,18 @@ for arg in "$@"; do
             usage
             exit 0
             ;;
+        --cds-train)
+            CDS_TRAINING=true
+            ;;
+        -k | --kill)
+            KILL=true
+            ;;
+        --port=*)
+            SERVER_PORT=${arg#--port=}
+            ;;
+        --daemonized)
+            DAEMONIZED=true
+            ;;
     esac
 done
 
@@ -134,6 +290,15 @@ find_groovy_command
 check_groovyserv_home
 setup_classpath
 setup_java_opts
+if $DAEMONIZED || ! $KILL; then
+    setup_cds $CDS_TRAINING true
+else
+    setup_cds $CDS_TRAINING false
+fi
 
 # Server operation
-invoke_server "$@"
+if $DAEMONIZED || $KILL; then
+    invoke_server "$@"
+else
+    start_server_in_background "$@"
+fi
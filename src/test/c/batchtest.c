@@ -0,0 +1,145 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "batch.h"
+
+static struct job_t* parse(const char* line) {
+  return parse_job_spec(strdup(line), 1);
+}
+
+void test_empty_line_and_comment() {
+  char* line = strdup("   ");
+  assert(parse_job_spec(line, 1) == NULL);
+  free(line);
+  line = strdup("  # -e 'println 1'");
+  assert(parse_job_spec(line, 1) == NULL);
+  free(line);
+  line = strdup("");
+  assert(parse_job_spec(line, 1) == NULL);
+  free(line);
+}
+
+void test_args() {
+  struct job_t* job = parse("-e  println(1)\tx");
+  assert(job->id == 1);
+  assert(job->invocation.argc == 4);
+  assert(strcmp(job->invocation.argv[0], "groovyclient") == 0);
+  assert(strcmp(job->invocation.argv[1], "-e") == 0);
+  assert(strcmp(job->invocation.argv[2], "println(1)") == 0);
+  assert(strcmp(job->invocation.argv[3], "x") == 0);
+  assert(job->invocation.argv[4] == NULL);
+  assert(job->invocation.envs[0] == NULL);
+  assert(job->invocation.cwd == NULL);
+  delete_job(job);
+}
+
+void test_quotes() {
+  struct job_t* job = parse("-e 'println \"a b\"' \"it's\" a\\ b 'x'\"y\"z \"\"");
+  assert(job->invocation.argc == 7);
+  assert(strcmp(job->invocation.argv[2], "println \"a b\"") == 0);
+  assert(strcmp(job->invocation.argv[3], "it's") == 0);
+  assert(strcmp(job->invocation.argv[4], "a b") == 0);
+  assert(strcmp(job->invocation.argv[5], "xyz") == 0);
+  assert(strcmp(job->invocation.argv[6], "") == 0);
+  delete_job(job);
+}
+
+void test_backslash() {
+  struct job_t* job = parse("\"a\\\"b\" 'c\\d' e\\\\f");
+  assert(job->invocation.argc == 4);
+  assert(strcmp(job->invocation.argv[1], "a\"b") == 0);
+  assert(strcmp(job->invocation.argv[2], "c\\d") == 0); /* not escaped in single quotes */
+  assert(strcmp(job->invocation.argv[3], "e\\f") == 0);
+  delete_job(job);
+}
+
+void test_unterminated_quote() {
+  struct job_t* job = parse("-e 'println 1");
+  assert(job->invocation.argv == NULL);
+  assert(strcmp(job->storage, "unterminated quote in batch spec") == 0);
+  delete_job(job);
+}
+
+void test_cwd_and_setenv() {
+  struct job_t* job = parse("-Ccwd /tmp -Csetenv A=1 script.groovy -Csetenv 'B=x y'");
+  assert(strcmp(job->invocation.cwd, "/tmp") == 0);
+  assert(job->invocation.argc == 2);
+  assert(strcmp(job->invocation.argv[1], "script.groovy") == 0);
+  assert(strcmp(job->invocation.envs[0], "A=1") == 0);
+  assert(strcmp(job->invocation.envs[1], "B=x y") == 0);
+  assert(job->invocation.envs[2] == NULL);
+  delete_job(job);
+}
+
+void test_invalid_option() {
+  struct job_t* job = parse("-Cp 1961 script.groovy");
+  assert(job->invocation.argv == NULL);
+  assert(strcmp(job->storage, "invalid option in batch spec: -Cp") == 0);
+  delete_job(job);
+
+  job = parse("-Csetenv NOVALUE script.groovy");
+  assert(job->invocation.argv == NULL);
+  assert(strcmp(job->storage, "invalid option in batch spec: -Csetenv") == 0);
+  delete_job(job);
+
+  job = parse("script.groovy -Ccwd");
+  assert(job->invocation.argv == NULL);
+  assert(strcmp(job->storage, "invalid option in batch spec: -Ccwd") == 0);
+  delete_job(job);
+}
+
+void test_quoted_client_option() {
+  struct job_t* job = parse("-e 'println args' '-Cp'");
+  assert(job->invocation.argv == NULL); /* a token is checked after quotes are removed */
+  delete_job(job);
+}
+
+void test_aggregate_exit_status() {
+  struct exit_status_t exit_status = { 0, 0 };
+  struct job_t jobs[] = { { 1 }, { 2 }, { 3 }, { 4 } };
+  jobs[0].status = 0;
+  jobs[1].status = 4;
+  jobs[2].status = 2;
+  jobs[3].status = 0;
+
+  /* finished in the order of 3, 4, 2, 1 */
+  aggregate_exit_status(&exit_status, &jobs[2]);
+  assert(exit_status.failed_id == 3 && exit_status.status == 2);
+  aggregate_exit_status(&exit_status, &jobs[3]);
+  assert(exit_status.failed_id == 3 && exit_status.status == 2);
+  aggregate_exit_status(&exit_status, &jobs[1]);
+  assert(exit_status.failed_id == 2 && exit_status.status == 4);
+  aggregate_exit_status(&exit_status, &jobs[0]);
+  assert(exit_status.failed_id == 2 && exit_status.status == 4);
+}
+
+int main(int argc, char** argv) {
+  test_empty_line_and_comment();
+  test_args();
+  test_quotes();
+  test_backslash();
+  test_unterminated_quote();
+  test_cwd_and_setenv();
+  test_invalid_option();
+  test_quoted_client_option();
+  test_aggregate_exit_status();
+  return 0;
+}
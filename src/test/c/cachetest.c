@@ -0,0 +1,284 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/param.h>
+
+#include "option.h"
+#include "cache.h"
+
+/* the cache directory is made under this instead of the real home */
+static char home[] = "/tmp/cachetestXXXXXX";
+
+static void write_file(const char* path, const char* text) {
+  FILE* fp = fopen(path, "w");
+  assert(fp != NULL);
+  fputs(text, fp);
+  fclose(fp);
+}
+
+static void key_of(char key[SHA256_HEX_SIZE], int argc, char** argv, char* stdin_text) {
+  struct cache_input_t input = { stdin_text, strlen(stdin_text) };
+  make_cache_key(key, argc, argv, &input);
+}
+
+/*
+ * run replay_cache_entry() with stdout and stderr written into out and err.
+ */
+static BOOL replay(const char* key, int* status, char* out, char* err) {
+  char out_path[MAXPATHLEN], err_path[MAXPATHLEN];
+  sprintf(out_path, "%s/out", home);
+  sprintf(err_path, "%s/err", home);
+  fflush(stdout);
+  fflush(stderr);
+  int saved_out = dup(1), saved_err = dup(2);
+  int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  int err_fd = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  dup2(out_fd, 1);
+  dup2(err_fd, 2);
+
+  BOOL found = replay_cache_entry(key, status);
+
+  fflush(stderr);
+  dup2(saved_out, 1);
+  dup2(saved_err, 2);
+  close(saved_out);
+  close(saved_err);
+  close(out_fd);
+  close(err_fd);
+
+  FILE* fp = fopen(out_path, "r");
+  out[fread(out, 1, 255, fp)] = '\0';
+  fclose(fp);
+  fp = fopen(err_path, "r");
+  err[fread(err, 1, 255, fp)] = '\0';
+  fclose(fp);
+  return found;
+}
+
+void test_key_is_hex_digest() {
+  char key[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println 1", NULL };
+  key_of(key, 3, argv, "");
+  assert(strlen(key) == SHA256_HEX_SIZE - 1);
+  assert(strspn(key, "0123456789abcdef") == SHA256_HEX_SIZE - 1);
+}
+
+void test_key_is_stable() {
+  char key1[SHA256_HEX_SIZE], key2[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println 1", NULL };
+  key_of(key1, 3, argv, "input");
+  key_of(key2, 3, argv, "input");
+  assert(strcmp(key1, key2) == 0);
+}
+
+void test_key_differs_by_args() {
+  char key1[SHA256_HEX_SIZE], key2[SHA256_HEX_SIZE];
+  char* argv1[] = { "groovyclient", "-e", "println 1", NULL };
+  char* argv2[] = { "groovyclient", "-e", "println 2", NULL };
+  key_of(key1, 3, argv1, "");
+  key_of(key2, 3, argv2, "");
+  assert(strcmp(key1, key2) != 0);
+}
+
+void test_key_differs_by_stdin() {
+  char key1[SHA256_HEX_SIZE], key2[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println System.in.text", NULL };
+  key_of(key1, 3, argv, "a");
+  key_of(key2, 3, argv, "b");
+  assert(strcmp(key1, key2) != 0);
+}
+
+void test_key_differs_by_script_contents() {
+  char key1[SHA256_HEX_SIZE], key2[SHA256_HEX_SIZE];
+  char script[MAXPATHLEN];
+  sprintf(script, "%s/script.groovy", home);
+  char* argv[] = { "groovyclient", script, NULL };
+  write_file(script, "println 1");
+  key_of(key1, 2, argv, "");
+  write_file(script, "println 2");
+  key_of(key2, 2, argv, "");
+  assert(strcmp(key1, key2) != 0);
+  unlink(script);
+}
+
+void test_key_differs_by_cache_input() {
+  char key1[SHA256_HEX_SIZE], key2[SHA256_HEX_SIZE];
+  char data[MAXPATHLEN];
+  sprintf(data, "%s/data.txt", home);
+  char* argv[] = { "groovyclient", "-e", "println new File('data.txt').text", NULL };
+  client_option.cache_inputs[0] = data;
+  write_file(data, "1");
+  key_of(key1, 3, argv, "");
+  write_file(data, "2");
+  key_of(key2, 3, argv, "");
+  client_option.cache_inputs[0] = NULL;
+  assert(strcmp(key1, key2) != 0);
+  unlink(data);
+}
+
+void test_key_differs_by_passed_envvar_only() {
+  char key1[SHA256_HEX_SIZE], key2[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println 1", NULL };
+
+  setenv("CACHETEST_OTHER", "1", 1);
+  key_of(key1, 3, argv, "");
+  setenv("CACHETEST_OTHER", "2", 1);
+  key_of(key2, 3, argv, "");
+  assert(strcmp(key1, key2) == 0);
+
+  client_option.env_include_mask[0] = "CACHETEST_PASSED";
+  setenv("CACHETEST_PASSED", "1", 1);
+  key_of(key1, 3, argv, "");
+  setenv("CACHETEST_PASSED", "2", 1);
+  key_of(key2, 3, argv, "");
+  client_option.env_include_mask[0] = NULL;
+  assert(strcmp(key1, key2) != 0);
+}
+
+void test_replay_miss() {
+  int status = -1;
+  char out[256], err[256];
+  assert(!replay("0000000000000000000000000000000000000000000000000000000000000000", &status, out, err));
+  assert(status == -1);
+  assert(strcmp(out, "") == 0);
+}
+
+void test_replay_hit() {
+  char key[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println 'hit'", NULL };
+  key_of(key, 3, argv, "");
+
+  FILE* fp = open_cache_entry(key);
+  assert(fp != NULL);
+  fprintf(fp, "Channel: out\nSize: 4\n\nhit\n");
+  fprintf(fp, "Channel: err\nSize: 5\n\nwarn\n");
+  fprintf(fp, "Channel: out\nSize: 3\n\n\n\n\n"); /* a body like a header isn't parsed */
+  fprintf(fp, "Status: 3\n\n");
+  commit_cache_entry(fp, key, TRUE);
+
+  int status = -1;
+  char out[256], err[256];
+  assert(replay(key, &status, out, err));
+  assert(status == 3);
+  assert(strcmp(out, "hit\n\n\n\n") == 0);
+  assert(strcmp(err, "warn\n") == 0);
+}
+
+void test_discarded_entry_is_not_replayed() {
+  char key[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "System.exit(1)", NULL };
+  key_of(key, 3, argv, "");
+
+  FILE* fp = open_cache_entry(key);
+  assert(fp != NULL);
+  fprintf(fp, "Status: 1\n\n");
+  commit_cache_entry(fp, key, FALSE);
+
+  int status = -1;
+  char out[256], err[256];
+  assert(!replay(key, &status, out, err));
+}
+
+void test_broken_entry_is_removed() {
+  char key[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println 'broken'", NULL };
+  key_of(key, 3, argv, "");
+
+  FILE* fp = open_cache_entry(key);
+  assert(fp != NULL);
+  fprintf(fp, "Channel: out\nSize: 100\n\nbroken\n"); /* truncated without status */
+  commit_cache_entry(fp, key, TRUE);
+
+  int status = -1;
+  char out[256], err[256];
+  assert(replay(key, &status, out, err));
+  assert(status == 1);
+  assert(strstr(err, "ERROR: broken cache entry") != NULL);
+  assert(!replay(key, &status, out, err));
+}
+
+void test_unwritable_output_is_reported() {
+  char key[SHA256_HEX_SIZE];
+  char* argv[] = { "groovyclient", "-e", "println 'unwritable'", NULL };
+  key_of(key, 3, argv, "");
+
+  FILE* fp = open_cache_entry(key);
+  assert(fp != NULL);
+  fprintf(fp, "Channel: out\nSize: 11\n\nunwritable\n");
+  fprintf(fp, "Status: 0\n\n");
+  commit_cache_entry(fp, key, TRUE);
+
+  char err_path[MAXPATHLEN];
+  sprintf(err_path, "%s/err", home);
+  fflush(stdout);
+  fflush(stderr);
+  int saved_out = dup(1), saved_err = dup(2);
+  int out_fd = open("/dev/null", O_RDONLY); /* write() fails */
+  int err_fd = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  dup2(out_fd, 1);
+  dup2(err_fd, 2);
+
+  int status = -1;
+  BOOL found = replay_cache_entry(key, &status);
+
+  fflush(stderr);
+  dup2(saved_out, 1);
+  dup2(saved_err, 2);
+  close(saved_out);
+  close(saved_err);
+  close(out_fd);
+  close(err_fd);
+
+  char out[256], err[256];
+  fp = fopen(err_path, "r");
+  err[fread(err, 1, 255, fp)] = '\0';
+  fclose(fp);
+  assert(found);
+  assert(status == 1);
+  assert(strstr(err, "ERROR: could not write output") != NULL);
+  assert(replay(key, &status, out, err)); /* the entry isn't broken */
+  assert(status == 0);
+  assert(strcmp(out, "unwritable\n") == 0);
+}
+
+int main(int argc, char** argv) {
+  assert(mkdtemp(home) != NULL);
+  setenv("HOME", home, 1);
+
+  test_key_is_hex_digest();
+  test_key_is_stable();
+  test_key_differs_by_args();
+  test_key_differs_by_stdin();
+  test_key_differs_by_script_contents();
+  test_key_differs_by_cache_input();
+  test_key_differs_by_passed_envvar_only();
+  test_replay_miss();
+  test_replay_hit();
+  test_discarded_entry_is_not_replayed();
+  test_broken_entry_is_removed();
+  test_unwritable_output_is_reported();
+
+  char command[MAXPATHLEN];
+  sprintf(command, "rm -rf %s", home);
+  system(command);
+  return 0;
+}
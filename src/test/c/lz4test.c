@@ -0,0 +1,132 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "lz4.h"
+
+static struct lz4_t ctx;
+
+/*
+ * compress and decompress the data, and return the compressed size.
+ */
+static int round_trip(const char* data, int size) {
+  char* packed = malloc(LZ4_MAX_COMPRESSED_SIZE(size));
+  char* unpacked = malloc(size + 1);
+  int packed_size = lz4_compress(&ctx, data, size, packed);
+  assert(packed_size > 0);
+  assert(packed_size <= LZ4_MAX_COMPRESSED_SIZE(size));
+  assert(lz4_decompress(packed, packed_size, unpacked, size) == size);
+  assert(memcmp(unpacked, data, size) == 0);
+  if (size > 0) {
+    assert(lz4_decompress(packed, packed_size, unpacked, size - 1) == -1); /* too small capacity */
+    assert(lz4_decompress(packed, packed_size - 1, unpacked, size) == -1); /* truncated */
+  }
+  free(packed);
+  free(unpacked);
+  return packed_size;
+}
+
+static char* random_data(int size, unsigned int seed) {
+  char* data = malloc(size);
+  int i;
+  srand(seed);
+  for (i = 0; i < size; i++) {
+    data[i] = rand() & 0xff;
+  }
+  return data;
+}
+
+void test_short() {
+  assert(round_trip("", 0) == 1);
+  assert(round_trip("a", 1) == 2);
+  round_trip("0123456789ab", 12);   /* only literals */
+  round_trip("0123456789abc", 13);
+  round_trip("aaaaaaaaaaaaaaaaaaaa", 20);
+}
+
+void test_text() {
+  int size = 0, i;
+  char* data = malloc(100000);
+  for (i = 0; size < 100000 - 64; i++) {
+    size += sprintf(data + size, "2013/01/01 00:00:%02d [INFO] line %d\n", i % 60, i);
+  }
+  assert(round_trip(data, size) < size / 4);
+  free(data);
+}
+
+void test_incompressible() {
+  char* data = random_data(100000, 1);
+  assert(round_trip(data, 100000) > 100000);
+  free(data);
+}
+
+void test_long_run() {
+  int size = 1024 * 1024;
+  char* data = calloc(size, 1);
+  assert(round_trip(data, size) < size / 200); /* lengths of 255 bytes */
+  free(data);
+}
+
+void test_beyond_max_distance() {
+  int block = 70000;
+  char* data = random_data(block * 2, 2);
+  memcpy(data + block, data, block); /* the same data too far to refer to */
+  assert(round_trip(data, block * 2) > block * 2);
+  free(data);
+}
+
+void test_within_max_distance() {
+  int block = 60000;
+  char* data = random_data(block * 2, 3);
+  memcpy(data + block, data, block);
+  assert(round_trip(data, block * 2) < block + 1000);
+  free(data);
+}
+
+/*
+ * a block made by hand in the LZ4 block format: a literal and an overlapped
+ * match of 14 bytes at distance 1, and the last 5 literals.
+ */
+void test_decompress_standard_block() {
+  const char block[] = "\x1a" "a" "\x01\x00" "\x50" "bcdef";
+  char dest[32];
+  assert(lz4_decompress(block, sizeof(block) - 1, dest, sizeof(dest)) == 20);
+  assert(memcmp(dest, "aaaaaaaaaaaaaaabcdef", 20) == 0);
+}
+
+void test_decompress_broken_block() {
+  char dest[32];
+  assert(lz4_decompress("\x10" "a" "\x00\x00", 4, dest, sizeof(dest)) == -1);   /* distance 0 */
+  assert(lz4_decompress("\x10" "a" "\x02\x00", 4, dest, sizeof(dest)) == -1);   /* before the start */
+  assert(lz4_decompress("\xf0" "\xff", 2, dest, sizeof(dest)) == -1);           /* unterminated length */
+  assert(lz4_decompress("\x10" "a" "\x01", 3, dest, sizeof(dest)) == -1);       /* truncated distance */
+}
+
+int main(int argc, char** argv) {
+  test_short();
+  test_text();
+  test_incompressible();
+  test_long_run();
+  test_beyond_max_distance();
+  test_within_max_distance();
+  test_decompress_standard_block();
+  test_decompress_broken_block();
+  return 0;
+}
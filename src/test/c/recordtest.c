@@ -0,0 +1,127 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/param.h>
+
+#include "record.h"
+
+static char dir[] = "/tmp/recordtestXXXXXX";
+static char path[MAXPATHLEN];
+
+static void write_file(const char* data, int size) {
+  FILE* fp = fopen(path, "wb");
+  assert(fp != NULL);
+  fwrite(data, 1, size, fp);
+  fclose(fp);
+}
+
+static BOOL is_broken(const char* data, int size) {
+  int count = -1;
+  write_file(data, size);
+  struct record_block_t* blocks = record_load(path, &count);
+  if (blocks != NULL) {
+    record_free(blocks, count);
+  }
+  return blocks == NULL;
+}
+
+void test_write_and_load() {
+  int large_size = 200 * 1024, i;
+  char* large = malloc(large_size);
+  for (i = 0; i < large_size; i++) {
+    large[i] = i % 251;
+  }
+
+  struct record_t* record = record_create(path);
+  assert(record != NULL);
+  assert(record_block(record, "Status: 0\n\n", 11));
+  assert(record_block(record, "", 0));
+  usleep(20000);
+  assert(record_block(record, large, large_size));
+  assert(record_close(record));
+
+  int count = -1;
+  struct record_block_t* blocks = record_load(path, &count);
+  assert(blocks != NULL);
+  assert(count == 3);
+  assert(blocks[0].size == 11 && memcmp(blocks[0].data, "Status: 0\n\n", 11) == 0);
+  assert(blocks[1].size == 0 && blocks[1].data != NULL);
+  assert(blocks[2].size == large_size && memcmp(blocks[2].data, large, large_size) == 0);
+  assert(blocks[0].delay >= 0 && blocks[1].delay >= 0);
+  assert(blocks[2].delay >= 20000);
+  record_free(blocks, count);
+  free(large);
+}
+
+void test_format() {
+  /* delay 128 and size 3 in varints, and then delay 0 and size 0 */
+  const char data[] = "GSRC\x01" "\x80\x01" "\x03" "abc" "\x00" "\x00";
+  int count = -1;
+  write_file(data, sizeof(data) - 1);
+  struct record_block_t* blocks = record_load(path, &count);
+  assert(blocks != NULL);
+  assert(count == 2);
+  assert(blocks[0].delay == 128 && blocks[0].size == 3 && memcmp(blocks[0].data, "abc", 3) == 0);
+  assert(blocks[1].delay == 0 && blocks[1].size == 0);
+  record_free(blocks, count);
+}
+
+void test_empty_session() {
+  record_close(record_create(path));
+  int count = -1;
+  struct record_block_t* blocks = record_load(path, &count);
+  assert(blocks != NULL);
+  assert(count == 0);
+  record_free(blocks, count);
+}
+
+void test_broken() {
+  assert(is_broken("", 0));
+  assert(is_broken("GSRX\x01", 5));                 /* magic */
+  assert(is_broken("GSRC\x02", 5));                 /* version */
+  assert(is_broken("GSRC\x01" "\x00", 6));          /* without size */
+  assert(is_broken("GSRC\x01" "\x00\x80", 7));      /* unterminated varint */
+  assert(is_broken("GSRC\x01" "\x00\x04" "abc", 9)); /* truncated data */
+  assert(is_broken("GSRC\x01" "\x00\xff\xff\xff\xff\x0f", 10)); /* too large block */
+}
+
+void test_missing_file() {
+  int count = -1;
+  char missing[MAXPATHLEN];
+  sprintf(missing, "%s/missing/session.rec", dir);
+  assert(record_load(missing, &count) == NULL);
+  assert(record_create(missing) == NULL);
+}
+
+int main(int argc, char** argv) {
+  assert(mkdtemp(dir) != NULL);
+  sprintf(path, "%s/session.rec", dir);
+
+  test_write_and_load();
+  test_format();
+  test_empty_session();
+  test_broken();
+  test_missing_file();
+
+  unlink(path);
+  rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "shm.h"
+
+/*
+ * the server side of a ring, which maps the file by itself as SharedMemoryRing does.
+ */
+struct server_ring_t {
+  volatile long long* tail;
+  char* data;
+  int capacity;
+  long long head;
+};
+
+static char received[1024 * 1024];
+static int received_size;
+
+static void collect(struct session_t* session, const char* channel, const char* data, int size) {
+  assert(received_size + size <= sizeof(received));
+  memcpy(received + received_size, data, size);
+  received_size += size;
+}
+
+static char* map_as_server(struct shm_t* shm, struct server_ring_t* out, struct server_ring_t* err) {
+  int fd = open(shm->path, O_RDWR);
+  assert(fd >= 0);
+  char* base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(base != MAP_FAILED);
+  close(fd);
+  out->tail = (volatile long long*) base;
+  out->data = base + SHM_CONTROL_SIZE;
+  out->capacity = shm->capacity;
+  out->head = 0;
+  err->tail = (volatile long long*) (base + SHM_CONTROL_SIZE + shm->capacity);
+  err->data = base + SHM_CONTROL_SIZE * 2 + shm->capacity;
+  err->capacity = shm->capacity;
+  err->head = 0;
+  return base;
+}
+
+/*
+ * write as much as the free space allows, and return the written size.
+ */
+static int server_write(struct server_ring_t* ring, const char* data, int size) {
+  long long free_space = ring->capacity - (ring->head - *ring->tail);
+  int written = (size < free_space) ? size : (int) free_space;
+  int i;
+  for (i = 0; i < written; i++) {
+    ring->data[(ring->head + i) & (ring->capacity - 1)] = data[i];
+  }
+  ring->head += written;
+  return written;
+}
+
+void test_create() {
+  struct shm_t* shm = shm_create(1024);
+  struct stat st;
+  char spec[SHM_SPEC_SIZE];
+  char path[MAXPATHLEN];
+  assert(shm != NULL);
+  assert(stat(shm->path, &st) == 0);
+  assert(st.st_size == 2 * (SHM_CONTROL_SIZE + 1024));
+  assert(shm->size == st.st_size);
+  snprintf(spec, sizeof(spec), "%s 1024", shm->path);
+  assert(strcmp(shm->spec, spec) == 0);
+  assert(*shm->out.tail == 0);
+  assert(*shm->err.tail == 0);
+  strcpy(path, shm->path);
+  shm_delete(shm);
+  assert(stat(path, &st) != 0);
+
+  assert(shm_create(1000) == NULL);                  /* not a power of 2 */
+  assert(shm_create(0) == NULL);
+  assert(shm_create(SHM_MAX_CAPACITY * 2) == NULL);  /* too large */
+}
+
+void test_layout() {
+  struct shm_t* shm = shm_create(256);
+  struct server_ring_t out, err;
+  char* base = map_as_server(shm, &out, &err);
+
+  assert(server_write(&out, "OUT", 3) == 3);
+  assert(server_write(&err, "ERR", 3) == 3);
+  assert(memcmp(shm->out.data, "OUT", 3) == 0);
+  assert(memcmp(shm->err.data, "ERR", 3) == 0);
+
+  received_size = 0;
+  assert(shm_drain(shm, NULL, "err", err.head, collect));
+  assert(received_size == 3 && memcmp(received, "ERR", 3) == 0);
+  assert(*err.tail == 3); /* the server reads the tail at the start of the ring */
+  assert(*out.tail == 0);
+
+  munmap(base, shm->size);
+  shm_delete(shm);
+}
+
+void test_wraparound() {
+  struct shm_t* shm = shm_create(64);
+  struct server_ring_t out, err;
+  char* base = map_as_server(shm, &out, &err);
+  char expected[sizeof(received)];
+  int expected_size = 0, i;
+
+  received_size = 0;
+  for (i = 0; i < 100; i++) {
+    char chunk[48];
+    int size = 1 + (i * 7) % sizeof(chunk);
+    int written = 0;
+    memset(chunk, 'a' + i % 26, size);
+    while (written < size) {
+      int n = server_write(&out, chunk + written, size - written);
+      if (n == 0) { /* the ring is full until the client drains it */
+        assert(out.head - *out.tail == 64);
+        assert(shm_drain(shm, NULL, "out", out.head, collect));
+        continue;
+      }
+      memcpy(expected + expected_size, chunk + written, n);
+      expected_size += n;
+      written += n;
+    }
+  }
+  assert(shm_drain(shm, NULL, "out", out.head, collect));
+  assert(out.head > 64 * 10);
+  assert(received_size == expected_size);
+  assert(memcmp(received, expected, expected_size) == 0);
+  assert(*out.tail == out.head);
+
+  munmap(base, shm->size);
+  shm_delete(shm);
+}
+
+void test_drain_invalid_position() {
+  struct shm_t* shm = shm_create(64);
+  struct server_ring_t out, err;
+  char* base = map_as_server(shm, &out, &err);
+
+  received_size = 0;
+  assert(!shm_drain(shm, NULL, "out", 65, collect));   /* beyond the capacity */
+  assert(!shm_drain(shm, NULL, "in", 0, collect));     /* unknown channel */
+  server_write(&out, "abc", 3);
+  assert(shm_drain(shm, NULL, "out", 3, collect));
+  assert(!shm_drain(shm, NULL, "out", 2, collect));    /* before the tail */
+  assert(received_size == 3);
+  assert(*shm->out.tail == 3);
+
+  munmap(base, shm->size);
+  shm_delete(shm);
+}
+
+int main(int argc, char** argv) {
+  char home[] = "/tmp/shmtestXXXXXX";
+  char dir[sizeof(home) + 32];
+  assert(mkdtemp(home) != NULL);
+  snprintf(dir, sizeof(dir), "%s/.groovy", home);
+  assert(mkdir(dir, 0700) == 0);
+  snprintf(dir, sizeof(dir), "%s/.groovy/groovyserv", home);
+  assert(mkdir(dir, 0700) == 0);
+  setenv("HOME", home, 1); /* files of rings are created under it */
+
+  test_create();
+  test_layout();
+  test_wraparound();
+  test_drain_invalid_position();
+
+  rmdir(dir);
+  snprintf(dir, sizeof(dir), "%s/.groovy", home);
+  rmdir(dir);
+  rmdir(home);
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.Specification
+
+/**
+ * Specifications for -Cbatch of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+class BatchSpec extends Specification {
+
+    static final String SEP = System.getProperty("line.separator")
+
+    File specFile
+
+    def setup() {
+        specFile = File.createTempFile("batch", ".spec")
+    }
+
+    def cleanup() {
+        specFile.delete()
+    }
+
+    /**
+     * Parse the output into the output text per job and channel, and the status per job.
+     */
+    private static Map parseResults(String text) {
+        def outputs = [:].withDefault { "" }
+        def statuses = [:]
+        def input = new ByteArrayInputStream(text.getBytes("UTF-8"))
+        while (true) {
+            def headers = [:]
+            String line
+            while ((line = readLine(input)) != null && line != "") {
+                def (key, value) = line.split(": ", 2)
+                headers[key] = value
+            }
+            if (headers.isEmpty()) break
+            def job = headers.Job as int
+            if (headers.Status != null) {
+                statuses[job] = headers.Status as int
+            } else {
+                byte[] body = new byte[headers.Size as int]
+                input.read(body)
+                outputs["${job}:${headers.Channel}"] += new String(body, "UTF-8")
+            }
+        }
+        return [outputs: outputs, statuses: statuses]
+    }
+
+    private static String readLine(InputStream input) {
+        def line = new ByteArrayOutputStream()
+        int c
+        while ((c = input.read()) != -1 && c != ('\n' as char)) {
+            line.write(c)
+        }
+        return (c == -1 && line.size() == 0) ? null : line.toString("UTF-8")
+    }
+
+    def "each line is run as an invocation and its output and status are tagged by the job number"() {
+        given:
+        specFile.text = """\
+            |# comment
+            |-e "println('A'); System.err.println('a')"
+            |
+            |-e "println('B'); System.exit(3)"
+            |-e "println('C'); System.exit(5)"
+            |""".stripMargin()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cbatch", specFile.path])
+        def results = parseResults(p.in.text)
+
+        then:
+        p.exitValue() == 3 // the status of the first failed job in input order
+        results.statuses == [1: 0, 2: 3, 3: 5]
+        results.outputs["1:out"] == "A" + SEP
+        results.outputs["1:err"] == "a" + SEP
+        results.outputs["2:out"] == "B" + SEP
+        results.outputs["3:out"] == "C" + SEP
+    }
+
+    def "a job has its own working directory and environment variables"() {
+        given:
+        def dir = new File(System.getProperty("java.io.tmpdir")).canonicalFile
+        specFile.text = """\
+            |-Ccwd ${dir.path} -Csetenv BATCH_SPEC_ENV='x y' -e "print(new File('.').canonicalPath + ',' + System.getenv('BATCH_SPEC_ENV'))"
+            |-e "print(System.getenv('BATCH_SPEC_ENV'))"
+            |""".stripMargin()
+
+        when:
+        def p = TestUtils.executeClientScriptOk(["-Cbatch", specFile.path])
+        def results = parseResults(p.in.text)
+
+        then:
+        results.outputs["1:out"] == "${dir.path},x y"
+        results.outputs["2:out"] == "null"
+    }
+
+    def "an invalid line fails only the job"() {
+        given:
+        specFile.text = """\
+            |-e "print('A')"
+            |-Cp 1961 -e "print('B')"
+            |-e "print('C
+            |""".stripMargin()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cbatch", specFile.path])
+        def results = parseResults(p.in.text)
+
+        then:
+        p.exitValue() == 1
+        results.statuses == [1: 0, 2: 1, 3: 1]
+        results.outputs["1:out"] == "A"
+        results.outputs["2:err"] == "ERROR: invalid option in batch spec: -Cp\n"
+        results.outputs["3:err"] == "ERROR: unterminated quote in batch spec\n"
+    }
+
+    def "specs are read from stdin by '-'"() {
+        when:
+        def p = TestUtils.executeClientScriptOk(["-Cbatch", "-"]) { p ->
+            p.out << '-e "print(\'FROM STDIN\')"' + "\n"
+            p.out.close()
+        }
+        def results = parseResults(p.in.text)
+
+        then:
+        results.statuses == [1: 0]
+        results.outputs["1:out"] == "FROM STDIN"
+    }
+}
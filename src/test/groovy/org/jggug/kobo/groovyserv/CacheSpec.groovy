@@ -0,0 +1,104 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.Specification
+
+/**
+ * Specifications for -Ccache of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ *
+ * A result printed by a script is different at each run unless it's replayed.
+ * An argument unique to each test case avoids hitting entries of previous runs.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+class CacheSpec extends Specification {
+
+    static final String SCRIPT = '"print(System.nanoTime()); System.err.print(\'ERR\')"'
+
+    def "a result of the same invocation is replayed from the cache"() {
+        given:
+        def unique = "hit-${System.currentTimeMillis()}"
+
+        when:
+        def first = TestUtils.executeClientScriptOk(["-Ccache", "-e", SCRIPT, unique])
+        def firstOut = first.in.text
+
+        then:
+        first.err.text == "ERR"
+
+        when:
+        def second = TestUtils.executeClientScriptOk(["-Ccache", "-e", SCRIPT, unique])
+
+        then:
+        second.in.text == firstOut
+        second.err.text == "ERR"
+    }
+
+    def "a different invocation is a cache miss"() {
+        given:
+        def unique = "miss-${System.currentTimeMillis()}"
+
+        when:
+        def first = TestUtils.executeClientScriptOk(["-Ccache", "-e", SCRIPT, unique])
+        def second = TestUtils.executeClientScriptOk(["-Ccache", "-e", SCRIPT, unique, "another"])
+
+        then:
+        first.in.text != second.in.text
+    }
+
+    def "stdin is a part of the cache key"() {
+        given:
+        def script = '"print(System.in.text + System.nanoTime())"'
+        def unique = "stdin-${System.currentTimeMillis()}"
+        def run = { String input ->
+            TestUtils.executeClientScriptOk(["-Ccache", "-e", script, unique]) { p ->
+                p.out << input
+                p.out.close()
+            }.in.text
+        }
+
+        when:
+        def a1 = run("A")
+        def b1 = run("B")
+        def a2 = run("A")
+
+        then:
+        a1.startsWith("A")
+        b1.startsWith("B")
+        a2 == a1
+    }
+
+    def "a result of a failed invocation isn't cached"() {
+        given:
+        def script = '"print(System.nanoTime()); System.exit(3)"'
+        def unique = "failed-${System.currentTimeMillis()}"
+
+        when:
+        def first = TestUtils.executeClientScript(["-Ccache", "-e", script, unique])
+        def firstOut = first.in.text
+        def second = TestUtils.executeClientScript(["-Ccache", "-e", script, unique])
+
+        then:
+        first.exitValue() == 3
+        second.exitValue() == 3
+        second.in.text != firstOut
+    }
+}
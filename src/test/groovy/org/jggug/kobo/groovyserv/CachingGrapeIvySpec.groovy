@@ -0,0 +1,135 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link CachingGrapeIvy} and {@link GrapeResolutionCache} classes.
+ * Resolution by Ivy is stubbed not to access any repository.
+ */
+@UnitTest
+class CachingGrapeIvySpec extends Specification {
+
+    static class StubbedGrapeIvy extends CachingGrapeIvy {
+        File dir
+        List<List<String>> resolved = [] // coordinates resolved by Ivy
+
+        @Override
+        protected URI[] resolveByIvy(ClassLoader loader, Map args, Map... dependencies) {
+            resolved << dependencies.collect { "${it.group}:${it.module}:${it.version}".toString() }
+            dependencies.collect { dep ->
+                def jar = new File(dir, "${dep.module}-${dep.version}.jar")
+                jar.createNewFile()
+                jar.toURI()
+            } as URI[]
+        }
+    }
+
+    GrapeResolutionCache cache = GrapeResolutionCache.instance
+    File dir = File.createTempFile("grapespec", "")
+    StubbedGrapeIvy grapes
+
+    def setup() {
+        dir.delete()
+        dir.mkdir()
+        grapes = new StubbedGrapeIvy(dir: dir)
+        cache.entries.clear()
+    }
+
+    def cleanup() {
+        cache.entries.clear()
+        dir.deleteDir()
+    }
+
+    private List<URI> resolve(Map... dependencies) {
+        grapes.resolve(new GroovyClassLoader(), [:], null, dependencies) as List<URI> // a loader for each session
+    }
+
+    def "the same coordinates are resolved by Ivy only once"() {
+        given:
+        def before = cache.report()
+
+        when:
+        def first = resolve([group: 'org.example', module: 'lib', version: '1.0'])
+        def second = resolve([group: 'org.example', module: 'lib', version: '1.0'])
+
+        then:
+        grapes.resolved == [['org.example:lib:1.0']]
+        second == first
+        first == [new File(dir, 'lib-1.0.jar').toURI()]
+        cache.report()['grapes.misses'] == before['grapes.misses'] + 1
+        cache.report()['grapes.hits'] == before['grapes.hits'] + 1
+    }
+
+    def "different coordinates are resolved separately"() {
+        when:
+        resolve([group: 'org.example', module: 'lib', version: '1.0'])
+        resolve([group: 'org.example', module: 'lib', version: '2.0'])
+        resolve([group: 'org.example', module: 'other', version: '1.0'])
+        resolve([group: 'org.example', module: 'lib', version: '2.0'])
+
+        then:
+        grapes.resolved == [['org.example:lib:1.0'], ['org.example:lib:2.0'], ['org.example:other:1.0']]
+        cache.report()['grapes.cached'] == 3
+    }
+
+    def "a repository added by @GrabResolver is a part of the key"() {
+        given:
+        resolve([group: 'org.example', module: 'lib', version: '1.0'])
+
+        when:
+        grapes.addResolver([name: 'spec', root: 'http://repository.example.org/'])
+        resolve([group: 'org.example', module: 'lib', version: '1.0'])
+        resolve([group: 'org.example', module: 'lib', version: '1.0'])
+
+        then:
+        grapes.resolved.size() == 2
+    }
+
+    def "an entry whose jar is gone is resolved by Ivy again"() {
+        given:
+        resolve([group: 'org.example', module: 'lib', version: '1.0'])
+        new File(dir, 'lib-1.0.jar').delete()
+
+        when:
+        resolve([group: 'org.example', module: 'lib', version: '1.0'])
+
+        then:
+        grapes.resolved.size() == 2
+        new File(dir, 'lib-1.0.jar').exists()
+    }
+
+    def "the least recently used entry is evicted over the limit"() {
+        given:
+        def jar = new File(dir, 'lib.jar')
+        jar.createNewFile()
+        int max = GrapeResolutionCache.MAX_ENTRIES
+        (0..<max).each { cache.put("key-${it}".toString(), [jar.toURI()]) }
+
+        when:
+        cache.get('key-0') // used recently
+        cache.put('key-new', [jar.toURI()])
+
+        then:
+        cache.report()['grapes.cached'] == max
+        cache.get('key-0') != null
+        cache.get('key-1') == null // the least recently used
+        cache.get('key-2') != null
+        cache.get('key-new') != null
+    }
+}
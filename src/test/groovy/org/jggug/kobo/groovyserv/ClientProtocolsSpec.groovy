@@ -15,6 +15,7 @@
  */
 package org.jggug.kobo.groovyserv
 
+import org.jggug.kobo.groovyserv.exception.InvalidRequestHeaderException
 import org.jggug.kobo.groovyserv.test.UnitTest
 import spock.lang.Specification
 
@@ -57,6 +58,92 @@ class ClientProtocolsSpec extends Specification {
         request.args == ['argument_1', 'argument_2']
     }
 
+    def "readInvocationRequest() with priority"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Auth: DUMMY_AUTHTOKEN\n${header}".bytes)
+
+        when:
+        def request = ClientProtocols.readInvocationRequest(connection)
+
+        then:
+        request.priority == priority
+
+        where:
+        header              | priority
+        ""                  | 'interactive'
+        "Priority: batch\n" | 'batch'
+    }
+
+    def "readInvocationRequest() with invalid priority"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Auth: DUMMY_AUTHTOKEN\nPriority: urgent\n".bytes)
+
+        when:
+        ClientProtocols.readInvocationRequest(connection)
+
+        then:
+        thrown InvalidRequestHeaderException
+    }
+
+    def "readInvocationRequest() with client"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Auth: DUMMY_AUTHTOKEN\nClient: 1234\n".bytes)
+
+        expect:
+        ClientProtocols.readInvocationRequest(connection).client == '1234'
+    }
+
+    def "readInvocationRequest() with compression"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Auth: DUMMY_AUTHTOKEN\nCompress: lz4\n".bytes)
+
+        expect:
+        ClientProtocols.readInvocationRequest(connection).compress == 'lz4'
+    }
+
+    def "readInvocationRequest() with argument stream"() {
+        given:
+        def frames = "10\nargument_2\n0\n3\na\nb"
+        socket.inputStream >> new ByteArrayInputStream("""\
+            |Auth: DUMMY_AUTHTOKEN
+            |Arg: ${'argument_1'.bytes.encodeBase64()}
+            |ArgStream: 3 ${frames.bytes.length}
+            |
+            |${frames}Size: 7
+            |""".stripMargin().replaceAll(/\r/, '').bytes)
+
+        when:
+        def request = ClientProtocols.readInvocationRequest(connection)
+
+        then:
+        request.args == ['argument_1', 'argument_2', '', 'a\nb']
+
+        and: "the following request is left in the stream"
+        ClientProtocols.readStreamRequest(connection).size == 7
+    }
+
+    def "readInvocationRequest() with invalid argument stream"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Auth: DUMMY_AUTHTOKEN\nArgStream: ${argStream}\n\n${frames}".bytes)
+
+        when:
+        ClientProtocols.readInvocationRequest(connection)
+
+        then:
+        thrown InvalidRequestHeaderException
+
+        where:
+        argStream | frames
+        "1"       | "1\na"
+        "1 x"     | "1\na"
+        "-1 3"    | "1\na"
+        "2 3"     | "1\na"
+        "1 3"     | "x\na"
+        "1 5"     | "3\nab"
+        "1 4"     | "1\nab"
+        "1 12"    | "2000000000\n"
+    }
+
     def "readStreamRequest()"() {
         given:
         socket.inputStream >> new ByteArrayInputStream("""\
@@ -76,6 +163,33 @@ class ClientProtocolsSpec extends Specification {
         request.size == 19
     }
 
+    def "readStreamRequest() with compressed body"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Size: 1000\nCompressed: 20\n\n".bytes)
+
+        when:
+        def request = ClientProtocols.readStreamRequest(connection)
+
+        then:
+        request.compressed
+        request.size == 1000
+        request.compressedSize == 20
+    }
+
+    def "readStreamRequest() with invalid compressed body"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("${header}\n".bytes)
+
+        when:
+        ClientProtocols.readStreamRequest(connection)
+
+        then:
+        thrown InvalidRequestHeaderException
+
+        where:
+        header << ["Size: 0\nCompressed: 20\n", "Size: 1000\nCompressed: 0\n", "Size: 1000\nCompressed: x\n"]
+    }
+
     def "readInvocationRequest() for CommandRequest of shutdown"() {
         given:
         def socket = Mock(Socket)
@@ -110,6 +224,29 @@ class ClientProtocolsSpec extends Specification {
         request.command == 'interrupt'
     }
 
+    def "readStreamRequest() for RerunRequest"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Cmd: rerun\n\n".bytes)
+
+        when:
+        def request = ClientProtocols.readStreamRequest(connection)
+
+        then:
+        request.rerun
+        request.size == 0
+    }
+
+    def "readStreamRequest() for RerunRequest with body"() {
+        given:
+        socket.inputStream >> new ByteArrayInputStream("Cmd: rerun\nSize: 3\n\n".bytes)
+
+        when:
+        ClientProtocols.readStreamRequest(connection)
+
+        then:
+        thrown InvalidRequestHeaderException
+    }
+
     def "readHeaders()"() {
         given:
         socket.inputStream >> new ByteArrayInputStream("""\
@@ -154,6 +291,11 @@ class ClientProtocolsSpec extends Specification {
         'err' | 12345 | 'Channel: err\nSize: 12345\n\n'
     }
 
+    def "formatAsResponseHeader() of compressed chunk"() {
+        expect:
+        ClientProtocols.formatAsResponseHeader('out', 65536, 1234) == 'Channel: out\nSize: 65536\nCompressed: 1234\n\n'.bytes
+    }
+
     def "formatAsExitHeader()"() {
         expect:
         ClientProtocols.formatAsExitHeader(status) == expected.bytes
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.Specification
+
+/**
+ * Specifications for detached jobs of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+class DetachedJobSpec extends Specification {
+
+    def "a detached job runs after the client exits, and its output and exit status are kept"() {
+        when:
+        def p = TestUtils.executeClientScriptOk(['-Cdetach', '-e', '"sleep 500; print(\'OUT\'); System.err.print(\'ERR\'); System.exit(7)"'])
+        def id = p.in.text.trim()
+
+        then:
+        id ==~ /\d+/
+
+        when:
+        def waiting = TestUtils.executeClientScript(["-Cjob-wait", id])
+
+        then:
+        waiting.exitValue() == 7
+        waiting.in.text == "OUT"
+        waiting.err.text == "ERR"
+
+        when:
+        def status = TestUtils.executeClientScriptOk(["-Cjob-status", id])
+
+        then:
+        status.in.text == "${id} exited 7 output=6 dropped=0\n"
+    }
+
+    def "the log of a job is streamed from an offset"() {
+        given:
+        def id = TestUtils.executeClientScriptOk(['-Cdetach', '-e', '"print(\'0123456789\')"']).in.text.trim()
+        TestUtils.executeClientScript(["-Cjob-wait", id])
+
+        expect:
+        TestUtils.executeClientScriptOk(["-Cjob-log", "${id}:4"]).in.text == "456789"
+    }
+
+    def "an unknown job is an error"() {
+        when:
+        def p = TestUtils.executeClientScript(["-Cjob-status", "999999"])
+
+        then:
+        p.exitValue() == ExitStatus.INVALID_REQUEST.code
+        p.err.text == "Unknown job: 999999\n"
+    }
+}
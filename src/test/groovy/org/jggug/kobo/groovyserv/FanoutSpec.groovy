@@ -0,0 +1,58 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.Specification
+
+/**
+ * Specifications for the fan-out mode ({@code :::}) of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+class FanoutSpec extends Specification {
+
+    static final String SEP = System.getProperty("line.separator")
+
+    def "output is grouped per input in input order even if a later one finishes first"() {
+        when:
+        def p = TestUtils.executeClientScriptOk(["-Cjobs", "3", "-e", '"sleep(300 * (3 - (args[0] as int))); println(\'out\' + args[0]); System.err.println(\'err\' + args[0])"', ":::", "1", "2", "3"])
+
+        then:
+        p.in.text == "out1" + SEP + "out2" + SEP + "out3" + SEP
+        p.err.text == "err1" + SEP + "err2" + SEP + "err3" + SEP
+    }
+
+    def "the exit status is the one of the first failed input"() {
+        when:
+        def p = TestUtils.executeClientScript(["-e", '"print(args[0]); System.exit(args[0] as int)"', ":::", "0", "4", "2"])
+
+        then:
+        p.exitValue() == 4
+        p.in.text == "042"
+    }
+
+    def "inputs are run with fewer jobs than them"() {
+        when:
+        def p = TestUtils.executeClientScriptOk(["-Cjobs", "2", "-e", '"print(args[0])"', ":::", "a", "b", "c", "d", "e"])
+
+        then:
+        p.in.text == "abcde"
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.IgnoreIf
+import spock.lang.Specification
+
+/**
+ * Specifications for -Crecord of the {@code groovyclient}, and replaying
+ * a recorded session by src/bench/c/replay.
+ * Before running this, you must start groovyserver.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+class RecordSpec extends Specification {
+
+    static final int REPLAY_PORT = 19625
+    static final String SCRIPT = '"print(\'RECORDED\'); System.err.print(\'ERR\'); System.exit(3)"'
+
+    File recordFile
+
+    def setup() {
+        recordFile = File.createTempFile("session", ".rec")
+    }
+
+    def cleanup() {
+        recordFile.delete()
+    }
+
+    def "a session is recorded without changing its output and exit status"() {
+        when:
+        def p = TestUtils.executeClientScript(["-Crecord", recordFile.path, "-e", SCRIPT])
+
+        then:
+        p.exitValue() == 3
+        p.in.text == "RECORDED"
+        p.err.text == "ERR"
+
+        and:
+        def bytes = new String(recordFile.bytes, "ISO-8859-1")
+        bytes.startsWith("GSRC\u0001")
+        bytes.contains("RECORDED")
+        bytes.contains("Status: 3")
+    }
+
+    def "a file which cannot be created is an error"() {
+        when:
+        def p = TestUtils.executeClientScript(["-Crecord", new File(recordFile.path, "missing").path, "-e", SCRIPT])
+
+        then:
+        p.exitValue() != 0
+        p.err.text.contains("ERROR:")
+    }
+
+    @IgnoreIf({ !properties["groovyserv.executable.replay"] })
+    def "a recorded session is replayed to any invocation"() {
+        given:
+        TestUtils.executeClientScript(["-Crecord", recordFile.path, "-e", SCRIPT])
+        def replay = [System.getProperty("groovyserv.executable.replay"), "-p", REPLAY_PORT, "-x", "0", recordFile.path].execute()
+        sleep 1000 // until it listens
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cp", REPLAY_PORT, "-Ca", "standin", "-e", '"print(\'NOT RUN\')"'])
+
+        then:
+        p.exitValue() == 3
+        p.in.text == "RECORDED"
+        p.err.text == "ERR"
+
+        cleanup:
+        replay?.destroy()
+    }
+}
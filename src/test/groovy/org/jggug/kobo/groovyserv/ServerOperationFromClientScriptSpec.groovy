@@ -116,6 +116,89 @@ class ServerOperationFromClientScriptSpec extends Specification {
         createAuthTokenFile(originalToken)
     }
 
+    def "show status of running server"() {
+        given:
+        TestUtils.startServerIfNotRunning()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cstatus"])
+
+        then:
+        p.exitValue() == 0
+        p.in.text =~ /^running: .+:\d+\n$/
+    }
+
+    def "show status of stopped server"() {
+        given:
+        TestUtils.shutdownServerIfRunning()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cstatus"])
+
+        then:
+        p.exitValue() == 3
+        p.in.text =~ /^stopped: .+:\d+\n$/
+    }
+
+    def "kill server which has already stopped with a stale authtoken file"() {
+        given:
+        TestUtils.shutdownServerIfRunning()
+        createAuthTokenFile()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Ckill-server"])
+
+        then:
+        p.exitValue() == 0
+        def err = p.err.text
+        err.contains("WARN: server is not running")
+        err.contains("WARN: old authtoken file is deleted: ")
+        !WorkFiles.AUTHTOKEN_FILE.exists()
+    }
+
+    def "kill running server with an invalid authtoken"() {
+        given:
+        TestUtils.startServerIfNotRunning()
+        def originalToken = updateAuthTokenFile("INVALID_TOKEN")
+
+        when:
+        def p = TestUtils.executeClientScript(["-Ckill-server"])
+
+        then:
+        p.exitValue() == 1
+        p.err.text.contains("ERROR: invalid authtoken")
+
+        cleanup:
+        updateAuthTokenFile(originalToken)
+    }
+
+    def "kill running server"() {
+        given:
+        TestUtils.startServerIfNotRunning()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Ckill-server"])
+
+        then:
+        p.exitValue() == 0
+        p.err.text.contains("Server is successfully shut down")
+        TestUtils.executeClientScript(["-Cstatus"]).exitValue() == 3
+    }
+
+    def "restart running server before invoking a script"() {
+        given:
+        TestUtils.startServerIfNotRunning()
+
+        when:
+        def p = TestUtils.executeClientScriptOk(["-Crestart-server", "-v"])
+
+        then:
+        assertIncludingVersion(p.in.text)
+        def err = p.err.text
+        err.contains("Server is successfully shut down")
+        assertIncludingServerInvocationLog(err)
+    }
+
     private static void assertIncludingServerInvocationLog(text) {
         assert text.contains("Invoking server")
         assert text.contains("Starting server")
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link SessionClassLoaders} class.
+ */
+@UnitTest
+class SessionClassLoadersSpec extends Specification {
+
+    static final int MAX_RECLAIMS = 10 // a full GC isn't guaranteed by System.gc()
+
+    SessionClassLoaders classLoaders = SessionClassLoaders.instance
+
+    def cleanup() {
+        classLoaders.sessions.clear()
+    }
+
+    private static GroovyClassLoader compile(String className) {
+        def loader = new GroovyClassLoader()
+        loader.parseClass("class ${className} { static cache = [new Object()] }")
+        return loader
+    }
+
+    // no reference to the loader is left in the caller
+    private void finishWithoutReference(String label) {
+        classLoaders.finished(label, [compile("Released")])
+    }
+
+    private void reclaimUntil(Closure<Boolean> condition) {
+        for (int i = 0; i < MAX_RECLAIMS && !condition(); i++) {
+            classLoaders.reclaim()
+        }
+    }
+
+    def "a loader of a finished session is collected when it's released"() {
+        given:
+        def before = classLoaders.report()
+
+        when:
+        finishWithoutReference("released session")
+
+        then:
+        classLoaders.report()['classloaders.tracked'] == before['classloaders.tracked'] + 1
+
+        when:
+        reclaimUntil { classLoaders.report()['classloaders.alive'] == 0 }
+        def after = classLoaders.report()
+
+        then:
+        after['classloaders.alive'] == 0
+        after['classloaders.unloaded'] == before['classloaders.unloaded'] + 1
+        after['classloaders.leaked'] == 0
+        after['reclaim.count'] > before['reclaim.count']
+    }
+
+    def "a loader which is still reachable after a reclamation is reported as a leak"() {
+        given:
+        def retained = compile("Retained") // like a thread left alive by the session
+        classLoaders.finished("retained session", [retained])
+        classLoaders.sessions.last().finishedAt -= SessionClassLoaders.LEAK_AGE + 1000 // as if finished long ago
+
+        when:
+        classLoaders.reclaim()
+        def stats = classLoaders.report()
+
+        then:
+        stats['classloaders.alive'] == 1
+        stats['classloaders.leaked'] == 1
+        stats['classloaders.leak.1'].toString().endsWith("1 classes retained session")
+        classLoaders.sessions.last().leakReported
+
+        cleanup:
+        retained.close()
+    }
+
+    def "a loader which has just finished isn't reported as a leak"() {
+        given:
+        def retained = compile("Recent")
+        classLoaders.finished("recent session", [retained])
+
+        when:
+        classLoaders.reclaim()
+
+        then:
+        classLoaders.report()['classloaders.leaked'] == 0
+
+        cleanup:
+        retained.close()
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+import spock.lang.Timeout
+
+import java.util.concurrent.LinkedBlockingQueue
+
+import static org.jggug.kobo.groovyserv.SessionScheduler.BATCH
+import static org.jggug.kobo.groovyserv.SessionScheduler.INTERACTIVE
+
+/**
+ * Specifications for the {@link SessionScheduler} class.
+ */
+@UnitTest
+@Timeout(10)
+class SessionSchedulerSpec extends Specification {
+
+    SessionScheduler scheduler = SessionScheduler.instance
+    Map<String, Integer> limits
+    List<SessionScheduler.Ticket> running = []
+    LinkedBlockingQueue<List> admissions = new LinkedBlockingQueue<List>() // [client, ticket or 'dropped']
+
+    def setup() {
+        def report = scheduler.report()
+        limits = SessionScheduler.PRIORITIES.collectEntries { [it, report["scheduler.${it}.limit"]] }
+    }
+
+    def cleanup() {
+        admissions.each { client, ticket -> if (ticket != 'dropped' && !(ticket in running)) running << ticket }
+        running.each { scheduler.release(it) }
+        limits.each { priority, limit -> scheduler.setLimit(priority, limit) }
+    }
+
+    private void run(String priority, String client) {
+        running << scheduler.acquire(priority, client)
+    }
+
+    // waits for admission in another thread, and returns after it's queued
+    private void queue(String priority, String client, Closure<Boolean> alive = { true }) {
+        int queued = scheduler.report()["scheduler.${priority}.queued"]
+        Thread.start {
+            def ticket = scheduler.acquire(priority, client, alive)
+            admissions << [client, ticket ?: 'dropped']
+        }
+        while (scheduler.report()["scheduler.${priority}.queued"] == queued) {
+            Thread.sleep(10)
+        }
+    }
+
+    private String nextAdmitted() {
+        def (client, ticket) = admissions.take()
+        if (ticket != 'dropped') running << ticket
+        return client
+    }
+
+    private void releaseFirst() {
+        scheduler.release(running.remove(0))
+    }
+
+    def "sessions of a class run up to its limit, which doesn't affect other classes"() {
+        given:
+        scheduler.setLimit(BATCH, 2)
+        run(BATCH, 'a')
+        run(BATCH, 'a')
+
+        when:
+        queue(BATCH, 'a')
+
+        then:
+        scheduler.report()["scheduler.batch.running"] == 2
+        scheduler.report()["scheduler.batch.queued"] == 1
+        admissions.empty
+
+        when:
+        run(INTERACTIVE, 'a')
+
+        then:
+        scheduler.report()["scheduler.interactive.running"] == 1
+
+        when:
+        releaseFirst()
+
+        then:
+        nextAdmitted() == 'a'
+        scheduler.report()["scheduler.batch.running"] == 2
+        scheduler.report()["scheduler.batch.queued"] == 0
+    }
+
+    def "a freed slot is given to the waiting client which has the fewest running sessions"() {
+        given:
+        scheduler.setLimit(BATCH, 2)
+        run(BATCH, 'a')
+        run(BATCH, 'a')
+        queue(BATCH, 'a') // waits longer
+        queue(BATCH, 'b')
+
+        when:
+        releaseFirst()
+
+        then:
+        nextAdmitted() == 'b'
+
+        when:
+        releaseFirst()
+
+        then:
+        nextAdmitted() == 'a'
+    }
+
+    def "a freed slot is given to the client which has waited longest among ones of the same running sessions"() {
+        given:
+        scheduler.setLimit(BATCH, 1)
+        run(BATCH, 'a')
+        queue(BATCH, 'b')
+        queue(BATCH, 'c')
+
+        when:
+        releaseFirst()
+
+        then:
+        nextAdmitted() == 'b'
+
+        when:
+        releaseFirst()
+
+        then:
+        nextAdmitted() == 'c'
+    }
+
+    def "a session whose client has gone while waiting is dropped instead of being admitted"() {
+        given:
+        scheduler.setLimit(BATCH, 1)
+        run(BATCH, 'a')
+        queue(BATCH, 'b', { false })
+        queue(BATCH, 'c')
+
+        when:
+        releaseFirst()
+        def results = [admissions.take(), admissions.take()].collectEntries() // in any order of threads
+        running << results.c
+
+        then:
+        results.b == 'dropped'
+        results.c instanceof SessionScheduler.Ticket
+        scheduler.report()["scheduler.batch.running"] == 1
+        scheduler.report()["scheduler.batch.queued"] == 0
+    }
+}
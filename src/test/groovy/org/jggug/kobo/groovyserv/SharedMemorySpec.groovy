@@ -0,0 +1,62 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.IgnoreIf
+import spock.lang.Specification
+
+/**
+ * Specifications for -Cshm of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+@IgnoreIf({ properties["os.name"].startsWith("Windows") })
+class SharedMemorySpec extends Specification {
+
+    static final int OUT_SIZE = 10 * 1024 * 1024 // larger than the default capacity of a ring
+    static final int ERR_SIZE = 5 * 1024 * 1024
+
+    def "output larger than the rings is received in order"() {
+        given:
+        def out = new ByteArrayOutputStream()
+        def err = new ByteArrayOutputStream()
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cshm", "-e", "\"(1..10).each { print('o' * ${OUT_SIZE.intdiv(10)}); System.err.print('e' * ${ERR_SIZE.intdiv(10)}) }\""]) {
+            it.waitForProcessOutput(out, err) // not to block the client by a full pipe
+        }
+
+        then:
+        p.exitValue() == 0
+        out.size() == OUT_SIZE
+        out.toString() == 'o' * OUT_SIZE
+        err.size() == ERR_SIZE // without a warning of falling back to socket
+        err.toString() == 'e' * ERR_SIZE
+    }
+
+    def "it cannot be combined with -Cwindow"() {
+        when:
+        def p = TestUtils.executeClientScript(["-Cshm", "-Cwindow", "1K", "-e", '"print(\'NOT RUN\')"'])
+
+        then:
+        p.exitValue() != 0
+        p.err.text.contains("ERROR: cannot specify both of -Cshm and -Cwindow")
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.IgnoreIf
+import spock.lang.Specification
+
+/**
+ * Specifications for -Cshell of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+class ShellSpec extends Specification {
+
+    static final String SEP = System.getProperty("line.separator")
+    static final int SPILL_PORT = 19626
+
+    private static Process runShell(String snippets) {
+        TestUtils.executeClientScript(["-Cshell"]) { p ->
+            p.out << snippets
+            p.out.close()
+        }
+    }
+
+    def "snippets are evaluated against the same binding"() {
+        when:
+        def p = runShell("x = 20\nprintln(x + 1)\n\ny = x * 2\nprintln(y)\n")
+
+        then:
+        p.exitValue() == 0
+        p.in.text == "21" + SEP + "40" + SEP
+        p.err.text == ""
+    }
+
+    def "a trailing backslash continues the line"() {
+        when:
+        def p = runShell("s = [1, 2,\\\n 3].sum()\nprintln(s)")
+
+        then:
+        p.exitValue() == 0
+        p.in.text == "6" + SEP
+    }
+
+    def "a failed snippet doesn't end the session"() {
+        when:
+        def p = runShell("println(undefinedVariable)\nprintln('next')\n")
+
+        then:
+        p.exitValue() == 0
+        p.in.text == "next" + SEP
+        p.err.text.contains("MissingPropertyException")
+    }
+
+    def "the exit status is the one of the last snippet"() {
+        when:
+        def p = runShell("println('first')\nSystem.exit(5)\n")
+
+        then:
+        p.exitValue() == 5
+        p.in.text == "first" + SEP
+    }
+
+    @IgnoreIf({ properties["os.name"].startsWith("Windows") })
+    def "output spilled for a small window comes before the status of each snippet"() {
+        given: "a server which spills output over the window"
+        TestUtils.executeServerScript(["-p", SPILL_PORT, "--spill", "1K"])
+
+        when:
+        def p = TestUtils.executeClientScript(["-Cp", SPILL_PORT, "-Cwindow", "1K", "-Cshell"]) { p ->
+            p.out << "print('a' * 100000)\nprint('b' * 100000)\nprint('c' * 100000); System.exit(3)\n"
+            p.out.close()
+        }
+
+        then:
+        p.exitValue() == 3
+        p.in.text == 'a' * 100000 + 'b' * 100000 + 'c' * 100000
+
+        cleanup:
+        TestUtils.executeServerScript(["-p", SPILL_PORT, "-k"])
+    }
+
+    def "arguments are passed to the binding"() {
+        when:
+        def p = TestUtils.executeClientScript(["-Cshell", "a", "b"]) { p ->
+            p.out << "println(args.join(','))\n"
+            p.out.close()
+        }
+
+        then:
+        p.exitValue() == 0
+        p.in.text == "a,b" + SEP
+    }
+}
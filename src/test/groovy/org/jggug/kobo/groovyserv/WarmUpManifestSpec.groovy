@@ -0,0 +1,121 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link WarmUpManifest} class.
+ * The manifest is saved to a file in a temporary directory instead of DATA_DIR.
+ */
+@UnitTest
+class WarmUpManifestSpec extends Specification {
+
+    WarmUpManifest manifest = WarmUpManifest.instance
+    File dir = File.createTempFile("warmupspec", "")
+    File savedWarmUpFile
+
+    def setup() {
+        dir.delete()
+        dir.mkdir()
+        savedWarmUpFile = WorkFiles.WARMUP_FILE
+        WorkFiles.WARMUP_FILE = new File(dir, "warmup")
+        manifest.entries.clear()
+    }
+
+    def cleanup() {
+        manifest.entries.clear()
+        WorkFiles.WARMUP_FILE = savedWarmUpFile
+        dir.deleteDir()
+    }
+
+    def "shapeOf() takes groovy options and a script without args for the script"() {
+        expect:
+        WarmUpManifest.shapeOf(args) == shape
+
+        where:
+        args                                               | shape
+        ['script.groovy', 'a', 'b']                        | ['script.groovy']
+        ['-d', 'script.groovy', '-d']                      | ['-d', 'script.groovy']
+        ['-c', 'UTF-8', 'script.groovy', 'a']              | ['-c', 'UTF-8', 'script.groovy']
+        ['--encoding', 'UTF-8', '-l', '8000', 'x.groovy']  | ['--encoding', 'UTF-8', '-l', '8000', 'x.groovy']
+        ['-e', 'println args', 'a']                        | ['-e', 'println args']
+        ['-e']                                             | []
+        ['-v']                                             | []
+        ['-c', 'UTF-8']                                    | []
+        []                                                 | []
+    }
+
+    def "invocations of the same shape are counted as an entry"() {
+        when:
+        manifest.record('/work', '/lib/a.jar', ['script.groovy', 'first'])
+        manifest.record('/work', '/lib/a.jar', ['script.groovy', 'second'])
+        manifest.record('/work', null, ['script.groovy'])
+        manifest.record('/other', '/lib/a.jar', ['script.groovy'])
+        manifest.record('/work', '/lib/a.jar', ['-v']) // no script
+
+        then:
+        manifest.topEntries.collect { [it.count, it.cwd, it.classpath, it.args] } == [
+            [2, '/work', '/lib/a.jar', ['script.groovy']],
+            [1, '/work', '', ['script.groovy']],
+            [1, '/other', '/lib/a.jar', ['script.groovy']],
+        ]
+    }
+
+    def "entries are saved and loaded with their counts"() {
+        given:
+        3.times { manifest.record('/work', '/lib/a.jar', ['script.groovy']) }
+        manifest.record('/work dir', '', ['-e', 'println "a\tb\nc"']) // characters of the format are encoded
+
+        when:
+        manifest.save()
+        manifest.entries.clear()
+        manifest.load()
+
+        then:
+        manifest.topEntries.collect { [it.count, it.cwd, it.classpath, it.args] } == [
+            [3, '/work', '/lib/a.jar', ['script.groovy']],
+            [1, '/work dir', '', ['-e', 'println "a\tb\nc"']],
+        ]
+    }
+
+    def "only the most frequent entries are saved"() {
+        given:
+        (1..WarmUpManifest.MAX_SAVED_ENTRIES + 5).each { n ->
+            n.times { manifest.record('/work', '', ["script${n}.groovy"]) }
+        }
+
+        when:
+        manifest.save()
+
+        then:
+        def lines = WorkFiles.WARMUP_FILE.readLines()
+        lines.size() == WarmUpManifest.MAX_SAVED_ENTRIES
+        lines[0].startsWith("${WarmUpManifest.MAX_SAVED_ENTRIES + 5}\t")
+    }
+
+    def "invalid lines are ignored when loading"() {
+        given:
+        WorkFiles.WARMUP_FILE.text = "broken\nx\t/work\t\t${'a.groovy'.bytes.encodeBase64()}\n2\t/work\t\t${'b.groovy'.bytes.encodeBase64()}\n"
+
+        when:
+        manifest.load()
+
+        then:
+        manifest.topEntries.collect { [it.count, it.args] } == [[2, ['b.groovy']]]
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv
+
+import org.jggug.kobo.groovyserv.test.IntegrationTest
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
+import org.jggug.kobo.groovyserv.test.TestUtils
+import spock.lang.Specification
+import spock.lang.Timeout
+
+/**
+ * Specifications for -Cwatch of the {@code groovyclient}.
+ * Before running this, you must start groovyserver.
+ *
+ * A change is made a while after the previous run, so that it's detected
+ * even where modification times are compared in seconds.
+ */
+@IntegrationTest
+@OnlyForNativeClient
+@Timeout(60)
+class WatchSpec extends Specification {
+
+    File dir
+    File script
+
+    def setup() {
+        dir = File.createTempDir()
+        script = new File(dir, "watched.groovy")
+    }
+
+    def cleanup() {
+        dir.deleteDir()
+    }
+
+    def "the script is run again when it or a source in its directory is changed"() {
+        given:
+        script.text = "println('run 1')"
+
+        when:
+        def lines = []
+        TestUtils.executeClientScript(["-Cwatch", script.path]) { p ->
+            def reader = p.in.newReader()
+            lines << reader.readLine()
+
+            sleep 1500
+            script.text = "println('run 2')"
+            lines << reader.readLine()
+
+            sleep 1500
+            new File(dir, "Helper.groovy").text = "class Helper {}"
+            lines << reader.readLine()
+
+            p.destroy()
+        }
+
+        then:
+        lines == ["run 1", "run 2", "run 2"]
+    }
+
+    def "a file specified by -Cwatch-input also makes the script run again"() {
+        given:
+        def input = new File(dir, "input.txt")
+        input.text = "A"
+        script.text = "println(new File('${input.path.replace('\\', '\\\\')}').text)"
+
+        when:
+        def lines = []
+        TestUtils.executeClientScript(["-Cwatch", "-Cwatch-input", input.path, script.path]) { p ->
+            def reader = p.in.newReader()
+            lines << reader.readLine()
+
+            sleep 1500
+            input.text = "B"
+            lines << reader.readLine()
+
+            p.destroy()
+        }
+
+        then:
+        lines == ["A", "B"]
+    }
+
+    def "a script which fails is run again after it's fixed"() {
+        given:
+        script.text = "throw new RuntimeException('BROKEN')"
+
+        when:
+        def lines = []
+        TestUtils.executeClientScript(["-Cwatch", script.path]) { p ->
+            def reader = p.in.newReader()
+            def errReader = p.err.newReader()
+            while (!errReader.readLine().contains("BROKEN")) {
+                // skip the stack trace until the message
+            }
+
+            sleep 1500
+            script.text = "println('FIXED')"
+            lines << reader.readLine()
+
+            p.destroy()
+        }
+
+        then:
+        lines == ["FIXED"]
+    }
+}
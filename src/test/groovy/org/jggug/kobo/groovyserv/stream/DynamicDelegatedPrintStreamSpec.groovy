@@ -0,0 +1,96 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.AuthToken
+import org.jggug.kobo.groovyserv.ClientConnection
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link org.jggug.kobo.groovyserv.stream.DynamicDelegatedPrintStream} class.
+ */
+@UnitTest
+class DynamicDelegatedPrintStreamSpec extends Specification {
+
+    DynamicDelegatedPrintStream stream = new DynamicDelegatedPrintStream(DynamicDelegatedPrintStream.OUT)
+
+    private ClientConnection connect(ByteArrayOutputStream output) {
+        def socket = Mock(Socket)
+        socket.outputStream >> output
+        new ClientConnection(new AuthToken("DUMMY_AUTHTOKEN"), socket) // bound to the current thread
+    }
+
+    def "output goes to the connection bound when resolved, until invalidated"() {
+        given:
+        def first = new ByteArrayOutputStream()
+        def second = new ByteArrayOutputStream()
+
+        when:
+        connect(first)
+        stream.print("A")
+        connect(second)
+        stream.print("B")
+        stream.invalidate()
+        stream.print("C")
+
+        then:
+        first.toString() == "Channel: out\nSize: 1\n\nA" + "Channel: out\nSize: 1\n\nB"
+        second.toString() == "Channel: out\nSize: 1\n\nC"
+    }
+
+    def "each thread writes to its own connection"() {
+        given:
+        def main = new ByteArrayOutputStream()
+        def sub = new ByteArrayOutputStream()
+        connect(main)
+
+        when:
+        stream.print("A")
+        def thread = Thread.start {
+            connect(sub)
+            stream.print("B")
+        }
+        thread.join()
+        stream.print("C")
+
+        then:
+        main.toString() == "Channel: out\nSize: 1\n\nA" + "Channel: out\nSize: 1\n\nC"
+        sub.toString() == "Channel: out\nSize: 1\n\nB"
+    }
+
+    def "invalidate() by a thread doesn't affect streams resolved by others"() {
+        given:
+        def main = new ByteArrayOutputStream()
+        def sub = new ByteArrayOutputStream()
+        connect(main)
+        stream.print("A")
+
+        when:
+        def thread = Thread.start {
+            connect(sub)
+            stream.invalidate()
+            stream.print("B")
+        }
+        thread.join()
+        connect(new ByteArrayOutputStream()) // not resolved again without invalidate()
+        stream.print("C")
+
+        then:
+        main.toString() == "Channel: out\nSize: 1\n\nA" + "Channel: out\nSize: 1\n\nC"
+        sub.toString() == "Channel: out\nSize: 1\n\nB"
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link org.jggug.kobo.groovyserv.stream.FrameCodec} class.
+ */
+@UnitTest
+class FrameCodecSpec extends Specification {
+
+    FrameCodec codec = new FrameCodec()
+
+    private static byte[] logLines(int count) {
+        (0..<count).collect { "2013-10-19 INFO [worker-${it % 4}] processed request ${it}\n" }.join().bytes
+    }
+
+    /**
+     * @return pairs of a header and a body
+     */
+    private static List<List> splitFrames(byte[] bytes) {
+        def frames = []
+        def ins = new ByteArrayInputStream(bytes)
+        while (ins.available() > 0) {
+            def header = new StringBuilder()
+            while (!header.toString().endsWith("\n\n")) {
+                header << (char) ins.read()
+            }
+            def fields = header.readLines().findAll { it }.collectEntries { it.split(': ') as List }
+            def body = new byte[(fields.Compressed ?: fields.Size) as int]
+            ins.read(body)
+            frames << [fields, body]
+        }
+        frames
+    }
+
+    def "compressible data is sent in compressed frames no more than MAX_SIZE"() {
+        given:
+        def data = logLines(3000)
+        def out = new ByteArrayOutputStream()
+
+        when:
+        codec.writeFrames(out, 'out', data, 0, data.length)
+        def frames = splitFrames(out.toByteArray())
+
+        then:
+        data.length > FrameCodec.MAX_SIZE
+        frames.size() == Math.ceil(data.length / FrameCodec.MAX_SIZE)
+        frames.every { fields, body -> fields.Channel == 'out' && (fields.Compressed as int) < (fields.Size as int) }
+        concat(frames.collect { fields, body ->
+            FrameCodec.readFrame(new ByteArrayInputStream(body), fields.Size as int, fields.Compressed as int)
+        }) == data
+    }
+
+    def "small or incompressible data is sent raw"() {
+        given:
+        def out = new ByteArrayOutputStream()
+
+        when:
+        codec.writeFrames(out, 'err', data, 0, data.length)
+
+        then:
+        out.toByteArray() == concat(["Channel: err\nSize: ${data.length}\n\n".bytes, data])
+
+        where:
+        data << [Arrays.copyOf(logLines(20), FrameCodec.MIN_SIZE - 1), randomBytes(4096)]
+    }
+
+    def "broken frame is rejected"() {
+        when:
+        FrameCodec.readFrame(new ByteArrayInputStream(packed as byte[]), size, packedSize)
+
+        then:
+        thrown IOException
+
+        where:
+        packed       | size                    | packedSize
+        [0x10]       | 1                       | 1  // a literal over the end
+        [0x10, 0x61] | 100                     | 2  // shorter than the size
+        [0x00]       | FrameCodec.MAX_SIZE + 1 | 1  // too large
+        [0x00]       | 1                       | 2  // the body is short
+    }
+
+    private static byte[] concat(List<byte[]> chunks) {
+        def out = new ByteArrayOutputStream()
+        chunks.each { out.write(it) }
+        out.toByteArray()
+    }
+
+    private static byte[] randomBytes(int size) {
+        def bytes = new byte[size]
+        new Random(1).nextBytes(bytes)
+        bytes
+    }
+}
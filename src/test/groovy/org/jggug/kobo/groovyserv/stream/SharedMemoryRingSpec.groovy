@@ -0,0 +1,117 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.WorkFiles
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+import java.nio.ByteOrder
+import java.nio.MappedByteBuffer
+import java.nio.channels.FileChannel
+
+import static org.jggug.kobo.groovyserv.stream.SharedMemoryRing.CONTROL_SIZE
+
+/**
+ * Specifications for the {@link org.jggug.kobo.groovyserv.stream.SharedMemoryRing} class.
+ * A file of rings is mapped by the spec as the client does.
+ */
+@UnitTest
+class SharedMemoryRingSpec extends Specification {
+
+    static final int CAPACITY = 64
+
+    File file
+
+    def setup() {
+        WorkFiles.DATA_DIR.mkdirs()
+        file = File.createTempFile("shm-spec-", "", WorkFiles.DATA_DIR)
+    }
+
+    def cleanup() {
+        file.delete()
+    }
+
+    private MappedByteBuffer mapAsClient(long size, File target = file) {
+        def raf = new RandomAccessFile(target, "rw")
+        try {
+            raf.setLength(size)
+            return raf.channel.map(FileChannel.MapMode.READ_WRITE, 0, size)
+        } finally {
+            raf.close()
+        }
+    }
+
+    private static String read(MappedByteBuffer buffer, int offset, int size) {
+        def bytes = new byte[size]
+        buffer.position(offset)
+        buffer.get(bytes)
+        new String(bytes, "ISO-8859-1")
+    }
+
+    def "rings of 'out' and 'err' are laid out in the file as shm.h of the client"() {
+        given:
+        def client = mapAsClient(2 * (CONTROL_SIZE + CAPACITY))
+
+        when:
+        def rings = SharedMemoryRing.map("${file.path} ${CAPACITY}")
+        rings.out.write("OUT".bytes, 0, 3)
+        rings.err.write("ERR".bytes, 0, 3)
+
+        then:
+        !file.exists() // removed after mapping
+        read(client, CONTROL_SIZE, 3) == "OUT"
+        read(client, CONTROL_SIZE * 2 + CAPACITY, 3) == "ERR"
+        rings.out.head == 3
+        rings.err.head == 3
+    }
+
+    def "data is written around the end of the ring as far as the tail advanced by the client"() {
+        given:
+        def client = mapAsClient(2 * (CONTROL_SIZE + CAPACITY))
+        def tail = client.duplicate().order(ByteOrder.nativeOrder())
+        def ring = SharedMemoryRing.map("${file.path} ${CAPACITY}").out
+
+        when:
+        int first = ring.write(("a" * 48).bytes, 0, 48)
+        tail.putLong(0, 40) // the client read 40 bytes
+        int second = ring.write(("b" * 64).bytes, 0, 64)
+
+        then:
+        first == 48
+        second == 56 // up to the capacity ahead of the tail
+        ring.head == 104
+        read(client, CONTROL_SIZE, CAPACITY) == "b" * 40 + "a" * 8 + "b" * 16
+    }
+
+    def "invalid rings are not mapped"() {
+        given:
+        def target = path ? new File(path) : file
+        if (size >= 0) mapAsClient(size, target)
+
+        expect:
+        SharedMemoryRing.map("${target.path} ${capacity}") == null
+
+        where:
+        description                  | capacity                          | size                          | path
+        "not a power of 2"           | 100                               | 2 * (CONTROL_SIZE + 100)      | null
+        "zero"                       | 0                                 | 2 * CONTROL_SIZE              | null
+        "over 64MB"                  | SharedMemoryRing.MAX_CAPACITY * 2 | -1                            | null
+        "unmatched size of the file" | CAPACITY                          | CONTROL_SIZE + CAPACITY       | null
+        "outside DATA_DIR"           | CAPACITY                          | 2 * (CONTROL_SIZE + CAPACITY) | File.createTempFile("shm-spec-", "").with { deleteOnExit(); it.path }
+        "missing file"               | CAPACITY                          | -1                            | new File(WorkFiles.DATA_DIR, "shm-spec-missing").path
+    }
+}
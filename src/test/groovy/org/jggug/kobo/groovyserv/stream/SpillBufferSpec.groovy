@@ -0,0 +1,74 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.stream
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link org.jggug.kobo.groovyserv.stream.SpillBuffer} class.
+ */
+@UnitTest
+class SpillBufferSpec extends Specification {
+
+    File dir = File.createTempFile("spillspec", "")
+    SpillBuffer spill
+
+    def setup() {
+        dir.delete()
+        dir.mkdir()
+        spill = new SpillBuffer(8, dir)
+    }
+
+    def cleanup() {
+        spill.close()
+        dir.deleteDir()
+    }
+
+    private String readAll() {
+        def buf = new byte[3]
+        def out = new ByteArrayOutputStream()
+        int size
+        while ((size = spill.read(buf, buf.length)) > 0) {
+            out.write(buf, 0, size)
+        }
+        out.toString()
+    }
+
+    def "data is read in order across memory and the spilled file"() {
+        when:
+        spill.append("abcde".bytes, 0, 5)
+        spill.append("fghij".bytes, 0, 5) // over the memory limit
+        spill.append("k".bytes, 0, 1)     // after spilled data even if it fits in memory
+
+        then:
+        spill.size == 11
+        dir.listFiles().size() == 1
+        readAll() == "abcdefghijk"
+        spill.empty
+    }
+
+    def "close() removes the spilled file"() {
+        when:
+        spill.append("0123456789".bytes, 0, 10)
+        spill.close()
+
+        then:
+        spill.empty
+        dir.listFiles().size() == 0
+    }
+
+}
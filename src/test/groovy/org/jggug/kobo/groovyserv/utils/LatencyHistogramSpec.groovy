@@ -0,0 +1,51 @@
+/*
+ * Copyright 2009-2013 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.jggug.kobo.groovyserv.utils
+
+import org.jggug.kobo.groovyserv.test.UnitTest
+import spock.lang.Specification
+
+/**
+ * Specifications for the {@link org.jggug.kobo.groovyserv.utils.LatencyHistogram} class.
+ */
+@UnitTest
+class LatencyHistogramSpec extends Specification {
+
+    LatencyHistogram histogram = new LatencyHistogram()
+
+    def "percentileMillis() returns 0 when nothing is recorded"() {
+        expect:
+        histogram.count == 0
+        histogram.percentileMillis(50) == 0
+        histogram.maxMillis == 0
+    }
+
+    def "percentileMillis() returns the upper bound of the bucket not exceeding the max"() {
+        when:
+        (1..99).each { histogram.recordNanos(1000 * 1000) } // 1ms
+        histogram.recordNanos(100 * 1000 * 1000) // 100ms
+
+        then:
+        histogram.count == 100
+        histogram.percentileMillis(50) >= 1
+        histogram.percentileMillis(50) < 2.1
+        histogram.percentileMillis(99) < 2.1
+        histogram.percentileMillis(100) == 100
+        histogram.maxMillis == 100
+        histogram.meanMillis == 1.99
+    }
+
+}
@@ -17,8 +17,9 @@
 import org.jggug.kobo.groovyserv.test.IgnoreForShellClient
 import org.jggug.kobo.groovyserv.test.IntegrationTest
 import org.jggug.kobo.groovyserv.test.IndependentForSpecificClient
+import org.jggug.kobo.groovyserv.test.OnlyForNativeClient
 
 runner {
     include IntegrationTest
-    exclude IndependentForSpecificClient, IgnoreForShellClient
+    exclude IndependentForSpecificClient, IgnoreForShellClient, OnlyForNativeClient
 }